@@ -0,0 +1,429 @@
+/** Headless batch eye center detection for image directories/lists (no GUI or display necessary).
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <okapi.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "isophoteeyedetector.hpp"
+#include "instrumentation.hpp"
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** Optional prior information about an image (invalid coordinates are -1). */
+struct ImagePriors
+{
+    cv::Rect face_box;
+    cv::Point left_eye;
+    cv::Point right_eye;
+
+    ImagePriors(void) : face_box(-1,-1,-1,-1), left_eye(-1,-1), right_eye(-1,-1) {}
+};
+
+/** Result of one image. */
+struct BatchResult
+{
+    bool valid;           // could the image be loaded and processed?
+    cv::Point left;       // left eye center
+    cv::Point right;      // right eye center
+    double latency_us;    // run-time of the detector (without loading the image)
+
+    BatchResult(void) : valid(false), left(-1,-1), right(-1,-1), latency_us(0) {}
+};
+
+struct BatchOptions
+{
+    int num_threads;
+    bool use_double;
+    double sigma;         // <= 0 => automatic sigma selection
+    string format;        // csv or binary
+    string output_fn;     // empty => stdout (csv only)
+    string priors_fn;
+    string trace_fn;
+    bool profile;
+
+    BatchOptions(void) : num_threads(1), use_double(false), sigma(-1), format("csv"), profile(false) {}
+};
+
+static const char help_str[] =
+    "Usage: %s [options] <image|directory|@list> [...]\n"
+    "\nHeadless eye center detection. Directories are scanned (not recursively) for pgm/ppm/png/jpg/bmp images and\n"
+    "@list reads one image path per line.\n"
+    "\nOptions:\n"
+    "  -t, --threads <n>     number of worker threads (default: 1; 0 = number of cores)\n"
+    "  -p, --priors <file>   CSV with priors: image,face_x,face_y,face_width,face_height,left_x,left_y,right_x,right_y\n"
+    "                        (image is matched by path or file name; -1 or empty fields are unknown)\n"
+    "  -o, --output <file>   output file (default: stdout)\n"
+    "  -f, --format <fmt>    csv (default) or binary\n"
+    "  -s, --sigma <sigma>   fixed sigma (default: automatic selection)\n"
+    "      --double          calculate in double instead of float precision\n"
+    "      --profile         print per-stage latency statistics\n"
+    "      --trace <file>    write a Chrome trace-event file\n"
+    "\nCSV output: image,valid,left_x,left_y,right_x,right_y,latency_us\n"
+    "Binary output (little endian): \"IECD\", uint32 version (1), uint32 count, and per image:\n"
+    "  uint32 path length, path, uint8 valid, int32 left_x, left_y, right_x, right_y, float32 latency_us\n";
+
+static bool
+HasImageExtension(const string& fn)
+{
+    const size_t dot = fn.rfind('.');
+    if (dot == string::npos)
+        return false;
+    string ext = fn.substr(dot + 1);
+    std::transform(ext.begin(),ext.end(),ext.begin(),::tolower);
+    return ext == "pgm" || ext == "ppm" || ext == "pnm" || ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp";
+}
+
+static string
+BaseName(const string& fn)
+{
+    const size_t slash = fn.find_last_of("/\\");
+    return (slash == string::npos ? fn : fn.substr(slash + 1));
+}
+
+/** Expand directories and @lists to image paths. */
+static bool
+CollectImages(const string& arg, vector<string>& images)
+{
+    if (!arg.empty() && arg[0] == '@')
+    {
+        ifstream ifs(arg.substr(1).c_str());
+        if (!ifs)
+        {
+            cerr << "Unable to open the image list '" << arg.substr(1) << "'!" << endl;
+            return false;
+        }
+        string line;
+        while (getline(ifs,line))
+        {
+            line.erase(line.find_last_not_of(" \t\r\n") + 1);
+            if (!line.empty() && line[0] != '#')
+                images.push_back(line);
+        }
+        return true;
+    }
+
+    struct stat st;
+    if (stat(arg.c_str(),&st) != 0)
+    {
+        cerr << "'" << arg << "' does not exist!" << endl;
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        images.push_back(arg);
+        return true;
+    }
+
+    DIR* dir = opendir(arg.c_str());
+    if (dir == NULL)
+    {
+        cerr << "Unable to read the directory '" << arg << "'!" << endl;
+        return false;
+    }
+    vector<string> dir_images;
+    for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+    {
+        const string name = entry->d_name;
+        if (HasImageExtension(name))
+            dir_images.push_back(arg + (arg[arg.size()-1] == '/' ? "" : "/") + name);
+    }
+    closedir(dir);
+    std::sort(dir_images.begin(),dir_images.end()); // deterministic order
+    images.insert(images.end(),dir_images.begin(),dir_images.end());
+    return true;
+}
+
+/** Load the priors CSV (see help_str); the priors are stored under the path and the file name of the image. */
+static bool
+LoadPriors(const string& fn, map<string,ImagePriors>& priors)
+{
+    ifstream ifs(fn.c_str());
+    if (!ifs)
+    {
+        cerr << "Unable to open the priors file '" << fn << "'!" << endl;
+        return false;
+    }
+    string line;
+    int line_number = 0;
+    while (getline(ifs,line))
+    {
+        line_number++;
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        vector<string> fields;
+        stringstream ss(line);
+        string field;
+        while (getline(ss,field,','))
+            fields.push_back(field);
+        if (fields.size() != 9)
+        {
+            cerr << fn << ":" << line_number << ": expected 9 fields, skipping line!" << endl;
+            continue;
+        }
+        int v[8];
+        for (int i = 0; i < 8; i++)
+            v[i] = (fields[i+1].empty() ? -1 : atoi(fields[i+1].c_str()));
+        ImagePriors p;
+        p.face_box = cv::Rect(v[0],v[1],v[2],v[3]);
+        p.left_eye = cv::Point(v[4],v[5]);
+        p.right_eye = cv::Point(v[6],v[7]);
+        priors[fields[0]] = p;
+        priors[BaseName(fields[0])] = p;
+    }
+    return true;
+}
+
+/** Process images[i] for all i that are claimed from next_index (every worker has its own detector). */
+template <typename T>
+static void
+ProcessImages(const BatchOptions& options, const vector<string>& images, const map<string,ImagePriors>& priors,
+              std::atomic<size_t>& next_index, vector<BatchResult>& results)
+{
+    typedef IsophoteEyeCenterDetector<T> iecd_t;
+    iecd_t iecd;
+    if (options.sigma > 0)
+        iecd.setSigma(T(options.sigma),T(options.sigma));
+    else
+        iecd.setAutoSigma();
+
+    for (size_t i = next_index.fetch_add(1); i < images.size(); i = next_index.fetch_add(1))
+    {
+        SetTraceFrame(i);
+        const uint64_t trace_load_start = TraceStart();
+        cv::Mat img = cv::imread(images[i],0); // gray scale
+        TraceStop("load image",trace_load_start);
+        if (img.empty())
+        {
+            cerr << "Unable to load '" << images[i] << "'! Skipping image!" << endl;
+            continue;
+        }
+
+        ImagePriors p;
+        map<string,ImagePriors>::const_iterator it = priors.find(images[i]);
+        if (it == priors.end())
+            it = priors.find(BaseName(images[i]));
+        if (it != priors.end())
+            p = it->second;
+
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        const uint64_t trace_detect_start = TraceStart();
+        const EyeCenterLocations<typename iecd_t::coord_t> eye_centers = iecd.detectEyeCenters(img,p.face_box,p.left_eye,p.right_eye);
+        TraceStop("detectEyeCenters",trace_detect_start);
+        const chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+
+        BatchResult& result = results[i];
+        result.valid = eye_centers.isValid();
+        result.left = eye_centers.left;
+        result.right = eye_centers.right;
+        result.latency_us = chrono::duration_cast<chrono::nanoseconds>(stop - start).count() / 1000.0;
+    }
+}
+
+template <typename V>
+static void
+WriteBinary(ostream& os, const V& value)
+{
+    os.write((const char*)&value,sizeof(value)); // we assume a little endian host
+}
+
+static bool
+WriteResults(const BatchOptions& options, const vector<string>& images, const vector<BatchResult>& results)
+{
+    ofstream ofs;
+    if (!options.output_fn.empty())
+    {
+        ofs.open(options.output_fn.c_str(),(options.format == "binary" ? ios::out | ios::binary : ios::out));
+        if (!ofs)
+        {
+            cerr << "Unable to open the output file '" << options.output_fn << "'!" << endl;
+            return false;
+        }
+    }
+    ostream& os = (options.output_fn.empty() ? cout : ofs);
+
+    if (options.format == "binary")
+    {
+        os.write("IECD",4);
+        WriteBinary(os,(uint32_t)1);
+        WriteBinary(os,(uint32_t)images.size());
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            const BatchResult& r = results[i];
+            WriteBinary(os,(uint32_t)images[i].size());
+            os.write(images[i].data(),images[i].size());
+            WriteBinary(os,(uint8_t)(r.valid ? 1 : 0));
+            WriteBinary(os,(int32_t)r.left.x);
+            WriteBinary(os,(int32_t)r.left.y);
+            WriteBinary(os,(int32_t)r.right.x);
+            WriteBinary(os,(int32_t)r.right.y);
+            WriteBinary(os,(float)r.latency_us);
+        }
+    }
+    else
+    {
+        os << "image,valid,left_x,left_y,right_x,right_y,latency_us" << endl;
+        os << fixed << setprecision(1);
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            const BatchResult& r = results[i];
+            os << images[i] << "," << (r.valid ? 1 : 0) << "," << r.left.x << "," << r.left.y << "," << r.right.x << "," << r.right.y << "," << r.latency_us << endl;
+        }
+    }
+    os.flush();
+    return (bool)os;
+}
+
+/** p-th percentile (nearest rank) of sorted values. */
+static double
+Percentile(const vector<double>& sorted_values, double p)
+{
+    if (sorted_values.empty())
+        return 0;
+    size_t rank = (size_t)(p / 100.0 * sorted_values.size() + 0.999999);
+    rank = std::min(std::max(rank,(size_t)1),sorted_values.size());
+    return sorted_values[rank - 1];
+}
+
+int
+main(int argc, char* argv[])
+{
+    // parse arguments
+    BatchOptions options;
+    vector<string> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        const bool has_value = (i + 1 < argc);
+        if ((arg == "-t" || arg == "--threads") && has_value)
+            options.num_threads = atoi(argv[++i]);
+        else if ((arg == "-p" || arg == "--priors") && has_value)
+            options.priors_fn = argv[++i];
+        else if ((arg == "-o" || arg == "--output") && has_value)
+            options.output_fn = argv[++i];
+        else if ((arg == "-f" || arg == "--format") && has_value)
+            options.format = argv[++i];
+        else if ((arg == "-s" || arg == "--sigma") && has_value)
+            options.sigma = atof(argv[++i]);
+        else if (arg == "--double")
+            options.use_double = true;
+        else if (arg == "--profile")
+            options.profile = true;
+        else if (arg == "--trace" && has_value)
+            options.trace_fn = argv[++i];
+        else if (arg == "-h" || arg == "--help")
+        {
+            printf(help_str,argv[0]);
+            return 0;
+        }
+        else if (!arg.empty() && arg[0] == '-' && arg.size() > 1)
+        {
+            printf(help_str,argv[0]);
+            return 1;
+        }
+        else
+            inputs.push_back(arg);
+    }
+    if (inputs.empty() || (options.format != "csv" && options.format != "binary"))
+    {
+        printf(help_str,argv[0]);
+        return 1;
+    }
+    if (options.format == "binary" && options.output_fn.empty())
+    {
+        cerr << "The binary format requires an output file (-o)!" << endl;
+        return 1;
+    }
+    if (options.num_threads <= 0)
+        options.num_threads = std::max(1,(int)thread::hardware_concurrency());
+
+    vector<string> images;
+    for (size_t i = 0; i < inputs.size(); i++)
+        if (!CollectImages(inputs[i],images))
+            return 1;
+    map<string,ImagePriors> priors;
+    if (!options.priors_fn.empty() && !LoadPriors(options.priors_fn,priors))
+        return 1;
+    if (options.profile)
+        SetInstrumentationEnabled(true);
+    if (!options.trace_fn.empty())
+        SetTraceEnabled(true);
+
+    // process the images
+    vector<BatchResult> results(images.size());
+    std::atomic<size_t> next_index(0);
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < options.num_threads; t++)
+    {
+        if (options.use_double)
+            workers.push_back(thread(ProcessImages<double>,std::cref(options),std::cref(images),std::cref(priors),std::ref(next_index),std::ref(results)));
+        else
+            workers.push_back(thread(ProcessImages<float>,std::cref(options),std::cref(images),std::cref(priors),std::ref(next_index),std::ref(results)));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    const double wall_s = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / 1e9;
+
+    if (!WriteResults(options,images,results))
+        return 1;
+
+    // report (on stderr, stdout may contain the results)
+    vector<double> latencies;
+    size_t num_valid = 0;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i].latency_us > 0)
+            latencies.push_back(results[i].latency_us);
+        if (results[i].valid)
+            num_valid++;
+    }
+    std::sort(latencies.begin(),latencies.end());
+    cerr << fixed << setprecision(1)
+         << "images: " << images.size() << " (processed: " << latencies.size() << ", valid: " << num_valid << "), threads: " << options.num_threads << endl
+         << "throughput: " << (wall_s > 0 ? latencies.size() / wall_s : 0) << " images/s (" << wall_s << " s, including image loading)" << endl
+         << "latency [us]: p50 " << Percentile(latencies,50) << ", p90 " << Percentile(latencies,90) << ", p99 " << Percentile(latencies,99)
+         << ", max " << (latencies.empty() ? 0 : latencies.back()) << endl;
+    if (options.profile)
+        PrintInstrumentationSnapshot(GetInstrumentationSnapshot(),cerr);
+    if (!options.trace_fn.empty())
+        WriteTrace(options.trace_fn);
+
+    return 0;
+}
@@ -24,10 +24,129 @@
 #include <okapi-videoio.hpp>
 
 #include "isophoteeyedetector.hpp"
+#include "eye_tracking_pipeline.hpp"
+#include "instrumentation.hpp"
 
 using namespace okapi;
 using namespace std;
 
+/** Camera/video source stage of the pipeline (--pipeline). */
+class VideoSourceFrameSource : public PipelineFrameSource
+{
+public:
+    explicit VideoSourceFrameSource(VideoSource* _src) : src(_src) {}
+    virtual bool grab(cv::Mat& image, double& timestamp)
+    {
+        if (!src->getNextFrame())
+            return false;
+        image = src->getImage().clone(); // the video source reuses its buffer
+        timestamp = src->getTimestamp();
+        return true;
+    }
+private:
+    VideoSource* src;
+};
+
+/** Face (and eye) detection stage of the pipeline; uses the largest face. */
+class BinaryPatternPipelineFaceDetector : public PipelineFaceDetector
+{
+public:
+    BinaryPatternPipelineFaceDetector(BinaryPatternFaceDetector* _fd, BinaryPatternEyeDetector* _ed) : fd(_fd), ed(_ed) {}
+    virtual bool detect(const cv::Mat& image, cv::Rect& face, cv::Point& left_eye, cv::Point& right_eye)
+    {
+        vector<RectDetection> faces = fd->detectFaces(image);
+        if (faces.empty())
+            return false;
+        size_t i = 0;
+        for (size_t j = 1; j < faces.size(); j++)
+            if (faces[j].box.area() > faces[i].box.area())
+                i = j;
+        face = faces[i].box;
+        left_eye = right_eye = cv::Point(-1,-1);
+        if (ed != NULL)
+        {
+            EyeLocations eyes = ed->detectEyes(image,fd->getMeanLeftEye(face),fd->getMeanRightEye(face));
+            if (eyes.isValid())
+            {
+                left_eye = cv::Point(cvRound(eyes.left.x),cvRound(eyes.left.y));
+                right_eye = cv::Point(cvRound(eyes.right.x),cvRound(eyes.right.y));
+            }
+        }
+        return true;
+    }
+private:
+    BinaryPatternFaceDetector* fd;
+    BinaryPatternEyeDetector* ed;
+};
+
+/** The pipelined main loop (--pipeline): capture, face/eye detection and eye center detection run concurrently, this thread only draws. */
+static void
+RunPipelineDemo(PipelineFrameSource* source, PipelineFaceDetector* face_detector, FrameDropPolicy policy, ColorOrder color_order, ImageWindow* imgwin, okapi::WidgetWindow* win_params, bool low_resolution)
+{
+    // the latency is bounded by the queues, i.e. use the smallest queues if frames are dropped anyway
+    EyeTrackingPipeline<double> pipeline(source,face_detector,NULL,(policy == BlockPolicy ? 2 : 1),policy);
+    pipeline.getEyeCenterDetector().setColorOrder(color_order);
+    pipeline.start();
+
+    bool auto_sigma = false;
+    double row_sigma = -1, col_sigma = -1;
+    PipelineFrame frame;
+    while (imgwin->getWindowState() && pipeline.pop(frame))
+    {
+        // forward the parameter changes to the eye center stage
+        const bool new_auto_sigma = win_params->getButton("set auto sigma");
+        win_params->toggleActivated("isophote row sigma (sigma)", !new_auto_sigma);
+        win_params->toggleActivated("isophote col sigma (sigma)", !new_auto_sigma);
+        const double new_row_sigma = win_params->getSlider("isophote row sigma (sigma)");
+        const double new_col_sigma = win_params->getSlider("isophote col sigma (sigma)");
+        if (new_auto_sigma != auto_sigma || (!new_auto_sigma && (new_row_sigma != row_sigma || new_col_sigma != col_sigma)))
+        {
+            if (new_auto_sigma)
+                pipeline.setAutoSigma();
+            else
+                pipeline.setSigma(new_row_sigma,new_col_sigma);
+            auto_sigma = new_auto_sigma;
+            row_sigma = new_row_sigma;
+            col_sigma = new_col_sigma;
+        }
+
+        cv::Mat aimg = frame.image.clone();
+        ImageDeco deco(aimg);
+        deco.setAntiAlias(true);
+        if (frame.has_face)
+        {
+            deco.setColor(127, 127, 127);
+            deco.setThickness(1);
+            deco.drawRect(frame.face);
+            deco.setColor(0, 127, 0);
+            if (frame.left_eye.x > 0)
+                deco.drawCircle(frame.left_eye.x, frame.left_eye.y, 3);
+            if (frame.right_eye.x > 0)
+                deco.drawCircle(frame.right_eye.x, frame.right_eye.y, 3);
+        }
+        if (frame.eye_centers.isValid())
+        {
+            deco.setThickness(2);
+            deco.setColor(255,0,0);
+            deco.drawCircle(frame.eye_centers.left.x,frame.eye_centers.left.y,3);
+            deco.drawCircle(frame.eye_centers.right.x,frame.eye_centers.right.y,3);
+            deco.setThickness(1);
+            deco.drawLine(frame.eye_centers.left.x,frame.eye_centers.left.y,frame.eye_centers.right.x,frame.eye_centers.right.y);
+        }
+
+        // throughput and end-to-end latency of the pipeline
+        const PipelineStatistics statistics = pipeline.getStatistics();
+        char buf[1000];
+        sprintf(buf, "%4.1f fps, %4.1f ms latency, %lu dropped\n", statistics.fps, statistics.mean_latency_ms, (unsigned long)statistics.dropped_frames);
+        deco.setColor(255, 255, 255);
+        deco.setThickness(1);
+        deco.drawText(buf, 0, 15);
+        imgwin->setImage("Video", aimg, low_resolution ? 2 : 1);
+    }
+    pipeline.stop();
+    PrintPipelineStatistics(pipeline.getStatistics());
+}
+
 static const char help_str[] =
     "\nOkapi eye center detector demonstration\n"
     "\nOptions:\n%s\n";
@@ -49,6 +168,11 @@ main(int argc, char* argv[])
     opt.addOption('s', "search-regions",         false, "Show eye and mouth search regions");
     opt.addOption(     "fps",                    false, "Display frames per second");
     opt.addOption('r', "draw-search-rectangles", false, "Draw the search rectangles (i.e. head, eye, etc.)");
+    opt.addOption('p', "profile",                false, "Print the latency statistics of the eye center detector stages at exit");
+    opt.addOption(     "profile-counters",       false, "Additionally capture hardware performance counters per stage (implies --profile)");
+    opt.addOption(     "trace",                  true,  "Write a Chrome trace-event file (Perfetto) of the per-frame stages at exit");
+    opt.addOption(     "pipeline",               false, "Run capture, face/eye detection and eye center detection as concurrent pipeline stages");
+    opt.addOption(     "drop-policy",            true,  "Handoff of the captured frames in the pipeline: block, drop-oldest or latest-only (default: latest-only for cameras)");
 
     if (argc < 3)
     {
@@ -56,8 +180,8 @@ main(int argc, char* argv[])
         exit(1);
     }
 
-    string fd_fn, ed_fn, md_fn, videosource;
-    bool low_resolution, display_fps, use_videosource, use_images, search_regions, display_search_rectangles;
+    string fd_fn, ed_fn, md_fn, videosource, trace_fn, drop_policy;
+    bool low_resolution, display_fps, use_videosource, use_images, search_regions, display_search_rectangles, profile, profile_counters, use_pipeline;
     vector<string> images;
     try
     {
@@ -66,12 +190,17 @@ main(int argc, char* argv[])
         ed_fn                     = opt.getArgument<string>("eye-detector", "");
         md_fn                     = opt.getArgument<string>("mouth-detector", "");
         videosource               = opt.getArgument<string>("videosource", "");
+        trace_fn                  = opt.getArgument<string>("trace", "");
+        drop_policy               = opt.getArgument<string>("drop-policy", "");
         low_resolution            = opt.parameterSet("low-resolution") > 0;
         display_fps               = opt.parameterSet("fps") > 0;
         use_videosource           = opt.parameterSet("videosource") > 0;
         use_images                = opt.parameterSet("images") > 0;
         search_regions            = opt.parameterSet("search-regions") > 0;
         display_search_rectangles = opt.parameterSet("draw-search-rectangles") > 0;
+        profile_counters          = opt.parameterSet("profile-counters") > 0;
+        profile                   = opt.parameterSet("profile") > 0 || profile_counters;
+        use_pipeline              = opt.parameterSet("pipeline") > 0;
     }
     catch (CommandLineOptionException e)
     {
@@ -100,6 +229,13 @@ main(int argc, char* argv[])
     // Eye center detector
     typedef IsophoteEyeCenterDetector<double> iecd_t; // can be instantiated as float and double (choice defines the algorithmic precision [vs. run-time])
     iecd_t iecd;
+    iecd.setColorOrder(RGBColorOrder); // the color images are converted to luma on the fly (no cvtColor necessary)
+    SetInstrumentationEnabled(profile);
+    if (profile_counters)
+        SetHardwareCountersEnabled(true);
+    if (!trace_fn.empty())
+        SetTraceEnabled(true);
+    uint64_t frame = 0;
 
     /* default parameters */
     // ...
@@ -107,6 +243,7 @@ main(int argc, char* argv[])
     double isophote_col_sigma = 1;
     // options
     bool set_auto_isophote_sigma = false;
+    bool rotation_aware = false;
 
     // Set up GUI
     GuiThread thread;
@@ -122,6 +259,7 @@ main(int argc, char* argv[])
     win_params->setSlider("isophote col sigma (sigma)",          isophote_col_sigma, 0, 5);     
     win_params->setButton("set auto sigma",                      set_auto_isophote_sigma);     
     win_params->setButton("display search rectangles",           display_search_rectangles);
+    win_params->setButton("rotation aware",                      rotation_aware);
 
     double old_ts = -1;
     double fps = -1;
@@ -154,7 +292,31 @@ main(int argc, char* argv[])
         }
     }
 
-    while (imgwin->getWindowState() && (use_images || src->getNextFrame()))
+    if (use_pipeline)
+    {
+        auto_ptr<PipelineFrameSource> pipeline_src;
+        if (use_videosource)
+            pipeline_src.reset(new VideoSourceFrameSource(src.get()));
+        else
+            pipeline_src.reset(new ImageFileFrameSource(images));
+        BinaryPatternPipelineFaceDetector pipeline_fd(&fd,ed.get());
+        // cameras: process the latest frame (bounded latency); images: process every image
+        FrameDropPolicy policy = (use_videosource ? LatestOnlyPolicy : BlockPolicy);
+        if (drop_policy == "block")
+            policy = BlockPolicy;
+        else if (drop_policy == "drop-oldest")
+            policy = DropOldestPolicy;
+        else if (drop_policy == "latest-only")
+            policy = LatestOnlyPolicy;
+        else if (!drop_policy.empty())
+        {
+            printf("Unknown drop policy '%s'\n", drop_policy.c_str());
+            exit(1);
+        }
+        RunPipelineDemo(pipeline_src.get(),&pipeline_fd,policy,(use_videosource ? RGBColorOrder : BGRColorOrder),imgwin,win_params,low_resolution); // cv::imread loads BGR images
+    }
+
+    while (!use_pipeline && imgwin->getWindowState() && (use_images || src->getNextFrame()))
     {
         if (use_images && images.empty())
         {
@@ -162,6 +324,9 @@ main(int argc, char* argv[])
             continue;
         }
 
+        SetTraceFrame(frame++);
+        const uint64_t trace_frame_start = TraceStart();
+
         string fn;
         cv::Mat img;
         if (use_videosource)
@@ -173,8 +338,6 @@ main(int argc, char* argv[])
             img = loadImage(fn);
         }
         cv::Mat aimg = img.clone();
-        cv::Mat gimg;
-        cv::cvtColor(aimg,gimg,CV_RGB2GRAY);
         ImageDeco deco(aimg);
         deco.setAntiAlias(true);
 
@@ -194,10 +357,14 @@ main(int argc, char* argv[])
             win_params->toggleActivated("isophote col sigma (sigma)", false);
         }
         display_search_rectangles = win_params->getButton("display search rectangles");
+        rotation_aware = win_params->getButton("rotation aware");
+        iecd.setRotationAware(rotation_aware); // rotate the eye ROIs (and anisotropic filters) with the face, i.e. no warpAffine of the frame
 
         // Detect faces
         OKAPI_TIMER_START("detect faces");
+        const uint64_t trace_faces_start = TraceStart();
         vector<RectDetection> faces = fd.detectFaces(img);
+        TraceStop("detect faces",trace_faces_start);
         OKAPI_TIMER_STOP("detect faces");
 
         double fsize=0; //faces[0].box.width * faces[0].box.height;
@@ -220,7 +387,9 @@ main(int argc, char* argv[])
                 double mouth_width = fd.getMeanMouthWidth(faces[i].box);
 
                 OKAPI_TIMER_START("detect mouth");
+                const uint64_t trace_mouth_start = TraceStart();
                 mouth = md->detectMouth(img, mouth, mouth_width);
+                TraceStop("detect mouth",trace_mouth_start);
                 OKAPI_TIMER_STOP("detect mouth");
 
                 if (mouth.x >= 0)
@@ -239,7 +408,9 @@ main(int argc, char* argv[])
                 re = fd.getMeanRightEye(faces[i].box);
 
                 OKAPI_TIMER_START("detect eyes");
+                const uint64_t trace_eyes_start = TraceStart();
                 eyes = ed->detectEyes(img, le, re);
+                TraceStop("detect eyes",trace_eyes_start);
                 OKAPI_TIMER_STOP("detect eyes");
 
                 /*if (search_regions)
@@ -289,7 +460,9 @@ main(int argc, char* argv[])
                 else
                     iecd.setSigma(isophote_row_sigma,isophote_col_sigma);
                 OKAPI_TIMER_START("iecd.detectEyeCenters");
-                EyeCenterLocations<iecd_t::coord_t> eye_centers = iecd.detectEyeCenters(gimg,faces[i].box,eyes.left,eyes.right);
+                const uint64_t trace_iecd_start = TraceStart();
+                EyeCenterLocations<iecd_t::coord_t> eye_centers = iecd.detectEyeCenters(img,faces[i].box,eyes.left,eyes.right);
+                TraceStop("iecd.detectEyeCenters",trace_iecd_start);
                 OKAPI_TIMER_STOP("iecd.detectEyeCenters");
                 if (set_auto_isophote_sigma)
                 {
@@ -306,7 +479,16 @@ main(int argc, char* argv[])
                 // Draw search regions, i.e. regions of interest
                 cv::Rect_<iecd_t::coord_t> left_roi, right_roi;
                 iecd.getCurrentSearchRegions(left_roi, right_roi);
-                if (display_search_rectangles)
+                if (display_search_rectangles && rotation_aware)
+                {
+                    cv::RotatedRect left_oriented_roi, right_oriented_roi;
+                    iecd.getCurrentOrientedSearchRegions(left_oriented_roi, right_oriented_roi);
+                    deco.setThickness(1);
+                    deco.setColor(255, 127, 127);
+                    deco.drawRect(left_oriented_roi);
+                    deco.drawRect(right_oriented_roi);
+                }
+                else if (display_search_rectangles)
                 {
                     if (iecd_t::isValidCoord(left_roi))
                     {
@@ -353,7 +535,9 @@ main(int argc, char* argv[])
                 else
                     iecd.setSigma(isophote_row_sigma,isophote_col_sigma);
                 OKAPI_TIMER_START("iecd.detectEyeCenters");
-                EyeCenterLocations<iecd_t::coord_t> eye_centers = iecd.detectEyeCenters(gimg,faces[i].box,iecd_t::getInvalidCoordPoint(),iecd_t::getInvalidCoordPoint());
+                const uint64_t trace_iecd_start = TraceStart();
+                EyeCenterLocations<iecd_t::coord_t> eye_centers = iecd.detectEyeCenters(img,faces[i].box,iecd_t::getInvalidCoordPoint(),iecd_t::getInvalidCoordPoint());
+                TraceStop("iecd.detectEyeCenters",trace_iecd_start);
                 OKAPI_TIMER_STOP("iecd.detectEyeCenters");
                 if (set_auto_isophote_sigma)
                 {
@@ -400,7 +584,13 @@ main(int argc, char* argv[])
             name = basename(fn);
         imgwin->setImage(name, aimg, low_resolution ? 2 : 1);
         imgwin->setImage("accumulator",iecd.getMatAcc(), low_resolution ? 2 : 1);
+        TraceStop("frame",trace_frame_start);
     }
 
+    if (profile)
+        PrintInstrumentationSnapshot(GetInstrumentationSnapshot());
+    if (!trace_fn.empty())
+        WriteTrace(trace_fn);
+
     return 0;
 }
@@ -0,0 +1,823 @@
+/** Parallel evaluation of the eye center detector on BioID and Yale B (accuracy and run-time of the same code).
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <okapi.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "isophoteeyedetector.hpp"
+#include "instrumentation.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** One annotated image of a data set. */
+struct EvalSample
+{
+    string image_fn;
+    cv::Point2d left_eye;  // ground truth
+    cv::Point2d right_eye; // ground truth
+};
+
+/** Detection result of one sample. */
+struct EvalResult
+{
+    bool valid;
+    cv::Point left;
+    cv::Point right;
+    double left_error;    // normalized error, i.e. distance to the ground truth divided by the interocular distance
+    double right_error;
+    double latency_us;
+
+    EvalResult(void) : valid(false), left(-1,-1), right(-1,-1), left_error(-1), right_error(-1), latency_us(0) {}
+};
+
+struct EvalOptions
+{
+    int num_threads;
+    bool use_double;
+    double sigma;           // <= 0 => automatic sigma selection
+    int roi_width;          // size of the eye ROIs around the (jittered) eye locations
+    int roi_height;
+    int jitter;             // maximal displacement of the eye ROI centers (BioID protocol: uniform in [-5,-1] and [1,5])
+    unsigned int seed;
+    string results_fn;      // per image results (CSV)
+    string curve_fn;        // accuracy curve (CSV)
+
+    EvalOptions(void) : num_threads(0), use_double(false), sigma(-1), roi_width(40), roi_height(30), jitter(-1), seed(0) {}
+};
+
+/** Parameter grid of the sweep mode. The derivatives and isophotes are calculated once per (image, jitter, sigma) and all other parameters
+ *  only repeat the voting and/or the accumulator smoothing on these planes (see IsophoteEyeCenterDetector::processIsophotes).
+ */
+struct SweepOptions
+{
+    vector<int> jitters;           // max. displacements of the eye ROI centers (default: the --jitter of the data set)
+    vector<double> sigmas;         // empty => no sweep
+    vector<cv::Size> rois;         // eye ROI sizes (default: the --roi size)
+    vector<double> min_radii;      // min. length of the displacement vectors that vote
+    vector<double> max_radii;      // max. length of the displacement vectors that vote (<= 0: unbounded)
+    vector<double> curvednesses;   // min. curvedness of the voting pixels relative to the max. curvedness in the ROI
+    vector<int> smoothings;        // size of the Gaussian accumulator smoothing (<= 1: no smoothing)
+    string table_fn;               // results table (CSV)
+
+    SweepOptions(void) : min_radii(1,0.0), max_radii(1,0.0), curvednesses(1,0.0), smoothings(1,9) {}
+
+    size_t numConfigurations(void) const { return jitters.size()*sigmas.size()*rois.size()*min_radii.size()*max_radii.size()*curvednesses.size()*smoothings.size(); }
+};
+
+/** Normalized error thresholds of the reported accuracies. */
+static const double accuracy_thresholds[] = { 0.05, 0.10, 0.15, 0.25 };
+#define NUM_ACCURACY_THRESHOLDS (sizeof(accuracy_thresholds)/sizeof(accuracy_thresholds[0]))
+
+/** Number of samples that are below the thresholds of one sweep configuration (best/worst/left/right eye). */
+struct SweepCounts
+{
+    unsigned int best[NUM_ACCURACY_THRESHOLDS];
+    unsigned int worst[NUM_ACCURACY_THRESHOLDS];
+    unsigned int left[NUM_ACCURACY_THRESHOLDS];
+    unsigned int right[NUM_ACCURACY_THRESHOLDS];
+
+    SweepCounts(void)
+    {
+        for (size_t i = 0; i < NUM_ACCURACY_THRESHOLDS; i++)
+            best[i] = worst[i] = left[i] = right[i] = 0;
+    }
+};
+
+static const char help_str[] =
+    "Usage: %s [options] <data set> [...]\n"
+    "\nEvaluates IsophoteEyeCenterDetector with the protocol of the MATLAB scripts in evaluation/ (eye ROIs around the\n"
+    "annotated eye locations) and reports the normalized error e = max/min/mean(d_left,d_right)/d_interocular next to the\n"
+    "per-image latency.\n"
+    "\nData sets:\n"
+    "  --bioid <path>            BioID (<path>/images/BioID_XXXX.pgm, <path>/metadata/BioID_XXXX.eye)\n"
+    "  --bioid-samples <n>       number of BioID images (default: 1521, i.e. all)\n"
+    "  --yaleb <path>            Yale B, all illuminations of pose 0 (<path>/images/yaleBSS_P00.info, <path>/metadata/*.crop)\n"
+    "  --yaleb-pose <path>       Yale B, ambient image of all poses\n"
+    "  --yaleb-subjects <n>      number of Yale B subjects (default: 10)\n"
+    "\nOptions:\n"
+    "  -t, --threads <n>         number of worker threads (default: number of cores)\n"
+    "  -s, --sigma <sigma>       fixed sigma (default: automatic selection)\n"
+    "      --roi <w>x<h>         eye ROI size (default: 40x30)\n"
+    "      --jitter <n>          maximal ROI displacement (default: 5 for BioID, 0 for Yale B)\n"
+    "      --seed <n>            seed of the ROI displacements (default: 0)\n"
+    "      --double              calculate in double instead of float precision\n"
+    "      --results <file>      write the per-image results (CSV)\n"
+    "      --curve <file>        write the accuracy curves for e = 0:0.01:0.3 (CSV)\n"
+    "\nParameter sweep (lists are \"a,b,c\" or \"first:step:last\"; the derivatives are calculated once per image and sigma):\n"
+    "      --sweep <sigmas>      evaluate the grid of all sweep parameters instead of a single configuration\n"
+    "      --sweep-jitter <list> maximal ROI displacements (default: --jitter); the displacements of a sample only\n"
+    "                            depend on --seed, the sample and the maximum, i.e. they are the same for all other parameters\n"
+    "      --sweep-rois <list>   eye ROI sizes, e.g. 30x20,40x30,50x40 (default: --roi)\n"
+    "      --sweep-min-radius <list>  min. displacement of the voting pixels (default: 0)\n"
+    "      --sweep-max-radius <list>  max. displacement of the voting pixels, 0: unbounded (default: 0)\n"
+    "      --sweep-curvedness <list>  min. curvedness of the voting pixels relative to the ROI maximum (default: 0)\n"
+    "      --sweep-smoothing <list>   accumulator smoothing kernel sizes, <= 1: none (default: 9)\n"
+    "      --sweep-table <file>  write the accuracies of all configurations (CSV)\n";
+
+/** Read a BioID .eye file ("#LX LY RX RY" header and one line of coordinates). */
+static bool
+ReadBioIDEye(const string& fn, cv::Point2d& left_eye, cv::Point2d& right_eye)
+{
+    ifstream ifs(fn.c_str());
+    string line;
+    while (getline(ifs,line))
+    {
+        if (line.size() < 2 || line[0] == '#')
+            continue;
+        double lx, ly, rx, ry;
+        if (sscanf(line.c_str(),"%lf %lf %lf %lf",&lx,&ly,&rx,&ry) != 4)
+            return false;
+        left_eye = cv::Point2d(lx,ly);
+        right_eye = cv::Point2d(rx,ry);
+        return true;
+    }
+    return false;
+}
+
+static bool
+LoadBioID(const string& path, int num_samples, vector<EvalSample>& samples)
+{
+    for (int i = 0; i < num_samples; i++)
+    {
+        char buf[64];
+        EvalSample sample;
+        sprintf(buf,"BioID_%04d",i);
+        sample.image_fn = path + "/images/" + buf + ".pgm";
+        if (!ReadBioIDEye(path + "/metadata/" + buf + ".eye",sample.left_eye,sample.right_eye))
+        {
+            cerr << "Unable to read the annotation of '" << buf << "'!" << endl;
+            return false;
+        }
+        samples.push_back(sample);
+    }
+    return true;
+}
+
+/** Read a Yale B .crop file: the left eye, right eye and mouth coordinates (one "x y" per line), each block has one line per image. */
+static bool
+ReadYaleCrop(const string& fn, vector<cv::Point2d>& left_eyes, vector<cv::Point2d>& right_eyes)
+{
+    ifstream ifs(fn.c_str());
+    vector<cv::Point2d> coords;
+    double x, y;
+    while (ifs >> x >> y)
+        coords.push_back(cv::Point2d(x,y));
+    if (coords.empty() || coords.size() % 3 != 0)
+        return false;
+    const size_t n = coords.size() / 3;
+    left_eyes.assign(coords.begin(),coords.begin() + n);
+    right_eyes.assign(coords.begin() + n,coords.begin() + 2*n);
+    return true;
+}
+
+static bool
+LoadYaleB(const string& path, int num_subjects, bool poses, vector<EvalSample>& samples)
+{
+    const int num_poses = (poses ? 9 : 1);
+    for (int subject = 1; subject <= num_subjects; subject++)
+    {
+        for (int pose = 0; pose < num_poses; pose++)
+        {
+            char buf[64];
+            sprintf(buf,"yaleB%02d_P%02d",subject,pose);
+            vector<cv::Point2d> left_eyes, right_eyes;
+            if (!ReadYaleCrop(path + "/metadata/" + buf + ".crop",left_eyes,right_eyes))
+            {
+                cerr << "Unable to read the annotation of '" << buf << "'!" << endl;
+                return false;
+            }
+
+            // the .info file lists the images of the subject/pose (the first one is the ambient image) in the order of the annotations
+            vector<string> image_fns;
+            ifstream ifs((path + "/images/" + buf + ".info").c_str());
+            string line;
+            while (getline(ifs,line))
+            {
+                line.erase(line.find_last_not_of(" \t\r\n") + 1);
+                if (!line.empty())
+                    image_fns.push_back(line);
+            }
+            if (image_fns.empty())
+            {
+                cerr << "Unable to read '" << buf << ".info'!" << endl;
+                return false;
+            }
+
+            const size_t n = (poses ? 1 : std::min(image_fns.size(),left_eyes.size())); // the pose evaluation only uses the ambient image
+            for (size_t i = 0; i < n; i++)
+            {
+                EvalSample sample;
+                sample.image_fn = path + "/images/" + image_fns[i];
+                sample.left_eye = left_eyes[i];
+                sample.right_eye = right_eyes[i];
+                samples.push_back(sample);
+            }
+        }
+    }
+    return true;
+}
+
+/** Displacement of an eye ROI (BioID protocol: randi(5)*sign, i.e. never 0). */
+static int
+Jitter(int max_jitter, std::mt19937& rng)
+{
+    if (max_jitter <= 0)
+        return 0;
+    const int d = std::uniform_int_distribution<int>(1,max_jitter)(rng);
+    return (std::uniform_int_distribution<int>(0,1)(rng) ? d : -d);
+}
+
+/** The (randomly displaced) eye locations around which the eye ROIs are placed; reproducible for a seed, i.e. independent of the number of threads. */
+static void
+GetEyePriors(const EvalSample& sample, int jitter, unsigned int seed, cv::Point& left_prior, cv::Point& right_prior)
+{
+    std::mt19937 rng(seed);
+    left_prior.x = (int)floor(sample.left_eye.x + 0.5) + Jitter(jitter,rng);
+    left_prior.y = (int)floor(sample.left_eye.y + 0.5) + Jitter(jitter,rng);
+    right_prior.x = (int)floor(sample.right_eye.x + 0.5) + Jitter(jitter,rng);
+    right_prior.y = (int)floor(sample.right_eye.y + 0.5) + Jitter(jitter,rng);
+}
+
+template <typename T>
+static void
+EvaluateSamples(const EvalOptions& options, int jitter, const vector<EvalSample>& samples, std::atomic<size_t>& next_index, vector<EvalResult>& results)
+{
+    typedef IsophoteEyeCenterDetector<T> iecd_t;
+    iecd_t iecd;
+    if (options.sigma > 0)
+        iecd.setSigma(T(options.sigma),T(options.sigma));
+    else
+        iecd.setAutoSigma();
+    // the eye prior is in the center of the ROI
+    iecd.setEyeROI(cv::Rect(options.roi_width/2,options.roi_height/2,options.roi_width,options.roi_height));
+
+    for (size_t i = next_index.fetch_add(1); i < samples.size(); i = next_index.fetch_add(1))
+    {
+        const EvalSample& sample = samples[i];
+        cv::Mat img = cv::imread(sample.image_fn,0); // gray scale
+        if (img.empty())
+        {
+            cerr << "Unable to load '" << sample.image_fn << "'! Skipping image!" << endl;
+            continue;
+        }
+
+        // the ROIs are placed around the (randomly displaced) ground truth and have to be inside of the image
+        cv::Point left_prior, right_prior;
+        GetEyePriors(sample,jitter,options.seed + (unsigned int)i,left_prior,right_prior);
+        const int min_x = options.roi_width/2, max_x = img.cols - options.roi_width + options.roi_width/2;
+        const int min_y = options.roi_height/2, max_y = img.rows - options.roi_height + options.roi_height/2;
+        if (max_x < min_x || max_y < min_y)
+        {
+            cerr << "'" << sample.image_fn << "' is smaller than the eye ROI! Skipping image!" << endl;
+            continue;
+        }
+        left_prior.x = std::min(std::max(left_prior.x,min_x),max_x);
+        left_prior.y = std::min(std::max(left_prior.y,min_y),max_y);
+        right_prior.x = std::min(std::max(right_prior.x,min_x),max_x);
+        right_prior.y = std::min(std::max(right_prior.y,min_y),max_y);
+
+        const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        const EyeCenterLocations<typename iecd_t::coord_t> eye_centers = iecd.detectEyeCenters(img,iecd_t::getInvalidCoordRect(),left_prior,right_prior);
+        const chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+
+        EvalResult& result = results[i];
+        result.valid = eye_centers.isValid();
+        result.left = eye_centers.left;
+        result.right = eye_centers.right;
+        result.latency_us = chrono::duration_cast<chrono::nanoseconds>(stop - start).count() / 1000.0;
+        const cv::Point2d d_eyes = sample.left_eye - sample.right_eye;
+        const double iod = sqrt(d_eyes.x*d_eyes.x + d_eyes.y*d_eyes.y); // interocular distance of the ground truth
+        const cv::Point2d d_left = sample.left_eye - cv::Point2d(result.left.x,result.left.y);
+        const cv::Point2d d_right = sample.right_eye - cv::Point2d(result.right.x,result.right.y);
+        result.left_error = sqrt(d_left.x*d_left.x + d_left.y*d_left.y) / iod;
+        result.right_error = sqrt(d_right.x*d_right.x + d_right.y*d_right.y) / iod;
+    }
+}
+
+/** p-th percentile (nearest rank) of sorted values. */
+static double
+Percentile(const vector<double>& sorted_values, double p)
+{
+    if (sorted_values.empty())
+        return 0;
+    size_t rank = (size_t)(p / 100.0 * sorted_values.size() + 0.999999);
+    rank = std::min(std::max(rank,(size_t)1),sorted_values.size());
+    return sorted_values[rank - 1];
+}
+
+/** Accuracies at the error threshold e (best/average/worst eye, left, right); samples that could not be processed count as errors. */
+static void
+GetAccuracies(const vector<EvalResult>& results, double e, double& best, double& average, double& worst, double& left, double& right)
+{
+    size_t nb = 0, nw = 0, nl = 0, nr = 0;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const EvalResult& r = results[i];
+        if (r.left_error < 0)
+            continue;
+        nb += (std::min(r.left_error,r.right_error) <= e);
+        nw += (std::max(r.left_error,r.right_error) <= e);
+        nl += (r.left_error <= e);
+        nr += (r.right_error <= e);
+    }
+    const double n = (double)std::max(results.size(),(size_t)1);
+    best = nb / n;
+    worst = nw / n;
+    left = nl / n;
+    right = nr / n;
+    average = (left + right) / 2;
+}
+
+static bool
+Evaluate(const string& name, const EvalOptions& options, int jitter, const vector<EvalSample>& samples)
+{
+    vector<EvalResult> results(samples.size());
+    std::atomic<size_t> next_index(0);
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < options.num_threads; t++)
+    {
+        if (options.use_double)
+            workers.push_back(thread(EvaluateSamples<double>,std::cref(options),jitter,std::cref(samples),std::ref(next_index),std::ref(results)));
+        else
+            workers.push_back(thread(EvaluateSamples<float>,std::cref(options),jitter,std::cref(samples),std::ref(next_index),std::ref(results)));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    const double wall_s = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / 1e9;
+
+    // accuracy
+    vector<double> latencies;
+    for (size_t i = 0; i < results.size(); i++)
+        if (results[i].left_error >= 0)
+            latencies.push_back(results[i].latency_us);
+    std::sort(latencies.begin(),latencies.end());
+    cout << name << ": " << latencies.size() << "/" << samples.size() << " images, " << options.num_threads << " threads, "
+         << fixed << setprecision(2) << wall_s << " s" << endl;
+    cout << setprecision(3);
+    for (size_t i = 0; i < NUM_ACCURACY_THRESHOLDS; i++)
+    {
+        double best, average, worst, left, right;
+        GetAccuracies(results,accuracy_thresholds[i],best,average,worst,left,right);
+        cout << setprecision(2) << "  e<=" << accuracy_thresholds[i] << ": " << setprecision(3)
+             << "b=" << best << " a=" << average << " w=" << worst << "  l=" << left << " r=" << right << endl;
+    }
+    cout << setprecision(1) << "  latency [us]: p50 " << Percentile(latencies,50) << ", p90 " << Percentile(latencies,90) << ", p99 " << Percentile(latencies,99)
+         << ", max " << (latencies.empty() ? 0 : latencies.back()) << endl;
+
+    bool success = true;
+    if (!options.results_fn.empty())
+    {
+        ofstream ofs(options.results_fn.c_str(),ios::out | ios::app);
+        if (!ofs)
+        {
+            cerr << "Unable to open '" << options.results_fn << "'!" << endl;
+            success = false;
+        }
+        ofs << fixed << setprecision(4);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const EvalResult& r = results[i];
+            ofs << name << "," << samples[i].image_fn << "," << samples[i].left_eye.x << "," << samples[i].left_eye.y << "," << samples[i].right_eye.x << "," << samples[i].right_eye.y << ","
+                << r.left.x << "," << r.left.y << "," << r.right.x << "," << r.right.y << "," << r.left_error << "," << r.right_error << "," << setprecision(1) << r.latency_us << setprecision(4) << endl;
+        }
+    }
+    if (!options.curve_fn.empty())
+    {
+        ofstream ofs(options.curve_fn.c_str(),ios::out | ios::app);
+        if (!ofs)
+        {
+            cerr << "Unable to open '" << options.curve_fn << "'!" << endl;
+            success = false;
+        }
+        ofs << setprecision(4);
+        for (int i = 0; i <= 30; i++)
+        {
+            double best, average, worst, left, right;
+            GetAccuracies(results,i / 100.0,best,average,worst,left,right);
+            ofs << name << "," << i / 100.0 << "," << best << "," << average << "," << worst << "," << left << "," << right << endl;
+        }
+    }
+    return success;
+}
+
+/** Parse a list of values ("a,b,c") or a MATLAB-style range ("first:step:last"). */
+static bool
+ParseValues(const string& str, vector<double>& values)
+{
+    values.clear();
+    double first, step, last;
+    if (sscanf(str.c_str(),"%lf:%lf:%lf",&first,&step,&last) == 3)
+    {
+        if (step <= 0 || last < first)
+            return false;
+        for (int i = 0; first + i*step <= last + step*1e-6; i++)
+            values.push_back(first + i*step);
+        return true;
+    }
+    stringstream ss(str);
+    string item;
+    while (getline(ss,item,','))
+    {
+        char* end = NULL;
+        const double value = strtod(item.c_str(),&end);
+        if (end == item.c_str())
+            return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+/** Parse a list of ROI sizes ("40x30,50x40"). */
+static bool
+ParseSizes(const string& str, vector<cv::Size>& sizes)
+{
+    sizes.clear();
+    stringstream ss(str);
+    string item;
+    while (getline(ss,item,','))
+    {
+        int w, h;
+        if (sscanf(item.c_str(),"%dx%d",&w,&h) != 2 || w <= 0 || h <= 0)
+            return false;
+        sizes.push_back(cv::Size(w,h));
+    }
+    return !sizes.empty();
+}
+
+/** The eye ROI of the given size around a prior; the same placement as in EvaluateSamples, i.e. the prior is clamped such that the ROI is inside of the image. */
+static bool
+GetEyeROI(cv::Point prior, const cv::Size& roi_size, const cv::Size& image_size, cv::Rect& roi)
+{
+    const int min_x = roi_size.width/2, max_x = image_size.width - roi_size.width + roi_size.width/2;
+    const int min_y = roi_size.height/2, max_y = image_size.height - roi_size.height + roi_size.height/2;
+    if (max_x < min_x || max_y < min_y)
+        return false;
+    prior.x = std::min(std::max(prior.x,min_x),max_x);
+    prior.y = std::min(std::max(prior.y,min_y),max_y);
+    roi = cv::Rect(prior.x - roi_size.width/2,prior.y - roi_size.height/2,roi_size.width,roi_size.height);
+    return true;
+}
+
+/** Count the sample in the accuracies of a sweep configuration. */
+static void
+AddSweepResult(const EvalSample& sample, const cv::Point& left, const cv::Point& right, SweepCounts& counts)
+{
+    const cv::Point2d d_eyes = sample.left_eye - sample.right_eye;
+    const double iod = sqrt(d_eyes.x*d_eyes.x + d_eyes.y*d_eyes.y);
+    const cv::Point2d d_left = sample.left_eye - cv::Point2d(left.x,left.y);
+    const cv::Point2d d_right = sample.right_eye - cv::Point2d(right.x,right.y);
+    const double left_error = sqrt(d_left.x*d_left.x + d_left.y*d_left.y) / iod;
+    const double right_error = sqrt(d_right.x*d_right.x + d_right.y*d_right.y) / iod;
+    for (size_t i = 0; i < NUM_ACCURACY_THRESHOLDS; i++)
+    {
+        const double e = accuracy_thresholds[i];
+        counts.best[i] += (std::min(left_error,right_error) <= e);
+        counts.worst[i] += (std::max(left_error,right_error) <= e);
+        counts.left[i] += (left_error <= e);
+        counts.right[i] += (right_error <= e);
+    }
+}
+
+/** Evaluate all sweep configurations on the samples of next_index. The configurations are indexed in the order jitter, sigma, ROI, min. radius,
+ *  max. radius, curvedness and smoothing (the last one changes fastest). The derivatives and isophotes are calculated once per jitter and sigma
+ *  in the bounding box of all ROI sizes, the votes once per ROI and pruning, i.e. the smoothings only repeat the accumulator processing.
+ */
+template <typename T>
+static void
+SweepSamples(const EvalOptions& options, const SweepOptions& sweep, const vector<EvalSample>& samples, std::atomic<size_t>& next_index,
+             vector<SweepCounts>& counts, double& isophote_s, double& voting_s)
+{
+    typedef IsophoteEyeCenterDetector<T> iecd_t;
+    iecd_t iecd;
+    const size_t num_rois = sweep.rois.size();
+    const size_t num_smoothings = sweep.smoothings.size();
+    chrono::steady_clock::duration isophote_time(0), voting_time(0);
+
+    vector<cv::Rect> left_rois(num_rois), right_rois(num_rois);
+    vector<bool> valid_rois(num_rois);
+    vector<cv::Point> left_centers(num_smoothings), right_centers(num_smoothings);
+    for (size_t i = next_index.fetch_add(1); i < samples.size(); i = next_index.fetch_add(1))
+    {
+        const EvalSample& sample = samples[i];
+        cv::Mat img = cv::imread(sample.image_fn,0); // gray scale
+        if (img.empty())
+        {
+            cerr << "Unable to load '" << sample.image_fn << "'! Skipping image!" << endl;
+            continue;
+        }
+        const ImageView<uint8_t> view((const uint8_t*)img.data,img.cols,img.rows,(int)img.step1());
+
+        const size_t configs_per_jitter = sweep.numConfigurations() / sweep.jitters.size();
+        for (size_t j = 0; j < sweep.jitters.size(); j++)
+        {
+            // ROIs of all sizes around the same priors; the planes are calculated in their bounding box
+            cv::Point left_prior, right_prior;
+            GetEyePriors(sample,sweep.jitters[j],options.seed + (unsigned int)i,left_prior,right_prior);
+            cv::Rect left_region, right_region;
+            bool has_valid_roi = false;
+            for (size_t r = 0; r < num_rois; r++)
+            {
+                valid_rois[r] = GetEyeROI(left_prior,sweep.rois[r],img.size(),left_rois[r]) && GetEyeROI(right_prior,sweep.rois[r],img.size(),right_rois[r]);
+                if (!valid_rois[r])
+                    continue;
+                left_region = (has_valid_roi ? left_region | left_rois[r] : left_rois[r]);
+                right_region = (has_valid_roi ? right_region | right_rois[r] : right_rois[r]);
+                has_valid_roi = true;
+            }
+            if (!has_valid_roi)
+            {
+                cerr << "'" << sample.image_fn << "' is smaller than the eye ROIs! Skipping image!" << endl;
+                continue;
+            }
+
+            size_t config = j*configs_per_jitter;
+            for (size_t s = 0; s < sweep.sigmas.size(); s++)
+            {
+                const T sigma = T(sweep.sigmas[s]);
+                const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                iecd.processIsophotes(view,sigma,sigma,left_region,right_region);
+                const chrono::steady_clock::time_point isophotes_done = chrono::steady_clock::now();
+                for (size_t r = 0; r < num_rois; r++)
+                {
+                    const size_t num_votes = sweep.min_radii.size()*sweep.max_radii.size()*sweep.curvednesses.size();
+                    if (!valid_rois[r])
+                    {
+                        config += num_votes*num_smoothings;
+                        continue;
+                    }
+                    double left_max_c = 0, right_max_c = 0; // the curvedness thresholds are relative to the maximum in the ROI
+                    cv::minMaxLoc(iecd.getMatC()(left_rois[r]),NULL,&left_max_c,NULL,NULL);
+                    cv::minMaxLoc(iecd.getMatC()(right_rois[r]),NULL,&right_max_c,NULL,NULL);
+                    for (size_t a = 0; a < sweep.min_radii.size(); a++)
+                        for (size_t b = 0; b < sweep.max_radii.size(); b++)
+                            for (size_t c = 0; c < sweep.curvednesses.size(); c++)
+                            {
+                                // both eyes vote into the same accumulator (as in detectEyeCenters)
+                                const T min_radius = T(sweep.min_radii[a]), max_radius = T(sweep.max_radii[b]);
+                                iecd.vote(left_rois[r],min_radius,max_radius,T(sweep.curvednesses[c]*left_max_c),true);
+                                iecd.vote(right_rois[r],min_radius,max_radius,T(sweep.curvednesses[c]*right_max_c),false);
+                                for (size_t d = 0; d < num_smoothings; d++, config++)
+                                    AddSweepResult(sample,iecd.locateAccumulatorMaximum(left_rois[r],sweep.smoothings[d]),iecd.locateAccumulatorMaximum(right_rois[r],sweep.smoothings[d]),counts[config]);
+                            }
+                }
+                isophote_time += isophotes_done - start;
+                voting_time += chrono::steady_clock::now() - isophotes_done;
+            }
+        }
+    }
+    isophote_s = chrono::duration_cast<chrono::nanoseconds>(isophote_time).count() / 1e9;
+    voting_s = chrono::duration_cast<chrono::nanoseconds>(voting_time).count() / 1e9;
+}
+
+/** Print the parameters of a sweep configuration (see SweepSamples for the order of the configurations). */
+static void
+PrintSweepConfiguration(ostream& os, const SweepOptions& sweep, size_t i, const char* sep)
+{
+    const size_t d = i % sweep.smoothings.size(); i /= sweep.smoothings.size();
+    const size_t c = i % sweep.curvednesses.size(); i /= sweep.curvednesses.size();
+    const size_t b = i % sweep.max_radii.size(); i /= sweep.max_radii.size();
+    const size_t a = i % sweep.min_radii.size(); i /= sweep.min_radii.size();
+    const size_t r = i % sweep.rois.size(); i /= sweep.rois.size();
+    const size_t s = i % sweep.sigmas.size(); i /= sweep.sigmas.size();
+    os << sweep.jitters[i] << sep << sweep.sigmas[s] << sep << sweep.rois[r].width << sep << sweep.rois[r].height << sep << sweep.min_radii[a] << sep
+       << sweep.max_radii[b] << sep << sweep.curvednesses[c] << sep << sweep.smoothings[d];
+}
+
+static bool
+Sweep(const string& name, const EvalOptions& options, const SweepOptions& dataset_sweep, int jitter, const vector<EvalSample>& samples)
+{
+    SweepOptions sweep(dataset_sweep);
+    if (sweep.jitters.empty())
+        sweep.jitters.push_back(jitter); // the default jitter of the data set
+    const size_t num_configs = sweep.numConfigurations();
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector< vector<SweepCounts> > thread_counts(options.num_threads,vector<SweepCounts>(num_configs));
+    vector<double> isophote_s(options.num_threads,0), voting_s(options.num_threads,0);
+    std::atomic<size_t> next_index(0);
+    vector<thread> workers;
+    for (int t = 0; t < options.num_threads; t++)
+    {
+        if (options.use_double)
+            workers.push_back(thread(SweepSamples<double>,std::cref(options),std::cref(sweep),std::cref(samples),std::ref(next_index),std::ref(thread_counts[t]),std::ref(isophote_s[t]),std::ref(voting_s[t])));
+        else
+            workers.push_back(thread(SweepSamples<float>,std::cref(options),std::cref(sweep),std::cref(samples),std::ref(next_index),std::ref(thread_counts[t]),std::ref(isophote_s[t]),std::ref(voting_s[t])));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    const double wall_s = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / 1e9;
+
+    // merge the counts of the threads and calculate the accuracies (samples that could not be processed count as errors)
+    const double n = (double)std::max(samples.size(),(size_t)1);
+    vector< vector<double> > accuracies(num_configs,vector<double>(3*NUM_ACCURACY_THRESHOLDS)); // best, average, worst per threshold
+    for (size_t i = 0; i < num_configs; i++)
+    {
+        for (size_t j = 0; j < NUM_ACCURACY_THRESHOLDS; j++)
+        {
+            unsigned int best = 0, worst = 0, left = 0, right = 0;
+            for (int t = 0; t < options.num_threads; t++)
+            {
+                best += thread_counts[t][i].best[j];
+                worst += thread_counts[t][i].worst[j];
+                left += thread_counts[t][i].left[j];
+                right += thread_counts[t][i].right[j];
+            }
+            accuracies[i][3*j] = best / n;
+            accuracies[i][3*j + 1] = (left + right) / (2*n);
+            accuracies[i][3*j + 2] = worst / n;
+        }
+    }
+    double total_isophote_s = 0, total_voting_s = 0;
+    for (int t = 0; t < options.num_threads; t++)
+    {
+        total_isophote_s += isophote_s[t];
+        total_voting_s += voting_s[t];
+    }
+
+    // the best configurations by the worst eye accuracy at e <= 0.05 (the usual BioID measure), ties are broken by the average accuracy
+    vector<size_t> order(num_configs);
+    for (size_t i = 0; i < num_configs; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(),order.end(),[&accuracies](size_t i, size_t j) { return (accuracies[i][2] != accuracies[j][2] ? accuracies[i][2] > accuracies[j][2] : accuracies[i][1] > accuracies[j][1]); });
+    cout << name << " sweep: " << samples.size() << " images, " << num_configs << " configurations, " << options.num_threads << " threads, "
+         << fixed << setprecision(2) << wall_s << " s (derivatives and isophotes " << total_isophote_s << " s, voting and accumulators " << total_voting_s << " s)" << endl;
+    cout << "  jitter sigma roi_w roi_h min_r max_r min_c smooth";
+    for (size_t j = 0; j < NUM_ACCURACY_THRESHOLDS; j++)
+        cout << "  b/a/w@" << setprecision(2) << accuracy_thresholds[j];
+    cout << endl;
+    const size_t num_printed = std::min(num_configs,(size_t)10);
+    for (size_t k = 0; k < num_printed; k++)
+    {
+        cout << "  " << setprecision(3);
+        PrintSweepConfiguration(cout,sweep,order[k]," ");
+        for (size_t j = 0; j < NUM_ACCURACY_THRESHOLDS; j++)
+            cout << "  " << accuracies[order[k]][3*j] << "/" << accuracies[order[k]][3*j + 1] << "/" << accuracies[order[k]][3*j + 2];
+        cout << endl;
+    }
+
+    if (!sweep.table_fn.empty())
+    {
+        ofstream ofs(sweep.table_fn.c_str(),ios::out | ios::app);
+        if (!ofs)
+        {
+            cerr << "Unable to open '" << sweep.table_fn << "'!" << endl;
+            return false;
+        }
+        ofs << setprecision(4);
+        for (size_t i = 0; i < num_configs; i++)
+        {
+            ofs << name << ",";
+            PrintSweepConfiguration(ofs,sweep,i,",");
+            for (size_t j = 0; j < 3*NUM_ACCURACY_THRESHOLDS; j++)
+                ofs << "," << accuracies[i][j];
+            ofs << endl;
+        }
+    }
+    return true;
+}
+
+int
+main(int argc, char* argv[])
+{
+    EvalOptions options;
+    SweepOptions sweep;
+    vector<double> smoothings, jitters;
+    string bioid_path, yaleb_path, yaleb_pose_path;
+    int bioid_samples = 1521;
+    int yaleb_subjects = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        const bool has_value = (i + 1 < argc);
+        if (arg == "--bioid" && has_value)
+            bioid_path = argv[++i];
+        else if (arg == "--bioid-samples" && has_value)
+            bioid_samples = atoi(argv[++i]);
+        else if (arg == "--yaleb" && has_value)
+            yaleb_path = argv[++i];
+        else if (arg == "--yaleb-pose" && has_value)
+            yaleb_pose_path = argv[++i];
+        else if (arg == "--yaleb-subjects" && has_value)
+            yaleb_subjects = atoi(argv[++i]);
+        else if ((arg == "-t" || arg == "--threads") && has_value)
+            options.num_threads = atoi(argv[++i]);
+        else if ((arg == "-s" || arg == "--sigma") && has_value)
+            options.sigma = atof(argv[++i]);
+        else if (arg == "--roi" && has_value && sscanf(argv[i+1],"%dx%d",&options.roi_width,&options.roi_height) == 2)
+            i++;
+        else if (arg == "--jitter" && has_value)
+            options.jitter = atoi(argv[++i]);
+        else if (arg == "--seed" && has_value)
+            options.seed = (unsigned int)atoi(argv[++i]);
+        else if (arg == "--double")
+            options.use_double = true;
+        else if (arg == "--results" && has_value)
+            options.results_fn = argv[++i];
+        else if (arg == "--curve" && has_value)
+            options.curve_fn = argv[++i];
+        else if (arg == "--sweep" && has_value && ParseValues(argv[i+1],sweep.sigmas))
+            i++;
+        else if (arg == "--sweep-jitter" && has_value && ParseValues(argv[i+1],jitters))
+            i++;
+        else if (arg == "--sweep-rois" && has_value && ParseSizes(argv[i+1],sweep.rois))
+            i++;
+        else if (arg == "--sweep-min-radius" && has_value && ParseValues(argv[i+1],sweep.min_radii))
+            i++;
+        else if (arg == "--sweep-max-radius" && has_value && ParseValues(argv[i+1],sweep.max_radii))
+            i++;
+        else if (arg == "--sweep-curvedness" && has_value && ParseValues(argv[i+1],sweep.curvednesses))
+            i++;
+        else if (arg == "--sweep-smoothing" && has_value && ParseValues(argv[i+1],smoothings))
+            i++;
+        else if (arg == "--sweep-table" && has_value)
+            sweep.table_fn = argv[++i];
+        else
+        {
+            printf(help_str,argv[0]);
+            return (arg == "-h" || arg == "--help" ? 0 : 1);
+        }
+    }
+    if ((bioid_path.empty() && yaleb_path.empty() && yaleb_pose_path.empty()) || options.roi_width <= 0 || options.roi_height <= 0)
+    {
+        printf(help_str,argv[0]);
+        return 1;
+    }
+    if (options.num_threads <= 0)
+        options.num_threads = std::max(1,(int)thread::hardware_concurrency());
+    if (sweep.rois.empty())
+        sweep.rois.push_back(cv::Size(options.roi_width,options.roi_height));
+    if (!smoothings.empty())
+        sweep.smoothings.assign(smoothings.begin(),smoothings.end());
+    if (!jitters.empty())
+        sweep.jitters.assign(jitters.begin(),jitters.end());
+    const bool sweep_mode = !sweep.sigmas.empty();
+
+    // the output files are appended per data set, i.e. write the headers once
+    if (!options.results_fn.empty())
+        ofstream(options.results_fn.c_str()) << "dataset,image,gt_left_x,gt_left_y,gt_right_x,gt_right_y,left_x,left_y,right_x,right_y,left_error,right_error,latency_us" << endl;
+    if (!options.curve_fn.empty())
+        ofstream(options.curve_fn.c_str()) << "dataset,e,best,average,worst,left,right" << endl;
+    if (sweep_mode && !sweep.table_fn.empty())
+    {
+        ofstream ofs(sweep.table_fn.c_str());
+        ofs << "dataset,jitter,sigma,roi_width,roi_height,min_radius,max_radius,min_curvedness,smoothing";
+        for (size_t j = 0; j < NUM_ACCURACY_THRESHOLDS; j++)
+            ofs << ",best_" << accuracy_thresholds[j] << ",average_" << accuracy_thresholds[j] << ",worst_" << accuracy_thresholds[j];
+        ofs << endl;
+    }
+
+    bool success = true;
+    if (!bioid_path.empty())
+    {
+        vector<EvalSample> samples;
+        const int jitter = (options.jitter >= 0 ? options.jitter : 5);
+        success = LoadBioID(bioid_path,bioid_samples,samples) && (sweep_mode ? Sweep("BioID",options,sweep,jitter,samples) : Evaluate("BioID",options,jitter,samples)) && success;
+    }
+    if (!yaleb_path.empty())
+    {
+        vector<EvalSample> samples;
+        const int jitter = std::max(options.jitter,0);
+        success = LoadYaleB(yaleb_path,yaleb_subjects,false,samples) && (sweep_mode ? Sweep("YaleB-illumination",options,sweep,jitter,samples) : Evaluate("YaleB-illumination",options,jitter,samples)) && success;
+    }
+    if (!yaleb_pose_path.empty())
+    {
+        vector<EvalSample> samples;
+        const int jitter = std::max(options.jitter,0);
+        success = LoadYaleB(yaleb_pose_path,yaleb_subjects,true,samples) && (sweep_mode ? Sweep("YaleB-pose",options,sweep,jitter,samples) : Evaluate("YaleB-pose",options,jitter,samples)) && success;
+    }
+    return (success ? 0 : 1);
+}
@@ -0,0 +1,107 @@
+/** A single, aligned memory slab that can be carved into image planes.
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "aligned_slab.hpp"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/** Allocate bytes of SLAB_ALIGNMENT aligned memory. Returns NULL on failure. */
+static void*
+AlignedMalloc(size_t bytes, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(bytes,alignment);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr,alignment,bytes) != 0)
+        return NULL;
+    return ptr;
+#endif
+}
+
+/** Free memory that has been allocated with AlignedMalloc. */
+static void
+AlignedFree(void* ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+AlignedSlab::AlignedSlab(bool _use_huge_pages)
+: mem(NULL), mem_capacity(0), use_huge_pages(_use_huge_pages)
+{
+}
+
+AlignedSlab::~AlignedSlab(void)
+{
+    release();
+}
+
+bool
+AlignedSlab::reserve(size_t bytes)
+{
+    if (bytes <= mem_capacity)
+        return false;
+
+    // grow geometrically (by 1.5), so that slowly growing frame/ROI sizes do not cause an allocation for every frame
+    size_t new_capacity = mem_capacity + mem_capacity / 2;
+    if (new_capacity < bytes)
+        new_capacity = bytes;
+    size_t alignment = SLAB_ALIGNMENT;
+    if (use_huge_pages)
+    {
+        alignment = SLAB_HUGE_PAGE_SIZE;
+        new_capacity = AlignSize(new_capacity,SLAB_HUGE_PAGE_SIZE);
+    }
+    else
+        new_capacity = AlignSize(new_capacity);
+
+    // the old content does not have to be preserved, i.e. release first to keep the peak memory low
+    release();
+    mem = AlignedMalloc(new_capacity,alignment);
+    if (mem == NULL)
+        return true; // the caller will notice the NULL data(); capacity stays 0
+    mem_capacity = new_capacity;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (use_huge_pages)
+        madvise(mem,mem_capacity,MADV_HUGEPAGE); // only an advice, i.e. failure is not a problem
+#endif
+
+    return true;
+}
+
+void
+AlignedSlab::release(void)
+{
+    if (mem != NULL)
+        AlignedFree(mem);
+    mem = NULL;
+    mem_capacity = 0;
+}
@@ -0,0 +1,101 @@
+/** A single, aligned memory slab that can be carved into image planes.
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <stddef.h>
+
+/** Alignment (in bytes) of the slab and of every plane/row that is carved out of it. 64 bytes is a cache line and is sufficient for SSE/AVX/AVX-512 aligned loads. */
+#ifndef SLAB_ALIGNMENT
+#define SLAB_ALIGNMENT 64
+#endif
+
+/** Size of a transparent huge page; the slab is rounded up to this size if huge pages are requested. */
+#ifndef SLAB_HUGE_PAGE_SIZE
+#define SLAB_HUGE_PAGE_SIZE (2*1024*1024)
+#endif
+
+/** Tell the compiler that ptr is SLAB_ALIGNMENT aligned (e.g., a plane or row start that has been carved out of an AlignedSlab).
+ *  Kernels can use this on row pointers of slab planes to get aligned vector loads/stores.
+ */
+#if defined(__GNUC__)
+#define _ASSUME_ALIGNED(ptr) __builtin_assume_aligned((ptr),SLAB_ALIGNMENT)
+#else
+#define _ASSUME_ALIGNED(ptr) (ptr)
+#endif
+
+/** Round bytes up to the next multiple of alignment (alignment has to be a power of 2). */
+inline size_t
+AlignSize(size_t bytes, size_t alignment = SLAB_ALIGNMENT)
+{
+    return (bytes + alignment - 1) & ~(alignment - 1);
+}
+
+/** Is ptr aligned to alignment bytes? */
+inline bool
+IsAligned(const void* ptr, size_t alignment = SLAB_ALIGNMENT)
+{
+    return ((size_t)ptr & (alignment - 1)) == 0;
+}
+
+/** Calculate the padded row stride (in elements) for rows of length elements.
+ *  The stride is a multiple of SLAB_ALIGNMENT bytes, i.e. every row starts aligned, and it is never a multiple of 512 bytes. Strides that are a
+ *  (large) power of two map vertically adjacent pixels onto the same cache sets, which hurts the column passes of the separable filter.
+ */
+template <typename T>
+inline int
+GetPaddedStride(int length)
+{
+    size_t stride_bytes = AlignSize(sizeof(T)*(size_t)length);
+    if (stride_bytes % 512 == 0)
+        stride_bytes += SLAB_ALIGNMENT;
+    return (int)(stride_bytes / sizeof(T));
+}
+
+/** One contiguous, SLAB_ALIGNMENT-aligned memory block.
+ *  The owner carves the slab into planes (see GetPaddedStride and AlignSize). The slab grows geometrically, i.e. a request for a slightly bigger
+ *  frame does not result in a new allocation for every frame, and it never shrinks (except by calling release).
+ *  Optionally, the slab is backed by transparent huge pages (Linux), which reduces TLB misses for the big strided column passes.
+ */
+class AlignedSlab
+{
+        public:
+            /** Constructor. Does not allocate any memory. */
+            AlignedSlab(bool use_huge_pages = false);
+            /** Destructor. */
+            ~AlignedSlab(void);
+
+            /** Make sure that the slab holds at least bytes bytes. Returns true if the slab has been (re-)allocated, i.e. the previous content is lost. */
+            bool reserve(size_t bytes);
+            /** Release/Free the slab memory. */
+            void release(void);
+
+            /** Get the (aligned) slab memory. */
+            inline void* data(void) { return mem; }
+            /** Get the (aligned) slab memory. */
+            inline const void* data(void) const { return mem; }
+            /** Get the currently allocated size in bytes. */
+            inline size_t capacity(void) const { return mem_capacity; }
+
+            /** Use transparent huge pages for the next allocation (if supported by the platform). */
+            inline void setUseHugePages(bool _use_huge_pages) { use_huge_pages = _use_huge_pages; }
+            /** Are transparent huge pages used for allocations? */
+            inline bool getUseHugePages(void) const { return use_huge_pages; }
+
+        private:
+            // no copies
+            AlignedSlab(const AlignedSlab&);
+            AlignedSlab& operator=(const AlignedSlab&);
+
+            void*  mem;           // the aligned memory
+            size_t mem_capacity;  // the size of the allocated memory in bytes
+            bool   use_huge_pages;// advise the kernel to back the slab with huge pages
+};
@@ -0,0 +1,235 @@
+/** Asynchronous eye center detection: jobs are submitted to a pool of worker threads and the results are delivered via futures or callbacks.
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "async_eye_center_detector.hpp"
+#include "instrumentation.hpp"
+
+#include <algorithm>
+#include <exception>
+
+const char*
+ToString(SubmitStatus status)
+{
+    switch (status)
+    {
+        case SubmitAccepted:  return "accepted";
+        case SubmitQueueFull: return "queue full";
+        case SubmitClosed:    return "closed";
+        default:              return "unknown";
+    }
+}
+
+template <typename T>
+AsyncEyeCenterDetector<T>::AsyncEyeCenterDetector(int num_workers, size_t queue_capacity)
+: jobs(queue_capacity), sigma_row(T(-1)), sigma_col(T(-1)), color_order(BGRColorOrder), settings_generation(0),
+  submitted(0), rejected(0), completed(0), failed(0), discarded(0), latency_ticks_sum(0), latency_ticks_max(0)
+{
+    if (num_workers <= 0)
+        num_workers = std::max(1,(int)std::thread::hardware_concurrency());
+
+    // the time base of the statistics is the one of the instrumentation (calibrated once)
+    GetInstrumentationNanosecondsPerTick();
+    for (int i = 0; i < num_workers; i++)
+        workers.push_back(std::thread(&AsyncEyeCenterDetector<T>::Worker,this));
+}
+
+template <typename T>
+AsyncEyeCenterDetector<T>::~AsyncEyeCenterDetector(void)
+{
+    shutdown();
+}
+
+template <typename T>
+void
+AsyncEyeCenterDetector<T>::InitJob(Job& job, const cv::Mat& image, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye) const
+{
+    job.image = image; // reference, no copy
+    job.face_box = face_box;
+    job.left_eye = left_eye;
+    job.right_eye = right_eye;
+    job.submit_ticks = GetInstrumentationTicks();
+}
+
+template <typename T>
+std::future<typename AsyncEyeCenterDetector<T>::result_t>
+AsyncEyeCenterDetector<T>::submit(const cv::Mat& image, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye)
+{
+    Job job;
+    InitJob(job,image,face_box,left_eye,right_eye);
+    std::future<result_t> result = job.promise.get_future();
+    // count the job before the push, i.e. a worker never completes a job that has not been counted yet
+    submitted++;
+    if (!jobs.push(job))
+    {
+        submitted--;
+        return std::future<result_t>();
+    }
+    return result;
+}
+
+template <typename T>
+SubmitStatus
+AsyncEyeCenterDetector<T>::TrySubmitJob(Job& job)
+{
+    submitted++;
+    if (jobs.tryPush(job))
+        return SubmitAccepted;
+    submitted--;
+    if (jobs.isClosed())
+        return SubmitClosed;
+    rejected++;
+    return SubmitQueueFull;
+}
+
+template <typename T>
+SubmitStatus
+AsyncEyeCenterDetector<T>::trySubmit(const cv::Mat& image, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                     std::future<result_t>& result)
+{
+    Job job;
+    InitJob(job,image,face_box,left_eye,right_eye);
+    std::future<result_t> job_result = job.promise.get_future();
+    const SubmitStatus status = TrySubmitJob(job);
+    result = (status == SubmitAccepted ? std::move(job_result) : std::future<result_t>());
+    return status;
+}
+
+template <typename T>
+SubmitStatus
+AsyncEyeCenterDetector<T>::trySubmit(const cv::Mat& image, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                     const callback_t& callback)
+{
+    Job job;
+    InitJob(job,image,face_box,left_eye,right_eye);
+    job.callback = callback;
+    return TrySubmitJob(job);
+}
+
+template <typename T>
+void
+AsyncEyeCenterDetector<T>::shutdown(bool discard)
+{
+    jobs.close(discard);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+    // the discarded jobs have been accepted, but they will never complete
+    discarded.store(submitted.load() - completed.load());
+}
+
+template <typename T>
+void
+AsyncEyeCenterDetector<T>::setSigma(T row_sigma, T col_sigma)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    sigma_row = row_sigma;
+    sigma_col = col_sigma;
+    settings_generation++;
+}
+
+template <typename T>
+void
+AsyncEyeCenterDetector<T>::setColorOrder(ColorOrder order)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    color_order = order;
+    settings_generation++;
+}
+
+template <typename T>
+void
+AsyncEyeCenterDetector<T>::Complete(uint64_t submit_ticks, bool job_failed)
+{
+    const uint64_t latency_ticks = GetInstrumentationTicks() - submit_ticks;
+    latency_ticks_sum += latency_ticks;
+    uint64_t max_ticks = latency_ticks_max.load();
+    while (latency_ticks > max_ticks && !latency_ticks_max.compare_exchange_weak(max_ticks,latency_ticks)) {}
+    if (job_failed)
+        failed++;
+    completed++;
+}
+
+template <typename T>
+void
+AsyncEyeCenterDetector<T>::Worker(void)
+{
+    iecd_t iecd;
+    unsigned int generation = 0; // the detector's defaults correspond to generation 0
+    Job job;
+    while (jobs.pop(job))
+    {
+        if (settings_generation.load() != generation)
+        {
+            std::lock_guard<std::mutex> lock(settings_mutex);
+            generation = settings_generation.load();
+            if (sigma_row > 0)
+                iecd.setSigma(sigma_row,sigma_col);
+            else
+                iecd.setAutoSigma();
+            iecd.setColorOrder(color_order);
+        }
+
+        result_t result;
+        std::string error;
+        std::exception_ptr exception;
+        try
+        {
+            result = iecd.detectEyeCenters(job.image,job.face_box,job.left_eye,job.right_eye);
+        }
+        catch (const std::exception& e)
+        {
+            error = e.what();
+            exception = std::current_exception();
+        }
+        // release the reference to the caller's buffer before the result is delivered (i.e., the caller may reuse it in the callback)
+        job.image = cv::Mat();
+        Complete(job.submit_ticks,(bool)exception);
+
+        if (job.callback)
+            job.callback(result,error);
+        else if (exception)
+            job.promise.set_exception(exception);
+        else
+            job.promise.set_value(result);
+        job.callback = callback_t();
+    }
+}
+
+template <typename T>
+AsyncEyeCenterDetectorStatistics
+AsyncEyeCenterDetector<T>::getStatistics(void) const
+{
+    const double ns_per_tick = GetInstrumentationNanosecondsPerTick();
+    AsyncEyeCenterDetectorStatistics statistics;
+    statistics.submitted = submitted.load();
+    statistics.rejected = rejected.load();
+    statistics.completed = completed.load();
+    statistics.failed = failed.load();
+    statistics.discarded = discarded.load();
+    statistics.max_queued = jobs.maxSize();
+    statistics.mean_latency_ms = (statistics.completed > 0 ? latency_ticks_sum.load() * ns_per_tick / 1e6 / statistics.completed : 0);
+    statistics.max_latency_ms = latency_ticks_max.load() * ns_per_tick / 1e6;
+    return statistics;
+}
+
+/* Template instantiation */
+template class AsyncEyeCenterDetector<float>;
+template class AsyncEyeCenterDetector<double>;
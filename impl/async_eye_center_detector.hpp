@@ -0,0 +1,150 @@
+/** Asynchronous eye center detection: jobs are submitted to a pool of worker threads and the results are delivered via futures or callbacks.
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <okapi.hpp>
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "isophoteeyedetector.hpp"
+
+/** NOTES:
+ *  - The image of a job is a cv::Mat header, i.e. the job holds a reference to the (reference counted) pixel buffer and no copy is made.
+ *    The caller may release its own reference after the submission, but it must not write into the buffer until the job has completed
+ *    (e.g., a camera that reuses its buffers has to hand out a clone).
+ *  - Every worker has its own IsophoteEyeCenterDetector (the detector is not thread-safe), i.e. the memory of the image planes is allocated
+ *    per worker. The results of a worker do not depend on the other jobs, but the jobs may complete out of order if there are several workers.
+ *  - The job queue is bounded: submit blocks while the queue is full, trySubmit never blocks and reports the back-pressure instead.
+ */
+
+/** Result of a submission. */
+enum SubmitStatus
+{
+    SubmitAccepted = 0, // the job has been queued
+    SubmitQueueFull,    // back-pressure: all workers are busy and the queue is full (the job has not been queued)
+    SubmitClosed        // the detector has been shut down (the job has not been queued)
+};
+
+/** Get the name of a submit status (e.g., "queue full"). */
+const char* ToString(SubmitStatus status);
+
+/** Counters of an asynchronous detector (see AsyncEyeCenterDetector::getStatistics). */
+struct AsyncEyeCenterDetectorStatistics
+{
+    uint64_t submitted;     // accepted jobs
+    uint64_t rejected;      // jobs rejected by trySubmit because the queue was full
+    uint64_t completed;     // jobs whose result has been delivered (including failed jobs)
+    uint64_t failed;        // jobs whose detection threw an exception (delivered as exception of the future)
+    uint64_t discarded;     // jobs that have been dropped by shutdown(true)
+    size_t max_queued;      // max. number of queued jobs (i.e., waiting for a worker)
+    double mean_latency_ms; // mean time between the submission and the delivery of the result
+    double max_latency_ms;
+};
+
+template <typename T>
+class AsyncEyeCenterDetector
+{
+        public:
+            typedef IsophoteEyeCenterDetector<T> iecd_t;
+            typedef typename iecd_t::coord_t coord_t;
+            typedef EyeCenterLocations<coord_t> result_t;
+            /** Completion callback; called by the worker thread, i.e. it must be thread-safe and should return quickly. error is non-empty if the detection failed. */
+            typedef std::function<void (const result_t& result, const std::string& error)> callback_t;
+
+            /** Start num_workers worker threads (<= 0: number of cores). queue_capacity is the number of jobs that may wait for a worker. */
+            AsyncEyeCenterDetector(int num_workers = 1, size_t queue_capacity = 4);
+            /** Shuts the detector down (the queued jobs are completed). */
+            ~AsyncEyeCenterDetector(void);
+
+            /** Submit a job and get a future for the result; blocks while the queue is full. The future is invalid if the detector has been shut down. */
+            std::future<result_t> submit(const cv::Mat& image,
+                                         const cv::Rect_<coord_t>& face_box,
+                                         const cv::Point_<coord_t>& left_eye = cv::Point_<coord_t>(-1,-1), const cv::Point_<coord_t>& right_eye = cv::Point_<coord_t>(-1,-1));
+            /** Submit a job if the queue is not full (never blocks). The future is only valid if the job has been accepted. */
+            SubmitStatus trySubmit(const cv::Mat& image,
+                                   const cv::Rect_<coord_t>& face_box,
+                                   const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                   std::future<result_t>& result);
+            /** Submit a job if the queue is not full (never blocks); the result is delivered to the callback. */
+            SubmitStatus trySubmit(const cv::Mat& image,
+                                   const cv::Rect_<coord_t>& face_box,
+                                   const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                   const callback_t& callback);
+
+            /** Stop accepting jobs and join the workers. If discard is true, the queued jobs are dropped (their futures report a broken promise
+             *  and their callbacks are not called), otherwise they are completed first.
+             */
+            void shutdown(bool discard = false);
+
+            /** Set the sigma of the detectors (applied to the jobs that a worker starts afterwards; row_sigma < 0: automatic selection). Thread-safe. */
+            void setSigma(T row_sigma, T col_sigma = -1);
+            inline void setAutoSigma(void) { setSigma(T(-1),T(-1)); }
+            /** Set the channel order of 3/4-channel images (see IsophoteEyeCenterDetector::setColorOrder). Thread-safe. */
+            void setColorOrder(ColorOrder order);
+
+            /** Number of jobs that wait for a worker. */
+            inline size_t getQueuedJobs(void) const { return jobs.size(); }
+            /** Number of jobs that have been accepted but not completed yet (queued or in progress). */
+            inline size_t getPendingJobs(void) const { return (size_t)(submitted.load() - completed.load() - discarded.load()); }
+            inline size_t getNumWorkers(void) const { return workers.size(); }
+            inline size_t getQueueCapacity(void) const { return jobs.getCapacity(); }
+
+            /** Get the counters (can be called from any thread). */
+            AsyncEyeCenterDetectorStatistics getStatistics(void) const;
+
+        protected:
+            struct Job
+            {
+                cv::Mat image; // shares the caller's pixel buffer
+                cv::Rect_<coord_t> face_box;
+                cv::Point_<coord_t> left_eye, right_eye;
+                std::promise<result_t> promise; // used if there is no callback
+                callback_t callback;
+                uint64_t submit_ticks;
+            };
+
+            /** Fill in a job (the image is not copied). */
+            void InitJob(Job& job, const cv::Mat& image, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye) const;
+            SubmitStatus TrySubmitJob(Job& job);
+            void Worker(void);
+            void Complete(uint64_t submit_ticks, bool failed);
+
+        private:
+            AsyncEyeCenterDetector(const AsyncEyeCenterDetector&);
+            AsyncEyeCenterDetector& operator=(const AsyncEyeCenterDetector&);
+
+            BoundedQueue<Job> jobs;
+            std::vector<std::thread> workers;
+
+            // detector settings; the workers apply them if the generation has changed
+            mutable std::mutex settings_mutex;
+            T sigma_row, sigma_col;
+            ColorOrder color_order;
+            std::atomic<unsigned int> settings_generation;
+
+            // statistics
+            std::atomic<uint64_t> submitted;
+            std::atomic<uint64_t> rejected;
+            std::atomic<uint64_t> completed;
+            std::atomic<uint64_t> failed;
+            std::atomic<uint64_t> discarded;
+            std::atomic<uint64_t> latency_ticks_sum;
+            std::atomic<uint64_t> latency_ticks_max;
+};
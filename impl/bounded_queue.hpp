@@ -0,0 +1,124 @@
+/** Bounded, blocking multi-producer/multi-consumer FIFO queue (e.g., to connect the stages of a pipeline).
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/** A FIFO queue with at most capacity elements. push blocks while the queue is full (back-pressure, i.e. a fast stage cannot run away
+ *  from a slow one) and pop blocks while the queue is empty. After close, push fails and pop returns the remaining elements and then fails.
+ *  The elements are moved (e.g., a cv::Mat only copies its header).
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t _capacity) : capacity(_capacity > 0 ? _capacity : 1), closed(false), max_size(0) {}
+
+    /** Append an element; blocks while the queue is full. Returns false (and drops the element) if the queue has been closed. */
+    bool push(T& element)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock,[this] { return closed || queue.size() < capacity; });
+        if (closed)
+            return false;
+        queue.push_back(std::move(element));
+        if (queue.size() > max_size)
+            max_size = queue.size();
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    /** Append an element if the queue is not full (never blocks). Returns false (and keeps the element) if the queue is full or has been closed. */
+    bool tryPush(T& element)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed || queue.size() >= capacity)
+            return false;
+        queue.push_back(std::move(element));
+        if (queue.size() > max_size)
+            max_size = queue.size();
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    /** Remove the oldest element; blocks while the queue is empty. Returns false if the queue is closed and empty. */
+    bool pop(T& element)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock,[this] { return closed || !queue.empty(); });
+        if (queue.empty())
+            return false;
+        element = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    /** Remove the oldest element if there is one (never blocks). */
+    bool tryPop(T& element)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (queue.empty())
+            return false;
+        element = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    /** Close the queue, i.e. wake up all blocked producers and consumers. If discard is true, the remaining elements are dropped. */
+    void close(bool discard = false)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            if (discard)
+                queue.clear();
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    /** Reopen a closed (and drained) queue. */
+    void reopen(void)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        closed = false;
+        max_size = 0;
+    }
+
+    bool isClosed(void) const { std::lock_guard<std::mutex> lock(mutex); return closed; }
+    size_t size(void) const { std::lock_guard<std::mutex> lock(mutex); return queue.size(); }
+    /** Maximal number of queued elements since the construction/reopen (i.e., how often the consumer has been the bottleneck). */
+    size_t maxSize(void) const { std::lock_guard<std::mutex> lock(mutex); return max_size; }
+    size_t getCapacity(void) const { return capacity; }
+
+private:
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    const size_t capacity;
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> queue;
+    bool closed;
+    size_t max_size;
+};
@@ -0,0 +1,250 @@
+/** Box approximation of the Gaussian derivatives with an integral image.
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "box_filter.hpp"
+#include "gauss_filter.hpp"
+
+#include <stdint.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+/** Sum of x^e for x in [a,b]. */
+static double
+SumOfPowers(int a, int b, int e)
+{
+    double s = 0;
+    for (int x = a; x <= b; x++)
+        s += pow((double)x,e);
+    return s;
+}
+
+template <typename T>
+void
+CreateBoxDerivativeKernel(const T& sigma, BoxDerivativeKernel<T>& kernel, bool normalize)
+{
+    const double s = std::max((double)sigma,0.1);
+    const double s2 = s*s;
+
+    // responses of the sampled filters to constant, linear and quadratic signals, i.e. the scales of the boxes
+    const int length = GetGaussLength<T,int>(sigma);
+    std::vector<T> ax(length), g(length), gp(length), gpp(length);
+    GetGaussSupport<T,int>(sigma,&ax[0]);
+    CreateGauss(sigma,normalize,&ax[0],&g[0]);
+    CreateGaussFirstDeriv(sigma,normalize,&ax[0],&gp[0]);
+    CreateGaussSecondDeriv(sigma,normalize,&ax[0],&gpp[0]);
+    double g_scale = 0, gp_scale = 0, gpp_scale = 0;
+    for (int i = 0; i < length; i++)
+    {
+        g_scale += g[i];
+        gp_scale += -gp[i]*ax[i];              // the filters are not flipped, i.e. the convolution with x is -sum(gp*ax)
+        gpp_scale += gpp[i]*ax[i]*ax[i] / 2;
+    }
+
+    kernel.sigma = sigma;
+    // Gaussian: the variance of box [-g,g] is g(g+1)/3
+    kernel.g = std::max(0,(int)floor((sqrt(12*s2 + 1) - 1) / 2 + 0.5));
+    kernel.g_weight = T(g_scale / (2*kernel.g + 1));
+    // 1st derivative: the ratio of the 3rd and 1st order moment of the lobes [1,gp] and [-gp,-1] is gp(gp+1)/2 (3 sigma^2 for the Gaussian)
+    kernel.gp = std::max(1,(int)floor((sqrt(24*s2 + 1) - 1) / 2 + 0.5));
+    kernel.gp_weight = T(gp_scale / (kernel.gp*(kernel.gp + 1)));
+    // 2nd derivative: the outer lobes are chosen such that the ratio of the 4th and 2nd order moment is 6 sigma^2 and both lobes have the same
+    // (absolute) sum, i.e. the response to a constant signal is 0 (the center lobe is a bit narrower than the distance of the zero crossings,
+    // which minimizes the deviation of the frequency responses)
+    const int p = (int)floor(0.75*s); // center lobe [-p,p]
+    int best_q = p + 1;
+    double best_error = -1;
+    for (int q = p + 1; q <= p + 2 + (int)ceil(4*s); q++)
+    {
+        const double outer = (2*p + 1) / (2.0*(q - p)); // weight of the outer lobes relative to the center lobe
+        const double m2 = 2*outer*SumOfPowers(p + 1,q,2) - 2*SumOfPowers(1,p,2);
+        const double m4 = 2*outer*SumOfPowers(p + 1,q,4) - 2*SumOfPowers(1,p,4);
+        const double error = fabs(m4 / m2 - 6*s2);
+        if (best_error < 0 || error < best_error)
+        {
+            best_error = error;
+            best_q = q;
+        }
+    }
+    const double outer = (2*p + 1) / (2.0*(best_q - p));
+    const double m2 = 2*outer*SumOfPowers(p + 1,best_q,2) - 2*SumOfPowers(1,p,2);
+    const double center_weight = 2*gpp_scale / m2; // response to x^2/2
+    kernel.gpp_inner = p;
+    kernel.gpp_outer = best_q;
+    kernel.gpp_outer_weight = T(outer*center_weight);
+    kernel.gpp_inner_weight = T((1 + outer)*center_weight); // box[-p,p] is also part of box[-q,q]
+    kernel.support = std::max(kernel.g,std::max(kernel.gp,kernel.gpp_outer));
+}
+template void CreateBoxDerivativeKernel(const float&, BoxDerivativeKernel<float>&, bool);
+template void CreateBoxDerivativeKernel(const double&, BoxDerivativeKernel<double>&, bool);
+
+/** Get the value of pixel (x,y) of an image view; color image views are converted to luma. */
+template <typename R, typename S>
+static inline R
+GetIntegralPixel(const ImageView<S>& in, int x, int y)
+{
+    return R(in(x,y));
+}
+template <typename R, typename S>
+static inline R
+GetIntegralPixel(const ColorImageView<S>& in, int x, int y)
+{
+    return in.template luma<R>(x,y);
+}
+
+template <typename V, typename R>
+void
+CalculateIntegralImage(const V& in, int roi_x, int roi_y, int roi_width, int roi_height, R* out, int out_stride)
+{
+    for (int x = 0; x <= roi_width; x++)
+        out[x] = R(0);
+    for (int y = 0; y < roi_height; y++)
+    {
+        const R* above = out + (size_t)y*out_stride;
+        R* row = out + (size_t)(y + 1)*out_stride;
+        R row_sum = R(0);
+        row[0] = R(0);
+        for (int x = 0; x < roi_width; x++)
+        {
+            row_sum += GetIntegralPixel<R>(in,roi_x + x,roi_y + y);
+            row[x + 1] = above[x + 1] + row_sum;
+        }
+    }
+}
+// instantiate for gray images
+template void CalculateIntegralImage(const ImageView<uint8_t>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ImageView<uint8_t>&, int, int, int, int, double*, int);
+template void CalculateIntegralImage(const ImageView<uint16_t>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ImageView<uint16_t>&, int, int, int, int, double*, int);
+template void CalculateIntegralImage(const ImageView<float>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ImageView<float>&, int, int, int, int, double*, int);
+template void CalculateIntegralImage(const ImageView<double>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ImageView<double>&, int, int, int, int, double*, int);
+// instantiate for color images
+template void CalculateIntegralImage(const ColorImageView<uint8_t>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ColorImageView<uint8_t>&, int, int, int, int, double*, int);
+template void CalculateIntegralImage(const ColorImageView<uint16_t>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ColorImageView<uint16_t>&, int, int, int, int, double*, int);
+template void CalculateIntegralImage(const ColorImageView<float>&, int, int, int, int, float*, int);
+template void CalculateIntegralImage(const ColorImageView<float>&, int, int, int, int, double*, int);
+
+/** Boundaries of the lobes of a BoxDerivativeKernel, i.e. the lobe [a,b] of a pixel covers the integral indices [a,b+1). */
+enum BoxBoundary
+{
+    GBegin = 0, GEnd,                    // [-g,g]
+    GpNegBegin, GpNegEnd,                // [-gp,-1]
+    GpPosBegin, GpPosEnd,                // [1,gp]
+    GppOuterBegin, GppOuterEnd,          // [-gpp_outer,gpp_outer]
+    GppInnerBegin, GppInnerEnd,          // [-gpp_inner,gpp_inner]
+    NumBoxBoundaries
+};
+
+/** Get the offsets of the boundaries of the lobes (see BoxBoundary). */
+template <typename T>
+static void
+GetBoxBoundaryOffsets(const BoxDerivativeKernel<T>& kernel, int* offsets)
+{
+    offsets[GBegin] = -kernel.g;               offsets[GEnd] = kernel.g + 1;
+    offsets[GpNegBegin] = -kernel.gp;          offsets[GpNegEnd] = 0;
+    offsets[GpPosBegin] = 1;                   offsets[GpPosEnd] = kernel.gp + 1;
+    offsets[GppOuterBegin] = -kernel.gpp_outer; offsets[GppOuterEnd] = kernel.gpp_outer + 1;
+    offsets[GppInnerBegin] = -kernel.gpp_inner; offsets[GppInnerEnd] = kernel.gpp_inner + 1;
+}
+
+/** Weights of the boxes of the derivatives (see BoxDerivativeKernel), i.e. the products of the weights of the row and col kernel. */
+template <typename R>
+struct BoxDerivativeWeights
+{
+    R Lx, Ly, Lxy;                   // the 1st derivatives have one weight per box
+    R Lxx_outer, Lxx_inner;
+    R Lyy_outer, Lyy_inner;
+};
+
+/** Calculate the derivatives of the pixels [x_begin,x_end) of a row. rows are the integral image rows of the boundaries (see BoxBoundary) and
+ *  x_offsets the offsets of the boundaries relative to the pixels; x is relative to the integral image. If Clip, then the columns of the boundaries
+ *  are clipped to the integral image, i.e. only the pixels at the border of the integral image have to be clipped.
+ */
+template <bool Clip, typename T, typename R>
+static inline void
+CalculateBoxDerivativesRow(const R* const* rows, const int* x_offsets, int integral_width, const BoxDerivativeWeights<R>& w, int x_begin, int x_end,
+                           T* Lx, T* Ly, T* Lxx, T* Lxy, T* Lyy)
+{
+    for (int x = x_begin; x < x_end; x++)
+    {
+        int c[NumBoxBoundaries];
+        for (int b = 0; b < NumBoxBoundaries; b++)
+            c[b] = (Clip ? std::min(std::max(x + x_offsets[b],0),integral_width) : x + x_offsets[b]);
+        // sum of the box [xa,xb)x[ya,yb) of the integral image
+#define _BOX(xa,xb,ya,yb) (rows[yb][c[xb]] - rows[ya][c[xb]] - rows[yb][c[xa]] + rows[ya][c[xa]])
+        Lx[x]  = T(w.Lx*(_BOX(GpPosBegin,GpPosEnd,GBegin,GEnd) - _BOX(GpNegBegin,GpNegEnd,GBegin,GEnd)));
+        Ly[x]  = T(w.Ly*(_BOX(GBegin,GEnd,GpPosBegin,GpPosEnd) - _BOX(GBegin,GEnd,GpNegBegin,GpNegEnd)));
+        Lxx[x] = T(w.Lxx_outer*_BOX(GppOuterBegin,GppOuterEnd,GBegin,GEnd) - w.Lxx_inner*_BOX(GppInnerBegin,GppInnerEnd,GBegin,GEnd));
+        Lyy[x] = T(w.Lyy_outer*_BOX(GBegin,GEnd,GppOuterBegin,GppOuterEnd) - w.Lyy_inner*_BOX(GBegin,GEnd,GppInnerBegin,GppInnerEnd));
+        Lxy[x] = T(w.Lxy*(_BOX(GpPosBegin,GpPosEnd,GpPosBegin,GpPosEnd) + _BOX(GpNegBegin,GpNegEnd,GpNegBegin,GpNegEnd)
+                        - _BOX(GpPosBegin,GpPosEnd,GpNegBegin,GpNegEnd) - _BOX(GpNegBegin,GpNegEnd,GpPosBegin,GpPosEnd)));
+#undef _BOX
+    }
+}
+
+template <typename T, typename R>
+void
+CalculateBoxDerivatives(const R* integral, int integral_stride, int integral_x, int integral_y, int integral_width, int integral_height,
+                        const BoxDerivativeKernel<T>& row_kernel, const BoxDerivativeKernel<T>& col_kernel,
+                        int roi_x, int roi_y, int roi_width, int roi_height,
+                        T* Lx, T* Ly, T* Lxx, T* Lxy, T* Lyy, int out_stride, int out_y0)
+{
+    if (roi_width <= 0 || roi_height <= 0)
+        return;
+
+    int x_offsets[NumBoxBoundaries], y_offsets[NumBoxBoundaries];
+    GetBoxBoundaryOffsets(row_kernel,x_offsets);
+    GetBoxBoundaryOffsets(col_kernel,y_offsets);
+    BoxDerivativeWeights<R> w;
+    w.Lx = R(row_kernel.gp_weight)*R(col_kernel.g_weight);
+    w.Ly = R(row_kernel.g_weight)*R(col_kernel.gp_weight);
+    w.Lxy = R(row_kernel.gp_weight)*R(col_kernel.gp_weight);
+    w.Lxx_outer = R(row_kernel.gpp_outer_weight)*R(col_kernel.g_weight);
+    w.Lxx_inner = R(row_kernel.gpp_inner_weight)*R(col_kernel.g_weight);
+    w.Lyy_outer = R(row_kernel.g_weight)*R(col_kernel.gpp_outer_weight);
+    w.Lyy_inner = R(row_kernel.g_weight)*R(col_kernel.gpp_inner_weight);
+
+    // columns (relative to the integral image) whose boxes are inside the integral image, i.e. do not have to be clipped
+    const int x_begin = roi_x - integral_x, x_end = x_begin + roi_width;
+    const int inner_begin = std::min(std::max(x_begin,row_kernel.support),x_end);
+    const int inner_end = std::max(std::min(x_end,integral_width - row_kernel.support),inner_begin);
+    for (int y = roi_y; y < roi_y + roi_height; y++)
+    {
+        // the (clipped) integral image rows of the boundaries
+        const R* rows[NumBoxBoundaries];
+        for (int b = 0; b < NumBoxBoundaries; b++)
+            rows[b] = integral + (size_t)std::min(std::max(y + y_offsets[b] - integral_y,0),integral_height)*integral_stride;
+        // the outputs are indexed relative to the integral image as well
+        const ptrdiff_t o = (ptrdiff_t)(y - out_y0)*out_stride + integral_x;
+        T *_Lx = Lx + o, *_Ly = Ly + o, *_Lxx = Lxx + o, *_Lxy = Lxy + o, *_Lyy = Lyy + o;
+        CalculateBoxDerivativesRow<true>(rows,x_offsets,integral_width,w,x_begin,inner_begin,_Lx,_Ly,_Lxx,_Lxy,_Lyy);
+        CalculateBoxDerivativesRow<false>(rows,x_offsets,integral_width,w,inner_begin,inner_end,_Lx,_Ly,_Lxx,_Lxy,_Lyy);
+        CalculateBoxDerivativesRow<true>(rows,x_offsets,integral_width,w,inner_end,x_end,_Lx,_Ly,_Lxx,_Lxy,_Lyy);
+    }
+}
+template void CalculateBoxDerivatives(const float*, int, int, int, int, int, const BoxDerivativeKernel<float>&, const BoxDerivativeKernel<float>&, int, int, int, int, float*, float*, float*, float*, float*, int, int);
+template void CalculateBoxDerivatives(const double*, int, int, int, int, int, const BoxDerivativeKernel<float>&, const BoxDerivativeKernel<float>&, int, int, int, int, float*, float*, float*, float*, float*, int, int);
+template void CalculateBoxDerivatives(const double*, int, int, int, int, int, const BoxDerivativeKernel<double>&, const BoxDerivativeKernel<double>&, int, int, int, int, double*, double*, double*, double*, double*, int, int);
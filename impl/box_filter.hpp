@@ -0,0 +1,63 @@
+/** Box approximation of the Gaussian derivatives with an integral image (i.e. the cost per pixel does not depend on sigma).
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include "image_view.hpp"
+
+/** 1-D box approximations of the Gaussian and its 1st and 2nd derivative for one sigma (see CreateBoxDerivativeKernel). The lobes are intervals of
+ *  offsets relative to the filtered pixel, i.e. every lobe is a box sum of the integral image:
+ *   Gaussian:       g_weight * box[-g,g]
+ *   1st derivative: gp_weight * (box[1,gp] - box[-gp,-1])
+ *   2nd derivative: gpp_outer_weight * box[-gpp_outer,gpp_outer] - gpp_inner_weight * box[-gpp_inner,gpp_inner]
+ *  The sizes are chosen such that the 2nd (Gaussian) or 4th (derivatives) order moments match the sampled Gaussian filters, and the weights such that
+ *  the responses to constant, linear and quadratic signals are those of CreateGauss, CreateGaussFirstDeriv and CreateGaussSecondDeriv.
+ */
+template <typename T>
+struct BoxDerivativeKernel
+{
+    T sigma;            // sigma of the approximated Gaussian
+    int g;              // half width of the Gaussian box
+    int gp;             // width of the lobes of the 1st derivative
+    int gpp_inner;      // half width of the (negative) center lobe of the 2nd derivative
+    int gpp_outer;      // half width of the 2nd derivative
+    T g_weight;         // weights of the boxes (see above)
+    T gp_weight;
+    T gpp_inner_weight;
+    T gpp_outer_weight;
+    int support;        // max. offset of all lobes, i.e. the filters read the interval [-support,support]
+};
+
+/** Calculate the box approximation of the Gaussian (mu=0) and its derivatives with parameter sigma; normalize has the same meaning as for CreateGauss. */
+template <typename T>
+void
+CreateBoxDerivativeKernel(const T& sigma, BoxDerivativeKernel<T>& kernel, bool normalize = false);
+
+/** Calculate the integral image of the ROI, i.e. out[(y+1)*out_stride + x+1] is the sum of the pixels [roi_x,roi_x+x]x[roi_y,roi_y+y]. The first row
+ *  and column of out are 0, i.e. out has (roi_height+1) rows with out_stride >= roi_width+1 elements each. Color image views are converted to luma on
+ *  the fly. R should be double for images that are larger than about 256x256 pixels (float has only a 24 bit mantissa).
+ */
+template <typename V, typename R>
+void
+CalculateIntegralImage(const V& in, int roi_x, int roi_y, int roi_width, int roi_height, R* out, int out_stride);
+
+/** Calculate the box approximations of the Gaussian derivatives Lx, Ly, Lxx, Lxy and Lyy in the ROI from an integral image (see CalculateIntegralImage)
+ *  of the image region [integral_x,integral_x+integral_width)x[integral_y,integral_y+integral_height). row_kernel filters in x-direction and col_kernel
+ *  in y-direction (as the separable row/col filters). Row y of the image is written into row y - out_y0 of the output planes (row stride out_stride),
+ *  i.e. the planes can be a strip of rows. The ROI has to be inside the integral image region and the boxes are clipped at the border of the region,
+ *  i.e. the responses are only valid if the support of the pixel is inside the region (as the responses of the separable filters at the image borders).
+ */
+template <typename T, typename R>
+void
+CalculateBoxDerivatives(const R* integral, int integral_stride, int integral_x, int integral_y, int integral_width, int integral_height,
+                        const BoxDerivativeKernel<T>& row_kernel, const BoxDerivativeKernel<T>& col_kernel,
+                        int roi_x, int roi_y, int roi_width, int roi_height,
+                        T* Lx, T* Ly, T* Lxx, T* Lxy, T* Lyy, int out_stride, int out_y0 = 0);
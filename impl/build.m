@@ -26,9 +26,27 @@ debug_build=true;
 if debug_build
   mex CXXFLAGS="\$CXXFLAGS -Wall" -g -D__MEX gauss_filter.cpp separable_filter.o
   mex CXXFLAGS="\$CXXFLAGS -Wall" -g -D__MEX separable_filter.cpp
-  mex CXXFLAGS="\$CXXFLAGS -Wall" -g -D__MEX isophote.cpp
+  mex CXXFLAGS="\$CXXFLAGS -Wall -std=c++11 -pthread" LDFLAGS="\$LDFLAGS -pthread" -g -D__MEX isophote.cpp
 else
   mex CXXFLAGS="\$CXXFLAGS -Wall" -D__MEX gauss_filter.cpp separable_filter.o
   mex CXXFLAGS="\$CXXFLAGS -Wall" -D__MEX separable_filter.cpp
-  mex CXXFLAGS="\$CXXFLAGS -Wall" -D__MEX isophote.cpp
+  mex CXXFLAGS="\$CXXFLAGS -Wall -std=c++11 -pthread" LDFLAGS="\$LDFLAGS -pthread" -D__MEX isophote.cpp
+end
+
+% the complete detector (isophoteeyedetector.mex*), i.e. only the eye centers (and explicitly requested planes) cross the MEX boundary;
+% needs the OKAPI/OpenCV headers and libraries (adapt the paths below) and C++11 (native worker threads for batches)
+build_detector=true;
+okapi_dir='/home/bschauer/devel/okapi';
+if build_detector
+  detector_flags={'CXXFLAGS=$CXXFLAGS -Wall -std=c++11 -pthread','LDFLAGS=$LDFLAGS -pthread',['-I' okapi_dir '/include'],['-L' okapi_dir '/build/lib']};
+  detector_srcs={'gauss_filter_bank.cpp','box_filter.cpp','isophote.cpp','aligned_slab.cpp','instrumentation.cpp'};
+  for i=1:numel(detector_srcs)
+    mex(detector_flags{:},'-c',detector_srcs{i});
+  end
+  detector_libs={'-lokapi-st','-lopencv_imgproc','-lopencv_core'};
+  if debug_build
+    mex(detector_flags{:},'-g','-D__MEX','isophoteeyedetector.cpp','separable_filter.o','gauss_filter.o','gauss_filter_bank.o','box_filter.o','isophote.o','aligned_slab.o','instrumentation.o',detector_libs{:});
+  else
+    mex(detector_flags{:},'-D__MEX','isophoteeyedetector.cpp','separable_filter.o','gauss_filter.o','gauss_filter_bank.o','box_filter.o','isophote.o','aligned_slab.o','instrumentation.o',detector_libs{:});
+  end
 end
@@ -33,209 +33,7 @@
 #include "matrix.h"
 #endif
 
-// implemented padding types
-typedef enum PadType
-{
-  ConstPad = 0,
-  ReplicatePad,
-  SymmetricPad, 
-  CircularPad,
-  NumPadTypes,
-  UnknownPad
-} PadType;
-
-std::string 
-ToString(const PadType t)
-{
-  switch (t)
-  {
-    case ConstPad:
-      return "ConstPad";
-    case ReplicatePad:
-      return "ReplicatePad";
-    case CircularPad:
-      return "CircularPad";
-    case SymmetricPad:
-      return "SymmetricPad";
-    default:
-      assert(false);
-      return "UnknownPad";
-  }
-}
-
-PadType 
-GetPadType(const char* c)
-{
-  if (strcasecmp("circular",c) == 0)
-    return ConstPad;
-  else if (strcasecmp("replicate",c) == 0)
-    return ReplicatePad;
-  else if (strcasecmp("symmetric",c) == 0)
-    return SymmetricPad;
-  else if (strcasecmp("const",c) == 0)
-    return CircularPad;
-  else 
-    return UnknownPad;
-}
-
-// create a padded copy of the input array
-//  in:            the input array (a step length between the elements can be specified using in_step_length)
-//  out:           the padded output array (will be allocated iff it is ==0)
-//  pad_length:    the length of the padding on each side of the array
-//  pad_type:      the type of the padding (constant, replicate, symmetric, or circular)
-//  pad_parameter: an optional parameter can be provided for the padding (most importantly the value for a constant pad)
-//
-// returns the pointer to the input data segment of the padded array (i.e. the beginning of the original data w/o the left pad)
-template <typename T, typename T_size>
-inline T* 
-PadArray(T*& out, const T* in, const T_size in_length, const PadType pad_type, const T_size pad_length, const void* pad_parameter = 0, const T_size in_step_length = 0)
-{
-  // if necessary, then we allocate the output array ourselves
-	if (out == NULL) 
-    out = new T[in_length + 2*pad_length];
-  
-  T* pad_left  = out;                          // start of the left pad array segment
-  T* pad_data  = out + pad_length;             // start of the central (in) data segment
-  T* pad_right = out + pad_length + in_length; // start of the right pad array segment
-  
-  // copy the input data
-  if (in_step_length == 0 || in_step_length == 1)
-    memcpy((void*)pad_data,(void*)in,sizeof(T)*in_length);
-  else
-    for (T_size i(0); i < in_length; i++)
-      pad_data[i] = in[i*in_step_length];
-  
-  // create the pad
-  switch (pad_type)
-  {
-    //
-    // Input array values outside the bounds of the array are implicitly assumed to have the value *((T*)pad_parameter).  When no (T*)pad_parameter (i.e. pad_parameter=0) is specified, X = 0 is used.
-    //
-    case ConstPad:
-      {
-        T pad_value = 0;
-        if (pad_parameter != 0)
-          pad_value = *((T*)pad_parameter);
-        for (T_size i(0); i < pad_length; i++)
-        {
-          pad_left[i] = pad_value;
-          pad_right[i] = pad_value;
-        }
-      }
-      break;
-    //
-    // Input array values outside the bounds of the array are computed by implicitly assuming the input array is periodic.
-    //
-    case CircularPad:
-      {
-        for (T_size i(0); i < pad_length; i++)
-        {
-          pad_left[i] = pad_data[in_length - pad_length + i];
-          pad_right[i] = pad_data[i];
-        }
-      }
-      break;
-    //
-    // Input array values outside the bounds of the array are computed by mirror-reflecting the array across the array border.
-    //
-    case SymmetricPad:
-      {
-        for (T_size i(0); i < pad_length; i++)
-        {
-          pad_left[i] = pad_data[pad_length - i - 1];
-          pad_right[i] = pad_data[in_length - 1 - i];
-        }
-      }
-      break;
-    //
-    // Input array values outside the bounds of the array are assumed to equal the nearest array border value.
-    //
-    case ReplicatePad:
-      {
-        T pad_value_left = pad_data[0];
-        T pad_value_right = pad_data[in_length - 1];
-        for (T_size i(0); i < pad_length; i++)
-        {
-          pad_left[i] = pad_value_left;
-          pad_right[i] = pad_value_right;
-        }
-      }
-      break;
-    default:
-      assert(false);
-      break;
-  }
-  
-  return pad_data;
-}
-
-// Filter a (padded) array.
-// Correlation-based filtering is used (i.e. no convolution)
-template <typename T, typename T_size>
-inline void 
-CorrFilterPaddedArray(T*& out, const T* padded_data, const T_size data_length, const T* filter, const T_size filter_length, const T_size filter_anchor = 0, const T_size out_step_length = 0)
-{
-  int _filter_length = (int)filter_length;
-  int _filter_anchor = (int)filter_anchor;
-  
-  if (out == 0)
-  {
-    if (out_step_length > 0)
-      out = new T[data_length*out_step_length];
-    else
-      out = new T[data_length];
-  }
-  
-  if (out_step_length == 0 || out_step_length == 1)
-  {
-    for (T_size i(0); i < data_length; i++)
-    {
-      // @todo: optimize implementation
-      out[i] = T(0);
-      const T* in = padded_data + _filter_anchor - filter_length + i;
-      for (int xf(0); xf < _filter_length; xf++)
-      {
-        out[i] += in[xf] * filter[xf];
-      }
-    }
-  }
-  else
-  {
-    for (T_size i(0); i < data_length; i++)
-    {
-      // @todo: optimize implementation
-      out[i*out_step_length] = T(0);
-      const T* in = padded_data + _filter_anchor - filter_length + i;
-      for (int xf(0); xf < _filter_length; xf++)
-      {
-        out[i*out_step_length] += in[xf] * filter[xf];
-      }
-    }
-  }
-}
-
-// simple interface to filter an array (not optimal, because the padded_in memory isn't reused
-template <typename T, typename T_size>
-inline void 
-CorrFilterArray(T*& out,                                         // output (allocated if ==0); the number of output elements (and the size respecting out_step_length) always is the same the input length
-                const T* in, const T_size in_length,             // input
-                const T* filter, const T_size filter_length,     // filter
-                const PadType pad_type, const T_size pad_length, // pad
-                const void* pad_parameter = 0,                   // optional: pad parameters
-                const T_size filter_anchor = 0,                  // optional: where is the filter anchored
-                const T_size in_step_length = 0,                 // optional: input data step length/size
-                const T_size out_step_length = 0                 // optional: output data step length/size
-               )
-{
-  T* padded_array = 0;
-  
-  // 1. pad array
-  T* padded_data = PadArray(padded_array,in,in_length,pad_type,pad_length,pad_parameter,in_step_length);
-  // 2. filter
-  CorrFilterPaddedArray(out,padded_data,in_length,filter,filter_length,filter_anchor,out_step_length);
-  
-  delete [] padded_array;
-}
+#include "corrfilter1d.hpp"
 
 #ifdef __MEX
 template <typename T>
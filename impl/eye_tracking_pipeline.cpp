@@ -0,0 +1,292 @@
+/** Pipelined eye tracking: capture, conversion, face detection and eye center detection run as separate stages on separate threads.
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "eye_tracking_pipeline.hpp"
+#include "instrumentation.hpp"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <iomanip>
+
+// names of the stages (statistics and trace spans)
+static const char* const stage_names[4] = { "capture", "conversion", "face detection", "eye center detection" };
+
+bool
+ImageFileFrameSource::grab(cv::Mat& image, double& timestamp)
+{
+    while (next < filenames.size())
+    {
+        const size_t index = next++;
+        image = cv::imread(filenames[index],flags);
+        if (image.empty())
+        {
+            std::cerr << "ImageFileFrameSource: unable to load '" << filenames[index] << "'! Skipping image!" << std::endl;
+            continue;
+        }
+        timestamp = (fps > 0 ? index / fps : 0);
+        return true;
+    }
+    return false;
+}
+
+void
+PrintPipelineStatistics(const PipelineStatistics& statistics, std::ostream& os)
+{
+    const std::ios_base::fmtflags flags = os.flags();
+    os << std::left << std::setw(22) << "stage" << std::right << std::setw(10) << "frames" << std::setw(12) << "mean [ms]" << std::setw(10) << "busy [%]" << std::setw(12) << "max queued" << std::endl;
+    for (int i = 0; i < 4; i++)
+    {
+        const PipelineStageStatistics& s = statistics.stages[i];
+        os << std::left << std::setw(22) << s.name << std::right << std::setw(10) << s.frames << std::fixed << std::setprecision(3) << std::setw(12) << s.mean_ms
+           << std::setprecision(1) << std::setw(10) << (statistics.wall_s > 0 ? s.busy_ms / (10*statistics.wall_s) : 0) << std::setw(12) << s.max_queued << std::endl;
+    }
+    os << "pipeline: " << statistics.frames << " frames, " << std::setprecision(1) << statistics.fps << " fps, latency mean " << std::setprecision(2)
+       << statistics.mean_latency_ms << " ms, max " << statistics.max_latency_ms << " ms" << std::endl;
+    os << "capture handoff (" << ToString(statistics.capture_policy) << "): " << statistics.dropped_frames << " dropped frames, queue age mean "
+       << statistics.mean_queue_age_ms << " ms, max " << statistics.max_queue_age_ms << " ms" << std::endl;
+    os.flags(flags);
+}
+
+template <typename T>
+EyeTrackingPipeline<T>::EyeTrackingPipeline(PipelineFrameSource* _source, PipelineFaceDetector* _face_detector, PipelineConverter* _converter, size_t queue_capacity,
+                                            FrameDropPolicy capture_policy)
+: source(_source), face_detector(_face_detector), converter(_converter), sigma_row(T(-1)), sigma_col(T(-1)), sigma_changed(false),
+  capture_ring(queue_capacity,capture_policy), conversion_queue(queue_capacity), face_queue(queue_capacity), output_queue(queue_capacity),
+  stopping(false), running_stages(0), start_ticks(0), output_frames(0), latency_ticks_sum(0), latency_ticks_max(0)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        stage_frames[i].store(0);
+        stage_ticks[i].store(0);
+    }
+}
+
+template <typename T>
+EyeTrackingPipeline<T>::~EyeTrackingPipeline(void)
+{
+    stop();
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::start(void)
+{
+    if (!threads.empty())
+        return;
+
+    // the time base of the statistics is the one of the instrumentation (calibrated once)
+    GetInstrumentationNanosecondsPerTick();
+    capture_ring.reopen();
+    conversion_queue.reopen();
+    face_queue.reopen();
+    output_queue.reopen();
+    for (int i = 0; i < 4; i++)
+    {
+        stage_frames[i].store(0);
+        stage_ticks[i].store(0);
+    }
+    output_frames.store(0);
+    latency_ticks_sum.store(0);
+    latency_ticks_max.store(0);
+    stopping.store(false);
+    start_ticks = GetInstrumentationTicks();
+
+    running_stages.store(4);
+    threads.push_back(std::thread(&EyeTrackingPipeline<T>::CaptureStage,this));
+    threads.push_back(std::thread(&EyeTrackingPipeline<T>::ConversionStage,this));
+    threads.push_back(std::thread(&EyeTrackingPipeline<T>::FaceDetectionStage,this));
+    threads.push_back(std::thread(&EyeTrackingPipeline<T>::EyeCenterDetectionStage,this));
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::stop(void)
+{
+    if (threads.empty())
+        return;
+    stopping.store(true);
+    capture_ring.close();
+    conversion_queue.close(true);
+    face_queue.close(true);
+    output_queue.close(true);
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    threads.clear();
+}
+
+template <typename T>
+bool
+EyeTrackingPipeline<T>::pop(PipelineFrame& frame)
+{
+    return output_queue.pop(frame);
+}
+
+template <typename T>
+bool
+EyeTrackingPipeline<T>::tryPop(PipelineFrame& frame)
+{
+    return output_queue.tryPop(frame);
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::StageDone(int stage, uint64_t stage_start_ticks)
+{
+    // only the stage's thread writes its counters, i.e. no read-modify-write is necessary
+    const uint64_t end_ticks = GetInstrumentationTicks();
+    stage_frames[stage].store(stage_frames[stage].load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+    stage_ticks[stage].store(stage_ticks[stage].load(std::memory_order_relaxed) + (end_ticks - stage_start_ticks),std::memory_order_relaxed);
+    if (IsTraceEnabled())
+        RecordTraceEvent(stage_names[stage],stage_start_ticks,end_ticks);
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::CaptureStage(void)
+{
+    uint64_t index = 0;
+    while (!stopping.load())
+    {
+        PipelineFrame frame;
+        SetTraceFrame(index);
+        const uint64_t ticks = GetInstrumentationTicks();
+        if (!source->grab(frame.image,frame.timestamp))
+            break;
+        frame.index = index++;
+        frame.capture_ticks = GetInstrumentationTicks();
+        StageDone(0,ticks);
+        if (!capture_ring.push(frame))
+            break;
+    }
+    capture_ring.close();
+    running_stages--;
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::ConversionStage(void)
+{
+    PipelineFrame frame;
+    while (!stopping.load() && capture_ring.pop(frame))
+    {
+        SetTraceFrame(frame.index);
+        const uint64_t ticks = GetInstrumentationTicks();
+        if (converter != NULL)
+            converter->convert(frame.image,frame.converted);
+        else
+            frame.converted = frame.image;
+        StageDone(1,ticks);
+        if (!conversion_queue.push(frame))
+            break;
+    }
+    conversion_queue.close();
+    running_stages--;
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::FaceDetectionStage(void)
+{
+    PipelineFrame frame;
+    while (conversion_queue.pop(frame))
+    {
+        SetTraceFrame(frame.index);
+        const uint64_t ticks = GetInstrumentationTicks();
+        if (face_detector != NULL)
+            frame.has_face = face_detector->detect(frame.converted,frame.face,frame.left_eye,frame.right_eye);
+        else
+        {
+            // no face detector, i.e. the images are face crops
+            frame.has_face = true;
+            frame.face = cv::Rect(0,0,frame.converted.cols,frame.converted.rows);
+        }
+        StageDone(2,ticks);
+        if (!face_queue.push(frame))
+            break;
+    }
+    face_queue.close();
+    running_stages--;
+}
+
+template <typename T>
+void
+EyeTrackingPipeline<T>::EyeCenterDetectionStage(void)
+{
+    PipelineFrame frame;
+    while (face_queue.pop(frame))
+    {
+        SetTraceFrame(frame.index);
+        const uint64_t ticks = GetInstrumentationTicks();
+        if (sigma_changed.exchange(false))
+        {
+            if (sigma_row.load() > 0)
+                iecd.setSigma(sigma_row.load(),sigma_col.load());
+            else
+                iecd.setAutoSigma();
+        }
+        if (frame.has_face)
+            frame.eye_centers = iecd.detectEyeCenters(frame.converted,frame.face,frame.left_eye,frame.right_eye);
+        StageDone(3,ticks);
+
+        const uint64_t latency_ticks = GetInstrumentationTicks() - frame.capture_ticks;
+        latency_ticks_sum.store(latency_ticks_sum.load(std::memory_order_relaxed) + latency_ticks,std::memory_order_relaxed);
+        if (latency_ticks > latency_ticks_max.load(std::memory_order_relaxed))
+            latency_ticks_max.store(latency_ticks,std::memory_order_relaxed);
+        output_frames.store(output_frames.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+        if (!output_queue.push(frame))
+            break;
+    }
+    output_queue.close();
+    running_stages--;
+}
+
+template <typename T>
+PipelineStatistics
+EyeTrackingPipeline<T>::getStatistics(void) const
+{
+    const double ns_per_tick = GetInstrumentationNanosecondsPerTick();
+    const SpscRingStatistics capture_statistics = capture_ring.getStatistics();
+    const size_t max_queued[4] = { capture_statistics.max_size, conversion_queue.maxSize(), face_queue.maxSize(), output_queue.maxSize() };
+    PipelineStatistics statistics;
+    for (int i = 0; i < 4; i++)
+    {
+        PipelineStageStatistics& s = statistics.stages[i];
+        s.name = stage_names[i];
+        s.frames = stage_frames[i].load(std::memory_order_relaxed);
+        s.busy_ms = stage_ticks[i].load(std::memory_order_relaxed) * ns_per_tick / 1e6;
+        s.mean_ms = (s.frames > 0 ? s.busy_ms / s.frames : 0);
+        s.max_queued = max_queued[i];
+    }
+    statistics.frames = output_frames.load(std::memory_order_relaxed);
+    statistics.wall_s = (start_ticks > 0 ? (GetInstrumentationTicks() - start_ticks) * ns_per_tick / 1e9 : 0);
+    statistics.fps = (statistics.wall_s > 0 ? statistics.frames / statistics.wall_s : 0);
+    statistics.mean_latency_ms = (statistics.frames > 0 ? latency_ticks_sum.load(std::memory_order_relaxed) * ns_per_tick / 1e6 / statistics.frames : 0);
+    statistics.max_latency_ms = latency_ticks_max.load(std::memory_order_relaxed) * ns_per_tick / 1e6;
+    statistics.capture_policy = capture_ring.getPolicy();
+    statistics.dropped_frames = capture_statistics.dropped;
+    statistics.mean_queue_age_ms = capture_statistics.mean_age_ms;
+    statistics.max_queue_age_ms = capture_statistics.max_age_ms;
+    return statistics;
+}
+
+/* Template instantiation */
+template class EyeTrackingPipeline<float>;
+template class EyeTrackingPipeline<double>;
@@ -0,0 +1,191 @@
+/** Pipelined eye tracking: capture, conversion, face detection and eye center detection run as separate stages on separate threads.
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <okapi.hpp>
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "isophoteeyedetector.hpp"
+#include "spsc_ring.hpp"
+
+/** NOTES:
+ *  - The stages are connected by bounded queues, i.e. the throughput approaches the throughput of the slowest stage and a slow stage
+ *    throttles the faster ones (no unbounded buffering). Every stage processes the frames in order.
+ *  - The source and the detectors are pluggable (see the interfaces below), e.g., an ImageFileFrameSource can stand in for a camera.
+ *  - Every stage is a single thread, i.e. the pluggable objects don't have to be thread-safe, but they must not be shared between stages.
+ */
+
+/** A frame on its way through the pipeline (the results of the stages are filled in stage by stage). */
+struct PipelineFrame
+{
+    uint64_t index;            // frame number (in capture order)
+    double timestamp;          // timestamp of the source (seconds)
+    uint64_t capture_ticks;    // capture time (see GetInstrumentationTicks), i.e. for the end-to-end latency
+    cv::Mat image;             // the image as delivered by the source
+    cv::Mat converted;         // the image used by the detectors (output of the conversion stage; the image itself without converter)
+    bool has_face;
+    cv::Rect face;             // face box
+    cv::Point left_eye;        // coarse eye locations of the face detector ((-1,-1) if not available)
+    cv::Point right_eye;
+    EyeCenterLocations<int> eye_centers; // invalid if no face has been found
+
+    PipelineFrame(void) : index(0), timestamp(0), capture_ticks(0), has_face(false), left_eye(-1,-1), right_eye(-1,-1) {}
+};
+
+/** Frame source stage (e.g., a camera or a list of image files). */
+class PipelineFrameSource
+{
+public:
+    virtual ~PipelineFrameSource(void) {}
+    /** Grab the next frame; returns false at the end of the stream. The image must not be modified by the source afterwards (i.e., clone
+     *  the image if the source reuses its buffers).
+     */
+    virtual bool grab(cv::Mat& image, double& timestamp) = 0;
+};
+
+/** Conversion stage (e.g., color conversion, resizing or undistortion). */
+class PipelineConverter
+{
+public:
+    virtual ~PipelineConverter(void) {}
+    virtual void convert(const cv::Mat& image, cv::Mat& converted) = 0;
+};
+
+/** Face detection stage (optionally with coarse eye locations, which define the eye ROIs of the eye center detector). */
+class PipelineFaceDetector
+{
+public:
+    virtual ~PipelineFaceDetector(void) {}
+    /** Detect the (main) face; returns false if there is no face. left_eye/right_eye are (-1,-1) if the eyes are not detected. */
+    virtual bool detect(const cv::Mat& image, cv::Rect& face, cv::Point& left_eye, cv::Point& right_eye) = 0;
+};
+
+/** Reads a list of image files (e.g., to replace a camera in tests or benchmarks). The timestamps are the frame numbers divided by fps. */
+class ImageFileFrameSource : public PipelineFrameSource
+{
+public:
+    ImageFileFrameSource(const std::vector<std::string>& _filenames, double _fps = 25, int _flags = 1) : filenames(_filenames), fps(_fps), flags(_flags), next(0) {}
+    virtual bool grab(cv::Mat& image, double& timestamp);
+private:
+    std::vector<std::string> filenames;
+    double fps;
+    int flags;      // cv::imread flags (1: color, 0: gray scale)
+    size_t next;
+};
+
+/** Statistics of a stage. */
+struct PipelineStageStatistics
+{
+    const char* name;
+    uint64_t frames;     // processed frames
+    double busy_ms;      // time spent in the stage's work (i.e., without waiting for the queues)
+    double mean_ms;      // busy_ms / frames
+    size_t max_queued;   // max. number of frames in the output queue of the stage, i.e. waiting for the next stage
+};
+
+/** Statistics of the pipeline. */
+struct PipelineStatistics
+{
+    PipelineStageStatistics stages[4]; // capture, conversion, face detection, eye center detection
+    uint64_t frames;                   // frames that left the pipeline
+    double wall_s;                     // time since start
+    double fps;                        // frames / wall_s
+    double mean_latency_ms;            // mean capture-to-output latency
+    double max_latency_ms;
+    FrameDropPolicy capture_policy;    // policy of the handoff of the captured frames (see SpscRing)
+    uint64_t dropped_frames;           // captured frames that have been dropped by the policy
+    double mean_queue_age_ms;          // mean time between capture and the start of the conversion
+    double max_queue_age_ms;
+};
+
+/** Print the statistics (one stage per line). */
+void
+PrintPipelineStatistics(const PipelineStatistics& statistics, std::ostream& os = std::cout);
+
+template <typename T>
+class EyeTrackingPipeline
+{
+        public:
+            typedef IsophoteEyeCenterDetector<T> iecd_t;
+
+            /** The pipeline does not take ownership of the source and the detectors. converter may be NULL (the detectors use the source image) and
+             *  face_detector may be NULL (the images are face crops, i.e. the face box is the complete image).
+             *  queue_capacity is the capacity of the queues between the stages (small capacities keep the latency low).
+             *  capture_policy defines what happens to captured frames if the pipeline falls behind: BlockPolicy processes every frame (the source is
+             *  throttled, e.g. for files), DropOldestPolicy/LatestOnlyPolicy drop frames, i.e. the latency stays bounded (e.g., for cameras).
+             */
+            EyeTrackingPipeline(PipelineFrameSource* source, PipelineFaceDetector* face_detector, PipelineConverter* converter = NULL, size_t queue_capacity = 2,
+                                FrameDropPolicy capture_policy = BlockPolicy);
+            /** Stops the pipeline. */
+            ~EyeTrackingPipeline(void);
+
+            /** The eye center detector of the eye center stage. Configure it before start (it is used by the stage thread afterwards; use setSigma/setAutoSigma below). */
+            inline iecd_t& getEyeCenterDetector(void) { return iecd; }
+            /** Set the sigma of the eye center detector (applied to the next frame; row_sigma < 0: automatic selection). Thread-safe. */
+            inline void setSigma(T row_sigma, T col_sigma) { sigma_row.store(row_sigma); sigma_col.store(col_sigma); sigma_changed.store(true); }
+            inline void setAutoSigma(void) { setSigma(T(-1),T(-1)); }
+
+            /** Start the stage threads. */
+            void start(void);
+            /** Get the next processed frame; blocks until a frame is available. Returns false if the pipeline has finished (end of the source or
+             *  stop) and all frames have been consumed.
+             */
+            bool pop(PipelineFrame& frame);
+            /** Get the next processed frame if one is available (never blocks). */
+            bool tryPop(PipelineFrame& frame);
+            /** Stop the stages (frames in the queues are dropped) and join the threads. */
+            void stop(void);
+            /** Is a stage still running? */
+            inline bool isRunning(void) const { return running_stages.load() > 0; }
+
+            /** Get the statistics (can be called while the pipeline runs). */
+            PipelineStatistics getStatistics(void) const;
+
+        protected:
+            void CaptureStage(void);
+            void ConversionStage(void);
+            void FaceDetectionStage(void);
+            void EyeCenterDetectionStage(void);
+            void StageDone(int stage, uint64_t start_ticks);
+
+        private:
+            EyeTrackingPipeline(const EyeTrackingPipeline&);
+            EyeTrackingPipeline& operator=(const EyeTrackingPipeline&);
+
+            PipelineFrameSource* source;
+            PipelineFaceDetector* face_detector;
+            PipelineConverter* converter;
+            iecd_t iecd;
+            std::atomic<T> sigma_row, sigma_col;
+            std::atomic<bool> sigma_changed;
+
+            // the output queues of the stages (output_queue is the output of the pipeline); the captured frames are handed off by a lock-free ring
+            SpscRing<PipelineFrame> capture_ring;
+            BoundedQueue<PipelineFrame> conversion_queue, face_queue, output_queue;
+            std::vector<std::thread> threads;
+            std::atomic<bool> stopping;
+            std::atomic<int> running_stages;
+
+            // statistics (stage_frames/stage_ticks are only written by the stage threads)
+            uint64_t start_ticks;
+            std::atomic<uint64_t> stage_frames[4];
+            std::atomic<uint64_t> stage_ticks[4];
+            std::atomic<uint64_t> output_frames;
+            std::atomic<uint64_t> latency_ticks_sum;
+            std::atomic<uint64_t> latency_ticks_max;
+};
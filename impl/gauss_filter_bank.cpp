@@ -0,0 +1,139 @@
+/** Process-wide cache of (flipped) Gaussian derivative filter banks.
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gauss_filter_bank.hpp"
+#include "gauss_filter.hpp"
+#include "separable_filter.hpp"
+#include "typetostring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+/** Calculate a new filter bank for the quantized sigma. */
+template <typename T>
+static GaussFilterBank<T>*
+CreateGaussFilterBank(long key, T sigma, bool normalize)
+{
+    GaussFilterBank<T>* bank = new GaussFilterBank<T>;
+    bank->key = key;
+    bank->sigma = sigma;
+    bank->normalize = normalize;
+    bank->length = GetGaussLength<T,int>(sigma);
+
+    // all filters are carved out of one slab
+    const size_t filter_bytes = AlignSize(sizeof(T)*bank->length);
+    bank->memory.reserve(4*filter_bytes);
+    char* mem = (char*)bank->memory.data();
+    T* g   = (T*)mem; mem += filter_bytes;
+    T* gp  = (T*)mem; mem += filter_bytes;
+    T* gpp = (T*)mem; mem += filter_bytes;
+    T* ax  = (T*)mem; mem += filter_bytes;
+
+    GetGaussSupport<T,int>(sigma,ax); // calculate the support
+    CreateGauss(sigma,normalize,ax,g);
+    CreateGaussFirstDeriv(sigma,normalize,ax,gp);
+    CreateGaussSecondDeriv(sigma,normalize,ax,gpp);
+    // we have to flip the arrays in order to calculate the "real" convolution with the RowFilter procedure
+    FlipArray(g,bank->length);
+    FlipArray(gp,bank->length);
+    FlipArray(gpp,bank->length);
+
+    bank->g = g;
+    bank->gp = gp;
+    bank->gpp = gpp;
+    bank->ax = ax;
+    return bank;
+}
+
+/** The cache of one precision: an open addressing hash table (linear probing) whose slots are only ever changed from NULL to a bank.
+ *  Thus, a lookup is a sequence of atomic loads and an insertion a single compare-and-swap; banks are never removed or modified.
+ *  A bank is only inserted within GAUSS_FILTER_BANK_MAX_PROBES slots of its hash, i.e. lookups never have to probe further.
+ */
+template <typename T>
+struct GaussFilterBankCache
+{
+    std::atomic<GaussFilterBank<T>*> slots[GAUSS_FILTER_BANK_CAPACITY];
+    std::atomic<int> num_overflows; // number of banks that could not be inserted (the cache is full)
+};
+
+template <typename T>
+static GaussFilterBankCache<T>&
+GetGaussFilterBankCache(void)
+{
+    static GaussFilterBankCache<T> cache; // zero-initialized, i.e. all slots are empty
+    return cache;
+}
+
+template <typename T>
+const GaussFilterBank<T>*
+GetGaussFilterBank(const T& sigma, bool normalize, std::unique_ptr<GaussFilterBank<T> >* overflow_bank)
+{
+    if (!(sigma > T(0)))
+        return NULL;
+
+    const long quantized_sigma = (long)(sigma*T(GAUSS_FILTER_BANK_QUANTIZATION) + T(0.5));
+    if (quantized_sigma <= 0)
+        return NULL;
+    const long key = 2*quantized_sigma + (normalize ? 1 : 0);
+
+    GaussFilterBankCache<T>& cache = GetGaussFilterBankCache<T>();
+    GaussFilterBank<T>* new_bank = NULL;
+    const size_t mask = GAUSS_FILTER_BANK_CAPACITY - 1;
+    const size_t max_probes = std::min<size_t>(GAUSS_FILTER_BANK_MAX_PROBES,GAUSS_FILTER_BANK_CAPACITY);
+    size_t idx = ((size_t)key * (size_t)2654435761u) & mask; // multiplicative hashing; neighboring sigmas are spread over the table
+    for (size_t probe = 0; probe < max_probes; probe++, idx = (idx + 1) & mask)
+    {
+        GaussFilterBank<T>* bank = cache.slots[idx].load(std::memory_order_acquire);
+        if (bank == NULL)
+        {
+            // not cached yet => calculate the bank (outside of any lock) and try to publish it
+            if (new_bank == NULL)
+                new_bank = CreateGaussFilterBank<T>(key,T(quantized_sigma) / T(GAUSS_FILTER_BANK_QUANTIZATION),normalize);
+            if (cache.slots[idx].compare_exchange_strong(bank,new_bank,std::memory_order_acq_rel,std::memory_order_acquire))
+                return new_bank;
+            // another thread has been faster; bank now holds the content of the slot
+        }
+        if (bank->key == key)
+        {
+            delete new_bank; // the bank of the other thread wins (NULL if we did not calculate a bank)
+            return bank;
+        }
+    }
+
+    // the cache is full (around the hash of the key); the bank is not cached, but kept by the caller
+    if (cache.num_overflows.fetch_add(1) == 0)
+        std::cerr << "GetGaussFilterBank<" << TypeToString<T>() << ">: Warning - the filter bank cache is full (increase GAUSS_FILTER_BANK_CAPACITY)!" << std::endl;
+    if (overflow_bank == NULL)
+    {
+        delete new_bank;
+        return NULL;
+    }
+    if (*overflow_bank && (*overflow_bank)->key == key)
+    {
+        delete new_bank;
+        return overflow_bank->get();
+    }
+    overflow_bank->reset(new_bank != NULL ? new_bank : CreateGaussFilterBank<T>(key,T(quantized_sigma) / T(GAUSS_FILTER_BANK_QUANTIZATION),normalize));
+    return overflow_bank->get();
+}
+template const GaussFilterBank<float>* GetGaussFilterBank(const float&,bool,std::unique_ptr<GaussFilterBank<float> >*);
+template const GaussFilterBank<double>* GetGaussFilterBank(const double&,bool,std::unique_ptr<GaussFilterBank<double> >*);
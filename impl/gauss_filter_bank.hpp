@@ -0,0 +1,67 @@
+/** Process-wide cache of (flipped) Gaussian derivative filter banks.
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include "aligned_slab.hpp"
+
+#include <memory>
+
+/** Resolution of the cache keys, i.e. sigma is quantized to multiples of 1/GAUSS_FILTER_BANK_QUANTIZATION. */
+#ifndef GAUSS_FILTER_BANK_QUANTIZATION
+#define GAUSS_FILTER_BANK_QUANTIZATION 1000
+#endif
+
+/** Number of slots of the cache (per precision); has to be a power of 2. */
+#ifndef GAUSS_FILTER_BANK_CAPACITY
+#define GAUSS_FILTER_BANK_CAPACITY 16384
+#endif
+
+/** Maximum number of slots that are probed per lookup, i.e. the cost of a lookup is bounded even if the cache is (nearly) full. */
+#ifndef GAUSS_FILTER_BANK_MAX_PROBES
+#define GAUSS_FILTER_BANK_MAX_PROBES 64
+#endif
+
+/** The Gaussian and its 1st and 2nd derivative for one (quantized) sigma.
+ *  The filters are flipped, i.e. RowFilter calculates the "real" convolution, and every filter starts SLAB_ALIGNMENT aligned.
+ *  Banks are immutable after their creation and are shared between all threads and detector instances, i.e. never modify or free them.
+ */
+template <typename T>
+struct GaussFilterBank
+{
+    long key;          // cache key (quantized sigma and normalization)
+    T sigma;           // the (quantized) sigma that has been used to calculate the filters
+    bool normalize;    // are the filters normalized?
+    int length;        // length of the filters (see GetGaussLength)
+    const T* g;        // Gaussian
+    const T* gp;       // 1st derivative of the Gaussian
+    const T* gpp;      // 2nd derivative of the Gaussian
+    const T* ax;       // support of the filters (not flipped)
+    AlignedSlab memory;// the memory of the filters
+};
+
+/** Quantize sigma as it is done by GetGaussFilterBank. */
+template <typename T>
+inline T
+QuantizeGaussSigma(const T& sigma)
+{
+    return T((long)(sigma*T(GAUSS_FILTER_BANK_QUANTIZATION) + T(0.5))) / T(GAUSS_FILTER_BANK_QUANTIZATION);
+}
+
+/** Get the filter bank for sigma (quantized, see QuantizeGaussSigma) from the process-wide cache; the bank is calculated on the first request.
+ *  Lookups are lock-free and thread-safe; if two threads request a new sigma at the same time, both calculate the bank, but only one is kept.
+ *  A cached bank is valid until the process terminates. If the bank cannot be cached (the cache is full), it is calculated into the caller's
+ *  overflow_bank instead (reused if it already holds the bank), i.e. it is valid until overflow_bank is changed. Returns NULL if sigma is not
+ *  positive or if the bank cannot be cached and there is no overflow_bank.
+ */
+template <typename T>
+const GaussFilterBank<T>*
+GetGaussFilterBank(const T& sigma, bool normalize = false, std::unique_ptr<GaussFilterBank<T> >* overflow_bank = NULL);
@@ -0,0 +1,142 @@
+/** Non-owning view of an image in the caller's memory (strided, cropped, interleaved).
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** A view of a single-channel image, i.e. pixel (x,y) is at data[y*row_stride + x*pixel_step].
+ *  The view never owns or copies the memory. This allows to directly process, e.g.,
+ *   - cropped/padded images (row_stride > width),
+ *   - 10/12/16-bit sensor frames (S = uint16_t),
+ *   - the Y plane of NV12/I420 buffers (see MakeNV12LumaView), and
+ *   - the Y samples of interleaved YUYV/UYVY buffers (pixel_step = 2, see MakeYUYVLumaView/MakeUYVYLumaView), and
+ *   - column-major images, e.g. MATLAB arrays or Fortran-ordered numpy arrays (row_stride = 1, see MakeColumnMajorView).
+ */
+template <typename S>
+struct ImageView
+{
+    typedef S value_type;
+
+    const S* data;  // pixel (0,0)
+    int width;      // width of the image (in pixels)
+    int height;     // height of the image (in pixels)
+    int row_stride; // number of elements between two vertically adjacent pixels (>= width*pixel_step)
+    int pixel_step; // number of elements between two horizontally adjacent pixels (1 for compact single-channel data)
+
+    /** Default constructor. Default is an empty/invalid view. */
+    ImageView(void)
+    : data(NULL), width(0), height(0), row_stride(0), pixel_step(1)
+    {
+    }
+
+    /** Constructor. If row_stride < 0, then the rows are expected to be compact, i.e. row_stride = width*pixel_step. */
+    ImageView(const S* _data, int _width, int _height, int _row_stride = -1, int _pixel_step = 1)
+    : data(_data), width(_width), height(_height), row_stride(_row_stride < 0 ? _width*_pixel_step : _row_stride), pixel_step(_pixel_step)
+    {
+    }
+
+    /** Get the pixel (x,y). */
+    inline const S& operator()(int x, int y) const { return data[(ptrdiff_t)y*row_stride + (ptrdiff_t)x*pixel_step]; }
+    /** Get a pointer to the first pixel of row y. */
+    inline const S* row(int y) const { return data + (ptrdiff_t)y*row_stride; }
+    /** Is it a valid (non-empty) view? */
+    inline bool isValid(void) const { return data != NULL && width > 0 && height > 0; }
+    /** Are the pixels of a row contiguous in memory? */
+    inline bool isRowContiguous(void) const { return pixel_step == 1; }
+    /** Are the pixels of a column contiguous in memory (but not the pixels of a row)? */
+    inline bool isColumnMajor(void) const { return row_stride == 1 && pixel_step > 1; }
+    /** Get the view of the transposed image, i.e. pixel (x,y) of the transposed view is pixel (y,x) of this view; no data is copied. */
+    inline ImageView<S> transposed(void) const { return ImageView<S>(data,height,width,pixel_step,row_stride); }
+    /** Get a view of the sub-image (x,y,w,h); no data is copied. */
+    inline ImageView<S> crop(int x, int y, int w, int h) const { return ImageView<S>(&(*this)(x,y),w,h,row_stride,pixel_step); }
+};
+
+/** Create a view of a column-major image, i.e. pixel (x,y) is at data[x*col_stride + y] (e.g., a MATLAB array). If col_stride < 0, then the
+ *  columns are expected to be compact, i.e. col_stride = height.
+ */
+template <typename S>
+inline ImageView<S>
+MakeColumnMajorView(const S* data, int width, int height, int col_stride = -1)
+{
+    return ImageView<S>(data,width,height,1,(col_stride < 0 ? height : col_stride));
+}
+
+/** Create a view of the Y plane of a NV12/NV21/I420 buffer. y_stride is the row stride of the Y plane in bytes. */
+inline ImageView<uint8_t>
+MakeNV12LumaView(const uint8_t* y_plane, int width, int height, int y_stride = -1)
+{
+    return ImageView<uint8_t>(y_plane,width,height,y_stride);
+}
+
+/** Create a view of the Y samples of an interleaved YUYV (YUY2) buffer (Y0 U Y1 V). stride is the row stride of the buffer in bytes. */
+inline ImageView<uint8_t>
+MakeYUYVLumaView(const uint8_t* yuyv, int width, int height, int stride = -1)
+{
+    return ImageView<uint8_t>(yuyv,width,height,(stride < 0 ? 2*width : stride),2);
+}
+
+/** Create a view of the Y samples of an interleaved UYVY buffer (U Y0 V Y1). stride is the row stride of the buffer in bytes. */
+inline ImageView<uint8_t>
+MakeUYVYLumaView(const uint8_t* uyvy, int width, int height, int stride = -1)
+{
+    return ImageView<uint8_t>(uyvy + 1,width,height,(stride < 0 ? 2*width : stride),2);
+}
+
+/** Order of the color channels of interleaved color images. */
+enum ColorOrder
+{
+    BGRColorOrder = 0, // OpenCV's default order
+    RGBColorOrder
+};
+
+/** A view of an interleaved 3-channel (BGR/RGB) or 4-channel (BGRA/RGBA) color image, i.e. the first channel of pixel (x,y) is at data[y*row_stride + x*pixel_step].
+ *  Consumers (e.g., RowFilter) convert to luma on the fly, i.e. only the pixels that are actually touched are converted and no grayscale buffer is necessary.
+ *  The luma weights are the ITU-R BT.601 weights (as used by cv::cvtColor), but the luma is not rounded to integers.
+ */
+template <typename S>
+struct ColorImageView
+{
+    typedef S value_type;
+
+    const S* data;     // first channel of pixel (0,0)
+    int width;         // width of the image (in pixels)
+    int height;        // height of the image (in pixels)
+    int row_stride;    // number of elements between two vertically adjacent pixels (>= width*pixel_step)
+    int pixel_step;    // number of elements between two horizontally adjacent pixels, i.e. the number of channels (3 or 4)
+    ColorOrder order;  // order of the color channels
+
+    /** Default constructor. Default is an empty/invalid view. */
+    ColorImageView(void)
+    : data(NULL), width(0), height(0), row_stride(0), pixel_step(3), order(BGRColorOrder)
+    {
+    }
+
+    /** Constructor. If row_stride < 0, then the rows are expected to be compact, i.e. row_stride = width*pixel_step. */
+    ColorImageView(const S* _data, int _width, int _height, ColorOrder _order = BGRColorOrder, int _row_stride = -1, int _pixel_step = 3)
+    : data(_data), width(_width), height(_height), row_stride(_row_stride < 0 ? _width*_pixel_step : _row_stride), pixel_step(_pixel_step), order(_order)
+    {
+    }
+
+    /** Get a pointer to the first channel of the first pixel of row y. */
+    inline const S* row(int y) const { return data + (ptrdiff_t)y*row_stride; }
+    /** Calculate the luma of the pixel that starts at p (e.g., row(y) + x*pixel_step). */
+    template <typename R> inline R luma(const S* p) const
+    {
+        const R wr = R(0.299), wg = R(0.587), wb = R(0.114);
+        return (order == BGRColorOrder ? wb*R(p[0]) + wg*R(p[1]) + wr*R(p[2]) : wr*R(p[0]) + wg*R(p[1]) + wb*R(p[2]));
+    }
+    /** Calculate the luma of pixel (x,y). */
+    template <typename R> inline R luma(int x, int y) const { return luma<R>(row(y) + (ptrdiff_t)x*pixel_step); }
+    /** Is it a valid (non-empty) view? */
+    inline bool isValid(void) const { return data != NULL && width > 0 && height > 0; }
+};
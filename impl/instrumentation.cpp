@@ -0,0 +1,604 @@
+/** Low-overhead, always available instrumentation of the detector's hot path (per-stage latency histograms).
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "instrumentation.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> g_instrumentation_enabled(false);
+std::atomic<bool> g_hardware_counters_enabled(false);
+std::atomic<bool> g_trace_enabled(false);
+
+/** The histograms of one thread. Only the owning thread writes (plain load+store, i.e. no lock prefix), all other threads only read. */
+struct ThreadInstrumentation
+{
+    std::atomic<uint64_t> counts[NUM_INSTRUMENTATION_STAGES][INSTRUMENTATION_NUM_BUCKETS];
+    std::atomic<uint64_t> total_ticks[NUM_INSTRUMENTATION_STAGES];
+    std::atomic<uint64_t> max_ticks[NUM_INSTRUMENTATION_STAGES];
+    std::atomic<uint64_t> pixels[NUM_INSTRUMENTATION_STAGES];
+    std::atomic<uint64_t> counter_count[NUM_INSTRUMENTATION_STAGES];
+    std::atomic<uint64_t> counters[NUM_INSTRUMENTATION_STAGES][NUM_HARDWARE_COUNTERS];
+    std::atomic<bool> in_use;           // owned by a running thread?
+    ThreadInstrumentation* next;        // next element of the registry (never changes after the insertion)
+};
+
+/** Registry of all thread histograms (lock-free singly-linked list; elements are never removed, but reused by new threads). */
+static std::atomic<ThreadInstrumentation*> g_thread_instrumentations(NULL);
+
+static ThreadInstrumentation*
+AcquireThreadInstrumentation(void)
+{
+    // reuse the histograms of a terminated thread (the recordings of terminated threads are kept)
+    for (ThreadInstrumentation* ti = g_thread_instrumentations.load(std::memory_order_acquire); ti != NULL; ti = ti->next)
+    {
+        bool expected = false;
+        if (!ti->in_use.load(std::memory_order_relaxed) && ti->in_use.compare_exchange_strong(expected,true,std::memory_order_acquire))
+            return ti;
+    }
+    ThreadInstrumentation* ti = new ThreadInstrumentation(); // value-initialized, i.e. all counters are 0
+    ti->in_use.store(true,std::memory_order_relaxed);
+    ThreadInstrumentation* head = g_thread_instrumentations.load(std::memory_order_relaxed);
+    do
+    {
+        ti->next = head;
+    } while (!g_thread_instrumentations.compare_exchange_weak(head,ti,std::memory_order_release,std::memory_order_relaxed));
+    return ti;
+}
+
+/** Releases the histograms of the thread when it terminates. */
+struct ThreadInstrumentationHolder
+{
+    ThreadInstrumentation* ti;
+    ThreadInstrumentationHolder(void) : ti(AcquireThreadInstrumentation()) {}
+    ~ThreadInstrumentationHolder(void) { ti->in_use.store(false,std::memory_order_release); }
+};
+
+static inline ThreadInstrumentation*
+GetThreadInstrumentation(void)
+{
+    static thread_local ThreadInstrumentationHolder holder;
+    return holder.ti;
+}
+
+/** Log-linear bucket of a value (in ticks). */
+static inline int
+GetInstrumentationBucket(uint64_t ticks)
+{
+    if (ticks < INSTRUMENTATION_SUB_BUCKETS)
+        return (int)ticks;
+#if defined(__GNUC__)
+    const int msb = 63 - __builtin_clzll(ticks);
+#else
+    int msb = 63;
+    while (!(ticks >> msb))
+        msb--;
+#endif
+    const int shift = msb - 4; // INSTRUMENTATION_SUB_BUCKETS = 2^4
+    return (msb - 3)*INSTRUMENTATION_SUB_BUCKETS + (int)((ticks >> shift) & (INSTRUMENTATION_SUB_BUCKETS - 1));
+}
+
+/** Range [lower,lower+width) of the values in a bucket. */
+static inline void
+GetInstrumentationBucketRange(int bucket, double& lower, double& width)
+{
+    if (bucket < INSTRUMENTATION_SUB_BUCKETS)
+    {
+        lower = bucket;
+        width = 1;
+        return;
+    }
+    const int msb = bucket / INSTRUMENTATION_SUB_BUCKETS + 3;
+    const int sub = bucket % INSTRUMENTATION_SUB_BUCKETS;
+    width = (double)(1ULL << (msb - 4));
+    lower = (INSTRUMENTATION_SUB_BUCKETS + sub) * width;
+}
+
+const char*
+ToString(InstrumentationStage stage)
+{
+    switch (stage)
+    {
+        case FilterSetupStage:
+            return "FilterSetup";
+        case RowFilterStage:
+            return "RowFilter";
+        case IsophoteStage:
+            return "CalculateIsophoteInformation";
+        case VotingStage:
+            return "CalculateAccumulator";
+        case AccumulatorProcessingStage:
+            return "AccumulatorProcessing";
+        case ScaleSelectionStage:
+            return "SelectSigma";
+        case DownsamplingStage:
+            return "Downsampling";
+        case FusedProcessingStage:
+            return "FusedProcessing";
+        case IntegralImageStage:
+            return "IntegralImage";
+        default:
+            return "unknown";
+    }
+}
+
+void
+SetInstrumentationEnabled(bool enabled)
+{
+    if (enabled)
+        GetInstrumentationNanosecondsPerTick(); // calibrate now and not in the middle of a measurement
+    g_instrumentation_enabled.store(enabled,std::memory_order_relaxed);
+}
+
+void
+RecordInstrumentation(InstrumentationStage stage, uint64_t ticks, uint64_t pixels)
+{
+    ThreadInstrumentation* ti = GetThreadInstrumentation();
+    std::atomic<uint64_t>& count = ti->counts[stage][GetInstrumentationBucket(ticks)];
+    count.store(count.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+    ti->total_ticks[stage].store(ti->total_ticks[stage].load(std::memory_order_relaxed) + ticks,std::memory_order_relaxed);
+    if (ticks > ti->max_ticks[stage].load(std::memory_order_relaxed))
+        ti->max_ticks[stage].store(ticks,std::memory_order_relaxed);
+    if (pixels > 0)
+        ti->pixels[stage].store(ti->pixels[stage].load(std::memory_order_relaxed) + pixels,std::memory_order_relaxed);
+}
+
+/** The perf_event counters of one thread (one group, i.e. all counters are read at once and count the same time span). */
+struct ThreadHardwareCounters
+{
+    bool initialized;
+    bool valid;
+    int fds[NUM_HARDWARE_COUNTERS];                   // -1 if the counter could not be opened
+    int group_index[NUM_HARDWARE_COUNTERS];           // position of the counter in the group read
+    int num_opened;
+    uint64_t start[NUM_INSTRUMENTATION_STAGES][NUM_HARDWARE_COUNTERS];
+
+    ThreadHardwareCounters(void) : initialized(false), valid(false), num_opened(0)
+    {
+        for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+            fds[i] = group_index[i] = -1;
+        for (int s = 0; s < NUM_INSTRUMENTATION_STAGES; s++)
+            start[s][CyclesCounter] = (uint64_t)-1; // no measurement started
+    }
+    ~ThreadHardwareCounters(void)
+    {
+#ifdef __linux__
+        for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+            if (fds[i] >= 0)
+                close(fds[i]);
+#endif
+    }
+};
+
+#ifdef __linux__
+static int
+OpenHardwareCounter(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(__NR_perf_event_open,&attr,0 /* this thread */,-1 /* any cpu */,group_fd,0);
+}
+#endif
+
+/** Open the counters of the calling thread (cycles are the group leader and have to be available). */
+static void
+OpenHardwareCounters(ThreadHardwareCounters& hc)
+{
+    hc.initialized = true;
+#ifdef __linux__
+    static const uint64_t configs[NUM_HARDWARE_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    hc.fds[CyclesCounter] = OpenHardwareCounter(configs[CyclesCounter],-1);
+    if (hc.fds[CyclesCounter] < 0)
+        return;
+    hc.group_index[CyclesCounter] = hc.num_opened++;
+    for (int i = 1; i < NUM_HARDWARE_COUNTERS; i++)
+    {
+        hc.fds[i] = OpenHardwareCounter(configs[i],hc.fds[CyclesCounter]);
+        if (hc.fds[i] >= 0)
+            hc.group_index[i] = hc.num_opened++;
+    }
+    hc.valid = true;
+#endif
+}
+
+/** Read all counters of the calling thread (0 for counters that could not be opened). */
+static bool
+ReadHardwareCounters(const ThreadHardwareCounters& hc, uint64_t values[NUM_HARDWARE_COUNTERS])
+{
+#ifdef __linux__
+    uint64_t buf[1 + NUM_HARDWARE_COUNTERS]; // PERF_FORMAT_GROUP: nr, values[nr]
+    if (!hc.valid || read(hc.fds[CyclesCounter],buf,sizeof(buf)) < (ssize_t)((1 + hc.num_opened)*sizeof(uint64_t)))
+        return false;
+    for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+        values[i] = (hc.group_index[i] >= 0 ? buf[1 + hc.group_index[i]] : 0);
+    return true;
+#else
+    (void)hc;
+    (void)values;
+    return false;
+#endif
+}
+
+static inline ThreadHardwareCounters&
+GetThreadHardwareCounters(void)
+{
+    static thread_local ThreadHardwareCounters hc;
+    if (!hc.initialized)
+        OpenHardwareCounters(hc);
+    return hc;
+}
+
+bool
+SetHardwareCountersEnabled(bool enabled)
+{
+    if (!enabled)
+    {
+        g_hardware_counters_enabled.store(false,std::memory_order_relaxed);
+        return true;
+    }
+    // check whether the counters are available (at least the cycles)
+    uint64_t values[NUM_HARDWARE_COUNTERS];
+    const ThreadHardwareCounters& hc = GetThreadHardwareCounters();
+    if (!ReadHardwareCounters(hc,values))
+    {
+        std::cerr << "SetHardwareCountersEnabled: hardware performance counters are not available (perf_event_open)!" << std::endl;
+        return false;
+    }
+    for (int i = 1; i < NUM_HARDWARE_COUNTERS; i++)
+        if (hc.fds[i] < 0)
+            std::cerr << "SetHardwareCountersEnabled: Warning - hardware counter " << i << " is not available and will be reported as 0!" << std::endl;
+    SetInstrumentationEnabled(true);
+    g_hardware_counters_enabled.store(true,std::memory_order_relaxed);
+    return true;
+}
+
+void
+StartHardwareCounters(InstrumentationStage stage)
+{
+    ThreadHardwareCounters& hc = GetThreadHardwareCounters();
+    if (!ReadHardwareCounters(hc,hc.start[stage]))
+        hc.start[stage][CyclesCounter] = (uint64_t)-1; // invalid measurement (e.g., the counters of this thread could not be opened)
+}
+
+void
+StopHardwareCounters(InstrumentationStage stage)
+{
+    ThreadHardwareCounters& hc = GetThreadHardwareCounters();
+    uint64_t values[NUM_HARDWARE_COUNTERS];
+    if (hc.start[stage][CyclesCounter] == (uint64_t)-1 || !ReadHardwareCounters(hc,values))
+        return;
+    ThreadInstrumentation* ti = GetThreadInstrumentation();
+    for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+    {
+        std::atomic<uint64_t>& counter = ti->counters[stage][i];
+        counter.store(counter.load(std::memory_order_relaxed) + (values[i] - hc.start[stage][i]),std::memory_order_relaxed);
+    }
+    ti->counter_count[stage].store(ti->counter_count[stage].load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+}
+
+double
+GetInstrumentationNanosecondsPerTick(void)
+{
+#ifdef _INSTRUMENTATION_RDTSC
+    // measure the TSC frequency once (thread-safe initialization of the static)
+    static const double ns_per_tick = []() -> double
+    {
+        const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        const uint64_t ticks0 = GetInstrumentationTicks();
+        std::chrono::steady_clock::time_point t1;
+        do
+        {
+            t1 = std::chrono::steady_clock::now();
+        } while (t1 - t0 < std::chrono::milliseconds(10));
+        const uint64_t ticks1 = GetInstrumentationTicks();
+        const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        return (ticks1 > ticks0 ? ns / (double)(ticks1 - ticks0) : 1.0);
+    }();
+    return ns_per_tick;
+#else
+    return 1.0;
+#endif
+}
+
+InstrumentationSnapshot
+GetInstrumentationSnapshot(void)
+{
+    const double ns_per_tick = GetInstrumentationNanosecondsPerTick();
+    InstrumentationSnapshot snapshot;
+    for (int s = 0; s < NUM_INSTRUMENTATION_STAGES; s++)
+    {
+        // merge the histograms of all threads
+        uint64_t counts[INSTRUMENTATION_NUM_BUCKETS];
+        uint64_t count = 0, total_ticks = 0, max_ticks = 0, pixels = 0, counter_count = 0;
+        uint64_t counters[NUM_HARDWARE_COUNTERS] = { 0 };
+        for (int b = 0; b < INSTRUMENTATION_NUM_BUCKETS; b++)
+            counts[b] = 0;
+        for (ThreadInstrumentation* ti = g_thread_instrumentations.load(std::memory_order_acquire); ti != NULL; ti = ti->next)
+        {
+            for (int b = 0; b < INSTRUMENTATION_NUM_BUCKETS; b++)
+            {
+                const uint64_t c = ti->counts[s][b].load(std::memory_order_relaxed);
+                counts[b] += c;
+                count += c;
+            }
+            total_ticks += ti->total_ticks[s].load(std::memory_order_relaxed);
+            max_ticks = std::max(max_ticks,ti->max_ticks[s].load(std::memory_order_relaxed));
+            pixels += ti->pixels[s].load(std::memory_order_relaxed);
+            counter_count += ti->counter_count[s].load(std::memory_order_relaxed);
+            for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+                counters[i] += ti->counters[s][i].load(std::memory_order_relaxed);
+        }
+
+        InstrumentationStatistics& stats = snapshot.stages[s];
+        stats.count = count;
+        stats.mean_ns = (count > 0 ? (double)total_ticks / (double)count * ns_per_tick : 0);
+        stats.max_ns = (double)max_ticks * ns_per_tick;
+        stats.p50_ns = stats.p99_ns = 0;
+        stats.pixels = pixels;
+        stats.ns_per_pixel = (pixels > 0 ? (double)total_ticks * ns_per_tick / (double)pixels : 0);
+        stats.counter_count = counter_count;
+        for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+            stats.counters[i] = counters[i];
+        stats.ipc = (counters[CyclesCounter] > 0 ? (double)counters[InstructionsCounter] / (double)counters[CyclesCounter] : 0);
+        stats.cache_misses_per_pixel = (pixels > 0 ? (double)counters[CacheMissesCounter] / (double)pixels : 0);
+        stats.branch_misses_per_pixel = (pixels > 0 ? (double)counters[BranchMissesCounter] / (double)pixels : 0);
+        if (count == 0)
+            continue;
+
+        // percentiles: the bucket center of the ceil(q*count)-th value (clamped to the maximum)
+        const uint64_t rank50 = (count*50 + 99) / 100;
+        const uint64_t rank99 = (count*99 + 99) / 100;
+        uint64_t cumulative = 0;
+        bool has_p50 = false;
+        for (int b = 0; b < INSTRUMENTATION_NUM_BUCKETS; b++)
+        {
+            if (counts[b] == 0)
+                continue;
+            cumulative += counts[b];
+            double lower, width;
+            GetInstrumentationBucketRange(b,lower,width);
+            const double center_ns = std::min(lower + 0.5*(width - 1),(double)max_ticks) * ns_per_tick;
+            if (!has_p50 && cumulative >= rank50)
+            {
+                stats.p50_ns = center_ns;
+                has_p50 = true;
+            }
+            if (cumulative >= rank99)
+            {
+                stats.p99_ns = center_ns;
+                break;
+            }
+        }
+    }
+    return snapshot;
+}
+
+void
+ResetInstrumentation(void)
+{
+    for (ThreadInstrumentation* ti = g_thread_instrumentations.load(std::memory_order_acquire); ti != NULL; ti = ti->next)
+    {
+        for (int s = 0; s < NUM_INSTRUMENTATION_STAGES; s++)
+        {
+            for (int b = 0; b < INSTRUMENTATION_NUM_BUCKETS; b++)
+                ti->counts[s][b].store(0,std::memory_order_relaxed);
+            ti->total_ticks[s].store(0,std::memory_order_relaxed);
+            ti->max_ticks[s].store(0,std::memory_order_relaxed);
+            ti->pixels[s].store(0,std::memory_order_relaxed);
+            ti->counter_count[s].store(0,std::memory_order_relaxed);
+            for (int i = 0; i < NUM_HARDWARE_COUNTERS; i++)
+                ti->counters[s][i].store(0,std::memory_order_relaxed);
+        }
+    }
+}
+
+void
+PrintInstrumentationSnapshot(const InstrumentationSnapshot& snapshot, std::ostream& os)
+{
+    bool has_counters = false;
+    for (int s = 0; s < NUM_INSTRUMENTATION_STAGES; s++)
+        has_counters = has_counters || (snapshot.stages[s].counter_count > 0);
+
+    const std::ios::fmtflags flags = os.flags();
+    os << std::left << std::setw(30) << "stage" << std::right
+       << std::setw(10) << "count" << std::setw(12) << "mean [us]" << std::setw(12) << "p50 [us]" << std::setw(12) << "p99 [us]" << std::setw(12) << "max [us]"
+       << std::setw(12) << "ns/pixel";
+    if (has_counters)
+        os << std::setw(8) << "IPC" << std::setw(14) << "LLC miss/px" << std::setw(14) << "br miss/px";
+    os << std::endl;
+    os << std::fixed << std::setprecision(2);
+    for (int s = 0; s < NUM_INSTRUMENTATION_STAGES; s++)
+    {
+        const InstrumentationStatistics& stats = snapshot.stages[s];
+        if (stats.count == 0)
+            continue;
+        os << std::left << std::setw(30) << ToString((InstrumentationStage)s) << std::right
+           << std::setw(10) << stats.count
+           << std::setw(12) << stats.mean_ns / 1000 << std::setw(12) << stats.p50_ns / 1000
+           << std::setw(12) << stats.p99_ns / 1000 << std::setw(12) << stats.max_ns / 1000
+           << std::setw(12) << stats.ns_per_pixel;
+        if (has_counters)
+            os << std::setw(8) << stats.ipc << std::setprecision(4) << std::setw(14) << stats.cache_misses_per_pixel << std::setw(14) << stats.branch_misses_per_pixel << std::setprecision(2);
+        os << std::endl;
+    }
+    os.flags(flags);
+}
+
+/** One span of the trace ring. The fields are relaxed atomics that are protected by a sequence number (seqlock): seq is odd while the
+ *  span is written and 2*(index+1) afterwards, i.e. a reader can detect spans that have been overwritten while they were read.
+ */
+struct TraceEvent
+{
+    std::atomic<uint64_t> seq;
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start_ticks;
+    std::atomic<uint64_t> end_ticks;
+    std::atomic<uint64_t> frame;
+    std::atomic<uint32_t> thread_id;
+};
+
+struct TraceRing
+{
+    size_t capacity; // power of 2
+    TraceEvent* events;
+};
+
+static std::atomic<TraceRing*> g_trace_ring(NULL);      // the ring (never freed, since writers may still use it)
+static std::atomic<uint64_t> g_trace_write_index(0);    // number of spans that have been started to be written
+static std::atomic<uint64_t> g_trace_start_ticks(0);    // time origin of the trace
+static std::atomic<uint32_t> g_trace_num_threads(0);
+
+struct TraceThreadState
+{
+    uint32_t thread_id;
+    uint64_t frame;
+    TraceThreadState(void) : thread_id(g_trace_num_threads.fetch_add(1) + 1), frame(0) {}
+};
+
+static inline TraceThreadState&
+GetTraceThreadState(void)
+{
+    static thread_local TraceThreadState state;
+    return state;
+}
+
+void
+SetTraceEnabled(bool enabled, size_t capacity)
+{
+    if (enabled)
+        SetInstrumentationEnabled(true); // also calibrates the ticks
+    if (enabled && g_trace_ring.load(std::memory_order_acquire) == NULL)
+    {
+        TraceRing* ring = new TraceRing;
+        ring->capacity = 1;
+        while (ring->capacity < capacity)
+            ring->capacity <<= 1;
+        ring->events = new TraceEvent[ring->capacity](); // value-initialized, i.e. all sequence numbers are 0 (empty)
+        TraceRing* expected = NULL;
+        g_trace_start_ticks.store(GetInstrumentationTicks(),std::memory_order_relaxed);
+        if (!g_trace_ring.compare_exchange_strong(expected,ring,std::memory_order_acq_rel))
+        {
+            // another thread has been faster
+            delete [] ring->events;
+            delete ring;
+        }
+    }
+    g_trace_enabled.store(enabled,std::memory_order_relaxed);
+}
+
+void
+SetTraceFrame(uint64_t frame)
+{
+    GetTraceThreadState().frame = frame;
+}
+
+void
+RecordTraceEvent(const char* name, uint64_t start_ticks, uint64_t end_ticks)
+{
+    const TraceRing* ring = g_trace_ring.load(std::memory_order_acquire);
+    if (ring == NULL)
+        return;
+    const TraceThreadState& state = GetTraceThreadState();
+    const uint64_t index = g_trace_write_index.fetch_add(1,std::memory_order_relaxed);
+    TraceEvent& e = ring->events[index & (ring->capacity - 1)];
+    e.seq.store(2*index + 1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.name.store(name,std::memory_order_relaxed);
+    e.start_ticks.store(start_ticks,std::memory_order_relaxed);
+    e.end_ticks.store(end_ticks,std::memory_order_relaxed);
+    e.frame.store(state.frame,std::memory_order_relaxed);
+    e.thread_id.store(state.thread_id,std::memory_order_relaxed);
+    e.seq.store(2*index + 2,std::memory_order_release);
+}
+
+void
+WriteTrace(std::ostream& os)
+{
+    const std::ios::fmtflags flags = os.flags();
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    const TraceRing* ring = g_trace_ring.load(std::memory_order_acquire);
+    if (ring != NULL)
+    {
+#ifdef __linux__
+        const long pid = (long)getpid();
+#else
+        const long pid = 0;
+#endif
+        const double us_per_tick = GetInstrumentationNanosecondsPerTick() / 1000;
+        const uint64_t origin = g_trace_start_ticks.load(std::memory_order_relaxed);
+        const uint64_t end = g_trace_write_index.load(std::memory_order_acquire);
+        const uint64_t begin = (end > ring->capacity ? end - ring->capacity : 0);
+        bool first = true;
+        os << std::fixed << std::setprecision(3);
+        for (uint64_t index = begin; index < end; index++)
+        {
+            TraceEvent& e = ring->events[index & (ring->capacity - 1)];
+            const uint64_t seq = e.seq.load(std::memory_order_acquire);
+            if (seq != 2*index + 2)
+                continue; // still being written or already overwritten
+            const char* name = e.name.load(std::memory_order_relaxed);
+            const uint64_t start_ticks = e.start_ticks.load(std::memory_order_relaxed);
+            const uint64_t end_ticks = e.end_ticks.load(std::memory_order_relaxed);
+            const uint64_t frame = e.frame.load(std::memory_order_relaxed);
+            const uint32_t thread_id = e.thread_id.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.seq.load(std::memory_order_relaxed) != seq)
+                continue; // overwritten while reading
+            const double ts = (start_ticks > origin ? (double)(start_ticks - origin) * us_per_tick : 0);
+            const double dur = (end_ticks > start_ticks ? (double)(end_ticks - start_ticks) * us_per_tick : 0);
+            os << (first ? "\n" : ",\n")
+               << "{\"name\":\"" << name << "\",\"cat\":\"isophote\",\"ph\":\"X\",\"ts\":" << ts << ",\"dur\":" << dur
+               << ",\"pid\":" << pid << ",\"tid\":" << thread_id << ",\"args\":{\"frame\":" << frame << "}}";
+            first = false;
+        }
+    }
+    os << "\n]}" << std::endl;
+    os.flags(flags);
+}
+
+bool
+WriteTrace(const std::string& filename)
+{
+    std::ofstream ofs(filename.c_str());
+    if (!ofs)
+    {
+        std::cerr << "WriteTrace: unable to open '" << filename << "'!" << std::endl;
+        return false;
+    }
+    WriteTrace(ofs);
+    return (bool)ofs;
+}
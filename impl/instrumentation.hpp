@@ -0,0 +1,265 @@
+/** Low-overhead, always available instrumentation of the detector's hot path (per-stage latency histograms).
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define _INSTRUMENTATION_RDTSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define _INSTRUMENTATION_RDTSC
+#else
+#include <chrono>
+#endif
+
+/** The instrumented stages of the detector. */
+enum InstrumentationStage
+{
+    FilterSetupStage = 0,        // memory (re-)allocation and filter bank lookup
+    RowFilterStage,              // separable filtering, i.e. the Gaussian derivatives
+    IsophoteStage,               // curvature, curvedness and displacement vectors
+    VotingStage,                 // accumulation of the votes
+    AccumulatorProcessingStage,  // smoothing of the accumulator and search for the maxima
+    ScaleSelectionStage,         // automatic sigma selection (scale-space)
+    DownsamplingStage,           // downsampling of the search region (coarse-to-fine search, canonical scale)
+    FusedProcessingStage,        // derivatives, isophotes and voting in one pass (see setOutputPlanes)
+    IntegralImageStage,          // integral image of the box derivative filters (see setDerivativeFilter)
+    NUM_INSTRUMENTATION_STAGES
+};
+
+/** Number of linear sub-buckets per power of 2 of the histograms, i.e. the relative error of the percentiles is below 1/INSTRUMENTATION_SUB_BUCKETS. */
+#define INSTRUMENTATION_SUB_BUCKETS 16
+/** Number of buckets of the histograms (values below INSTRUMENTATION_SUB_BUCKETS ticks are exact, every larger power of 2 has its own sub-buckets). */
+#define INSTRUMENTATION_NUM_BUCKETS ((64 - 3)*INSTRUMENTATION_SUB_BUCKETS)
+
+/** Get the name of a stage (e.g., "RowFilter"). */
+const char*
+ToString(InstrumentationStage stage);
+
+/** Enable/disable the instrumentation (process-wide; disabled by default). If it is disabled, a stage costs one relaxed atomic load. */
+void
+SetInstrumentationEnabled(bool enabled);
+
+extern std::atomic<bool> g_instrumentation_enabled;
+
+inline bool
+IsInstrumentationEnabled(void)
+{
+    return g_instrumentation_enabled.load(std::memory_order_relaxed);
+}
+
+/** Current timestamp in ticks. On x86 this is the TSC (we assume an invariant TSC, as found on all recent CPUs), otherwise nanoseconds. */
+inline uint64_t
+GetInstrumentationTicks(void)
+{
+#ifdef _INSTRUMENTATION_RDTSC
+    return (uint64_t)__rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/** The hardware performance counters that are captured per stage (if enabled, see SetHardwareCountersEnabled). */
+enum HardwareCounter
+{
+    CyclesCounter = 0,       // CPU cycles (user space)
+    InstructionsCounter,     // retired instructions
+    CacheMissesCounter,      // last level cache misses
+    BranchMissesCounter,     // mispredicted branches
+    NUM_HARDWARE_COUNTERS
+};
+
+/** Capture the hardware counters around every stage (Linux perf_event_open; the counters of a thread are opened on its first measurement).
+ *  This also enables the instrumentation. Reading the counters costs a system call per start/stop, i.e. this mode is meant for the analysis
+ *  of regressions and not for production. Returns false (and leaves the counters disabled) if the counters are not available, e.g. on other
+ *  platforms, in virtual machines without PMU, or if /proc/sys/kernel/perf_event_paranoid forbids it.
+ */
+bool
+SetHardwareCountersEnabled(bool enabled);
+
+extern std::atomic<bool> g_hardware_counters_enabled;
+
+inline bool
+IsHardwareCountersEnabled(void)
+{
+    return g_hardware_counters_enabled.load(std::memory_order_relaxed);
+}
+
+/** Record the duration (in ticks) of one execution of a stage and the number of processed pixels in the histogram of the calling thread
+ *  (lock-free, no atomic read-modify-write).
+ */
+void
+RecordInstrumentation(InstrumentationStage stage, uint64_t ticks, uint64_t pixels = 0);
+
+/** Read the hardware counters of the calling thread at the start of stage (nesting of the same stage is not supported). */
+void
+StartHardwareCounters(InstrumentationStage stage);
+
+/** Accumulate the hardware counter deltas of stage since StartHardwareCounters. */
+void
+StopHardwareCounters(InstrumentationStage stage);
+
+/** Default number of events of the trace ring buffer (see SetTraceEnabled). */
+#ifndef TRACE_DEFAULT_CAPACITY
+#define TRACE_DEFAULT_CAPACITY 65536
+#endif
+
+/** Record every stage (and every TraceStart/TraceStop span) as a span in a bounded in-memory ring buffer, i.e. the oldest spans are overwritten.
+ *  The ring is allocated on the first call with enabled=true (capacity is rounded up to a power of 2; later calls do not change the capacity).
+ *  Enabling the trace also enables the instrumentation. See WriteTrace for the export.
+ */
+void
+SetTraceEnabled(bool enabled, size_t capacity = TRACE_DEFAULT_CAPACITY);
+
+extern std::atomic<bool> g_trace_enabled;
+
+inline bool
+IsTraceEnabled(void)
+{
+    return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+/** Set the frame number of the calling thread; the frame number is attached to all following spans of the thread. */
+void
+SetTraceFrame(uint64_t frame);
+
+/** Append a span [start_ticks,end_ticks] of the calling thread to the trace ring (lock-free; name has to be a string literal or live forever). */
+void
+RecordTraceEvent(const char* name, uint64_t start_ticks, uint64_t end_ticks);
+
+/** Start a custom span (e.g., the face detection of a demo loop); returns 0 if tracing is disabled. */
+inline uint64_t
+TraceStart(void)
+{
+    return (IsTraceEnabled() ? GetInstrumentationTicks() : 0);
+}
+
+/** Stop a custom span that has been started with TraceStart. */
+inline void
+TraceStop(const char* name, uint64_t start_ticks)
+{
+    if (start_ticks != 0)
+        RecordTraceEvent(name,start_ticks,GetInstrumentationTicks());
+}
+
+/** Write the spans in the trace ring as Chrome trace-event JSON (complete events; open with Perfetto or chrome://tracing).
+ *  Can be called while other threads record; spans that are overwritten while they are read are skipped.
+ */
+void
+WriteTrace(std::ostream& os);
+
+/** Write the trace into a file; returns false if the file could not be written. */
+bool
+WriteTrace(const std::string& filename);
+
+/** Start the measurement of a stage; returns 0 if the instrumentation is disabled. */
+inline uint64_t
+InstrumentationStart(InstrumentationStage stage)
+{
+    if (!IsInstrumentationEnabled())
+        return 0;
+    if (IsHardwareCountersEnabled())
+        StartHardwareCounters(stage);
+    return GetInstrumentationTicks();
+}
+
+/** Stop the measurement of a stage that has been started with InstrumentationStart; pixels is the number of pixels that have been processed. */
+inline void
+InstrumentationStop(InstrumentationStage stage, uint64_t start_ticks, uint64_t pixels = 0)
+{
+    if (start_ticks != 0)
+    {
+        const uint64_t end_ticks = GetInstrumentationTicks();
+        if (IsHardwareCountersEnabled())
+            StopHardwareCounters(stage);
+        RecordInstrumentation(stage,end_ticks - start_ticks,pixels);
+        if (IsTraceEnabled())
+            RecordTraceEvent(ToString(stage),start_ticks,end_ticks);
+    }
+}
+
+/** Measures the lifetime of the scope as one execution of stage. */
+class InstrumentationScope
+{
+public:
+    explicit InstrumentationScope(InstrumentationStage _stage, uint64_t _pixels = 0) : stage(_stage), pixels(_pixels), start_ticks(InstrumentationStart(_stage)) {}
+    ~InstrumentationScope(void) { InstrumentationStop(stage,start_ticks,pixels); }
+private:
+    InstrumentationScope(const InstrumentationScope&);
+    InstrumentationScope& operator=(const InstrumentationScope&);
+
+    InstrumentationStage stage;
+    uint64_t pixels;
+    uint64_t start_ticks;
+};
+
+/** Macros for the instrumentation of code blocks; define _NO_INSTRUMENTATION to remove the instrumentation at compile time. */
+#ifndef _NO_INSTRUMENTATION
+#define INSTRUMENTATION_START(stage) const uint64_t _instrumentation_start_##stage = InstrumentationStart(stage)
+#define INSTRUMENTATION_STOP(stage) InstrumentationStop(stage,_instrumentation_start_##stage)
+#define INSTRUMENTATION_STOP_PIXELS(stage,pixels) InstrumentationStop(stage,_instrumentation_start_##stage,(uint64_t)(pixels))
+#define INSTRUMENTATION_SCOPE(stage) InstrumentationScope _instrumentation_scope_##stage(stage)
+#else
+#define INSTRUMENTATION_START(stage)
+#define INSTRUMENTATION_STOP(stage)
+#define INSTRUMENTATION_STOP_PIXELS(stage,pixels)
+#define INSTRUMENTATION_SCOPE(stage)
+#endif
+
+/** Latency statistics of one stage (merged over all threads). */
+struct InstrumentationStatistics
+{
+    uint64_t count;  // number of recorded executions
+    double mean_ns;  // mean latency
+    double p50_ns;   // median latency
+    double p99_ns;   // 99th percentile of the latency
+    double max_ns;   // maximum latency (exact)
+    uint64_t pixels; // total number of processed pixels
+    double ns_per_pixel;
+
+    // hardware counters (only if SetHardwareCountersEnabled; counters that could not be opened are 0)
+    uint64_t counter_count;                           // number of executions with hardware counters
+    uint64_t counters[NUM_HARDWARE_COUNTERS];         // totals
+    double ipc;                                       // instructions per cycle
+    double cache_misses_per_pixel;
+    double branch_misses_per_pixel;
+};
+
+/** Snapshot of the statistics of all stages. */
+struct InstrumentationSnapshot
+{
+    InstrumentationStatistics stages[NUM_INSTRUMENTATION_STAGES];
+};
+
+/** Get the statistics of all stages since the start of the process or the last reset.
+ *  Can be called while other threads record; the snapshot is then not necessarily consistent across stages.
+ */
+InstrumentationSnapshot
+GetInstrumentationSnapshot(void);
+
+/** Clear the histograms of all threads (recordings that happen concurrently may partially survive the reset). */
+void
+ResetInstrumentation(void);
+
+/** Print a snapshot as a table (one stage per line; stages without recordings are skipped). */
+void
+PrintInstrumentationSnapshot(const InstrumentationSnapshot& snapshot, std::ostream& os = std::cout);
+
+/** Conversion factor from ticks to nanoseconds (calibrated once against the steady clock). */
+double
+GetInstrumentationNanosecondsPerTick(void);
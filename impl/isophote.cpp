@@ -21,8 +21,15 @@
  */
 #include "isophote.hpp"
 #include "epsilon.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
 #include <iostream>
+#include <limits>
 #include <math.h>
+#include <thread>
+#include <vector>
 
 #ifdef _OPENMP_ISOPHOTE_CALCULATION
 #include <omp.h>
@@ -73,12 +80,51 @@ _sqrt<long double>(long double x)
 
 template <typename T, typename T_size>
 void
-CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T* acc, bool zero_acc, bool row_major)
+CalculateDerivatives(const T* L, T_size width, T_size height, T_size stride, T* Lx, T* Ly, T* Lxx, T* Lxy, T* Lyy,
+                     T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height)
+{
+    // the central differences need the left/right and upper/lower neighbor, i.e. skip the image border
+    const T_size x_min = (roi_x_min > T_size(1) ? roi_x_min : T_size(1));
+    const T_size y_min = (roi_y_min > T_size(1) ? roi_y_min : T_size(1));
+    const T_size x_max = (roi_x_min + roi_width < width - 1 ? roi_x_min + roi_width : width - 1);
+    const T_size y_max = (roi_y_min + roi_height < height - 1 ? roi_y_min + roi_height : height - 1);
+
+    for (T_size y = y_min; y < y_max; y++)
+    {
+        const T* l  = L + y*stride;
+        const T* lu = l - stride; // upper row
+        const T* ll = l + stride; // lower row
+        for (T_size x = x_min; x < x_max; x++)
+        {
+            const T_size idx = _ROWMAJOR_INDEX(x,y,stride,height);
+            Lx[idx]  = T(0.5)*(l[x+1] - l[x-1]);
+            Ly[idx]  = T(0.5)*(ll[x] - lu[x]);
+            Lxx[idx] = l[x+1] - T(2)*l[x] + l[x-1];
+            Lyy[idx] = ll[x] - T(2)*l[x] + lu[x];
+            Lxy[idx] = T(0.25)*((ll[x+1] - ll[x-1]) - (lu[x+1] - lu[x-1]));
+        }
+    }
+}
+template void CalculateDerivatives(const float*,int,int,int,float*,float*,float*,float*,float*,int,int,int,int);
+template void CalculateDerivatives(const double*,int,int,int,double*,double*,double*,double*,double*,int,int,int,int);
+template void CalculateDerivatives(const float*,size_t,size_t,size_t,float*,float*,float*,float*,float*,size_t,size_t,size_t,size_t);
+template void CalculateDerivatives(const double*,size_t,size_t,size_t,double*,double*,double*,double*,double*,size_t,size_t,size_t,size_t);
+template void CalculateDerivatives(const float*,unsigned int,unsigned int,unsigned int,float*,float*,float*,float*,float*,unsigned int,unsigned int,unsigned int,unsigned int);
+template void CalculateDerivatives(const double*,unsigned int,unsigned int,unsigned int,double*,double*,double*,double*,double*,unsigned int,unsigned int,unsigned int,unsigned int);
+
+template <typename T, typename T_size>
+void
+CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride, T* acc, bool zero_acc, bool row_major)
 {
     /* Set accumulator cells to zero if necessary */
     if (!zero_acc)
-        for (T_size i(0); i < width*height; i++)
-            acc[i] = T(0);
+    {
+        const T_size lines  = (row_major ? height : width); // number of rows/columns
+        const T_size length = (row_major ? width : height); // length of a row/column
+        for (T_size l(0); l < lines; l++)
+            for (T_size i(0); i < length; i++)
+                acc[l*stride + i] = T(0);
+    }
     
     /* Calculate the accumulator */
     for (T_size y(0); y < height; y++)
@@ -87,7 +133,7 @@ CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size wi
         {
             if (row_major) // data is stored in row-major order
             {
-                const T_size idx = _ROWMAJOR_INDEX(x,y,width,height);
+                const T_size idx = _ROWMAJOR_INDEX(x,y,stride,height);
                 const T cval = c[idx];
                 const T kval = k[idx];
                 if (kval < 0)
@@ -103,13 +149,13 @@ CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size wi
                     const T_size indy = T_size(dy[idx] + T(0.5)) + y; // +0.5 for cheap round
                     if (indx < 0 || indx > width-1 || indy < 0 || indy > height - 1) // @NOTE: actually checking indy or indx < 0 problematic for unsigned types; however, due to the limited range and tight boundaries the potentially wrap-around is not problematic in combination with indx < width and indy < height ...
                         continue;
-                    const T_size accidx = _ROWMAJOR_INDEX(indx,indy,width,height);
+                    const T_size accidx = _ROWMAJOR_INDEX(indx,indy,stride,height);
                     acc[accidx] += cval;
                 }
             }
             else  // data is stored in column-major order
             {
-                const T_size idx = _COLUMNMAJOR_INDEX(x,y,width,height);
+                const T_size idx = _COLUMNMAJOR_INDEX(x,y,width,stride);
                 const T cval = c[idx];
                 const T kval = k[idx];
                 if (kval < 0)
@@ -126,13 +172,299 @@ CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size wi
                     // valid index
                     if (indx < 0 || indx > (width-1) || indy < 0 || indy > (height-1)) // @NOTE: actually checking indy or indx < 0 problematic for unsigned types; however, due to the limited range and tight boundaries the potentially wrap-around is not problematic in combination with indx < width and indy < height ...
                         continue;
-                    const T_size accidx = _COLUMNMAJOR_INDEX(indx,indy,width,height);
+                    const T_size accidx = _COLUMNMAJOR_INDEX(indx,indy,width,stride);
                     acc[accidx] += cval;
                 }
             }
         }
     }
 }
+template void CalculateAccumulator(const float*,const float*,const float*,const float*,int,int,int,float*,bool,bool);
+template void CalculateAccumulator(const double*,const double*,const double*,const double*,int,int,int,double*,bool,bool);
+template void CalculateAccumulator(const float*,const float*,const float*,const float*,size_t,size_t,size_t,float*,bool,bool);
+template void CalculateAccumulator(const double*,const double*,const double*,const double*,size_t,size_t,size_t,double*,bool,bool);
+template void CalculateAccumulator(const float*,const float*,const float*,const float*,unsigned int,unsigned int,unsigned int,float*,bool,bool);
+template void CalculateAccumulator(const double*,const double*,const double*,const double*,unsigned int,unsigned int,unsigned int,double*,bool,bool);
+
+/** Add the vote of pixel (x,y) with displacement (dxval,dyval) and curvedness cval to the nearest accumulator cell (if it is inside of the accumulator). */
+template <typename T, typename T_size>
+static inline void
+AddVote(T* acc, T_size width, T_size height, T_size stride, T_size x, T_size y, T dxval, T dyval, T cval)
+{
+    const T_size indx = T_size(dxval + T(0.5)) + x; // +0.5 for cheap round (same rounding as above)
+    const T_size indy = T_size(dyval + T(0.5)) + y; // +0.5 for cheap round
+    if (indx < 0 || indx > width-1 || indy < 0 || indy > height - 1) // see above for unsigned types
+        return;
+    acc[_ROWMAJOR_INDEX(indx,indy,stride,height)] += cval;
+}
+
+/** Split the vote of pixel (x,y) bilinearly among the four accumulator cells around its sub-pixel position (see CalculateBilinearAccumulator). */
+template <typename T, typename T_size>
+static inline void
+AddBilinearVote(T* acc, T_size width, T_size height, T_size stride, T_size x, T_size y, T dxval, T dyval, T cval)
+{
+    const T px = T(x) + dxval;
+    const T py = T(y) + dyval;
+    if (!(px > T(-1) && px < T(width) && py > T(-1) && py < T(height))) // also drops NaNs
+        return;
+    const T max_x = T(width - 1);
+    const T max_y = T(height - 1);
+    const T fx0 = std::floor(px);
+    const T fy0 = std::floor(py);
+    const T wx = px - fx0;
+    const T wy = py - fy0;
+    const T_size x0 = T_size(fx0 + T(1)) - 1; // floor >= -1, i.e. no negative casts (see above for unsigned types)
+    const T_size y0 = T_size(fy0 + T(1)) - 1;
+    if (fx0 >= 0 && fy0 >= 0 && fx0 < max_x && fy0 < max_y)
+    {
+        // all four cells are inside of the accumulator
+        T* a = acc + _ROWMAJOR_INDEX(x0,y0,stride,height);
+        a[0]          += cval*(T(1) - wx)*(T(1) - wy);
+        a[1]          += cval*wx*(T(1) - wy);
+        a[stride]     += cval*(T(1) - wx)*wy;
+        a[stride + 1] += cval*wx*wy;
+    }
+    else
+    {
+        // accumulator border
+        if (fy0 >= 0)
+        {
+            if (fx0 >= 0)    acc[_ROWMAJOR_INDEX(x0,y0,stride,height)]     += cval*(T(1) - wx)*(T(1) - wy);
+            if (fx0 < max_x) acc[_ROWMAJOR_INDEX(x0 + 1,y0,stride,height)] += cval*wx*(T(1) - wy);
+        }
+        if (fy0 < max_y)
+        {
+            if (fx0 >= 0)    acc[_ROWMAJOR_INDEX(x0,y0 + 1,stride,height)]     += cval*(T(1) - wx)*wy;
+            if (fx0 < max_x) acc[_ROWMAJOR_INDEX(x0 + 1,y0 + 1,stride,height)] += cval*wx*wy;
+        }
+    }
+}
+
+template <typename T, typename T_size>
+void
+CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                     T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                     T* acc, T min_radius, T max_radius, T min_curvedness)
+{
+    // compare the squared radii, i.e. no sqrt per pixel
+    const T min_radius2 = SQR(min_radius);
+    const T max_radius2 = (max_radius > 0 ? SQR(max_radius) : T(-1));
+
+    for (T_size y = roi_y_min; y < roi_y_min + roi_height; y++)
+    {
+        for (T_size x = roi_x_min; x < roi_x_min + roi_width; x++)
+        {
+            const T_size idx = _ROWMAJOR_INDEX(x,y,stride,height);
+            const T cval = c[idx];
+            const T kval = k[idx];
+            if (kval < 0 && cval >= min_curvedness)
+            {
+                const T r2 = SQR(dx[idx]) + SQR(dy[idx]);
+                if (r2 < min_radius2 || (max_radius2 >= 0 && r2 > max_radius2))
+                    continue;
+                AddVote(acc,width,height,stride,x,y,dx[idx],dy[idx],cval);
+            }
+        }
+    }
+}
+template void CalculateAccumulator(const float*,const float*,const float*,const float*,int,int,int,int,int,int,int,float*,float,float,float);
+template void CalculateAccumulator(const double*,const double*,const double*,const double*,int,int,int,int,int,int,int,double*,double,double,double);
+template void CalculateAccumulator(const float*,const float*,const float*,const float*,size_t,size_t,size_t,size_t,size_t,size_t,size_t,float*,float,float,float);
+template void CalculateAccumulator(const double*,const double*,const double*,const double*,size_t,size_t,size_t,size_t,size_t,size_t,size_t,double*,double,double,double);
+template void CalculateAccumulator(const float*,const float*,const float*,const float*,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,float*,float,float,float);
+template void CalculateAccumulator(const double*,const double*,const double*,const double*,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,double*,double,double,double);
+
+template <typename T, typename T_size>
+void
+CalculateBilinearAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                             T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                             T* acc, T min_radius, T max_radius, T min_curvedness)
+{
+    const T min_radius2 = SQR(min_radius);
+    const T max_radius2 = (max_radius > 0 ? SQR(max_radius) : T(-1));
+
+    for (T_size y = roi_y_min; y < roi_y_min + roi_height; y++)
+    {
+        for (T_size x = roi_x_min; x < roi_x_min + roi_width; x++)
+        {
+            const T_size idx = _ROWMAJOR_INDEX(x,y,stride,height);
+            const T cval = c[idx];
+            const T kval = k[idx];
+            if (kval < 0 && cval >= min_curvedness)
+            {
+                const T r2 = SQR(dx[idx]) + SQR(dy[idx]);
+                if (r2 < min_radius2 || (max_radius2 >= 0 && r2 > max_radius2))
+                    continue;
+                AddBilinearVote(acc,width,height,stride,x,y,dx[idx],dy[idx],cval);
+            }
+        }
+    }
+}
+template void CalculateBilinearAccumulator(const float*,const float*,const float*,const float*,int,int,int,int,int,int,int,float*,float,float,float);
+template void CalculateBilinearAccumulator(const double*,const double*,const double*,const double*,int,int,int,int,int,int,int,double*,double,double,double);
+template void CalculateBilinearAccumulator(const float*,const float*,const float*,const float*,size_t,size_t,size_t,size_t,size_t,size_t,size_t,float*,float,float,float);
+template void CalculateBilinearAccumulator(const double*,const double*,const double*,const double*,size_t,size_t,size_t,size_t,size_t,size_t,size_t,double*,double,double,double);
+template void CalculateBilinearAccumulator(const float*,const float*,const float*,const float*,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,float*,float,float,float);
+template void CalculateBilinearAccumulator(const double*,const double*,const double*,const double*,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,double*,double,double,double);
+
+template <typename T, typename T_size>
+void
+CalculateIsophoteAccumulator(const T* Lx, const T* Ly, const T* Lxx, const T* Lxy, const T* Lyy, T_size width, T_size height, T_size stride,
+                             T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, T_size y_offset,
+                             T* acc, bool bilinear, T* k, T* c, T* dx, T* dy)
+{
+    for (T_size y = roi_y_min; y < roi_y_min + roi_height; y++)
+    {
+        const T_size image_y = y + y_offset;
+        for (T_size x = roi_x_min; x < roi_x_min + roi_width; x++)
+        {
+            // same calculations as CalculateIsophoteInformation, i.e. the results are identical
+            const T_size i = y*stride + x;
+            const T Lx2 = SQR(Lx[i]);
+            const T Ly2 = SQR(Ly[i]);
+            T T1 = (2 * Lx[i] * Lxy[i] * Ly[i]) - (Lx2 * Lyy[i]) - (Ly2 * Lxx[i]);
+            if (T1 == 0)
+                T1 = epsilon<T>();
+            const T tmp = (Lx2 + Ly2);
+            const T kval = T1 / (_sqrt(CUBIC(tmp)) + epsilon<T>());
+            const T cval = _sqrt<T>(SQR(Lxx[i]) + 2*SQR(Lxy[i]) + SQR(Lyy[i]));
+            const T dxval = (Lx[i] * tmp) / T1;
+            const T dyval = (Ly[i] * tmp) / T1;
+
+            const T_size o = image_y*stride + x; // index of the output planes
+            if (k != NULL)  k[o] = kval;
+            if (c != NULL)  c[o] = cval;
+            if (dx != NULL) dx[o] = dxval;
+            if (dy != NULL) dy[o] = dyval;
+            if (kval < 0)
+            {
+                if (bilinear)
+                    AddBilinearVote(acc,width,height,stride,x,image_y,dxval,dyval,cval);
+                else
+                    AddVote(acc,width,height,stride,x,image_y,dxval,dyval,cval);
+            }
+        }
+    }
+}
+template void CalculateIsophoteAccumulator(const float*,const float*,const float*,const float*,const float*,int,int,int,int,int,int,int,int,float*,bool,float*,float*,float*,float*);
+template void CalculateIsophoteAccumulator(const double*,const double*,const double*,const double*,const double*,int,int,int,int,int,int,int,int,double*,bool,double*,double*,double*,double*);
+template void CalculateIsophoteAccumulator(const float*,const float*,const float*,const float*,const float*,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,float*,bool,float*,float*,float*,float*);
+template void CalculateIsophoteAccumulator(const double*,const double*,const double*,const double*,const double*,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,double*,bool,double*,double*,double*,double*);
+template void CalculateIsophoteAccumulator(const float*,const float*,const float*,const float*,const float*,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,float*,bool,float*,float*,float*,float*);
+template void CalculateIsophoteAccumulator(const double*,const double*,const double*,const double*,const double*,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,unsigned int,double*,bool,double*,double*,double*,double*);
+
+/** Add weight to *cell; saturates at the maximum of A. */
+template <typename A>
+static inline void
+SaturatingAdd(A* cell, A weight)
+{
+    const A max_value = std::numeric_limits<A>::max();
+    *cell = (*cell > max_value - weight ? max_value : A(*cell + weight));
+}
+
+/** Add weight to *cell with a relaxed atomic compare-and-swap; saturates at the maximum of A. */
+template <typename A>
+static inline void
+AtomicSaturatingAdd(A* cell, A weight)
+{
+    const A max_value = std::numeric_limits<A>::max();
+#if defined(__GNUC__)
+    A old_value = __atomic_load_n(cell,__ATOMIC_RELAXED);
+    A new_value;
+    do
+        new_value = (old_value > max_value - weight ? max_value : A(old_value + weight));
+    while (!__atomic_compare_exchange_n(cell,&old_value,new_value,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+#else
+    std::atomic<A>* atomic_cell = reinterpret_cast<std::atomic<A>*>(cell);
+    A old_value = atomic_cell->load(std::memory_order_relaxed);
+    A new_value;
+    do
+        new_value = (old_value > max_value - weight ? max_value : A(old_value + weight));
+    while (!atomic_cell->compare_exchange_weak(old_value,new_value,std::memory_order_relaxed));
+#endif
+}
+
+/** Vote with the rows roi_y_min + first_row, roi_y_min + first_row + row_step, ... of the ROI (see CalculateQuantizedAccumulator). */
+template <typename T, typename A, typename T_size, bool atomic>
+static void
+VoteQuantizedRows(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                  T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                  A* acc, T_size acc_stride, T weight_scale, T min_radius, T max_radius, T min_curvedness,
+                  T_size first_row, T_size row_step)
+{
+    const T min_radius2 = SQR(min_radius);
+    const T max_radius2 = (max_radius > 0 ? SQR(max_radius) : T(-1));
+    const T max_weight = T(std::numeric_limits<A>::max());
+
+    for (T_size y = roi_y_min + first_row; y < roi_y_min + roi_height; y += row_step)
+    {
+        for (T_size x = roi_x_min; x < roi_x_min + roi_width; x++)
+        {
+            const T_size idx = _ROWMAJOR_INDEX(x,y,stride,height);
+            const T cval = c[idx];
+            const T kval = k[idx];
+            if (kval < 0 && cval >= min_curvedness)
+            {
+                const T r2 = SQR(dx[idx]) + SQR(dy[idx]);
+                if (r2 < min_radius2 || (max_radius2 >= 0 && r2 > max_radius2))
+                    continue;
+                const T_size indx = T_size(dx[idx] + T(0.5)) + x; // +0.5 for cheap round (same rounding as above)
+                const T_size indy = T_size(dy[idx] + T(0.5)) + y; // +0.5 for cheap round
+                if (indx < 0 || indx > width-1 || indy < 0 || indy > height - 1) // see above for unsigned types
+                    continue;
+                const T w = cval*weight_scale + T(0.5); // +0.5 for cheap round (cval >= 0)
+                const A weight = (w < max_weight ? A(w) : std::numeric_limits<A>::max());
+                if (weight == 0)
+                    continue;
+                if (atomic)
+                    AtomicSaturatingAdd(&acc[_ROWMAJOR_INDEX(indx,indy,acc_stride,height)],weight);
+                else
+                    SaturatingAdd(&acc[_ROWMAJOR_INDEX(indx,indy,acc_stride,height)],weight);
+            }
+        }
+    }
+}
+
+template <typename T, typename A, typename T_size>
+void
+CalculateQuantizedAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                              T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                              A* acc, T_size acc_stride, T weight_scale, int num_threads,
+                              T min_radius, T max_radius, T min_curvedness)
+{
+    if (num_threads <= 0)
+        num_threads = std::max(1,(int)std::thread::hardware_concurrency());
+    // a thread should at least vote with a few rows
+    num_threads = std::min(num_threads,std::max(1,(int)roi_height / 4));
+    if (num_threads == 1)
+    {
+        VoteQuantizedRows<T,A,T_size,false>(k,c,dx,dy,width,height,stride,roi_x_min,roi_y_min,roi_width,roi_height,acc,acc_stride,weight_scale,
+                                            min_radius,max_radius,min_curvedness,T_size(0),T_size(1));
+        return;
+    }
+
+    // the rows are interleaved, i.e. the threads vote with neighboring rows and the work is balanced if the votes concentrate in a part of the ROI
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+        threads.push_back(std::thread(VoteQuantizedRows<T,A,T_size,true>,k,c,dx,dy,width,height,stride,roi_x_min,roi_y_min,roi_width,roi_height,acc,acc_stride,weight_scale,
+                                      min_radius,max_radius,min_curvedness,T_size(t),T_size(num_threads)));
+    VoteQuantizedRows<T,A,T_size,true>(k,c,dx,dy,width,height,stride,roi_x_min,roi_y_min,roi_width,roi_height,acc,acc_stride,weight_scale,
+                                       min_radius,max_radius,min_curvedness,T_size(0),T_size(num_threads));
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+template void CalculateQuantizedAccumulator(const float*,const float*,const float*,const float*,int,int,int,int,int,int,int,uint16_t*,int,float,int,float,float,float);
+template void CalculateQuantizedAccumulator(const float*,const float*,const float*,const float*,int,int,int,int,int,int,int,uint32_t*,int,float,int,float,float,float);
+template void CalculateQuantizedAccumulator(const double*,const double*,const double*,const double*,int,int,int,int,int,int,int,uint16_t*,int,double,int,double,double,double);
+template void CalculateQuantizedAccumulator(const double*,const double*,const double*,const double*,int,int,int,int,int,int,int,uint32_t*,int,double,int,double,double,double);
+
+template <typename T, typename T_size>
+void
+CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T* acc, bool zero_acc, bool row_major)
+{
+    // compact (unpadded) planes
+    CalculateAccumulator(k,c,dx,dy,width,height,(row_major ? width : height),acc,zero_acc,row_major);
+}
 template void CalculateAccumulator(const float*,const float*,const float*,const float*,int,int,float*,bool,bool);
 template void CalculateAccumulator(const double*,const double*,const double*,const double*,int,int,double*,bool,bool);
 template void CalculateAccumulator(const float*,const float*,const float*,const float*,size_t,size_t,float*,bool,bool);
@@ -285,11 +617,15 @@ template void CalculateIsophoteInformation(const double*,const double*,const dou
 
 template <typename T, typename T_size>
 void
-CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lxy, const T* Lyy, T_size width, T_size height, T* k, T* c, T* dx, T* dy, 
+CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lxy, const T* Lyy, T_size width, T_size height, T_size stride, T* k, T* c, T* dx, T* dy, 
                              T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
                              T* tmpT1, T* tmpLx2, T* tmpLy2)
 {
-    const T_size size(width*height);
+    // the planes are padded, i.e. the temporary planes are allocated with the stride; the width only bounds the ROI
+    assert(stride >= width);
+    assert(roi_x_min + roi_width <= width && roi_y_min + roi_height <= height);
+    (void)width; // only used by the assertions, i.e. unused if NDEBUG is defined
+    const T_size size(stride*height);
     
     // shortcuts
     T* T1 = NULL;
@@ -317,7 +653,7 @@ CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lx
     /* Pre-calculate some terms */
     for (T_size y(roi_y_min); y <= y_max; y++)
     {
-        T_size i = y*width + roi_x_min; // row-major order index
+        T_size i = y*stride + roi_x_min; // row-major order index
         for (T_size x(roi_x_min); x <= x_max; x++, i++)
         {
             Lx2[i] = SQR(Lx[i]);
@@ -331,7 +667,7 @@ CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lx
     /* Main calculation (actually we could merge this with the pre-calculation loop) */
     for (T_size y(roi_y_min); y <= y_max; y++)
     {
-        T_size i = y*width + roi_x_min; // row-major order index
+        T_size i = y*stride + roi_x_min; // row-major order index
         for (T_size x(roi_x_min); x <= x_max; x++, i++)
         {
             T tmp = (Lx2[i] + Ly2[i]);
@@ -351,6 +687,22 @@ CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lx
     if (tmpLy2 == NULL)
         delete [] Ly2;
 }
+template void CalculateIsophoteInformation(const float*,const float*,const float*,const float*,const float*,int,int,int,float*,float*,float*,float*,int,int,int,int,float*,float*,float*);
+template void CalculateIsophoteInformation(const double*,const double*,const double*,const double*,const double*,int,int,int,double*,double*,double*,double*,int,int,int,int,double*,double*,double*);
+template void CalculateIsophoteInformation(const float*,const float*,const float*,const float*,const float*,size_t,size_t,size_t,float*,float*,float*,float*,size_t,size_t,size_t,size_t,float*,float*,float*);
+template void CalculateIsophoteInformation(const double*,const double*,const double*,const double*,const double*,size_t,size_t,size_t,double*,double*,double*,double*,size_t,size_t,size_t,size_t,double*,double*,double*);
+template void CalculateIsophoteInformation(const float*,const float*,const float*,const float*,const float*,unsigned int,unsigned int,unsigned int,float*,float*,float*,float*,unsigned int,unsigned int,unsigned int,unsigned int,float*,float*,float*);
+template void CalculateIsophoteInformation(const double*,const double*,const double*,const double*,const double*,unsigned int,unsigned int,unsigned int,double*,double*,double*,double*,unsigned int,unsigned int,unsigned int,unsigned int,double*,double*,double*);
+
+template <typename T, typename T_size>
+void
+CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lxy, const T* Lyy, T_size width, T_size height, T* k, T* c, T* dx, T* dy, 
+                             T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                             T* tmpT1, T* tmpLx2, T* tmpLy2)
+{
+    // compact (unpadded) planes
+    CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,width,height,width,k,c,dx,dy,roi_x_min,roi_y_min,roi_width,roi_height,tmpT1,tmpLx2,tmpLy2);
+}
 template void CalculateIsophoteInformation(const float*,const float*,const float*,const float*,const float*,int,int,float*,float*,float*,float*,int,int,int,int,float*,float*,float*);
 template void CalculateIsophoteInformation(const double*,const double*,const double*,const double*,const double*,int,int,double*,double*,double*,double*,int,int,int,int,double*,double*,double*);
 template void CalculateIsophoteInformation(const float*,const float*,const float*,const float*,const float*,size_t,size_t,float*,float*,float*,float*,size_t,size_t,size_t,size_t,float*,float*,float*);
@@ -65,6 +65,29 @@ CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lx
                              T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
                              T* tmpT1 = NULL, T* tmpLx2 = NULL, T* tmpLy2 = NULL);
 
+/** Calculate the isophote information in a ROI of padded planes (see above), i.e. the element (x,y) of every in- and output plane is at y*stride + x.
+ *  \param stride number of elements between two consecutive rows of all planes (>= width)
+ *
+ *  \note data is expected in row-major order
+ */
+template <typename T, typename T_size>
+void
+CalculateIsophoteInformation(const T* Lx, const T* Ly, const T* Lxx, const T* Lxy, const T* Lyy, T_size width, T_size height, T_size stride, T* k, T* c, T* dx, T* dy,
+                             T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                             T* tmpT1 = NULL, T* tmpLx2 = NULL, T* tmpLy2 = NULL);
+
+/** Calculate the 1st and 2nd order partial derivatives of a (smoothed) image with central differences in a ROI of padded planes.
+ *  This is a cheap alternative to the Gaussian derivative filters if the smoothed image L is already available (e.g., in a scale-space).
+ *  \param L the smoothed image
+ *  \param stride number of elements between two consecutive rows of all planes (>= width)
+ *
+ *  \note data is expected in row-major order; the 1 pixel image border is not calculated
+ */
+template <typename T, typename T_size>
+void
+CalculateDerivatives(const T* L, T_size width, T_size height, T_size stride, T* Lx, T* Ly, T* Lxx, T* Lxy, T* Lyy,
+                     T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height);
+
 /** 
  * Calculates the accumulator. Only updates the accumulator for values of 
  * k < 0 (i.e., for eye-center detection - gradient towards the darker eye 
@@ -74,6 +97,79 @@ template <typename T, typename T_size>
 void
 CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T* acc, bool zero_acc = false, bool row_major = true); // zero_acc => are the accumulator cells set to zero?
 
+/** 
+ * Calculates the accumulator for padded planes (see above). stride is the 
+ * number of elements between two consecutive rows (row_major) or columns 
+ * (!row_major) of all planes. 
+ */
+template <typename T, typename T_size>
+void
+CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride, T* acc, bool zero_acc = false, bool row_major = true); // zero_acc => are the accumulator cells set to zero?
+
+/**
+ * Calculates the accumulator from the pixels in a ROI of padded, row-major
+ * planes (see above) and prunes the votes, i.e. a pixel (k < 0) only votes
+ * if the length of its displacement vector is in [min_radius,max_radius]
+ * (max_radius <= 0: no upper bound) and its curvedness is >= min_curvedness.
+ * The votes can land anywhere in the width x height accumulator. The
+ * accumulator is not set to zero.
+ */
+template <typename T, typename T_size>
+void
+CalculateAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                     T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                     T* acc, T min_radius = 0, T max_radius = 0, T min_curvedness = 0);
+
+/**
+ * Calculates the accumulator from the pixels in a ROI (see above), but the
+ * votes are not rounded to the nearest cell: a vote at the sub-pixel
+ * position (x+dx,y+dy) is split bilinearly among the four surrounding
+ * cells (the weights sum to the curvedness), i.e. the peak of the (smoothed)
+ * accumulator reflects the sub-pixel position of the votes. Weights of
+ * cells outside of the accumulator are dropped. The accumulator is not set
+ * to zero.
+ */
+template <typename T, typename T_size>
+void
+CalculateBilinearAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                             T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                             T* acc, T min_radius = 0, T max_radius = 0, T min_curvedness = 0);
+
+/**
+ * Calculates the isophote information (see CalculateIsophoteInformation)
+ * and votes into the accumulator (see CalculateAccumulator and
+ * CalculateBilinearAccumulator) in one pass over a ROI of the derivative
+ * planes, i.e. the isophote information of a pixel is only stored if the
+ * corresponding output plane is not NULL. The derivative planes can be a
+ * strip of rows of the image (e.g., cache-sized): row y of the derivative
+ * planes is row y + y_offset of the width x height output planes and of the
+ * accumulator. stride is the row stride of all planes. The accumulator is
+ * not set to zero.
+ */
+template <typename T, typename T_size>
+void
+CalculateIsophoteAccumulator(const T* Lx, const T* Ly, const T* Lxx, const T* Lxy, const T* Lyy, T_size width, T_size height, T_size stride,
+                             T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, T_size y_offset,
+                             T* acc, bool bilinear = false, T* k = NULL, T* c = NULL, T* dx = NULL, T* dy = NULL);
+
+/**
+ * Calculates a quantized (fixed-point) accumulator from the pixels in a ROI
+ * of padded, row-major planes (same pruning as above). A vote adds the
+ * integer weight round(c*weight_scale), clamped to the range of A, and the
+ * additions saturate. Integer additions do not depend on their order, i.e.
+ * the rows of the ROI can be split among num_threads threads that vote into
+ * the shared accumulator with relaxed atomic adds and the accumulator is
+ * identical for every number of threads. A is uint16_t or uint32_t and
+ * acc_stride is the row stride of acc (in elements of A). The accumulator
+ * is not set to zero.
+ */
+template <typename T, typename A, typename T_size>
+void
+CalculateQuantizedAccumulator(const T* k, const T* c, const T* dx, const T* dy, T_size width, T_size height, T_size stride,
+                              T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height,
+                              A* acc, T_size acc_stride, T weight_scale, int num_threads = 1,
+                              T min_radius = 0, T max_radius = 0, T min_curvedness = 0);
+
 /** 
  * Calculates the accumulator. Only updates the accumulator for values of 
  * k > 0 (i.e., for saliency maps - gradient towards the more salient center 
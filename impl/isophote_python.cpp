@@ -0,0 +1,518 @@
+/** Python extension module (isophote_eye_center) around the IsophoteEyeCenterDetector.
+ *
+ * Images are accepted through the buffer protocol (e.g., NumPy arrays, memoryviews) and processed in place, i.e. without a copy.
+ * Strided views (e.g., a[::2,10:-10] or the channels of an interleaved color image) are supported as long as the strides are positive
+ * multiples of the element size. The GIL is released during the detection, i.e. threads with separate Detector objects run in parallel.
+ *
+ *   import numpy as np, isophote_eye_center as iec
+ *   detector = iec.Detector(sigma=1.5, precision="float")
+ *   (left, right) = detector.detect(gray, face=(x, y, w, h))   # None if no eye centers have been found
+ *   results = detector.detect_batch(crops)                      # crops: (n, height, width) stack of face crops
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "isophoteeyedetector.hpp"
+#include "image_view.hpp"
+
+#include <limits.h>
+#include <stdint.h>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef IsophoteEyeCenterDetector<float>::coord_t coord_t;
+
+/** Layout of a buffer: a single image (height,width), a color image (height,width,channels) or a stack of images (count,height,width).
+ *  The strides are in elements.
+ */
+struct BufferLayout
+{
+    char type;           // element type: 'B' (uint8), 'H' (uint16), 'f' (float32) or 'd' (float64)
+    const char* data;
+    int count;           // number of images (1 if it is not a stack)
+    int width, height;
+    int channels;        // 1 (gray) or 3/4 (interleaved color)
+    Py_ssize_t image_stride; // elements between two images of a stack
+    int row_stride, pixel_step;
+};
+
+/** Get the element type of a buffer format string ('\0' if unsupported). Only native byte order is supported. */
+static char
+GetElementType(const char* format)
+{
+    if (format == NULL)
+        return 'B';
+    if (*format == '@' || *format == '=')
+        format++;
+#if PY_LITTLE_ENDIAN
+    else if (*format == '<')
+        format++;
+#else
+    else if (*format == '>' || *format == '!')
+        format++;
+#endif
+    if (format[0] == '\0' || format[1] != '\0')
+        return '\0';
+    switch (format[0])
+    {
+        case 'B': case 'H': case 'f': case 'd': return format[0];
+        default: return '\0';
+    }
+}
+
+/** Convert a stride in bytes to a stride in elements (false if it is negative or not a multiple of the element size). */
+static bool
+GetElementStride(Py_ssize_t stride, Py_ssize_t itemsize, Py_ssize_t& element_stride)
+{
+    if (stride < 0 || stride % itemsize != 0 || stride / itemsize > INT_MAX)
+        return false;
+    element_stride = stride / itemsize;
+    return true;
+}
+
+/** Get the layout of a buffer (sets a Python exception and returns false on errors). If stack is true, a (count,height,width) stack is
+ *  expected, otherwise a (height,width) image or a (height,width,channels) color image.
+ */
+static bool
+GetBufferLayout(const Py_buffer& buffer, bool stack, BufferLayout& layout)
+{
+    layout.type = GetElementType(buffer.format);
+    if (layout.type == '\0')
+    {
+        PyErr_Format(PyExc_TypeError,"unsupported element type '%s' (supported: uint8, uint16, float32, float64)",buffer.format);
+        return false;
+    }
+    const bool color = (!stack && buffer.ndim == 3);
+    if (buffer.ndim != (stack ? 3 : 2) && !color)
+    {
+        PyErr_SetString(PyExc_ValueError,(stack ? "expected a (count, height, width) stack of images" : "expected a (height, width) or (height, width, channels) image"));
+        return false;
+    }
+    const int offset = (stack ? 1 : 0);
+    const Py_ssize_t count = (stack ? buffer.shape[0] : 1);
+    const Py_ssize_t height = buffer.shape[offset], width = buffer.shape[offset + 1];
+    if (count > INT_MAX || height > INT_MAX || width > INT_MAX || count <= 0 || height <= 0 || width <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError,"invalid image size");
+        return false;
+    }
+    layout.data = (const char*)buffer.buf;
+    layout.count = (int)count;
+    layout.height = (int)height;
+    layout.width = (int)width;
+    layout.channels = (color ? (int)buffer.shape[2] : 1);
+
+    // buffers without strides (PyBUF_ND) are C-contiguous
+    Py_ssize_t strides[3];
+    strides[buffer.ndim - 1] = buffer.itemsize;
+    for (int i = buffer.ndim - 2; i >= 0; i--)
+        strides[i] = strides[i + 1] * buffer.shape[i + 1];
+    if (buffer.strides != NULL)
+        for (int i = 0; i < buffer.ndim; i++)
+            strides[i] = buffer.strides[i];
+
+    Py_ssize_t row_stride, pixel_step, image_stride = 0, channel_step = 1;
+    if (!GetElementStride(strides[offset],buffer.itemsize,row_stride) || !GetElementStride(strides[offset + 1],buffer.itemsize,pixel_step)
+        || (stack && !GetElementStride(strides[0],buffer.itemsize,image_stride)) || (color && !GetElementStride(strides[2],buffer.itemsize,channel_step)))
+    {
+        PyErr_SetString(PyExc_ValueError,"the strides of the image have to be positive multiples of the element size");
+        return false;
+    }
+    if (color && ((layout.channels != 3 && layout.channels != 4) || channel_step != 1 || layout.type == 'd'))
+    {
+        PyErr_SetString(PyExc_ValueError,"color images have to be interleaved (contiguous channels) uint8, uint16 or float32 images with 3 or 4 channels");
+        return false;
+    }
+    layout.image_stride = image_stride;
+    layout.row_stride = (int)row_stride;
+    layout.pixel_step = (int)pixel_step;
+    return true;
+}
+
+/** Detect the eye centers in a color image (color views of double images are not supported, see GetBufferLayout). */
+template <typename T, typename S>
+static EyeCenterLocations<coord_t>
+DetectColorImage(IsophoteEyeCenterDetector<T>& iecd, const ColorImageView<S>& img, const cv::Rect_<coord_t>& face, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye)
+{
+    return iecd.detectEyeCenters(img,face,left_eye,right_eye);
+}
+template <typename T>
+static EyeCenterLocations<coord_t>
+DetectColorImage(IsophoteEyeCenterDetector<T>&, const ColorImageView<double>&, const cv::Rect_<coord_t>&, const cv::Point_<coord_t>&, const cv::Point_<coord_t>&)
+{
+    return EyeCenterLocations<coord_t>();
+}
+
+/** Detect the eye centers in all images of the layout (the face box is clipped to each image; an empty face box is the full image). */
+template <typename T, typename S>
+static void
+DetectImages(IsophoteEyeCenterDetector<T>& iecd, const BufferLayout& layout, ColorOrder color_order,
+             const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+             std::vector<EyeCenterLocations<coord_t> >& results)
+{
+    const cv::Rect_<coord_t> face = (face_box.width > 0 && face_box.height > 0 ? face_box : cv::Rect_<coord_t>(0,0,layout.width,layout.height))
+                                    & cv::Rect_<coord_t>(0,0,layout.width,layout.height);
+    results.resize(layout.count);
+    for (int i = 0; i < layout.count; i++)
+    {
+        const S* data = (const S*)layout.data + i*layout.image_stride;
+        if (face.width <= 0 || face.height <= 0)
+            results[i] = EyeCenterLocations<coord_t>();
+        else if (layout.channels == 1)
+            results[i] = iecd.detectEyeCenters(ImageView<S>(data,layout.width,layout.height,layout.row_stride,layout.pixel_step),face,left_eye,right_eye);
+        else
+            results[i] = DetectColorImage(iecd,ColorImageView<S>(data,layout.width,layout.height,color_order,layout.row_stride,layout.pixel_step),face,left_eye,right_eye);
+    }
+}
+
+template <typename T>
+static void
+DetectImages(IsophoteEyeCenterDetector<T>& iecd, const BufferLayout& layout, ColorOrder color_order,
+             const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+             std::vector<EyeCenterLocations<coord_t> >& results)
+{
+    switch (layout.type)
+    {
+        case 'B': DetectImages<T,uint8_t>(iecd,layout,color_order,face_box,left_eye,right_eye,results); break;
+        case 'H': DetectImages<T,uint16_t>(iecd,layout,color_order,face_box,left_eye,right_eye,results); break;
+        case 'f': DetectImages<T,float>(iecd,layout,color_order,face_box,left_eye,right_eye,results); break;
+        case 'd': DetectImages<T,double>(iecd,layout,color_order,face_box,left_eye,right_eye,results); break;
+    }
+}
+
+///
+// Detector type
+///
+typedef struct
+{
+    PyObject_HEAD
+    IsophoteEyeCenterDetector<float>* float_detector;   // one of the detectors is used (see the precision argument)
+    IsophoteEyeCenterDetector<double>* double_detector;
+    std::mutex* mutex;  // serializes the calls of different threads (the detector is not thread-safe)
+    ColorOrder color_order;
+} DetectorObject;
+
+static void
+Detector_dealloc(DetectorObject* self)
+{
+    delete self->float_detector;
+    delete self->double_detector;
+    delete self->mutex;
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject*
+Detector_new(PyTypeObject* type, PyObject*, PyObject*)
+{
+    DetectorObject* self = (DetectorObject*)type->tp_alloc(type,0);
+    if (self != NULL)
+    {
+        self->float_detector = NULL;
+        self->double_detector = NULL;
+        self->mutex = new std::mutex();
+        self->color_order = BGRColorOrder;
+    }
+    return (PyObject*)self;
+}
+
+/** Set the sigma of a detector (row_sigma < 0: automatic selection). */
+template <typename T>
+static void
+SetSigma(IsophoteEyeCenterDetector<T>& iecd, double row_sigma, double col_sigma)
+{
+    (row_sigma < 0 ? iecd.setAutoSigma() : iecd.setSigma((T)row_sigma,(T)col_sigma));
+}
+
+/** Set the sigma of the detector (row_sigma < 0: automatic selection). */
+static void
+SetSigma(DetectorObject* self, double row_sigma, double col_sigma)
+{
+    std::lock_guard<std::mutex> lock(*self->mutex);
+    if (self->float_detector != NULL)
+        SetSigma(*self->float_detector,row_sigma,col_sigma);
+    else if (self->double_detector != NULL)
+        SetSigma(*self->double_detector,row_sigma,col_sigma);
+}
+
+/** Parse a color order name (sets a Python exception and returns false on errors). */
+static bool
+ParseColorOrder(const char* name, ColorOrder& order)
+{
+    const std::string s(name);
+    if (s == "bgr")
+        order = BGRColorOrder;
+    else if (s == "rgb")
+        order = RGBColorOrder;
+    else
+    {
+        PyErr_Format(PyExc_ValueError,"unknown color order '%s' (expected 'bgr' or 'rgb')",name);
+        return false;
+    }
+    return true;
+}
+
+static int
+Detector_init(DetectorObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "sigma", "col_sigma", "precision", "color_order", NULL };
+    double sigma = -1, col_sigma = -1;
+    const char* precision = "float";
+    const char* color_order = "bgr";
+    if (!PyArg_ParseTupleAndKeywords(args,kwds,"|ddss",(char**)kwlist,&sigma,&col_sigma,&precision,&color_order))
+        return -1;
+    ColorOrder order;
+    if (!ParseColorOrder(color_order,order))
+        return -1;
+    // the new detector is configured before it replaces the old one under the lock, i.e. __init__ can be called again while other threads detect
+    IsophoteEyeCenterDetector<float>* float_detector = NULL;
+    IsophoteEyeCenterDetector<double>* double_detector = NULL;
+    if (std::string(precision) == "float")
+    {
+        float_detector = new IsophoteEyeCenterDetector<float>();
+        float_detector->setColorOrder(order);
+        SetSigma(*float_detector,sigma,(col_sigma < 0 ? sigma : col_sigma));
+    }
+    else if (std::string(precision) == "double")
+    {
+        double_detector = new IsophoteEyeCenterDetector<double>();
+        double_detector->setColorOrder(order);
+        SetSigma(*double_detector,sigma,(col_sigma < 0 ? sigma : col_sigma));
+    }
+    else
+    {
+        PyErr_Format(PyExc_ValueError,"unknown precision '%s' (expected 'float' or 'double')",precision);
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(*self->mutex);
+        std::swap(self->float_detector,float_detector);
+        std::swap(self->double_detector,double_detector);
+        self->color_order = order;
+    }
+    delete float_detector;
+    delete double_detector;
+    return 0;
+}
+
+/** Convert the eye center locations to ((left_x, left_y), (right_x, right_y)) or None. */
+static PyObject*
+BuildResult(const EyeCenterLocations<coord_t>& result)
+{
+    if (!result.isValid())
+        Py_RETURN_NONE;
+    return Py_BuildValue("((ii)(ii))",result.left.x,result.left.y,result.right.x,result.right.y);
+}
+
+/** Run the detection on a buffer without the GIL (sets a Python exception and returns false on errors). */
+static bool
+Detect(DetectorObject* self, PyObject* image, bool stack, const cv::Rect_<coord_t>& face, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+       std::vector<EyeCenterLocations<coord_t> >& results)
+{
+    // the buffer stays exported (i.e., the array cannot be resized) until it is released
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(image,&buffer,PyBUF_RECORDS_RO) != 0)
+        return false;
+    BufferLayout layout;
+    if (!GetBufferLayout(buffer,stack,layout))
+    {
+        PyBuffer_Release(&buffer);
+        return false;
+    }
+
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        std::lock_guard<std::mutex> lock(*self->mutex);
+        // the detector is only accessed under the lock, because __init__ may replace it
+        if (self->float_detector != NULL)
+            DetectImages(*self->float_detector,layout,self->color_order,face,left_eye,right_eye,results);
+        else if (self->double_detector != NULL)
+            DetectImages(*self->double_detector,layout,self->color_order,face,left_eye,right_eye,results);
+        else
+            error = "the detector has not been initialized";
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&buffer);
+
+    if (!error.empty())
+    {
+        PyErr_SetString(PyExc_RuntimeError,error.c_str());
+        return false;
+    }
+    return true;
+}
+
+/** Parse an optional (x, y, width, height) box; None keeps the default (sets a Python exception and returns false on errors). */
+static bool
+ParseOptionalBox(PyObject* obj, cv::Rect_<coord_t>& box)
+{
+    if (obj == NULL || obj == Py_None)
+        return true;
+    return PyArg_Parse(obj,"(iiii);face has to be an (x, y, width, height) tuple or None",&box.x,&box.y,&box.width,&box.height) != 0;
+}
+
+/** Parse an optional (x, y) point; None keeps the default, i.e. the invalid location (-1,-1) (sets a Python exception and returns false on errors). */
+static bool
+ParseOptionalPoint(PyObject* obj, const char* name, cv::Point_<coord_t>& point)
+{
+    if (obj == NULL || obj == Py_None)
+        return true;
+    const std::string format = std::string("(ii);") + name + " has to be an (x, y) tuple or None";
+    return PyArg_Parse(obj,format.c_str(),&point.x,&point.y) != 0;
+}
+
+static PyObject*
+Detector_detect(DetectorObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "image", "face", "left_eye", "right_eye", NULL };
+    PyObject* image = NULL;
+    cv::Rect_<coord_t> face(0,0,0,0);
+    cv::Point_<coord_t> left_eye(-1,-1), right_eye(-1,-1);
+    PyObject* face_obj = NULL;
+    PyObject* left_eye_obj = NULL;
+    PyObject* right_eye_obj = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args,kwds,"O|OOO",(char**)kwlist,&image,&face_obj,&left_eye_obj,&right_eye_obj))
+        return NULL;
+    if (!ParseOptionalBox(face_obj,face) || !ParseOptionalPoint(left_eye_obj,"left_eye",left_eye) || !ParseOptionalPoint(right_eye_obj,"right_eye",right_eye))
+        return NULL;
+
+    std::vector<EyeCenterLocations<coord_t> > results;
+    if (!Detect(self,image,false,face,left_eye,right_eye,results))
+        return NULL;
+    return BuildResult(results[0]);
+}
+
+static PyObject*
+Detector_detect_batch(DetectorObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* kwlist[] = { "images", "face", NULL };
+    PyObject* images = NULL;
+    cv::Rect_<coord_t> face(0,0,0,0);
+    PyObject* face_obj = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args,kwds,"O|O",(char**)kwlist,&images,&face_obj))
+        return NULL;
+    if (!ParseOptionalBox(face_obj,face))
+        return NULL;
+
+    std::vector<EyeCenterLocations<coord_t> > results;
+    if (!Detect(self,images,true,face,cv::Point_<coord_t>(-1,-1),cv::Point_<coord_t>(-1,-1),results))
+        return NULL;
+    PyObject* list = PyList_New((Py_ssize_t)results.size());
+    if (list == NULL)
+        return NULL;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        PyObject* result = BuildResult(results[i]);
+        if (result == NULL)
+        {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list,(Py_ssize_t)i,result);
+    }
+    return list;
+}
+
+static PyObject*
+Detector_set_sigma(DetectorObject* self, PyObject* args)
+{
+    double sigma = -1, col_sigma = -1;
+    if (!PyArg_ParseTuple(args,"d|d",&sigma,&col_sigma))
+        return NULL;
+    SetSigma(self,sigma,(col_sigma < 0 ? sigma : col_sigma));
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Detector_set_auto_sigma(DetectorObject* self, PyObject*)
+{
+    SetSigma(self,-1,-1);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef Detector_methods[] =
+{
+    { "detect", (PyCFunction)(void(*)(void))Detector_detect, METH_VARARGS | METH_KEYWORDS,
+      "detect(image, face=None, left_eye=None, right_eye=None) -> ((left_x, left_y), (right_x, right_y)) or None\n\n"
+      "Detect the eye centers in a (height, width) gray or (height, width, 3|4) interleaved color image (uint8, uint16, float32, float64;\n"
+      "color: no float64). face is a (x, y, width, height) box (default: the full image), left_eye/right_eye are coarse (x, y) eye\n"
+      "locations that define the search ROIs. The image is not copied and the GIL is released during the detection." },
+    { "detect_batch", (PyCFunction)(void(*)(void))Detector_detect_batch, METH_VARARGS | METH_KEYWORDS,
+      "detect_batch(images, face=None) -> list of ((left_x, left_y), (right_x, right_y)) or None\n\n"
+      "Detect the eye centers in a (count, height, width) stack of face crops (the face box defaults to the full crop).\n"
+      "The GIL is released once for the complete stack." },
+    { "set_sigma", (PyCFunction)Detector_set_sigma, METH_VARARGS,
+      "set_sigma(sigma, col_sigma=sigma): set the scale of the derivative filters (sigma < 0: automatic selection)" },
+    { "set_auto_sigma", (PyCFunction)Detector_set_auto_sigma, METH_NOARGS,
+      "set_auto_sigma(): select the scale automatically (default)" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject DetectorType =
+{
+    PyVarObject_HEAD_INIT(NULL,0)
+    "isophote_eye_center.Detector",             // tp_name
+    sizeof(DetectorObject),                     // tp_basicsize
+};
+
+static PyModuleDef isophote_eye_center_module =
+{
+    PyModuleDef_HEAD_INIT,
+    "isophote_eye_center",
+    "Isophote-based eye center detection (zero-copy, see Detector).",
+    -1,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC
+PyInit_isophote_eye_center(void)
+{
+    DetectorType.tp_dealloc = (destructor)Detector_dealloc;
+    DetectorType.tp_flags = Py_TPFLAGS_DEFAULT;
+    DetectorType.tp_doc = "Detector(sigma=-1, col_sigma=sigma, precision='float', color_order='bgr')\n\n"
+                          "Isophote-based eye center detector. Use one detector per thread: the calls of a detector are serialized.";
+    DetectorType.tp_methods = Detector_methods;
+    DetectorType.tp_init = (initproc)Detector_init;
+    DetectorType.tp_new = Detector_new;
+    if (PyType_Ready(&DetectorType) < 0)
+        return NULL;
+
+    PyObject* module = PyModule_Create(&isophote_eye_center_module);
+    if (module == NULL)
+        return NULL;
+    Py_INCREF(&DetectorType);
+    if (PyModule_AddObject(module,"Detector",(PyObject*)&DetectorType) < 0)
+    {
+        Py_DECREF(&DetectorType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -23,10 +23,28 @@
 
 // include necessary stuff for isophote calculation
 #include "isophote.hpp"
+#include "box_filter.hpp"
 #include "gauss_filter.hpp"
+#include "gauss_filter_bank.hpp"
+#include "instrumentation.hpp"
 #include "separable_filter.hpp"
 #include "typetostring.hpp"
 
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <vector>
+
+#ifdef __MEX
+#include <mex.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#endif
+
 #ifdef __STANDALONE
 #include <okapi.hpp>
 #include <okapi-gui.hpp>
@@ -34,26 +52,27 @@
 #include <opencv2/highgui/highgui.hpp>
 #endif
 
-#ifndef SAFE_DELETE_ARRAY
-#define SAFE_DELETE_ARRAY(x) { if ((x) != NULL) delete [] x; x = NULL; }
-#endif
-
+// the stages are always measured by the built-in instrumentation (see instrumentation.hpp; if enabled), and additionally by the OKAPI timers;
+// pixels is the number of processed pixels of the stage (used for the per pixel statistics, e.g., cache misses per pixel)
 #define BENCHMARK_ISOPHOTE_EYE_CENTER_DETECTOR
 #ifdef BENCHMARK_ISOPHOTE_EYE_CENTER_DETECTOR
-#define BENCHMARK_START(name) OKAPI_TIMER_START(name)
-#define BENCHMARK_STOP(name) OKAPI_TIMER_STOP(name)
+#define BENCHMARK_START(name,stage) OKAPI_TIMER_START(name); INSTRUMENTATION_START(stage)
+#define BENCHMARK_STOP(name,stage,pixels) INSTRUMENTATION_STOP_PIXELS(stage,pixels); OKAPI_TIMER_STOP(name)
 #else
-#define BENCHMARK_START(name) 
-#define BENCHMARK_STOP(name)
+#define BENCHMARK_START(name,stage) INSTRUMENTATION_START(stage)
+#define BENCHMARK_STOP(name,stage,pixels) INSTRUMENTATION_STOP_PIXELS(stage,pixels)
 #endif
 
 template <typename T>
 IsophoteEyeCenterDetector<T>::IsophoteEyeCenterDetector(void)
-: current_row_filter_length(0), current_col_filter_length(0), current_width(0), current_height(0), current_row_sigma(0), current_col_sigma(0),
-  manual_eye_roi(-1,-1,-1,-1), manual_row_sigma(-1), manual_col_sigma(-1),
-  buf_width(0), buf_height(0), Lx(NULL), Ly(NULL), Lxx(NULL), Lxy(NULL), Lyy(NULL), tmpColMajor(NULL), tmpT1(NULL), tmpLx2(NULL), tmpLy2(NULL), acc(NULL),
-  buf_length(0), row_g(NULL), row_gp(NULL), row_gpp(NULL), col_g(NULL), col_gp(NULL), col_gpp(NULL), row_ax(NULL), col_ax(NULL)
+: current_row_filter_length(0), current_col_filter_length(0), current_width(0), current_height(0), current_row_sigma(0), current_col_sigma(0), current_roll_angle(0),
+  manual_eye_roi(-1,-1,-1,-1), manual_row_sigma(-1), manual_col_sigma(-1), color_order(BGRColorOrder),
+  auto_min_sigma(0.5), auto_max_sigma(3), auto_num_scales(6), accumulator_precision(FloatingPointAccumulator), accumulator_threads(1), acc_weight_scale(1),
+  coarse_factor(0), coarse_candidates(2), canonical_iod(0), subpixel_precision(false), output_planes(AllOutputPlanes),
+  derivative_filter(GaussianDerivativeFilter), rotation_aware(false), filter_shear(0), integral_stride(0), buf_width(0), buf_height(0), buf_stride(0), buf_tmp_stride(0), k(NULL), c(NULL), dx(NULL), dy(NULL), Lx(NULL), Ly(NULL), Lxx(NULL), Lxy(NULL), Lyy(NULL), tmpColMajor(NULL), tmpT1(NULL), tmpLx2(NULL), tmpLy2(NULL), acc(NULL), qacc(NULL), Ls(NULL),
+  row_bank(NULL), col_bank(NULL)
 {
+    row_box.sigma = col_box.sigma = T(-1); // the box filters are created on demand (see ProcessView)
 }
 
 template <typename T>
@@ -66,54 +85,56 @@ template <typename T>
 void
 IsophoteEyeCenterDetector<T>::ReallocateImageMemory(int new_width, int new_height, bool set_zero)
 {
-    int buf_size = buf_width*buf_height;
-    int new_size = new_width*new_height;
     if (new_width != buf_width || new_height != buf_height)
     {
-        if (buf_size < new_size)
+        // all planes are carved out of one slab; every row of every plane starts SLAB_ALIGNMENT aligned
+        const int new_stride = GetPaddedStride<T>(new_width);      // row-major planes: new_height rows with new_stride elements each
+        const int new_tmp_stride = GetPaddedStride<T>(new_height); // transposed (col-major) plane: new_width rows with new_tmp_stride elements each
+        const size_t plane_bytes = AlignSize(sizeof(T)*(size_t)new_stride*new_height);
+        const size_t tmp_plane_bytes = AlignSize(sizeof(T)*(size_t)new_tmp_stride*new_width);
+        const size_t qacc_plane_bytes = AlignSize(sizeof(uint32_t)*(size_t)new_stride*new_height); // fixed-point accumulator (16 or 32 bit)
+        const size_t num_planes = 14; // k, c, dx, dy, Lx, Ly, Lxx, Lxy, Lyy, tmpT1, tmpLx2, tmpLy2, acc, Ls (+ tmpColMajor, qacc)
+        const size_t slab_bytes = num_planes*plane_bytes + tmp_plane_bytes + qacc_plane_bytes;
+        image_slab.reserve(slab_bytes); // grows geometrically, i.e. usually a no-op for slightly bigger frames
+        if (image_slab.data() == NULL && slab_bytes > 0)
         {
-            // release old memory
+            // the old slab has been released, i.e. the old planes are invalid, too, and the next call has to allocate again
             ReleaseImageMemory();
-    
-            // allocate new memory
-            k           = new T[new_size];
-            c           = new T[new_size];
-            dx          = new T[new_size];
-            dy          = new T[new_size];
-            Lx          = new T[new_size];
-            Ly          = new T[new_size];
-            Lxx         = new T[new_size];
-            Lxy         = new T[new_size];
-            Lyy         = new T[new_size];
-            tmpColMajor = new T[new_size];
-            tmpT1       = new T[new_size];
-            tmpLx2      = new T[new_size];
-            tmpLy2      = new T[new_size];
-            acc         = new T[new_size];
-    
-            // set new buffer width/height
-            buf_width = new_width;
-            buf_height = new_height;
+            throw std::bad_alloc(); // as new T[] did
         }
+
+        // carve the planes
+        char* mem = (char*)image_slab.data();
+        k           = (T*)mem; mem += plane_bytes;
+        c           = (T*)mem; mem += plane_bytes;
+        dx          = (T*)mem; mem += plane_bytes;
+        dy          = (T*)mem; mem += plane_bytes;
+        Lx          = (T*)mem; mem += plane_bytes;
+        Ly          = (T*)mem; mem += plane_bytes;
+        Lxx         = (T*)mem; mem += plane_bytes;
+        Lxy         = (T*)mem; mem += plane_bytes;
+        Lyy         = (T*)mem; mem += plane_bytes;
+        tmpT1       = (T*)mem; mem += plane_bytes;
+        tmpLx2      = (T*)mem; mem += plane_bytes;
+        tmpLy2      = (T*)mem; mem += plane_bytes;
+        acc         = (T*)mem; mem += plane_bytes;
+        Ls          = (T*)mem; mem += plane_bytes;
+        tmpColMajor = (T*)mem; mem += tmp_plane_bytes;
+        qacc        = (void*)mem; mem += qacc_plane_bytes;
+
+        // set new buffer width/height
+        buf_width = new_width;
+        buf_height = new_height;
+        buf_stride = new_stride;
+        buf_tmp_stride = new_tmp_stride;
+
         if (set_zero)
         {
-            for (int i = 0; i < new_width*new_height; i++)
-            {
-                k[i]           = T(0);
-                c[i]           = T(0);
-                dx[i]          = T(0);
-                dy[i]          = T(0);
-                Lx[i]          = T(0);
-                Ly[i]          = T(0);
-                Lxx[i]         = T(0);
-                Lxy[i]         = T(0);
-                Lyy[i]         = T(0);
-                tmpColMajor[i] = T(0);
-                tmpT1[i]       = T(0);
-                tmpLx2[i]      = T(0);
-                tmpLy2[i]      = T(0);
-                acc[i]         = T(0);
-            }
+            // the planes are contiguous in the slab, i.e. we can zero them in one pass (including the row padding)
+            T* planes = (T*)_ASSUME_ALIGNED(image_slab.data());
+            const size_t n = slab_bytes / sizeof(T);
+            for (size_t i = 0; i < n; i++)
+                planes[i] = T(0);
         }
     }
 }
@@ -122,180 +143,275 @@ template <typename T>
 void
 IsophoteEyeCenterDetector<T>::ReleaseImageMemory(void)
 {
-    if (buf_width != 0 || buf_height != 0)
-    {
-        SAFE_DELETE_ARRAY(k);
-        SAFE_DELETE_ARRAY(c);
-        SAFE_DELETE_ARRAY(dx);
-        SAFE_DELETE_ARRAY(dy);
-        SAFE_DELETE_ARRAY(Lx);
-        SAFE_DELETE_ARRAY(Ly);
-        SAFE_DELETE_ARRAY(Lxx);
-        SAFE_DELETE_ARRAY(Lxy);
-        SAFE_DELETE_ARRAY(Lyy);
-        SAFE_DELETE_ARRAY(tmpColMajor);
-        SAFE_DELETE_ARRAY(tmpT1);
-        SAFE_DELETE_ARRAY(tmpLx2);
-        SAFE_DELETE_ARRAY(tmpLy2);
-        SAFE_DELETE_ARRAY(acc);
-    }
+    image_slab.release();
+    k = c = dx = dy = NULL;
+    Lx = Ly = Lxx = Lxy = Lyy = NULL;
+    tmpColMajor = tmpT1 = tmpLx2 = tmpLy2 = NULL;
+    acc = Ls = NULL;
+    qacc = NULL;
+    buf_width = buf_height = 0;
+    buf_stride = buf_tmp_stride = 0;
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+void
+IsophoteEyeCenterDetector<T>::process(const S* img, int width, int height, T row_sigma, T col_sigma, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi, T roll_angle)
+{
+    process(ImageView<S>(img,width,height),row_sigma,col_sigma,left_roi,right_roi,roll_angle);
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+void
+IsophoteEyeCenterDetector<T>::process(const ImageView<S>& img, T row_sigma, T col_sigma, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi, T roll_angle)
+{
+    ProcessView(img,row_sigma,col_sigma,left_roi,right_roi,roll_angle);
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+void
+IsophoteEyeCenterDetector<T>::process(const ColorImageView<S>& img, T row_sigma, T col_sigma, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi, T roll_angle)
+{
+    ProcessView(img,row_sigma,col_sigma,left_roi,right_roi,roll_angle);
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+void
+IsophoteEyeCenterDetector<T>::processIsophotes(const ImageView<S>& img, T row_sigma, T col_sigma, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi, T roll_angle)
+{
+    ProcessView(img,row_sigma,col_sigma,left_roi,right_roi,roll_angle,false);
 }
 
 template <typename T>
 void
-IsophoteEyeCenterDetector<T>::ReallocateFilterMemory(int new_row_length, int new_col_length)
+IsophoteEyeCenterDetector<T>::vote(const cv::Rect_<coord_t>& roi, T min_radius, T max_radius, T min_curvedness, bool zero_acc)
 {
-    // we are lazy and don't really distinguish between the lengths
-    int new_length = (new_row_length > new_col_length ? new_row_length : new_col_length);   
-    
-    if (new_row_length > buf_length || new_col_length > buf_length)
-    {
-        // release old memory
-        ReleaseFilterMemory();
+    const cv::Rect_<coord_t> vote_roi = roi & cv::Rect_<coord_t>(0,0,current_width,current_height);
+    if (acc == NULL || vote_roi.area() <= 0)
+        return;
 
-        // allocate new memory
-        row_g   = new T[new_length];
-        row_gp  = new T[new_length];
-        row_gpp = new T[new_length];
-        col_g   = new T[new_length];
-        col_gp  = new T[new_length];
-        col_gpp = new T[new_length];
-        row_ax  = new T[new_length];
-        col_ax  = new T[new_length];
+    BENCHMARK_START("CalculateAccumulator",VotingStage);
+    VoteAccumulator(vote_roi,min_radius,max_radius,min_curvedness,zero_acc);
+    BENCHMARK_STOP("CalculateAccumulator",VotingStage,vote_roi.area());
+}
+
+template <typename T>
+void
+IsophoteEyeCenterDetector<T>::VoteAccumulator(const cv::Rect_<coord_t>& roi, T min_radius, T max_radius, T min_curvedness, bool zero_acc)
+{
+    switch (accumulator_precision)
+    {
+        case FixedPoint16Accumulator: VoteQuantizedAccumulator<uint16_t>(roi,min_radius,max_radius,min_curvedness,zero_acc); return;
+        case FixedPoint32Accumulator: VoteQuantizedAccumulator<uint32_t>(roi,min_radius,max_radius,min_curvedness,zero_acc); return;
+        default: break;
+    }
 
-        buf_length = new_length;
+    if (zero_acc)
+    {
+        T* _acc = (T*)_ASSUME_ALIGNED(acc);
+        for (int i = 0; i < buf_stride*buf_height; i++)
+            _acc[i] = T(0);
     }
+    if (subpixel_precision)
+        CalculateBilinearAccumulator(k,c,dx,dy,buf_width,buf_height,buf_stride,(int)roi.x,(int)roi.y,(int)roi.width,(int)roi.height,acc,min_radius,max_radius,min_curvedness);
+    else
+        CalculateAccumulator(k,c,dx,dy,buf_width,buf_height,buf_stride,(int)roi.x,(int)roi.y,(int)roi.width,(int)roi.height,acc,min_radius,max_radius,min_curvedness);
 }
 
-template <typename T>
+template <typename T> // for the class
+template <typename A> // for the method
 void
-IsophoteEyeCenterDetector<T>::ReleaseFilterMemory(void)
+IsophoteEyeCenterDetector<T>::VoteQuantizedAccumulator(const cv::Rect_<coord_t>& roi, T min_radius, T max_radius, T min_curvedness, bool zero_acc)
 {
-    if (buf_length != 0)
+    const int n = buf_stride*buf_height;
+    A* _qacc = (A*)_ASSUME_ALIGNED(qacc);
+    T* _acc = (T*)_ASSUME_ALIGNED(acc);
+    if (zero_acc)
     {
-        SAFE_DELETE_ARRAY(row_g);
-        SAFE_DELETE_ARRAY(row_gp);
-        SAFE_DELETE_ARRAY(row_gpp);
-        SAFE_DELETE_ARRAY(col_g);
-        SAFE_DELETE_ARRAY(col_gp);
-        SAFE_DELETE_ARRAY(col_gpp);
-        SAFE_DELETE_ARRAY(row_ax);
-        SAFE_DELETE_ARRAY(col_ax);
+        for (int i = 0; i < n; i++)
+            _qacc[i] = A(0);
     }
+    else
+    {
+        // continue with the current accumulator (exact if it holds the votes of a fixed-point voting with the same quantization)
+        const T max_value = T(std::numeric_limits<A>::max());
+        for (int i = 0; i < n; i++)
+        {
+            const T w = _acc[i]*acc_weight_scale + T(0.5); // +0.5 for cheap round
+            _qacc[i] = (w < max_value ? A(w) : std::numeric_limits<A>::max());
+        }
+    }
+    CalculateQuantizedAccumulator(k,c,dx,dy,buf_width,buf_height,buf_stride,(int)roi.x,(int)roi.y,(int)roi.width,(int)roi.height,_qacc,buf_stride,acc_weight_scale,
+                                  accumulator_threads,min_radius,max_radius,min_curvedness);
+    // back to the units of the curvedness, i.e. the smoothing/maximum search and getAcc do not depend on the precision
+    const T inv_scale = T(1) / acc_weight_scale;
+    for (int i = 0; i < n; i++)
+        _acc[i] = T(_qacc[i]) * inv_scale;
+}
+
+template <typename T>
+void
+IsophoteEyeCenterDetector<T>::SetAccumulatorWeightScale(const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi)
+{
+    // the max. weight leaves headroom for the sum of many votes (2^8 votes of the max. weight in 16 bit, 2^16 in 32 bit; the sums saturate)
+    const T max_weight = (accumulator_precision == FixedPoint16Accumulator ? T(255) : T(65535));
+    const cv::Rect_<coord_t> image_rect(0,0,buf_width,buf_height);
+    const cv::Rect_<coord_t> rois[2] = { left_roi & image_rect, right_roi & image_rect };
+    T max_c = T(0);
+    for (int r = 0; r < 2; r++)
+        for (int y = rois[r].y; y < rois[r].y + rois[r].height; y++)
+            for (int x = rois[r].x; x < rois[r].x + rois[r].width; x++)
+            {
+                const int idx = y*buf_stride + x;
+                if (k[idx] < 0 && c[idx] > max_c)
+                    max_c = c[idx];
+            }
+    acc_weight_scale = (max_c > 0 ? max_weight / max_c : T(1));
+}
+
+template <typename T>
+cv::Point_<typename IsophoteEyeCenterDetector<T>::coord_t>
+IsophoteEyeCenterDetector<T>::locateAccumulatorMaximum(const cv::Rect_<coord_t>& roi, int smoothing_size) const
+{
+    const cv::Rect_<coord_t> search_roi = roi & cv::Rect_<coord_t>(0,0,current_width,current_height);
+    if (acc == NULL || search_roi.area() <= 0)
+        return getInvalidCoordPoint();
+
+    // only the ROI is smoothed, but the border is taken from the surrounding accumulator (no BORDER_ISOLATED), i.e. the result is identical
+    // to the smoothing of the complete accumulator in detectEyeCenters
+    cv::Mat macc = getMatAcc();
+    cv::Mat smacc;
+    if (smoothing_size > 1)
+        cv::GaussianBlur(macc(search_roi),smacc,cv::Size(smoothing_size | 1,smoothing_size | 1),0,0);
+    else
+        smacc = macc(search_roi);
+    cv::Point max_loc;
+    cv::minMaxLoc(smacc,NULL,NULL,NULL,&max_loc);
+    return cv::Point_<coord_t>(max_loc.x + search_roi.x,max_loc.y + search_roi.y);
+}
+
+/** Decompose the Gaussian with sigma row_sigma along the rotated rows (angle, clockwise in image coordinates) and col_sigma along the rotated columns
+ *  into a row filter (sigma filter_row_sigma) and a column filter (sigma filter_col_sigma) along the sheared columns (x + shear*t,y + t). The covariance
+ *  of the rotated Gaussian is S = R diag(row_sigma^2,col_sigma^2) R^T, i.e. shear = S_xy/S_yy, filter_col_sigma^2 = S_yy and filter_row_sigma^2 = det(S)/S_yy.
+ */
+template <typename T>
+static void
+GetShearedGaussParameters(T row_sigma, T col_sigma, T angle, T& filter_row_sigma, T& filter_col_sigma, T& shear)
+{
+    const T c = std::cos(angle);
+    const T s = std::sin(angle);
+    const T row_var = row_sigma*row_sigma;
+    const T col_var = col_sigma*col_sigma;
+    const T s_yy = s*s*row_var + c*c*col_var;
+    const T s_xy = c*s*(row_var - col_var);
+    shear = s_xy / s_yy;
+    filter_col_sigma = std::sqrt(s_yy);
+    filter_row_sigma = row_sigma*col_sigma / filter_col_sigma;
 }
 
 template <typename T> // for the class
-template <typename S> // for the method
+template <typename V> // for the method
 void
-IsophoteEyeCenterDetector<T>::process(const S* img, int width, int height, T row_sigma, T col_sigma, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi)
+IsophoteEyeCenterDetector<T>::ProcessView(const V& img, T row_sigma, T col_sigma, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi, T roll_angle, bool calculate_accumulator)
 {
-    static bool displayed_warning = false;
-    if (!displayed_warning)
+    const int width = img.width;
+    const int height = img.height;
+    // the planes of the previous image are invalid from now on (the size is set again once this image has been processed)
+    current_width = current_height = 0;
+
+    static std::atomic<bool> displayed_warning(false); // detectors may run concurrently (e.g., AsyncEyeCenterDetector)
+    if (!displayed_warning.exchange(true))
         std::cout << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.process: Warning - use of ROI's in processing not implemented yet!" << std::endl;
-    displayed_warning = true;
     // @TODO: check whether one ROI contains the other ROI and then just process the bigger ROI!
 
     // (Re-)Allocate memory if necessary
+    BENCHMARK_START("FilterSetup",FilterSetupStage);
     ReallocateImageMemory(width,height);
 
-    // Calculate the filters
+    // a rotated anisotropic Gaussian is filtered along the rows and the sheared columns (see FilterShearedDerivatives)
+    T filter_row_sigma = row_sigma;
+    T filter_col_sigma = col_sigma;
+    T new_shear = T(0);
+    if (roll_angle != 0 && row_sigma != col_sigma)
+        GetShearedGaussParameters(row_sigma,col_sigma,roll_angle,filter_row_sigma,filter_col_sigma,new_shear);
+
+    // Get the (flipped) filters from the process-wide filter bank cache
     bool normalize_filter = false; // @TODO: does setting this to true really disturb the results? Currently I have the -subjective- feeling that it could be a problem!
-    bool flip_filter = true;
-    int row_filter_length = GetGaussLength<T,int>(row_sigma); // calculate the necessary filter length, i.e. as defined by the support
-    int col_filter_length = GetGaussLength<T,int>(col_sigma); // calculate the necessary filter length, i.e. as defined by the support
-    ReallocateFilterMemory(row_filter_length,col_filter_length);
-    // recalculate row filters if necessary
-    if (row_sigma != current_row_sigma)
-    {
-        GetGaussSupport<T,int>(row_sigma,row_ax); // calculate the support
-        CreateGauss(row_sigma,normalize_filter,row_ax,row_g);
-        CreateGaussFirstDeriv(row_sigma,normalize_filter,row_ax,row_gp);
-        CreateGaussSecondDeriv(row_sigma,normalize_filter,row_ax,row_gpp);
-        // we have to flip the arrays in order to calculate the "real" convolution with the RowFilter procedure
-        if (flip_filter)
-        {
-            // @todo: add another parameter to CreateGauss* to directly get flipped filters as output
-            FlipArray(row_g,row_filter_length);
-            FlipArray(row_gp,row_filter_length);
-            FlipArray(row_gpp,row_filter_length);
-        }
+    const bool same_filters = (roll_angle == current_roll_angle);
+    const GaussFilterBank<T>* new_row_bank = (row_bank != NULL && row_sigma == current_row_sigma && same_filters ? row_bank : GetGaussFilterBank(filter_row_sigma,normalize_filter,&row_overflow_bank));
+    const GaussFilterBank<T>* new_col_bank = (col_bank != NULL && col_sigma == current_col_sigma && same_filters ? col_bank : GetGaussFilterBank(filter_col_sigma,normalize_filter,&col_overflow_bank));
+    if (new_row_bank == NULL || new_col_bank == NULL)
+    {
+        row_bank = col_bank = NULL; // the previous banks may have been replaced in the overflow banks
+        std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.process: invalid sigma! Skipping image!" << std::endl;
+        return;
     }
-    // recalculate col filters if necessary 
-    if (col_sigma != current_col_sigma)
+    row_bank = new_row_bank;
+    col_bank = new_col_bank;
+    filter_shear = new_shear;
+    const int row_filter_length = row_bank->length;
+    const int col_filter_length = col_bank->length;
+    const bool box_filter = (derivative_filter == BoxDerivativeFilter && filter_shear == 0); // the box filters are axis-aligned
+    if (box_filter)
     {
-        GetGaussSupport<T,int>(col_sigma,col_ax); // calculate the support
-        CreateGauss(col_sigma,normalize_filter,col_ax,col_g);
-        CreateGaussFirstDeriv(col_sigma,normalize_filter,col_ax,col_gp);
-        CreateGaussSecondDeriv(col_sigma,normalize_filter,col_ax,col_gpp);
-        // we have to flip the arrays in order to calculate the "real" convolution with the RowFilter procedure
-        if (flip_filter)
-        {
-            // @todo: add another parameter to CreateGauss* to directly get flipped filters as output
-            FlipArray(col_g,col_filter_length);
-            FlipArray(col_gp,col_filter_length);
-            FlipArray(col_gpp,col_filter_length);
-        }
+        if (row_box.sigma != row_sigma)
+            CreateBoxDerivativeKernel(row_sigma,row_box,normalize_filter);
+        if (col_box.sigma != col_sigma)
+            CreateBoxDerivativeKernel(col_sigma,col_box,normalize_filter);
     }
+    BENCHMARK_STOP("FilterSetup",FilterSetupStage,0);
+    if (box_filter)
+        IntegralImageSetup(img,left_roi,right_roi);
+    const int roi_pixels = (int)(left_roi.area() + right_roi.area()); // processed pixels (per pass)
 
-    // Let's calculate the Gaussian and its derivatives
-    BENCHMARK_START("RowFilter");
+    // without debug planes, the derivatives, isophotes and votes are calculated in one pass (see setOutputPlanes)
+    if (calculate_accumulator && accumulator_precision == FloatingPointAccumulator && output_planes != AllOutputPlanes)
+        ProcessFused(img,left_roi,right_roi);
+    else
+    {
+        // Let's calculate the Gaussian and its derivatives
+        BENCHMARK_START("RowFilter",RowFilterStage);
 #define _ROI_ROW_FILTER
 #ifdef _ROI_ROW_FILTER
-    // 1. Left eye
-    // (a) Calculate Ly and Lyy
-    RowFilter(img,width,height,row_g,row_filter_length,tmpColMajor,left_roi.x,left_roi.y,left_roi.width,left_roi.height,false,true);
-    RowFilter(tmpColMajor,height,width,col_gp,col_filter_length,Ly,left_roi.y,left_roi.x,left_roi.height,left_roi.width,false,true);
-    RowFilter(tmpColMajor,height,width,col_gpp,col_filter_length,Lyy,left_roi.y,left_roi.x,left_roi.height,left_roi.width,false,true);
-    // (b) Calculate Lx and Lxy
-    RowFilter(img,width,height,row_gp,row_filter_length,tmpColMajor,left_roi.x,left_roi.y,left_roi.width,left_roi.height,false,true);
-    RowFilter(tmpColMajor,height,width,col_g,col_filter_length,Lx,left_roi.y,left_roi.x,left_roi.height,left_roi.width,false,true); 
-    RowFilter(tmpColMajor,height,width,col_gp,col_filter_length,Lxy,left_roi.y,left_roi.x,left_roi.height,left_roi.width,false,true); 
-    // (c) Calculate Lxx
-    RowFilter(img,width,height,row_gpp,row_filter_length,tmpColMajor,left_roi.x,left_roi.y,left_roi.width,left_roi.height,false,true);
-    RowFilter(tmpColMajor,height,width,col_g,col_filter_length,Lxx,left_roi.y,left_roi.x,left_roi.height,left_roi.width,false,true);
-    // 2. Right eye
-    // (a) Calculate Ly and Lyy
-    RowFilter(img,width,height,row_g,row_filter_length,tmpColMajor,right_roi.x,right_roi.y,right_roi.width,right_roi.height,false,true);
-    RowFilter(tmpColMajor,height,width,col_gp,col_filter_length,Ly,right_roi.y,right_roi.x,right_roi.height,right_roi.width,false,true);
-    RowFilter(tmpColMajor,height,width,col_gpp,col_filter_length,Lyy,right_roi.y,right_roi.x,right_roi.height,right_roi.width,false,true);
-    // (b) Calculate Lx and Lxy
-    RowFilter(img,width,height,row_gp,row_filter_length,tmpColMajor,right_roi.x,right_roi.y,right_roi.width,right_roi.height,false,true);
-    RowFilter(tmpColMajor,height,width,col_g,col_filter_length,Lx,right_roi.y,right_roi.x,right_roi.height,right_roi.width,false,true); 
-    RowFilter(tmpColMajor,height,width,col_gp,col_filter_length,Lxy,right_roi.y,right_roi.x,right_roi.height,right_roi.width,false,true); 
-    // (c) Calculate Lxx
-    RowFilter(img,width,height,row_gpp,row_filter_length,tmpColMajor,right_roi.x,right_roi.y,right_roi.width,right_roi.height,false,true);
-    RowFilter(tmpColMajor,height,width,col_g,col_filter_length,Lxx,right_roi.y,right_roi.x,right_roi.height,right_roi.width,false,true);
+        FilterDerivatives(img,left_roi,GetImageDerivativePlanes());
+        FilterDerivatives(img,right_roi,GetImageDerivativePlanes());
 #else
-    // (a) Calculate Ly and Lyy
-    RowFilter(img,width,height,row_g,row_filter_length,tmpColMajor,true);
-    RowFilter(tmpColMajor,height,width,col_gp,col_filter_length,Ly,true);
-    RowFilter(tmpColMajor,height,width,col_gpp,col_filter_length,Lyy,true);
-    // (b) Calculate Lx and Lxy
-    RowFilter(img,width,height,row_gp,row_filter_length,tmpColMajor,true);
-    RowFilter(tmpColMajor,height,width,col_g,col_filter_length,Lx,true); 
-    RowFilter(tmpColMajor,height,width,col_gp,col_filter_length,Lxy,true); 
-    // (c) Calculate Lxx
-    RowFilter(img,width,height,row_gpp,row_filter_length,tmpColMajor,true);
-    RowFilter(tmpColMajor,height,width,col_g,col_filter_length,Lxx,true);
+        FilterDerivatives(img,cv::Rect_<coord_t>(0,0,width,height),GetImageDerivativePlanes());
 #endif
-    BENCHMARK_STOP("RowFilter");
-                                                                                                    
-    // Calculate the isophote information, i.e. curvature, curvedness, and displacement vectors
-    BENCHMARK_START("CalculateIsophoteInformation");
+        BENCHMARK_STOP("RowFilter",RowFilterStage,roi_pixels);
+
+        // Calculate the isophote information, i.e. curvature, curvedness, and displacement vectors
+        BENCHMARK_START("CalculateIsophoteInformation",IsophoteStage);
 //    CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,width,height,k,c,dx,dy,tmpT1,tmpLx2,tmpLy2);
-    // set k to zero => elements with k=0 are not processed in CalculateAccumulator
-    for (int i = 0; i < width*height; i++)
-        k[i] = T(0);
-    CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,(int)width,(int)height,k,c,dx,dy,(int)left_roi.x,(int)left_roi.y,(int)left_roi.width,(int)left_roi.height,tmpT1,tmpLx2,tmpLy2);
-    CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,(int)width,(int)height,k,c,dx,dy,(int)right_roi.x,(int)right_roi.y,(int)right_roi.width,(int)right_roi.height,tmpT1,tmpLx2,tmpLy2);
-    BENCHMARK_STOP("CalculateIsophoteInformation");
-    BENCHMARK_START("CalculateAccumulator");
-    CalculateAccumulator(k,c,dx,dy,width,height,acc,false,true);
-    BENCHMARK_STOP("CalculateAccumulator");
+        // set k to zero => elements with k=0 are not processed in CalculateAccumulator
+        {
+            T* _k = (T*)_ASSUME_ALIGNED(k);
+            for (int i = 0; i < buf_stride*height; i++)
+                _k[i] = T(0);
+        }
+        CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,(int)width,(int)height,buf_stride,k,c,dx,dy,(int)left_roi.x,(int)left_roi.y,(int)left_roi.width,(int)left_roi.height,tmpT1,tmpLx2,tmpLy2);
+        CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,(int)width,(int)height,buf_stride,k,c,dx,dy,(int)right_roi.x,(int)right_roi.y,(int)right_roi.width,(int)right_roi.height,tmpT1,tmpLx2,tmpLy2);
+        BENCHMARK_STOP("CalculateIsophoteInformation",IsophoteStage,roi_pixels);
+        if (accumulator_precision != FloatingPointAccumulator)
+            SetAccumulatorWeightScale(left_roi,right_roi);
+        if (calculate_accumulator)
+        {
+            BENCHMARK_START("CalculateAccumulator",VotingStage);
+            if (accumulator_precision == FloatingPointAccumulator && !subpixel_precision)
+                CalculateAccumulator(k,c,dx,dy,width,height,buf_stride,acc,false,true);
+            else
+                VoteAccumulator(cv::Rect_<coord_t>(0,0,width,height),T(0),T(0),T(0),true); // k is zero outside of the ROIs (see above)
+            BENCHMARK_STOP("CalculateAccumulator",VotingStage,roi_pixels);
+        }
+    }
 
     // save the most relevant information about the image processing
     current_row_sigma = row_sigma;
     current_col_sigma = col_sigma;
+    current_roll_angle = roll_angle;
     current_width = width;
     current_height = height;
     current_row_filter_length = row_filter_length;
@@ -304,24 +420,578 @@ IsophoteEyeCenterDetector<T>::process(const S* img, int width, int height, T row
     current_right_roi = right_roi;
 }
 
+template <typename T> // for the class
+template <typename V> // for the method
+void
+IsophoteEyeCenterDetector<T>::FilterDerivatives(const V& img, const cv::Rect_<coord_t>& roi, const DerivativePlanes& out)
+{
+    if (filter_shear != 0)
+    {
+        FilterShearedDerivatives(img,roi,out);
+        return;
+    }
+    if (derivative_filter == BoxDerivativeFilter)
+    {
+        FilterBoxDerivatives(roi,out);
+        return;
+    }
+
+    const int width = img.width;
+    const int height = img.height;
+    const T *row_g = row_bank->g, *row_gp = row_bank->gp, *row_gpp = row_bank->gpp;
+    const T *col_g = col_bank->g, *col_gp = col_bank->gp, *col_gpp = col_bank->gpp;
+    const int row_filter_length = row_bank->length;
+    const int col_filter_length = col_bank->length;
+
+    // the row filter is applied first and writes the transposed (col-major) temporary plane, whose rows are then filtered by the column filter.
+    // The first pass covers the support of the column filter, i.e. the second pass never reads rows of the temporary plane that have not been
+    // filtered for this ROI (e.g., left over from the other ROI or a previous image).
+    const int y_min = std::max(0,(int)roi.y - col_filter_length / 2);
+    const int y_max = std::min(height,(int)(roi.y + roi.height) + col_filter_length / 2);
+    // The second pass starts at column out.y0 of the temporary plane, i.e. it writes row y of the image into row y - out.y0 of the output planes
+    // (the anchors of the column filter do not change, because out.y0 <= max(0,roi.y - col_filter_length/2)).
+    const T* tmp = tmpColMajor + out.y0;
+    const int tmp_width = height - out.y0;
+    const int tmp_roi_y = roi.y - out.y0;
+    // (a) Calculate Ly and Lyy
+    RowFilter(img,row_g,row_filter_length,tmpColMajor,buf_tmp_stride,roi.x,y_min,roi.width,y_max - y_min,false,true);
+    RowFilter(tmp,tmp_width,width,buf_tmp_stride,col_gp,col_filter_length,out.Ly,buf_stride,tmp_roi_y,roi.x,roi.height,roi.width,false,true);
+    RowFilter(tmp,tmp_width,width,buf_tmp_stride,col_gpp,col_filter_length,out.Lyy,buf_stride,tmp_roi_y,roi.x,roi.height,roi.width,false,true);
+    // (b) Calculate Lx and Lxy
+    RowFilter(img,row_gp,row_filter_length,tmpColMajor,buf_tmp_stride,roi.x,y_min,roi.width,y_max - y_min,false,true);
+    RowFilter(tmp,tmp_width,width,buf_tmp_stride,col_g,col_filter_length,out.Lx,buf_stride,tmp_roi_y,roi.x,roi.height,roi.width,false,true);
+    RowFilter(tmp,tmp_width,width,buf_tmp_stride,col_gp,col_filter_length,out.Lxy,buf_stride,tmp_roi_y,roi.x,roi.height,roi.width,false,true);
+    // (c) Calculate Lxx
+    RowFilter(img,row_gpp,row_filter_length,tmpColMajor,buf_tmp_stride,roi.x,y_min,roi.width,y_max - y_min,false,true);
+    RowFilter(tmp,tmp_width,width,buf_tmp_stride,col_g,col_filter_length,out.Lxx,buf_stride,tmp_roi_y,roi.x,roi.height,roi.width,false,true);
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+void
+IsophoteEyeCenterDetector<T>::FilterDerivatives(const ImageView<S>& img, const cv::Rect_<coord_t>& roi, const DerivativePlanes& out)
+{
+    if (!img.isColumnMajor() || derivative_filter == BoxDerivativeFilter || filter_shear != 0)
+    {
+        FilterDerivatives<ImageView<S> >(img,roi,out);
+        return;
+    }
+
+    const int width = img.width;
+    const int height = img.height;
+    const T *row_g = row_bank->g, *row_gp = row_bank->gp, *row_gpp = row_bank->gpp;
+    const T *col_g = col_bank->g, *col_gp = col_bank->gp, *col_gpp = col_bank->gpp;
+    const int row_filter_length = row_bank->length;
+    const int col_filter_length = col_bank->length;
+
+    // the columns are contiguous (e.g., MATLAB images), i.e. we swap the filter order: the column filter is applied first on the transposed view
+    // (its rows are the image columns) and writes a row-major temporary plane (tmpT1 is not used before CalculateIsophoteInformation), whose rows
+    // are then filtered by the row filter. Both passes read contiguous memory and no transposed copy of the image is necessary. The first pass
+    // covers the support of the row filter (see above).
+    const ImageView<S> timg = img.transposed();
+    const int x_min = std::max(0,(int)roi.x - row_filter_length / 2);
+    const int x_max = std::min(width,(int)(roi.x + roi.width) + row_filter_length / 2);
+    // the second pass starts at row out.y0 of the temporary plane, i.e. it writes row y of the image into row y - out.y0 of the output planes
+    const T* tmp = tmpT1 + (size_t)out.y0*buf_stride;
+    const int tmp_height = height - out.y0;
+    const int tmp_roi_y = roi.y - out.y0;
+    // (a) Calculate Lx and Lxx
+    RowFilter(timg,col_g,col_filter_length,tmpT1,buf_stride,roi.y,x_min,roi.height,x_max - x_min,false,true);
+    RowFilter(tmp,width,tmp_height,buf_stride,row_gp,row_filter_length,out.Lx,buf_stride,roi.x,tmp_roi_y,roi.width,roi.height,false,false);
+    RowFilter(tmp,width,tmp_height,buf_stride,row_gpp,row_filter_length,out.Lxx,buf_stride,roi.x,tmp_roi_y,roi.width,roi.height,false,false);
+    // (b) Calculate Ly and Lxy
+    RowFilter(timg,col_gp,col_filter_length,tmpT1,buf_stride,roi.y,x_min,roi.height,x_max - x_min,false,true);
+    RowFilter(tmp,width,tmp_height,buf_stride,row_g,row_filter_length,out.Ly,buf_stride,roi.x,tmp_roi_y,roi.width,roi.height,false,false);
+    RowFilter(tmp,width,tmp_height,buf_stride,row_gp,row_filter_length,out.Lxy,buf_stride,roi.x,tmp_roi_y,roi.width,roi.height,false,false);
+    // (c) Calculate Lyy
+    RowFilter(timg,col_gpp,col_filter_length,tmpT1,buf_stride,roi.y,x_min,roi.height,x_max - x_min,false,true);
+    RowFilter(tmp,width,tmp_height,buf_stride,row_g,row_filter_length,out.Lyy,buf_stride,roi.x,tmp_roi_y,roi.width,roi.height,false,false);
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+void
+IsophoteEyeCenterDetector<T>::FilterShearedDerivatives(const V& img, const cv::Rect_<coord_t>& roi, const DerivativePlanes& out)
+{
+    const int width = img.width;
+    const int height = img.height;
+    const T *row_g = row_bank->g, *row_gp = row_bank->gp, *row_gpp = row_bank->gpp;
+    const T *col_g = col_bank->g, *col_gp = col_bank->gp, *col_gpp = col_bank->gpp;
+    const int row_filter_length = row_bank->length;
+    const int col_filter_length = col_bank->length;
+    const T mu = filter_shear;
+
+    // the Gaussian is G(x,y) = g_row(x - mu*y)*g_col(y), i.e. the row filter writes a row-major temporary plane (tmpT1 is not used before
+    // CalculateIsophoteInformation) and the column filter runs along the lines (x + mu*t,y + t). The first pass covers the support of the
+    // sheared column filter, i.e. the rows and the horizontal reach of the shear around the ROI.
+    const int reach = (int)std::ceil(std::fabs(mu) * (col_filter_length / 2)) + 1;
+    const int x_min = std::max(0,(int)roi.x - reach);
+    const int x_max = std::min(width,(int)(roi.x + roi.width) + reach);
+    const int y_min = std::max(0,(int)roi.y - col_filter_length / 2);
+    const int y_max = std::min(height,(int)(roi.y + roi.height) + col_filter_length / 2);
+    // the second pass starts at row out.y0 of the temporary plane, i.e. it writes row y of the image into row y - out.y0 of the output planes
+    const T* tmp = tmpT1 + (size_t)out.y0*buf_stride;
+    const int tmp_height = height - out.y0;
+    const int tmp_roi_y = roi.y - out.y0;
+    // (a) Calculate Lt and Ltt (derivatives along the sheared columns) in Ly and Lyy
+    RowFilter(img,row_g,row_filter_length,tmpT1,buf_stride,x_min,y_min,x_max - x_min,y_max - y_min,false,false);
+    ShearedColumnFilter(tmp,width,tmp_height,buf_stride,col_gp,col_filter_length,mu,out.Ly,buf_stride,(int)roi.x,tmp_roi_y,(int)roi.width,(int)roi.height);
+    ShearedColumnFilter(tmp,width,tmp_height,buf_stride,col_gpp,col_filter_length,mu,out.Lyy,buf_stride,(int)roi.x,tmp_roi_y,(int)roi.width,(int)roi.height);
+    // (b) Calculate Lx and Lxt (in Lxy)
+    RowFilter(img,row_gp,row_filter_length,tmpT1,buf_stride,x_min,y_min,x_max - x_min,y_max - y_min,false,false);
+    ShearedColumnFilter(tmp,width,tmp_height,buf_stride,col_g,col_filter_length,mu,out.Lx,buf_stride,(int)roi.x,tmp_roi_y,(int)roi.width,(int)roi.height);
+    ShearedColumnFilter(tmp,width,tmp_height,buf_stride,col_gp,col_filter_length,mu,out.Lxy,buf_stride,(int)roi.x,tmp_roi_y,(int)roi.width,(int)roi.height);
+    // (c) Calculate Lxx
+    RowFilter(img,row_gpp,row_filter_length,tmpT1,buf_stride,x_min,y_min,x_max - x_min,y_max - y_min,false,false);
+    ShearedColumnFilter(tmp,width,tmp_height,buf_stride,col_g,col_filter_length,mu,out.Lxx,buf_stride,(int)roi.x,tmp_roi_y,(int)roi.width,(int)roi.height);
+    // (d) d/dy = d/dt - mu*d/dx, i.e. Ly = Lt - mu*Lx, Lxy = Lxt - mu*Lxx and Lyy = Ltt - 2*mu*Lxt + mu^2*Lxx
+    for (int y = tmp_roi_y; y < tmp_roi_y + (int)roi.height; y++)
+    {
+        const size_t row = (size_t)y*buf_stride;
+        T *_Lx = out.Lx + row, *_Ly = out.Ly + row, *_Lxx = out.Lxx + row, *_Lxy = out.Lxy + row, *_Lyy = out.Lyy + row;
+        for (int x = roi.x; x < roi.x + roi.width; x++)
+        {
+            const T lxt = _Lxy[x];
+            _Lyy[x] = _Lyy[x] - T(2)*mu*lxt + mu*mu*_Lxx[x];
+            _Lxy[x] = lxt - mu*_Lxx[x];
+            _Ly[x] = _Ly[x] - mu*_Lx[x];
+        }
+    }
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+void
+IsophoteEyeCenterDetector<T>::IntegralImageSetup(const V& img, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi)
+{
+    // one integral image for both ROIs and all derivatives: the bounding box of the ROIs plus the support of the boxes (the eye ROIs are close to
+    // each other, i.e. the bounding box is not much bigger than the ROIs)
+    cv::Rect_<coord_t> region;
+    if (left_roi.area() > 0)
+        region = left_roi;
+    if (right_roi.area() > 0)
+        region = (region.area() > 0 ? region | right_roi : right_roi);
+    region = cv::Rect_<coord_t>(region.x - row_box.support,region.y - col_box.support,region.width + 2*row_box.support,region.height + 2*col_box.support);
+    region &= cv::Rect_<coord_t>(0,0,img.width,img.height);
+
+    BENCHMARK_START("IntegralImage",IntegralImageStage);
+    integral_stride = GetPaddedStride<double>(region.width + 1);
+    integral_slab.reserve(sizeof(double)*(size_t)integral_stride*(region.height + 1));
+    CalculateIntegralImage(img,region.x,region.y,region.width,region.height,(double*)integral_slab.data(),integral_stride);
+    integral_region = region;
+    BENCHMARK_STOP("IntegralImage",IntegralImageStage,region.area());
+}
+
+template <typename T>
+void
+IsophoteEyeCenterDetector<T>::FilterBoxDerivatives(const cv::Rect_<coord_t>& roi, const DerivativePlanes& out)
+{
+    // the ROI is inside the integral image region (see IntegralImageSetup)
+    CalculateBoxDerivatives((const double*)integral_slab.data(),integral_stride,integral_region.x,integral_region.y,integral_region.width,integral_region.height,
+                            row_box,col_box,roi.x,roi.y,roi.width,roi.height,out.Lx,out.Ly,out.Lxx,out.Lxy,out.Lyy,buf_stride,out.y0);
+}
+
+/** Split b minus a into at most 4 rectangles (above, below, left and right of a); returns the number of rectangles. */
+static int
+SubtractRect(const cv::Rect& b, const cv::Rect& a, cv::Rect* out)
+{
+    const cv::Rect i = a & b;
+    if (i.area() <= 0)
+    {
+        out[0] = b;
+        return (b.area() > 0 ? 1 : 0);
+    }
+    int n = 0;
+    if (i.y > b.y)
+        out[n++] = cv::Rect(b.x,b.y,b.width,i.y - b.y);
+    if (i.y + i.height < b.y + b.height)
+        out[n++] = cv::Rect(b.x,i.y + i.height,b.width,(b.y + b.height) - (i.y + i.height));
+    if (i.x > b.x)
+        out[n++] = cv::Rect(b.x,i.y,i.x - b.x,i.height);
+    if (i.x + i.width < b.x + b.width)
+        out[n++] = cv::Rect(i.x + i.width,i.y,(b.x + b.width) - (i.x + i.width),i.height);
+    return n;
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+void
+IsophoteEyeCenterDetector<T>::ProcessFused(const V& img, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi)
+{
+    const int width = img.width;
+    const int height = img.height;
+    const int strip_height = 32; // rows per strip; only the ROI columns of the strip planes are touched, i.e. a strip of an eye ROI stays in the L1/L2 cache
+
+    BENCHMARK_START("FusedProcessing",FusedProcessingStage);
+    // only the selected isophote planes are written
+    T* out_k  = (output_planes & KOutputPlane  ? k : NULL);
+    T* out_c  = (output_planes & COutputPlane  ? c : NULL);
+    T* out_dx = (output_planes & DxOutputPlane ? dx : NULL);
+    T* out_dy = (output_planes & DyOutputPlane ? dy : NULL);
+    {
+        T* _acc = (T*)_ASSUME_ALIGNED(acc);
+        for (int i = 0; i < buf_stride*height; i++)
+            _acc[i] = T(0);
+        if (out_k != NULL) // k is zero outside of the ROIs (as in ProcessView)
+        {
+            T* _k = (T*)_ASSUME_ALIGNED(k);
+            for (int i = 0; i < buf_stride*height; i++)
+                _k[i] = T(0);
+        }
+    }
+
+    // every pixel of the ROIs votes once (as with the full-image voting of ProcessView), i.e. the overlap of the ROIs is only processed once
+    cv::Rect regions[5];
+    int num_regions = 0;
+    if (left_roi.area() > 0)
+        regions[num_regions++] = left_roi;
+    num_regions += SubtractRect(right_roi,left_roi,regions + num_regions);
+
+    if (output_planes & DerivativeOutputPlanes)
+    {
+        // the derivative planes are retained, i.e. the ROIs are filtered into the planes
+        FilterDerivatives(img,left_roi,GetImageDerivativePlanes());
+        FilterDerivatives(img,right_roi,GetImageDerivativePlanes());
+        for (int r = 0; r < num_regions; r++)
+            CalculateIsophoteAccumulator(Lx,Ly,Lxx,Lxy,Lyy,width,height,buf_stride,regions[r].x,regions[r].y,regions[r].width,regions[r].height,0,
+                                         acc,subpixel_precision,out_k,out_c,out_dx,out_dy);
+    }
+    else
+    {
+        // strips of rows: the derivatives of a strip are written into small planes (plus the support of the column filter above the strip)
+        const int strip_rows = strip_height + col_bank->length / 2;
+        const size_t strip_plane_bytes = AlignSize(sizeof(T)*(size_t)buf_stride*strip_rows);
+        strip_slab.reserve(5*strip_plane_bytes);
+        char* mem = (char*)strip_slab.data();
+        DerivativePlanes strip;
+        strip.Lx  = (T*)mem; mem += strip_plane_bytes;
+        strip.Ly  = (T*)mem; mem += strip_plane_bytes;
+        strip.Lxx = (T*)mem; mem += strip_plane_bytes;
+        strip.Lxy = (T*)mem; mem += strip_plane_bytes;
+        strip.Lyy = (T*)mem; mem += strip_plane_bytes;
+        for (int r = 0; r < num_regions; r++)
+        {
+            const cv::Rect& region = regions[r];
+            for (int y = region.y; y < region.y + region.height; y += strip_height)
+            {
+                const cv::Rect_<coord_t> strip_roi(region.x,y,region.width,std::min(strip_height,region.y + region.height - y));
+                strip.y0 = std::max(0,y - col_bank->length / 2);
+                FilterDerivatives(img,strip_roi,strip);
+                CalculateIsophoteAccumulator(strip.Lx,strip.Ly,strip.Lxx,strip.Lxy,strip.Lyy,width,height,buf_stride,
+                                             (int)strip_roi.x,(int)strip_roi.y - strip.y0,(int)strip_roi.width,(int)strip_roi.height,strip.y0,
+                                             acc,subpixel_precision,out_k,out_c,out_dx,out_dy);
+            }
+        }
+    }
+    BENCHMARK_STOP("FusedProcessing",FusedProcessingStage,left_roi.area() + right_roi.area());
+}
+
+template <typename T>
+T
+IsophoteEyeCenterDetector<T>::GetAccumulatorConcentration(int width, int height, const cv::Rect_<coord_t>& roi) const
+{
+    // same smoothing as in detectEyeCenters, but the accumulator outside of the ROI is not used (see SelectSigma)
+    const cv::Rect_<coord_t> valid_roi = roi & cv::Rect_<coord_t>(0,0,width,height);
+    if (valid_roi.area() <= 0)
+        return T(0); // e.g., an eye ROI outside of the image does not contribute to the score
+    cv::Mat macc(height,width,cv::DataType<T>::type,(void*)acc,buf_stride*sizeof(T));
+    cv::Mat smacc;
+    cv::GaussianBlur(macc(valid_roi),smacc,cv::Size(9,9),0,0,cv::BORDER_DEFAULT | cv::BORDER_ISOLATED);
+    double max_val = 0;
+    cv::minMaxLoc(smacc,NULL,&max_val,NULL,NULL);
+    const double sum = cv::sum(macc(valid_roi))[0];
+    return (sum > 0 ? T(max_val / sum) : T(0));
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+T
+IsophoteEyeCenterDetector<T>::SelectSigma(const V& img, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi)
+{
+    const int width = img.width;
+    const int height = img.height;
+    const int num_scales = std::max(auto_num_scales,1);
+    const int max_no_improvement = 2; // stop after the score did not improve for this many consecutive scales
+
+    // (Re-)Allocate memory if necessary
+    ReallocateImageMemory(width,height);
+
+    // geometrically spaced scales; scales below the quantization of the filter bank cannot be filtered, i.e. the range is clamped
+    const T min_sigma = std::max(auto_min_sigma,T(1) / T(GAUSS_FILTER_BANK_QUANTIZATION));
+    const T max_sigma = std::max(auto_max_sigma,min_sigma);
+    std::vector<T> sigmas(num_scales);
+    for (int i = 0; i < num_scales; i++)
+        sigmas[i] = (num_scales > 1 ? min_sigma * T(pow(double(max_sigma / min_sigma),double(i) / double(num_scales - 1))) : min_sigma);
+
+    // (incremental) blurs; blur_sigmas[i]^2 = sigmas[i]^2 - sigmas[i-1]^2
+    std::vector<T> blur_sigmas(num_scales);
+    for (int i = 0; i < num_scales; i++)
+        blur_sigmas[i] = (i == 0 ? sigmas[0] : T(sqrt(double(sigmas[i]*sigmas[i] - sigmas[i-1]*sigmas[i-1]))));
+
+    // every blur is only calculated inside a region around the ROIs, i.e. the values outside the region are not updated. Blur i needs valid values
+    // in its region expanded by its filter support, i.e. we expand the ROIs by the support of all following blurs (+1 for the central differences)
+    // and the regions shrink from scale to scale.
+    std::vector<int> margins(num_scales);
+    margins[num_scales-1] = 1;
+    for (int i = num_scales - 2; i >= 0; i--)
+        margins[i] = margins[i+1] + GetGaussLength<T,int>(blur_sigmas[i+1]) / 2;
+    const cv::Rect_<coord_t> image_rect(0,0,width,height);
+    cv::Rect_<coord_t> rois[2] = { left_roi & image_rect, right_roi & image_rect };
+    // overlapping regions would be blurred twice, i.e. we process the bounding box of the ROIs instead
+    int num_regions = 2;
+    cv::Rect_<coord_t> region_rois[2] = { rois[0], rois[1] };
+    {
+        const int m = margins[0];
+        const cv::Rect_<coord_t> left_region(rois[0].x - m,rois[0].y - m,rois[0].width + 2*m,rois[0].height + 2*m);
+        const cv::Rect_<coord_t> right_region(rois[1].x - m,rois[1].y - m,rois[1].width + 2*m,rois[1].height + 2*m);
+        if ((left_region & right_region).area() > 0)
+        {
+            region_rois[0] = rois[0] | rois[1];
+            num_regions = 1;
+        }
+    }
+
+    std::unique_ptr<GaussFilterBank<T> > overflow_bank; // only used if the filter bank cache is full
+    T best_sigma = sigmas[0];
+    T best_score = T(-1);
+    int no_improvement = 0;
+    for (int i = 0; i < num_scales; i++)
+    {
+        // get the (incremental) Gaussian; normalized, i.e. the blurs do not change the intensity level
+        const T sigma = sigmas[i];
+        const GaussFilterBank<T>* bank = GetGaussFilterBank(blur_sigmas[i],true,&overflow_bank);
+        if (bank == NULL)
+            continue; // the (quantized) scale equals the previous scale, i.e. Ls and the score do not change (the first scale is always valid, see above)
+        const T* scale_g = bank->g;
+        const int length = bank->length;
+
+        // L(sigma_i) = L(sigma_{i-1}) * G(blur_sigma), i.e. the image is only read for the first scale
+        for (int r = 0; r < num_regions; r++)
+        {
+            const int m = margins[i];
+            const cv::Rect_<coord_t> region = cv::Rect_<coord_t>(region_rois[r].x - m,region_rois[r].y - m,region_rois[r].width + 2*m,region_rois[r].height + 2*m) & image_rect;
+            // the column filter reads length/2 rows above and below the region, i.e. the row filter has to process these rows, too
+            const int y_min = std::max(0,(int)region.y - length / 2);
+            const int y_max = std::min(height,(int)(region.y + region.height) + length / 2);
+            if (i == 0)
+                RowFilter(img,scale_g,length,tmpColMajor,buf_tmp_stride,(int)region.x,y_min,(int)region.width,y_max - y_min,false,true);
+            else
+                RowFilter(ImageView<T>(Ls,width,height,buf_stride),scale_g,length,tmpColMajor,buf_tmp_stride,(int)region.x,y_min,(int)region.width,y_max - y_min,false,true);
+            RowFilter(tmpColMajor,height,width,buf_tmp_stride,scale_g,length,Ls,buf_stride,region.y,region.x,region.height,region.width,false,true);
+        }
+
+        // derivatives, isophotes and accumulator in the ROIs; the score only depends on the accumulator inside the ROIs, i.e. we can restrict the
+        // voting to the ROIs (votes outside of the ROI are dropped) and don't have to process the complete image
+        for (int r = 0; r < 2; r++)
+        {
+            const cv::Rect_<coord_t>& roi = rois[r];
+            if (roi.area() <= 0)
+                continue;
+            const size_t offset = (size_t)roi.y*buf_stride + roi.x;
+            CalculateDerivatives(Ls,width,height,buf_stride,Lx,Ly,Lxx,Lxy,Lyy,(int)roi.x,(int)roi.y,(int)roi.width,(int)roi.height);
+            CalculateIsophoteInformation(Lx,Ly,Lxx,Lxy,Lyy,width,height,buf_stride,k,c,dx,dy,(int)roi.x,(int)roi.y,(int)roi.width,(int)roi.height,tmpT1,tmpLx2,tmpLy2);
+            CalculateAccumulator(k + offset,c + offset,dx + offset,dy + offset,(int)roi.width,(int)roi.height,buf_stride,acc + offset,false,true);
+        }
+
+        // the raw accumulator peak is not comparable across scales (the curvedness decays and the number of voting pixels grows with sigma), i.e.
+        // we use the fraction of the votes that end up in the peak, which does not depend on the scale or the contrast
+        const T score = GetAccumulatorConcentration(width,height,rois[0]) + GetAccumulatorConcentration(width,height,rois[1]);
+        if (score > best_score)
+        {
+            best_score = score;
+            best_sigma = sigma;
+            no_improvement = 0;
+        }
+        else if (++no_improvement >= max_no_improvement)
+            break;
+    }
+
+    return best_sigma;
+}
+
 template <typename T> // for the class
 template <typename S> // for the method
 EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t> // yay, nasty template shit
 IsophoteEyeCenterDetector<T>::detectEyeCenters(const S* img, int width, int height, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye)
 {
+    return detectEyeCenters(ImageView<S>(img,width,height),face_box,left_eye,right_eye);
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t> // yay, nasty template shit
+IsophoteEyeCenterDetector<T>::detectEyeCenters(const ImageView<S>& img, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye)
+{
+    return DetectEyeCentersView(img,face_box,left_eye,right_eye,GetEyeRollAngle(left_eye,right_eye));
+}
+
+template <typename T> // for the class
+template <typename S> // for the method
+EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t> // yay, nasty template shit
+IsophoteEyeCenterDetector<T>::detectEyeCenters(const ColorImageView<S>& img, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye)
+{
+    return DetectEyeCentersView(img,face_box,left_eye,right_eye,GetEyeRollAngle(left_eye,right_eye));
+}
+
+/** Get the value of element (x,y) of a single channel float or double matrix. */
+static inline double
+GetMatValue(const cv::Mat& m, int x, int y)
+{
+    return (m.depth() == CV_64F ? m.at<double>(y,x) : (double)m.at<float>(y,x));
+}
+
+/** Refine the position of the maximum p of the (smoothed) accumulator with a quadratic fit of the 3x3 neighborhood (separately in x and y). The
+ *  offset is limited to +-0.5, i.e. the refined position is inside of the pixel of the maximum.
+ */
+template <typename R>
+static cv::Point_<R>
+RefineAccumulatorMaximum(const cv::Mat& smacc, const cv::Point& p)
+{
+    double offset[2] = { 0, 0 };
+    for (int d = 0; d < 2; d++)
+    {
+        const int dx = (d == 0 ? 1 : 0);
+        const int dy = 1 - dx;
+        if (p.x - dx < 0 || p.y - dy < 0 || p.x + dx >= smacc.cols || p.y + dy >= smacc.rows)
+            continue;
+        const double l = GetMatValue(smacc,p.x - dx,p.y - dy);
+        const double c = GetMatValue(smacc,p.x,p.y);
+        const double r = GetMatValue(smacc,p.x + dx,p.y + dy);
+        const double curvature = l - 2*c + r;
+        if (curvature < 0)
+            offset[d] = std::max(-0.5,std::min(0.5,0.5*(l - r) / curvature));
+    }
+    return cv::Point_<R>(R(p.x + offset[0]),R(p.y + offset[1]));
+}
+
+/** Estimate the roll angle of the face from the eye locations, i.e. the angle of the eye line (clockwise in image coordinates, in (-pi/2,pi/2]). */
+template <typename T>
+static T
+GetRollAngle(const cv::Point& left_eye, const cv::Point& right_eye)
+{
+    T angle = (T)std::atan2((double)(right_eye.y - left_eye.y),(double)(right_eye.x - left_eye.x));
+    // the eye line has no direction, i.e. the order of the eyes does not matter
+    if (angle > T(CV_PI/2))
+        angle -= T(CV_PI);
+    else if (angle <= -T(CV_PI/2))
+        angle += T(CV_PI);
+    return angle;
+}
+
+template <typename T>
+T
+IsophoteEyeCenterDetector<T>::GetEyeRollAngle(const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye) const
+{
+    if (!rotation_aware || !isValidCoord(left_eye) || !isValidCoord(right_eye))
+        return T(0);
+    return GetRollAngle<T>(left_eye,right_eye);
+}
+
+/** Rotate the offset (u,v) in the frame of the face by angle (see GetRollAngle) into image coordinates. */
+template <typename T>
+static inline cv::Point_<T>
+RotateOffset(T u, T v, T angle)
+{
+    const T c = std::cos(angle);
+    const T s = std::sin(angle);
+    return cv::Point_<T>(c*u - s*v,s*u + c*v);
+}
+
+/** Get the bounding box of the eye ROI (see GetEyeROI) rotated by angle around the eye location, in the format of GetEyeROI (i.e. x/y is the
+ *  position of the eye location in the box).
+ */
+template <typename T>
+static cv::Rect
+GetRotatedEyeROI(const cv::Rect& eye_roi, T angle)
+{
+    // corners of the ROI pixels relative to the eye location
+    const T u[2] = { T(-eye_roi.x), T(eye_roi.width - 1 - eye_roi.x) };
+    const T v[2] = { T(-eye_roi.y), T(eye_roi.height - 1 - eye_roi.y) };
+    T min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        const cv::Point_<T> p = RotateOffset(u[i & 1],v[i >> 1],angle);
+        min_x = (i == 0 ? p.x : std::min(min_x,p.x));
+        max_x = (i == 0 ? p.x : std::max(max_x,p.x));
+        min_y = (i == 0 ? p.y : std::min(min_y,p.y));
+        max_y = (i == 0 ? p.y : std::max(max_y,p.y));
+    }
+    return cv::Rect(-cvFloor(min_x),-cvFloor(min_y),cvCeil(max_x) - cvFloor(min_x) + 1,cvCeil(max_y) - cvFloor(min_y) + 1);
+}
+
+/** Get the eye ROI (see GetEyeROI) rotated by angle around the eye location. */
+template <typename T>
+static cv::RotatedRect
+GetOrientedEyeROI(const cv::Point& eye, const cv::Rect& eye_roi, T angle)
+{
+    const cv::Point_<T> center = RotateOffset(T(eye_roi.width - 1) / 2 - eye_roi.x,T(eye_roi.height - 1) / 2 - eye_roi.y,angle);
+    return cv::RotatedRect(cv::Point2f((float)(eye.x + center.x),(float)(eye.y + center.y)),cv::Size2f((float)eye_roi.width,(float)eye_roi.height),
+                           (float)(angle * T(180 / CV_PI)));
+}
+
+/** Mask of the pixels of roi that are inside the eye ROI rotated by angle around the eye location (see GetRotatedEyeROI). */
+template <typename T>
+static cv::Mat
+GetOrientedEyeROIMask(const cv::Rect& roi, const cv::Point& eye, const cv::Rect& eye_roi, T angle)
+{
+    cv::Mat mask(roi.height,roi.width,CV_8UC1);
+    for (int y = 0; y < roi.height; y++)
+        for (int x = 0; x < roi.width; x++)
+        {
+            // the pixel offset in the frame of the face
+            const cv::Point_<T> p = RotateOffset(T(roi.x + x - eye.x),T(roi.y + y - eye.y),-angle);
+            const bool inside = (p.x >= -eye_roi.x - T(0.5) && p.x < eye_roi.width - eye_roi.x - T(0.5) &&
+                                 p.y >= -eye_roi.y - T(0.5) && p.y < eye_roi.height - eye_roi.y - T(0.5));
+            mask.at<uint8_t>(y,x) = (inside ? 255 : 0);
+        }
+    return mask;
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t> // yay, nasty template shit
+IsophoteEyeCenterDetector<T>::DetectEyeCentersView(const V& img, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                                   T roll_angle)
+{
+    const int width = img.width;
+    const int height = img.height;
+
     EyeCenterLocations<coord_t> result(cv::Point_<coord_t>(-1,-1),cv::Point_<coord_t>(-1,-1));
+    current_width = current_height = 0; // the planes of this detector are not updated by the canonical detection
 
     // calculate ROI's
     bool has_face_box      = isValidCoord(face_box);  // do we have a valid face box?
     bool has_left_eye_loc  = isValidCoord(left_eye);  // do we have a pre-estimated left eye location?
     bool has_right_eye_loc = isValidCoord(right_eye); // do we have a pre-estimated right eye location?
+    // big faces: detection at the canonical scale (if enabled)
+    if (canonical_iod > 0)
+    {
+        const T iod_per_face_width = T(0.4); // typical ratio of frontal face detectors (e.g., Viola-Jones)
+        T iod = 0;
+        if (has_left_eye_loc && has_right_eye_loc)
+            iod = (T)cv::norm(right_eye - left_eye);
+        else if (has_face_box)
+            iod = face_box.width * iod_per_face_width;
+        if (iod > canonical_iod)
+            return DetectEyeCentersCanonical(img,canonical_iod / iod,face_box,left_eye,right_eye,roll_angle);
+    }
+    // no eye locations: coarse-to-fine search (if enabled and the downsampled search region is big enough)
+    if (coarse_factor > 1 && !has_left_eye_loc && !has_right_eye_loc)
+    {
+        const int min_coarse_size = 16;
+        const cv::Rect_<coord_t> image_rect(0,0,width,height);
+        const cv::Rect_<coord_t> region = (has_face_box ? face_box & image_rect : image_rect);
+        if (region.width / coarse_factor >= min_coarse_size && region.height / coarse_factor >= min_coarse_size)
+            return DetectEyeCentersCoarseToFine(img,region,face_box);
+    }
+
     cv::Rect left_roi(0,0,width,height);  // default ROI: the complete image
     cv::Rect right_roi(0,0,width,height); // default ROI: the complete image
-    cv::Rect eye_roi;
-    if (isValidCoord(manual_eye_roi))
-        eye_roi = manual_eye_roi; // did someone set an eye ROI?
-    else
-        eye_roi = cv::Rect(24,24,48,36); // general size of the region of interest around pre-detected eye locations; @TODO: automatical calculation/estimation of best eye ROI
+    const cv::Rect oriented_eye_roi = GetEyeROI(face_box,has_face_box);
+    // rotation-aware processing: the eye ROIs are rotated with the face, i.e. the derivatives are calculated in the bounding boxes of the rotated ROIs
+    if (!has_left_eye_loc || !has_right_eye_loc)
+        roll_angle = T(0);
+    const cv::Rect eye_roi = (roll_angle != 0 ? GetRotatedEyeROI(oriented_eye_roi,roll_angle) : oriented_eye_roi);
     // simple version => use the face box and ROI around detected eyes
     if (has_face_box)
     {
@@ -333,11 +1003,6 @@ IsophoteEyeCenterDetector<T>::detectEyeCenters(const S* img, int width, int heig
             std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: Warning - left eye location is not inside the face box!" << std::endl;
         if (has_right_eye_loc && !isValidCoord(right_eye,face_box))
             std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: Warning - right eye location is not inside the face box!" << std::endl;
-
-        eye_roi.width = std::min(eye_roi.width,(int)face_box.width/2);
-        eye_roi.height = std::min(eye_roi.height,(int)face_box.height/3);
-        eye_roi.x = eye_roi.width / 2;
-        eye_roi.y = eye_roi.height / 2;
     }
     if (has_left_eye_loc)
     {
@@ -353,22 +1018,36 @@ IsophoteEyeCenterDetector<T>::detectEyeCenters(const S* img, int width, int heig
         right_roi.width = eye_roi.width;
         right_roi.height = eye_roi.height;
     }
+    // without an eye location, the search region is the (unrotated) face box or image, i.e. the rotated ROI is the ROI itself
+    current_left_oriented_roi = (has_left_eye_loc ? GetOrientedEyeROI(left_eye,oriented_eye_roi,roll_angle) : GetOrientedEyeROI(left_roi.tl(),cv::Rect(0,0,left_roi.width,left_roi.height),T(0)));
+    current_right_oriented_roi = (has_right_eye_loc ? GetOrientedEyeROI(right_eye,oriented_eye_roi,roll_angle) : GetOrientedEyeROI(right_roi.tl(),cv::Rect(0,0,right_roi.width,right_roi.height),T(0)));
+    // eye locations near the image border (e.g., candidates of the coarse-to-fine search)
+    left_roi &= cv::Rect(0,0,width,height);
+    right_roi &= cv::Rect(0,0,width,height);
 
     // process the image
     T row_sigma = 1;
     T col_sigma = 1;
     if (manual_row_sigma > 0)
+    {
         row_sigma = manual_row_sigma;
+        col_sigma = (manual_col_sigma > 0 ? manual_col_sigma : manual_row_sigma);
+    }
     else
-        row_sigma = 1; // @TODO: automatically calculate the "best" row sigma
-    if (manual_col_sigma > 0)
-        col_sigma = manual_col_sigma;
-    else
-        col_sigma = 1; // @TODO: automatically calculate the "best" col sigma
-    process(img,width,height,row_sigma,col_sigma,left_roi,right_roi);
+    {
+        BENCHMARK_START("SelectSigma",ScaleSelectionStage);
+        row_sigma = col_sigma = SelectSigma(img,left_roi,right_roi); // automatically calculate the "best" (isotropic) sigma
+        BENCHMARK_STOP("SelectSigma",ScaleSelectionStage,left_roi.area() + right_roi.area());
+    }
+    process(img,row_sigma,col_sigma,left_roi,right_roi,roll_angle);
+    if (current_width != width || current_height != height) // the image could not be processed
+    {
+        subpixel_centers = EyeCenterLocations<T>(result.left,result.right);
+        return result;
+    }
     
     // Process accumulator in order to detect eye center hypotheses
-    BENCHMARK_START("AccumulatorProcessing");
+    BENCHMARK_START("AccumulatorProcessing",AccumulatorProcessingStage);
     cv::Mat macc = getMatAcc();
     cv::Mat smacc; // smoothed accumulator
     double accumulator_row_sigma=0;
@@ -376,41 +1055,380 @@ IsophoteEyeCenterDetector<T>::detectEyeCenters(const S* img, int width, int heig
     cv::GaussianBlur(macc,smacc,cv::Size(9,9),accumulator_row_sigma,accumulator_col_sigma);
     cv::Point left_max_loc;
     cv::Point right_max_loc;
+    cv::Mat left_mask, right_mask; // rotated eye ROIs inside the processed bounding boxes (see setRotationAware)
+    if (roll_angle != 0)
+    {
+        left_mask = GetOrientedEyeROIMask(left_roi,left_eye,oriented_eye_roi,roll_angle);
+        right_mask = GetOrientedEyeROIMask(right_roi,right_eye,oriented_eye_roi,roll_angle);
+        if (cv::countNonZero(left_mask) == 0) // the rotated ROI is outside of the image
+            left_mask = cv::Mat();
+        if (cv::countNonZero(right_mask) == 0)
+            right_mask = cv::Mat();
+    }
     cv::Mat lrsmacc = smacc(left_roi); // ROI of the smoothed accumulator for the left eye
-    cv::minMaxLoc(lrsmacc,NULL,NULL,NULL,&left_max_loc);
+    cv::minMaxLoc(lrsmacc,NULL,NULL,NULL,&left_max_loc,left_mask);
     cv::Mat rrsmacc = smacc(right_roi); // ROI of the smoothed accumulator for the right eye
-    cv::minMaxLoc(rrsmacc,NULL,NULL,NULL,&right_max_loc);
+    cv::minMaxLoc(rrsmacc,NULL,NULL,NULL,&right_max_loc,right_mask);
     left_max_loc.x += left_roi.x;
     left_max_loc.y += left_roi.y;
     right_max_loc.x += right_roi.x;
     right_max_loc.y += right_roi.y;
     result.left = left_max_loc;
     result.right = right_max_loc;
-    BENCHMARK_STOP("AccumulatorProcessing");
+    if (subpixel_precision)
+        subpixel_centers = EyeCenterLocations<T>(RefineAccumulatorMaximum<T>(smacc,left_max_loc),RefineAccumulatorMaximum<T>(smacc,right_max_loc));
+    else
+        subpixel_centers = EyeCenterLocations<T>(result.left,result.right);
+    BENCHMARK_STOP("AccumulatorProcessing",AccumulatorProcessingStage,width*height);
     
     return result;
 }
 
+template <typename T>
+cv::Rect_<typename IsophoteEyeCenterDetector<T>::coord_t>
+IsophoteEyeCenterDetector<T>::GetEyeROI(const cv::Rect_<coord_t>& face_box, bool has_face_box) const
+{
+    cv::Rect_<coord_t> eye_roi;
+    if (isValidCoord(manual_eye_roi))
+        eye_roi = manual_eye_roi; // did someone set an eye ROI?
+    else
+        eye_roi = cv::Rect_<coord_t>(24,24,48,36); // general size of the region of interest around pre-detected eye locations; @TODO: automatical calculation/estimation of best eye ROI
+    if (has_face_box)
+    {
+        eye_roi.width = std::min(eye_roi.width,(coord_t)face_box.width/2);
+        eye_roi.height = std::min(eye_roi.height,(coord_t)face_box.height/3);
+        eye_roi.x = eye_roi.width / 2;
+        eye_roi.y = eye_roi.height / 2;
+    }
+    return eye_roi;
+}
+
+template <typename T>
+T
+IsophoteEyeCenterDetector<T>::GetSmoothedAccumulatorValue(const cv::Point_<coord_t>& p, cv::Point_<T>* subpixel_p) const
+{
+    // the 9x9 Gaussian of detectEyeCenters only depends on the 9x9 neighborhood, i.e. it is sufficient to smooth a small patch around p (the
+    // 3x3 neighborhood of the sub-pixel refinement is still inside the valid part of the patch)
+    const int r = 8;
+    const cv::Rect_<coord_t> patch = cv::Rect_<coord_t>(p.x - r,p.y - r,2*r + 1,2*r + 1) & cv::Rect_<coord_t>(0,0,current_width,current_height);
+    if (acc == NULL || !isValidCoord(p,patch))
+        return T(-1);
+    cv::Mat smacc;
+    cv::GaussianBlur(getMatAcc()(patch),smacc,cv::Size(9,9),0,0);
+    double value = 0;
+    cv::minMaxLoc(smacc(cv::Rect(p.x - patch.x,p.y - patch.y,1,1)),NULL,&value,NULL,NULL);
+    if (subpixel_p != NULL)
+    {
+        if (subpixel_precision)
+            *subpixel_p = RefineAccumulatorMaximum<T>(smacc,cv::Point(p.x - patch.x,p.y - patch.y)) + cv::Point_<T>(T(patch.x),T(patch.y));
+        else
+            *subpixel_p = cv::Point_<T>(T(p.x),T(p.y));
+    }
+    return T(value);
+}
+
+/** Get the (luma) value of pixel (x,y) of an image view. */
+template <typename R, typename S>
+static inline R
+GetPixelValue(const ImageView<S>& img, int x, int y)
+{
+    return R(img(x,y));
+}
+
+template <typename R, typename S>
+static inline R
+GetPixelValue(const ColorImageView<S>& img, int x, int y)
+{
+    return img.template luma<R>(img.row(y) + x*img.pixel_step);
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t>
+IsophoteEyeCenterDetector<T>::DetectEyeCentersCoarseToFine(const V& img, const cv::Rect_<coord_t>& region, const cv::Rect_<coord_t>& face_box)
+{
+    const int f = coarse_factor;
+    const int coarse_width = region.width / f;
+    const int coarse_height = region.height / f;
+
+    // 1. downsample the search region (f x f box average)
+    BENCHMARK_START("Downsampling",DownsamplingStage);
+    resampled_image.resize((size_t)coarse_width*coarse_height);
+    const T norm = T(1) / T(f*f);
+    for (int cy = 0; cy < coarse_height; cy++)
+        for (int cx = 0; cx < coarse_width; cx++)
+        {
+            T sum = T(0);
+            for (int y = region.y + cy*f; y < region.y + (cy + 1)*f; y++)
+                for (int x = region.x + cx*f; x < region.x + (cx + 1)*f; x++)
+                    sum += GetPixelValue<T>(img,x,y);
+            resampled_image[(size_t)cy*coarse_width + cx] = sum * norm;
+        }
+    BENCHMARK_STOP("Downsampling",DownsamplingStage,region.area());
+
+    // 2. detect at the coarse resolution; the sigmas shrink with the resolution
+    IsophoteEyeCenterDetector<T>& coarse_detector = GetResampledDetector(T(1) / f);
+    const cv::Rect_<coord_t> coarse_rect(0,0,coarse_width,coarse_height);
+    coarse_detector.DetectEyeCentersView(ImageView<T>(&resampled_image[0],coarse_width,coarse_height),coarse_rect,getInvalidCoordPoint(),getInvalidCoordPoint(),T(0));
+
+    // 3. the candidates are the strongest peaks of the smoothed coarse accumulator; the next candidate has to be outside of the eye ROI of the
+    //    previous candidates (non-maximum suppression)
+    const cv::Rect_<coord_t> eye_roi = GetEyeROI(face_box,isValidCoord(face_box));
+    const int smoothing_size = std::max(3,(9 / f) | 1);
+    cv::Mat smacc;
+    cv::GaussianBlur(coarse_detector.getMatAcc(),smacc,cv::Size(smoothing_size,smoothing_size),0,0);
+    std::vector<cv::Point_<coord_t> > candidates;
+    for (int i = 0; i < coarse_candidates; i++)
+    {
+        double max_val = 0;
+        cv::Point max_loc;
+        cv::minMaxLoc(smacc,NULL,&max_val,NULL,&max_loc);
+        if (i > 0 && max_val <= 0)
+            break;
+        candidates.push_back(cv::Point_<coord_t>(region.x + max_loc.x*f + f/2,region.y + max_loc.y*f + f/2)); // center of the f x f block
+        const cv::Rect suppressed(max_loc.x - eye_roi.width/(2*f),max_loc.y - eye_roi.height/(2*f),eye_roi.width/f + 1,eye_roi.height/f + 1);
+        smacc(suppressed & cv::Rect(0,0,smacc.cols,smacc.rows)).setTo(cv::Scalar(-1));
+    }
+
+    // 4. refine every candidate at full resolution in the eye ROI around it. All candidates are processed with the same sigma, i.e. the sigma of
+    //    the coarse detection scaled to full resolution (or the manual sigma), and without rotation (the candidates are no eye pair), i.e. their
+    //    accumulator values are comparable
+    const T row_sigma = (manual_row_sigma > 0 ? manual_row_sigma : coarse_detector.getRowSigma() * f);
+    const T col_sigma = (manual_row_sigma > 0 ? (manual_col_sigma > 0 ? manual_col_sigma : manual_row_sigma) : coarse_detector.getColSigma() * f);
+    const cv::Rect_<coord_t> image_rect(0,0,img.width,img.height);
+    std::vector<cv::Point_<coord_t> > refined;
+    std::vector<cv::Point_<T> > refined_subpixel;
+    std::vector<T> values;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const cv::Rect_<coord_t> roi = cv::Rect_<coord_t>(candidates[i].x - eye_roi.x,candidates[i].y - eye_roi.y,eye_roi.width,eye_roi.height) & image_rect;
+        if (roi.area() <= 0)
+            continue;
+        ProcessView(img,row_sigma,col_sigma,roi,roi,T(0),true); // the overlap of the ROIs votes once, i.e. the ROI votes once
+        const cv::Point_<coord_t> p = locateAccumulatorMaximum(roi);
+        if (!isValidCoord(p)) // the image could not be processed
+            continue;
+        cv::Point_<T> subpixel_p;
+        const T value = GetSmoothedAccumulatorValue(p,&subpixel_p);
+        refined.push_back(p);
+        refined_subpixel.push_back(subpixel_p);
+        values.push_back(value);
+    }
+
+    // 5. the two strongest refined candidates; refined candidates that converged to the same eye (inside the eye ROI of a stronger one) are skipped
+    int best[2] = { -1, -1 };
+    for (size_t i = 0; i < refined.size(); i++)
+        if (best[0] < 0 || values[i] > values[best[0]])
+            best[0] = (int)i;
+    for (size_t i = 0; i < refined.size() && best[0] >= 0; i++)
+    {
+        const cv::Point_<coord_t> d = refined[i] - refined[best[0]];
+        if (std::abs(d.x) <= eye_roi.width/2 && std::abs(d.y) <= eye_roi.height/2)
+            continue;
+        if (best[1] < 0 || values[i] > values[best[1]])
+            best[1] = (int)i;
+    }
+    EyeCenterLocations<coord_t> result(cv::Point_<coord_t>(-1,-1),cv::Point_<coord_t>(-1,-1));
+    if (best[0] < 0)
+    {
+        subpixel_centers = EyeCenterLocations<T>(cv::Point_<T>(-1,-1),cv::Point_<T>(-1,-1));
+        return result;
+    }
+    if (best[1] < 0)
+        best[1] = best[0];
+    else if (refined[best[1]].x > refined[best[0]].x)
+        std::swap(best[0],best[1]); // the left eye of the subject is on the right side of the image
+    result = EyeCenterLocations<coord_t>(refined[best[0]],refined[best[1]]);
+    subpixel_centers = EyeCenterLocations<T>(refined_subpixel[best[0]],refined_subpixel[best[1]]);
+    return result;
+}
+
+template <typename T>
+IsophoteEyeCenterDetector<T>&
+IsophoteEyeCenterDetector<T>::GetResampledDetector(T sigma_scale)
+{
+    if (!resampled_detector)
+        resampled_detector.reset(new IsophoteEyeCenterDetector<T>());
+    const T min_sigma = T(0.5);
+    if (manual_row_sigma > 0)
+        resampled_detector->setSigma(std::max(manual_row_sigma * sigma_scale,min_sigma),std::max(manual_col_sigma * sigma_scale,min_sigma));
+    else
+    {
+        resampled_detector->setAutoSigma();
+        resampled_detector->setAutoSigmaRange(std::max(auto_min_sigma * sigma_scale,min_sigma),std::max(auto_max_sigma * sigma_scale,min_sigma),auto_num_scales);
+    }
+    resampled_detector->setEyeROI(manual_eye_roi);
+    resampled_detector->setAccumulatorPrecision(accumulator_precision,accumulator_threads);
+    resampled_detector->setCoarseToFine(0);
+    resampled_detector->setSubpixelPrecision(subpixel_precision);
+    resampled_detector->setOutputPlanes(output_planes);
+    resampled_detector->setDerivativeFilter(derivative_filter);
+    resampled_detector->setRotationAware(rotation_aware);
+    return *resampled_detector;
+}
+
+/** Get the weights of the area resampling of n_in samples to n_out = floor(n_in*scale) samples, i.e. output sample i is the average of the input
+ *  interval [i/scale,(i+1)/scale). The weights of output sample i belong to the input samples first[i],first[i]+1,... (max_num weights per sample).
+ */
+template <typename T>
+static void
+GetAreaResamplingWeights(int n_in, int n_out, T scale, std::vector<int>& first, std::vector<T>& weights, int& max_num)
+{
+    const T inv_scale = T(1) / scale;
+    max_num = (int)std::ceil(inv_scale) + 1;
+    first.resize(n_out);
+    weights.assign((size_t)n_out*max_num,T(0));
+    for (int i = 0; i < n_out; i++)
+    {
+        const T a = i*inv_scale;
+        const T b = std::min((i + 1)*inv_scale,(T)n_in);
+        first[i] = std::min((int)a,n_in - 1);
+        for (int j = first[i], n = 0; j < b && n < max_num; j++, n++)
+            weights[(size_t)i*max_num + n] = (std::min(b,T(j + 1)) - std::max(a,T(j))) * scale;
+    }
+}
+
+template <typename T> // for the class
+template <typename V> // for the method
+EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t>
+IsophoteEyeCenterDetector<T>::DetectEyeCentersCanonical(const V& img, T scale, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                                        T roll_angle)
+{
+    const cv::Rect_<coord_t> image_rect(0,0,img.width,img.height);
+    const bool has_face_box = isValidCoord(face_box);
+    const bool has_eye_locs = isValidCoord(left_eye) && isValidCoord(right_eye);
+
+    // 1. the resampled region: with both eye locations, the eye ROIs (in canonical pixels) plus the support of the filters; otherwise the face box
+    cv::Rect_<coord_t> region = face_box & image_rect;
+    cv::Rect_<coord_t> canonical_eye_roi;
+    if (has_eye_locs)
+    {
+        const cv::Rect_<coord_t> canonical_face_box(0,0,(coord_t)(face_box.width * scale),(coord_t)(face_box.height * scale));
+        canonical_eye_roi = GetEyeROI(canonical_face_box,has_face_box);
+        // the resampled detector rotates the eye ROI with the face (the resampling does not change the roll angle)
+        const cv::Rect_<coord_t> region_eye_roi = (roll_angle != 0 ? GetRotatedEyeROI(canonical_eye_roi,roll_angle) : canonical_eye_roi);
+        const T max_sigma = (manual_row_sigma > 0 ? std::max(manual_row_sigma,manual_col_sigma) : auto_max_sigma);
+        const int margin = GetGaussLength<T,int>(max_sigma) / 2 + 1;
+        const cv::Point_<coord_t> eyes[2] = { left_eye, right_eye };
+        for (int i = 0; i < 2; i++)
+        {
+            const cv::Rect_<coord_t> roi((coord_t)std::floor(eyes[i].x - (region_eye_roi.x + margin) / scale),
+                                         (coord_t)std::floor(eyes[i].y - (region_eye_roi.y + margin) / scale),
+                                         (coord_t)std::ceil((region_eye_roi.width + 2*margin) / scale),
+                                         (coord_t)std::ceil((region_eye_roi.height + 2*margin) / scale));
+            region = (i == 0 ? roi : region | roi);
+        }
+        region &= image_rect;
+    }
+    const int canonical_width = (int)(region.width * scale);
+    const int canonical_height = (int)(region.height * scale);
+    if (canonical_width <= 0 || canonical_height <= 0)
+    {
+        subpixel_centers = EyeCenterLocations<T>();
+        return EyeCenterLocations<coord_t>();
+    }
+
+    // 2. resample the region (area average, i.e. every pixel of the region is read once or twice)
+    BENCHMARK_START("Downsampling",DownsamplingStage);
+    std::vector<int> first_x, first_y;
+    std::vector<T> weights_x, weights_y;
+    int num_x = 0, num_y = 0;
+    GetAreaResamplingWeights(region.width,canonical_width,scale,first_x,weights_x,num_x);
+    GetAreaResamplingWeights(region.height,canonical_height,scale,first_y,weights_y,num_y);
+    resampled_image.assign((size_t)canonical_width*canonical_height,T(0));
+    for (int cy = 0; cy < canonical_height; cy++)
+    {
+        T* out = &resampled_image[(size_t)cy*canonical_width];
+        for (int j = 0; j < num_y && first_y[cy] + j < region.height; j++)
+        {
+            const T wy = weights_y[(size_t)cy*num_y + j];
+            if (wy <= 0)
+                continue;
+            const int y = region.y + first_y[cy] + j;
+            for (int cx = 0; cx < canonical_width; cx++)
+            {
+                T sum = T(0);
+                for (int i = 0; i < num_x && first_x[cx] + i < region.width; i++)
+                    sum += weights_x[(size_t)cx*num_x + i] * GetPixelValue<T>(img,region.x + first_x[cx] + i,y);
+                out[cx] += wy * sum;
+            }
+        }
+    }
+    BENCHMARK_STOP("Downsampling",DownsamplingStage,region.area());
+
+    // 3. detect at the canonical scale (the sigmas and the eye ROI are in canonical pixels)
+    IsophoteEyeCenterDetector<T>& canonical_detector = GetResampledDetector(T(1));
+    canonical_detector.setCoarseToFine(coarse_factor,coarse_candidates);
+    cv::Rect_<coord_t> canonical_face_box = getInvalidCoordRect();
+    if (has_eye_locs)
+        canonical_detector.setEyeROI(canonical_eye_roi); // already limited by the face box
+    else
+        canonical_face_box = cv::Rect_<coord_t>(0,0,canonical_width,canonical_height);
+    cv::Point_<coord_t> canonical_eyes[2] = { left_eye, right_eye };
+    for (int i = 0; i < 2; i++)
+        if (isValidCoord(canonical_eyes[i]))
+            canonical_eyes[i] = cv::Point_<coord_t>((coord_t)cvRound((canonical_eyes[i].x - region.x + T(0.5)) * scale - T(0.5)),
+                                                    (coord_t)cvRound((canonical_eyes[i].y - region.y + T(0.5)) * scale - T(0.5)));
+    canonical_detector.DetectEyeCentersView(ImageView<T>(&resampled_image[0],canonical_width,canonical_height),canonical_face_box,canonical_eyes[0],canonical_eyes[1],
+                                            (has_eye_locs ? roll_angle : T(0)));
+
+    // 4. map the (pixel centers of the) canonical locations back to the image
+    const EyeCenterLocations<T>& canonical_centers = canonical_detector.getEyeCentersSubpixel();
+    const cv::Point_<T> centers[2] = { canonical_centers.left, canonical_centers.right };
+    cv::Point_<T> mapped[2] = { cv::Point_<T>(-1,-1), cv::Point_<T>(-1,-1) };
+    for (int i = 0; i < 2; i++)
+        if (centers[i].x >= 0 && centers[i].y >= 0)
+            mapped[i] = cv::Point_<T>(region.x + (centers[i].x + T(0.5)) / scale - T(0.5),region.y + (centers[i].y + T(0.5)) / scale - T(0.5));
+    subpixel_centers = EyeCenterLocations<T>(mapped[0],mapped[1]);
+    cv::Point_<coord_t> rounded[2];
+    for (int i = 0; i < 2; i++)
+        rounded[i] = cv::Point_<coord_t>(cvRound(mapped[i].x),cvRound(mapped[i].y));
+    return EyeCenterLocations<coord_t>(rounded[0],rounded[1]);
+}
+
 template <typename T>
 EyeCenterLocations<typename IsophoteEyeCenterDetector<T>::coord_t> // yay, nasty template shit
 IsophoteEyeCenterDetector<T>::detectEyeCenters(const cv::Mat& img, const cv::Rect_<coord_t>& face_box, const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye)
 {
-    // we need compact memory layout, i.e. rowstep = ?, so we can use the data from img directly
-    if (img.step1() != (size_t)img.cols)     
+    // the rows may be padded (e.g., img is a ROI of a bigger image), i.e. we can use the data from img directly
+    const int row_stride = (int)img.step1(); // row stride in elements (not bytes)
+
+    // color images are converted to luma on the fly (only the pixels that are necessary for the processing of the ROIs)
+    if (img.channels() == 3 || img.channels() == 4)
     {
-        std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: img.step1 != img.cols! Skipping image!" << std::endl;
-        return EyeCenterLocations<coord_t>();
+        switch (img.depth())
+        {
+            case CV_8U:
+                return detectEyeCenters(ColorImageView<uint8_t>((const uint8_t*)img.data,img.cols,img.rows,color_order,row_stride,img.channels()),face_box,left_eye,right_eye);
+            case CV_16U:
+                return detectEyeCenters(ColorImageView<uint16_t>((const uint16_t*)img.data,img.cols,img.rows,color_order,row_stride,img.channels()),face_box,left_eye,right_eye);
+            case CV_32F:
+                return detectEyeCenters(ColorImageView<float>((const float*)img.data,img.cols,img.rows,color_order,row_stride,img.channels()),face_box,left_eye,right_eye);
+            default:
+                std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: unsupported color image type! Skipping image!" << std::endl;
+                return EyeCenterLocations<coord_t>();
+        }
     }
 
-    // img has to be uint8, single channel
-    if (img.type() != CV_8UC1)
+    if (img.channels() != 1)
     {
-        std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: unsupported image type! Skipping image!" << std::endl;
+        std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: unsupported number of channels! Skipping image!" << std::endl;
         return EyeCenterLocations<coord_t>();
     }
-    else
+
+    switch (img.depth())
     {
-        return detectEyeCenters((uint8_t*)img.data,img.cols,img.rows,face_box,left_eye,right_eye);
+        case CV_8U:
+            return detectEyeCenters(ImageView<uint8_t>((const uint8_t*)img.data,img.cols,img.rows,row_stride),face_box,left_eye,right_eye);
+        case CV_16U:
+            return detectEyeCenters(ImageView<uint16_t>((const uint16_t*)img.data,img.cols,img.rows,row_stride),face_box,left_eye,right_eye);
+        case CV_32F:
+            return detectEyeCenters(ImageView<float>((const float*)img.data,img.cols,img.rows,row_stride),face_box,left_eye,right_eye);
+        case CV_64F:
+            return detectEyeCenters(ImageView<double>((const double*)img.data,img.cols,img.rows,row_stride),face_box,left_eye,right_eye);
+        default:
+            std::cerr << "IsophoteEyeCenterDetector<" << TypeToString<T>() << ">.detectEyeCenters: unsupported image type! Skipping image!" << std::endl;
+            return EyeCenterLocations<coord_t>();
     }
 }
 
@@ -425,6 +1443,32 @@ IsophoteEyeCenterDetector<T>::getSearchRegions(const cv::Mat& img, const cv::Rec
 /* Template instantiation for non-standalone compile */
 template class IsophoteEyeCenterDetector<float>;
 template class IsophoteEyeCenterDetector<double>;
+// the template methods have to be instantiated explicitly for all supported image types
+#define _INSTANTIATE_IMAGE_METHODS(T,S) \
+    template EyeCenterLocations<IsophoteEyeCenterDetector<T>::coord_t> IsophoteEyeCenterDetector<T>::detectEyeCenters(const S*, int, int, const cv::Rect_<coord_t>&, const cv::Point_<coord_t>&, const cv::Point_<coord_t>&); \
+    template EyeCenterLocations<IsophoteEyeCenterDetector<T>::coord_t> IsophoteEyeCenterDetector<T>::detectEyeCenters(const ImageView<S>&, const cv::Rect_<coord_t>&, const cv::Point_<coord_t>&, const cv::Point_<coord_t>&); \
+    template void IsophoteEyeCenterDetector<T>::process(const S*, int, int, T, T, const cv::Rect_<coord_t>&, const cv::Rect_<coord_t>&, T); \
+    template void IsophoteEyeCenterDetector<T>::process(const ImageView<S>&, T, T, const cv::Rect_<coord_t>&, const cv::Rect_<coord_t>&, T); \
+    template void IsophoteEyeCenterDetector<T>::processIsophotes(const ImageView<S>&, T, T, const cv::Rect_<coord_t>&, const cv::Rect_<coord_t>&, T);
+_INSTANTIATE_IMAGE_METHODS(float,uint8_t)
+_INSTANTIATE_IMAGE_METHODS(float,uint16_t)
+_INSTANTIATE_IMAGE_METHODS(float,float)
+_INSTANTIATE_IMAGE_METHODS(float,double)
+_INSTANTIATE_IMAGE_METHODS(double,uint8_t)
+_INSTANTIATE_IMAGE_METHODS(double,uint16_t)
+_INSTANTIATE_IMAGE_METHODS(double,float)
+_INSTANTIATE_IMAGE_METHODS(double,double)
+#undef _INSTANTIATE_IMAGE_METHODS
+#define _INSTANTIATE_COLOR_IMAGE_METHODS(T,S) \
+    template EyeCenterLocations<IsophoteEyeCenterDetector<T>::coord_t> IsophoteEyeCenterDetector<T>::detectEyeCenters(const ColorImageView<S>&, const cv::Rect_<coord_t>&, const cv::Point_<coord_t>&, const cv::Point_<coord_t>&); \
+    template void IsophoteEyeCenterDetector<T>::process(const ColorImageView<S>&, T, T, const cv::Rect_<coord_t>&, const cv::Rect_<coord_t>&, T);
+_INSTANTIATE_COLOR_IMAGE_METHODS(float,uint8_t)
+_INSTANTIATE_COLOR_IMAGE_METHODS(float,uint16_t)
+_INSTANTIATE_COLOR_IMAGE_METHODS(float,float)
+_INSTANTIATE_COLOR_IMAGE_METHODS(double,uint8_t)
+_INSTANTIATE_COLOR_IMAGE_METHODS(double,uint16_t)
+_INSTANTIATE_COLOR_IMAGE_METHODS(double,float)
+#undef _INSTANTIATE_COLOR_IMAGE_METHODS
 
 
 #ifdef __STANDALONE
@@ -446,9 +1490,18 @@ main(int argc, char* argv[])
     typedef IsophoteEyeCenterDetector<float> ed_t;
     ed_t ed;
 
-    // load a test image 
-    //IplImage* imgIpl = cvLoadImage("/home/bschauer/work/matlab/eye_detection/images/test_pattern.png", 1);
-    IplImage* imgIpl = cvLoadImage("/home/bschauer/data/face/BioID-X/images/BioID_1014.pgm",1);
+    // load the test image (e.g., a BioID image) 
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <image>" << std::endl;
+        return 1;
+    }
+    IplImage* imgIpl = cvLoadImage(argv[1],1);
+    if (imgIpl == NULL)
+    {
+        std::cerr << "Unable to load '" << argv[1] << "'!" << std::endl;
+        return 1;
+    }
     cv::Mat imgbgr(imgIpl);
     cv::Mat imgrgb(imgbgr);
     cvtColor(imgbgr, imgrgb, CV_BGR2RGB);
@@ -516,3 +1569,323 @@ main(int argc, char* argv[])
     return 0;
 }
 #endif
+
+#ifdef __MEX
+/* MATLAB interface: the complete detector, i.e. only the eye centers (and the explicitly requested planes) cross the MEX boundary
+ * -> be aware that MATLAB uses column-major data storage; the images are not copied, but processed as column-major views (see
+ *    MakeColumnMajorView), i.e. x runs along the columns of the MATLAB matrix and the derivatives are filtered column-first
+ *
+ *   centers = isophoteeyedetector(I)
+ *   centers = isophoteeyedetector(I, options)
+ *   [centers, planes] = isophoteeyedetector(I, options)
+ *
+ * I is a 2-D image (uint8, uint16, single or double), a HxWxN stack of images or a cell array of images (batch). options is a struct with the
+ * (optional) fields
+ *   face       [x y width height] (1-based); one row for all images or one row per image (default: the full image)
+ *   left_eye   [x y] coarse left eye location (1-based); one row for all images or one row per image (default: automatic ROIs)
+ *   right_eye  [x y]
+ *   sigma      sigma or [row_sigma col_sigma] (default: automatic selection)
+ *   precision  'single' or 'double' (default: 'double' for double images, otherwise 'single')
+ *   threads    number of worker threads of a batch (default: number of cores)
+ *   planes     cell array of the requested planes, i.e. of 'k', 'c', 'dx', 'dy', 'acc', 'Lx', 'Ly', 'Lxx', 'Lxy', 'Lyy'
+ * centers is a Nx4 matrix [left_x left_y right_x right_y] (1-based; NaN if the eye centers have not been found) and planes is a 1xN struct
+ * array with the requested planes (only calculated in the eye ROIs, i.e. 0 elsewhere).
+ */
+
+// planes that can be requested (options.planes)
+static const char* const mex_plane_names[] = { "k", "c", "dx", "dy", "acc", "Lx", "Ly", "Lxx", "Lxy", "Lyy" };
+static const int num_mex_planes = 10;
+
+/** Get a plane of the detector (see mex_plane_names). */
+template <typename T>
+static const T*
+GetMexPlane(const IsophoteEyeCenterDetector<T>& iecd, int plane)
+{
+    switch (plane)
+    {
+        case 0: return iecd.getK();
+        case 1: return iecd.getC();
+        case 2: return iecd.getDx();
+        case 3: return iecd.getDy();
+        case 4: return iecd.getAcc();
+        case 5: return iecd.getLx();
+        case 6: return iecd.getLy();
+        case 7: return iecd.getLxx();
+        case 8: return iecd.getLxy();
+        case 9: return iecd.getLyy();
+        default: return NULL;
+    }
+}
+
+/** An image of a batch and the pre-allocated outputs (the worker threads must not call the MATLAB API). */
+struct MexJob
+{
+    mxClassID class_id;
+    const void* data;                 // column-major, i.e. pixel (x,y) is at data[x*height + y]
+    int width, height;
+    cv::Rect_<int> face_box;
+    cv::Point_<int> left_eye, right_eye;
+    double* centers;                  // first element of the row of the job in the Nx4 centers matrix
+    size_t centers_stride;            // N
+    void* planes[num_mex_planes];     // NULL if not requested
+};
+
+template <typename T, typename S>
+static EyeCenterLocations<int>
+DetectMexImage(IsophoteEyeCenterDetector<T>& iecd, const MexJob& job)
+{
+    // view of the column-major image (no copy); the detector filters it column-first (see FilterDerivatives)
+    const ImageView<S> img = MakeColumnMajorView((const S*)job.data,job.width,job.height);
+    return iecd.detectEyeCenters(img,job.face_box,job.left_eye,job.right_eye);
+}
+
+/** Worker thread: process the jobs (each worker has its own detector). */
+template <typename T>
+static void
+ProcessMexJobs(const std::vector<MexJob>* jobs, T row_sigma, T col_sigma, std::atomic<size_t>* next_job, std::mutex* error_mutex, std::string* error)
+{
+    IsophoteEyeCenterDetector<T> iecd;
+    if (row_sigma > 0)
+        iecd.setSigma(row_sigma,col_sigma);
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (size_t i = (*next_job)++; i < jobs->size(); i = (*next_job)++)
+    {
+        const MexJob& job = (*jobs)[i];
+        EyeCenterLocations<int> result;
+        bool processed = false; // did this job fill the planes of the detector?
+        try
+        {
+            switch (job.class_id)
+            {
+                case mxUINT8_CLASS:  result = DetectMexImage<T,uint8_t>(iecd,job); break;
+                case mxUINT16_CLASS: result = DetectMexImage<T,uint16_t>(iecd,job); break;
+                case mxSINGLE_CLASS: result = DetectMexImage<T,float>(iecd,job); break;
+                case mxDOUBLE_CLASS: result = DetectMexImage<T,double>(iecd,job); break;
+                default: break; // checked before
+            }
+            processed = (iecd.getWidth() == job.width && iecd.getHeight() == job.height); // the size is reset if the image could not be processed
+        }
+        catch (const std::exception& e)
+        {
+            std::lock_guard<std::mutex> lock(*error_mutex);
+            if (error->empty())
+                *error = e.what();
+        }
+
+        // 1-based coordinates
+        const bool valid = result.isValid();
+        job.centers[0*job.centers_stride] = (valid ? result.left.x + 1 : nan);
+        job.centers[1*job.centers_stride] = (valid ? result.left.y + 1 : nan);
+        job.centers[2*job.centers_stride] = (valid ? result.right.x + 1 : nan);
+        job.centers[3*job.centers_stride] = (valid ? result.right.y + 1 : nan);
+
+        // transpose the requested planes to column-major order (the planes are zero if the image could not be processed)
+        const int stride = iecd.getStride();
+        for (int p = 0; p < num_mex_planes; p++)
+        {
+            const T* plane = GetMexPlane(iecd,p);
+            if (job.planes[p] == NULL || plane == NULL || !processed)
+                continue;
+            T* out = (T*)job.planes[p];
+            for (int x = 0; x < job.width; x++)
+                for (int y = 0; y < job.height; y++)
+                    out[(size_t)x*job.height + y] = plane[(size_t)y*stride + x];
+        }
+    }
+}
+
+/** Get the row i of a numeric option with cols columns (the option has 1 row, i.e. the same for all images, or one row per image).
+ *  Returns false if the option is not set.
+ */
+static bool
+GetMexOptionRow(const mxArray* options, const char* name, size_t i, size_t num_images, size_t cols, double* values)
+{
+    const mxArray* field = (options != NULL ? mxGetField(options,0,name) : NULL);
+    if (field == NULL || mxIsEmpty(field))
+        return false;
+    const size_t rows = mxGetM(field);
+    if (mxGetClassID(field) != mxDOUBLE_CLASS || mxGetN(field) != cols || (rows != 1 && rows != num_images))
+    {
+        char buf[256];
+        sprintf(buf,"options.%s has to be a double matrix with %d columns and 1 or %d rows!\n",name,(int)cols,(int)num_images);
+        mexErrMsgTxt(buf);
+    }
+    const double* data = mxGetPr(field);
+    const size_t row = (rows == 1 ? 0 : i);
+    for (size_t c = 0; c < cols; c++)
+        values[c] = data[c*rows + row];
+    return true;
+}
+
+/** Get a string option (empty if not set). */
+static std::string
+GetMexOptionString(const mxArray* options, const char* name)
+{
+    const mxArray* field = (options != NULL ? mxGetField(options,0,name) : NULL);
+    if (field == NULL)
+        return std::string();
+    if (!mxIsChar(field))
+    {
+        char buf[256];
+        sprintf(buf,"options.%s has to be a string!\n",name);
+        mexErrMsgTxt(buf);
+    }
+    char* str = mxArrayToString(field);
+    const std::string s(str);
+    mxFree(str);
+    return s;
+}
+
+void
+mexFunction(int nlhs, mxArray* plhs[],
+            int nrhs, const mxArray* prhs[])
+{
+    /* Check number of input parameters. */
+    if (nrhs < 1 || nrhs > 2)
+        mexErrMsgTxt("Wrong number of input arguments. Input should be: image [options]\n");
+    if (nlhs > 2)
+        mexErrMsgTxt("Wrong number of output arguments. Output should be: centers [planes]\n");
+    const mxArray* options = (nrhs == 2 ? prhs[1] : NULL);
+    if (options != NULL && (!mxIsStruct(options) || mxGetNumberOfElements(options) != 1))
+        mexErrMsgTxt("options has to be a 1x1 struct!\n");
+
+    /* Collect the images (cell array, stack or single image) */
+    std::vector<const mxArray*> arrays;
+    std::vector<size_t> slices; // index of the image in the stack
+    if (mxIsCell(prhs[0]))
+    {
+        for (size_t i = 0; i < mxGetNumberOfElements(prhs[0]); i++)
+        {
+            arrays.push_back(mxGetCell(prhs[0],i));
+            slices.push_back(0);
+        }
+    }
+    else
+    {
+        const mwSize ndims = mxGetNumberOfDimensions(prhs[0]);
+        const size_t num_slices = (ndims == 3 ? mxGetDimensions(prhs[0])[2] : 1);
+        if (ndims > 3)
+            mexErrMsgTxt("The image has to be a 2-D image or a HxWxN stack of images!\n");
+        for (size_t i = 0; i < num_slices; i++)
+        {
+            arrays.push_back(prhs[0]);
+            slices.push_back(i);
+        }
+    }
+    const size_t num_images = arrays.size();
+
+    /* Options */
+    std::string precision = GetMexOptionString(options,"precision");
+    if (precision.empty())
+        precision = (num_images > 0 && arrays[0] != NULL && mxGetClassID(arrays[0]) == mxDOUBLE_CLASS ? "double" : "single");
+    if (precision != "single" && precision != "double")
+        mexErrMsgTxt("options.precision has to be 'single' or 'double'!\n");
+    const mxClassID plane_class = (precision == "double" ? mxDOUBLE_CLASS : mxSINGLE_CLASS);
+    double sigma[2] = { -1, -1 };
+    const mxArray* mxSigma = (options != NULL ? mxGetField(options,0,"sigma") : NULL);
+    if (mxSigma != NULL && !mxIsEmpty(mxSigma))
+    {
+        if (mxGetClassID(mxSigma) != mxDOUBLE_CLASS || (mxGetNumberOfElements(mxSigma) != 1 && mxGetNumberOfElements(mxSigma) != 2))
+            mexErrMsgTxt("options.sigma has to be sigma or [row_sigma col_sigma] (double)!\n");
+        sigma[0] = mxGetPr(mxSigma)[0];
+        sigma[1] = mxGetPr(mxSigma)[mxGetNumberOfElements(mxSigma) - 1];
+    }
+    double threads = 0;
+    if (!GetMexOptionRow(options,"threads",0,1,1,&threads) || threads <= 0)
+        threads = std::max(1u,std::thread::hardware_concurrency());
+
+    // requested planes
+    std::vector<int> planes;
+    const mxArray* mxPlanes = (options != NULL ? mxGetField(options,0,"planes") : NULL);
+    if (mxPlanes != NULL)
+    {
+        const size_t num_names = (mxIsCell(mxPlanes) ? mxGetNumberOfElements(mxPlanes) : 1);
+        for (size_t i = 0; i < num_names; i++)
+        {
+            const mxArray* mxName = (mxIsCell(mxPlanes) ? mxGetCell(mxPlanes,i) : mxPlanes);
+            if (mxName == NULL || !mxIsChar(mxName))
+                mexErrMsgTxt("options.planes has to be a cell array of plane names!\n");
+            char* name = mxArrayToString(mxName);
+            int plane = -1;
+            for (int p = 0; p < num_mex_planes; p++)
+                if (std::string(name) == mex_plane_names[p])
+                    plane = p;
+            if (plane < 0)
+            {
+                char buf[256];
+                sprintf(buf,"Unknown plane '%s'!\n",name);
+                mxFree(name);
+                mexErrMsgTxt(buf);
+            }
+            mxFree(name);
+            planes.push_back(plane);
+        }
+    }
+    if (nlhs == 2 && planes.empty())
+        mexErrMsgTxt("Request the planes with options.planes, e.g. options.planes = {'acc'}!\n");
+
+    /* Create the output arrays (the worker threads only write into them) */
+    mxArray* mxCenters = mxCreateDoubleMatrix(num_images,4,mxREAL);
+    plhs[0] = mxCenters;
+    double* centers = mxGetPr(mxCenters);
+    mxArray* mxPlaneStruct = NULL;
+    if (nlhs == 2)
+    {
+        std::vector<const char*> field_names;
+        for (size_t i = 0; i < planes.size(); i++)
+            field_names.push_back(mex_plane_names[planes[i]]);
+        mxPlaneStruct = mxCreateStructMatrix(1,num_images,(int)field_names.size(),&field_names[0]);
+        plhs[1] = mxPlaneStruct;
+    }
+
+    /* Jobs */
+    std::vector<MexJob> jobs(num_images);
+    for (size_t i = 0; i < num_images; i++)
+    {
+        const mxArray* mxImage = arrays[i];
+        if (mxImage == NULL || mxIsComplex(mxImage) || (mxIsCell(prhs[0]) && mxGetNumberOfDimensions(mxImage) != 2))
+            mexErrMsgTxt("The images have to be real 2-D images!\n");
+        MexJob& job = jobs[i];
+        job.class_id = mxGetClassID(mxImage);
+        if (job.class_id != mxUINT8_CLASS && job.class_id != mxUINT16_CLASS && job.class_id != mxSINGLE_CLASS && job.class_id != mxDOUBLE_CLASS)
+            mexErrMsgTxt("Unsupported image type (supported: uint8, uint16, single and double)!\n");
+        job.height = (int)mxGetM(mxImage);
+        job.width = (int)(mxGetNumberOfDimensions(mxImage) == 3 ? mxGetDimensions(mxImage)[1] : mxGetN(mxImage));
+        job.data = (const char*)mxGetData(mxImage) + slices[i] * (size_t)job.width * job.height * mxGetElementSize(mxImage);
+
+        double values[4];
+        job.face_box = (GetMexOptionRow(options,"face",i,num_images,4,values) ? cv::Rect_<int>((int)values[0] - 1,(int)values[1] - 1,(int)values[2],(int)values[3])
+                                                                             : cv::Rect_<int>(0,0,job.width,job.height));
+        job.left_eye = (GetMexOptionRow(options,"left_eye",i,num_images,2,values) ? cv::Point_<int>((int)values[0] - 1,(int)values[1] - 1) : cv::Point_<int>(-1,-1));
+        job.right_eye = (GetMexOptionRow(options,"right_eye",i,num_images,2,values) ? cv::Point_<int>((int)values[0] - 1,(int)values[1] - 1) : cv::Point_<int>(-1,-1));
+        job.centers = centers + i;
+        job.centers_stride = num_images;
+        for (int p = 0; p < num_mex_planes; p++)
+            job.planes[p] = NULL;
+        for (size_t j = 0; j < planes.size() && mxPlaneStruct != NULL; j++)
+        {
+            mxArray* mxPlane = mxCreateNumericMatrix(job.height,job.width,plane_class,mxREAL);
+            mxSetField(mxPlaneStruct,i,mex_plane_names[planes[j]],mxPlane);
+            job.planes[planes[j]] = mxGetData(mxPlane);
+        }
+    }
+
+    /* Process the jobs with native threads */
+    const size_t num_threads = std::min((size_t)threads,std::max(num_images,(size_t)1));
+    std::atomic<size_t> next_job(0);
+    std::mutex error_mutex;
+    std::string error;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        if (plane_class == mxDOUBLE_CLASS)
+            workers.push_back(std::thread(ProcessMexJobs<double>,&jobs,sigma[0],sigma[1],&next_job,&error_mutex,&error));
+        else
+            workers.push_back(std::thread(ProcessMexJobs<float>,&jobs,(float)sigma[0],(float)sigma[1],&next_job,&error_mutex,&error));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    if (!error.empty())
+        mexErrMsgTxt(error.c_str());
+}
+#endif
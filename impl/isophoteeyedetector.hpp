@@ -13,6 +13,15 @@
 
 #include <okapi.hpp>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "aligned_slab.hpp"
+#include "box_filter.hpp"
+#include "gauss_filter_bank.hpp"
+#include "image_view.hpp"
+
 /** NOTES:
  *  - Interface is supposed to be similar to the BinaryPatternEyeDetector
  */
@@ -40,6 +49,39 @@ struct EyeCenterLocations
     }
 };
 
+/** Precision of the accumulator (see IsophoteEyeCenterDetector::setAccumulatorPrecision). */
+enum AccumulatorPrecision
+{
+    FloatingPointAccumulator = 0, // the curvedness of the votes is added in T
+    FixedPoint16Accumulator,      // the votes are quantized to 8 bit weights and added in a uint16_t plane
+    FixedPoint32Accumulator       // the votes are quantized to 16 bit weights and added in a uint32_t plane
+};
+
+/** Image planes that are retained by the processing (see IsophoteEyeCenterDetector::setOutputPlanes); can be combined with |. */
+enum OutputPlane
+{
+    NoOutputPlanes         = 0,
+    LxOutputPlane          = 1 << 0, // getLx
+    LyOutputPlane          = 1 << 1, // getLy
+    LxxOutputPlane         = 1 << 2, // getLxx
+    LxyOutputPlane         = 1 << 3, // getLxy
+    LyyOutputPlane         = 1 << 4, // getLyy
+    KOutputPlane           = 1 << 5, // getK
+    COutputPlane           = 1 << 6, // getC
+    DxOutputPlane          = 1 << 7, // getDx
+    DyOutputPlane          = 1 << 8, // getDy
+    DerivativeOutputPlanes = LxOutputPlane | LyOutputPlane | LxxOutputPlane | LxyOutputPlane | LyyOutputPlane,
+    IsophoteOutputPlanes   = KOutputPlane | COutputPlane | DxOutputPlane | DyOutputPlane,
+    AllOutputPlanes        = DerivativeOutputPlanes | IsophoteOutputPlanes
+};
+
+/** Filters of the Gaussian derivatives (see IsophoteEyeCenterDetector::setDerivativeFilter). */
+enum DerivativeFilter
+{
+    GaussianDerivativeFilter = 0, // separable filters (see CreateGauss, CreateGaussFirstDeriv and CreateGaussSecondDeriv)
+    BoxDerivativeFilter           // box approximations on an integral image (see CreateBoxDerivativeKernel)
+};
+
 template <typename T>
 class IsophoteEyeCenterDetector
 {
@@ -54,7 +96,11 @@ class IsophoteEyeCenterDetector
             ///
             // Main calculation methods
             ///
-            /** Detect the eye center locations in the image. */
+            /** Detect the eye center locations in the image. 
+             *  img has to be a single channel 8-bit, 16-bit, float or double image, or a 3/4-channel 8-bit, 16-bit or float color image (see setColorOrder).
+             *  Padded rows (e.g., a ROI of a bigger cv::Mat) are processed without a copy and color images are converted to luma on the fly, i.e. only
+             *  the pixels that are actually processed are converted.
+             */
             EyeCenterLocations<coord_t> detectEyeCenters(const cv::Mat& img,
                     const cv::Rect_<coord_t>& face_box,
                     const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye);
@@ -64,6 +110,27 @@ class IsophoteEyeCenterDetector
                                                                                const cv::Rect_<coord_t>& face_box,
                                                                                const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye);
 
+            /** Main method to calculate the eye center locations in an image view (e.g., strided, 16-bit, or the luma samples of a YUV buffer; see image_view.hpp). 
+             *  The detector directly reads the caller's memory, i.e. no copy is made.
+             */
+            template <typename S> EyeCenterLocations<coord_t> detectEyeCenters(const ImageView<S>& img,
+                                                                               const cv::Rect_<coord_t>& face_box,
+                                                                               const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye);
+
+            /** Main method to calculate the eye center locations in an interleaved color image view. The luma is calculated on the fly in the first filter pass. */
+            template <typename S> EyeCenterLocations<coord_t> detectEyeCenters(const ColorImageView<S>& img,
+                                                                               const cv::Rect_<coord_t>& face_box,
+                                                                               const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye);
+
+            /** Detect the eye center locations with sub-pixel precision (see detectEyeCenters and setSubpixelPrecision). */
+            inline EyeCenterLocations<T> detectEyeCentersSubpixel(const cv::Mat& img,
+                    const cv::Rect_<coord_t>& face_box,
+                    const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye) { detectEyeCenters(img,face_box,left_eye,right_eye); return subpixel_centers; }
+            /** Detect the eye center locations in an image view with sub-pixel precision (see detectEyeCenters and setSubpixelPrecision). */
+            template <typename S> inline EyeCenterLocations<T> detectEyeCentersSubpixel(const ImageView<S>& img,
+                                                                                        const cv::Rect_<coord_t>& face_box,
+                                                                                        const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye) { detectEyeCenters(img,face_box,left_eye,right_eye); return subpixel_centers; }
+
             /** Run the image processing, filtering, etc. and finally calculate the raw accumulator that is further processed by detectEyeCenters to locate the eye centers.
              *  If you know what you are doing, you can just call process and get the raw accumulator (and the other image and filter informations) and write custom eye
              *  center detection routines based on this data/processing.
@@ -71,7 +138,39 @@ class IsophoteEyeCenterDetector
             template <typename S> void process(const S* img, int width, int height,
                                                T row_sigma, T col_sigma,
                                                const cv::Rect_<coord_t>& left_roi,
-                                               const cv::Rect_<coord_t>& right_roi);
+                                               const cv::Rect_<coord_t>& right_roi,
+                                               T roll_angle = 0);
+            /** Run the image processing (see above) on an image view. */
+            template <typename S> void process(const ImageView<S>& img,
+                                               T row_sigma, T col_sigma,
+                                               const cv::Rect_<coord_t>& left_roi,
+                                               const cv::Rect_<coord_t>& right_roi,
+                                               T roll_angle = 0);
+            /** Run the image processing (see above) on a color image view. */
+            template <typename S> void process(const ColorImageView<S>& img,
+                                               T row_sigma, T col_sigma,
+                                               const cv::Rect_<coord_t>& left_roi,
+                                               const cv::Rect_<coord_t>& right_roi,
+                                               T roll_angle = 0);
+
+            /** Run the image processing up to the isophote information, i.e. process without the voting. The derivatives and isophotes are only calculated
+             *  in the ROIs and are identical for every sub-rectangle of the ROIs, i.e. vote and locateAccumulatorMaximum can be called several times to
+             *  evaluate different (smaller) ROIs, vote prunings and accumulator smoothings on the same planes (e.g., for parameter sweeps).
+             */
+            template <typename S> void processIsophotes(const ImageView<S>& img,
+                                                        T row_sigma, T col_sigma,
+                                                        const cv::Rect_<coord_t>& left_roi,
+                                                        const cv::Rect_<coord_t>& right_roi,
+                                                        T roll_angle = 0);
+            /** Calculate the accumulator from the isophote information of the previous process/processIsophotes call. Only the pixels inside roi vote
+             *  (roi has to be inside the processed ROIs) and the votes are pruned by the displacement length and the curvedness (see CalculateAccumulator).
+             *  If zero_acc is false, the votes are added to the current accumulator.
+             */
+            void vote(const cv::Rect_<coord_t>& roi, T min_radius = 0, T max_radius = 0, T min_curvedness = 0, bool zero_acc = true);
+            /** Locate the maximum of the accumulator inside roi after smoothing the accumulator with a smoothing_size x smoothing_size Gaussian
+             *  (smoothing_size <= 1: no smoothing; detectEyeCenters uses 9).
+             */
+            cv::Point_<coord_t> locateAccumulatorMaximum(const cv::Rect_<coord_t>& roi, int smoothing_size = 9) const;
 
             /** Return the area in which the eyes are searched, i.e. the regions of interest */
             void getSearchRegions(const cv::Mat& img,
@@ -82,9 +181,9 @@ class IsophoteEyeCenterDetector
             ///
             // Informations
             ///
-            /** Get height of the (previously) processed image (defines the height of the output images). */
+            /** Get height of the (previously) processed image (defines the height of the output images, 0 if the last image could not be processed). */
             inline const int getHeight(void) const { return current_height; }
-            /** Get width of the (previously) processed image (defines the width of the output images). */
+            /** Get width of the (previously) processed image (defines the width of the output images, 0 if the last image could not be processed). */
             inline const int getWidth(void) const { return current_width; }
             /** Get sigma that was used to process the image rows. */
             inline const T getRowSigma(void) const { return current_row_sigma; }
@@ -94,8 +193,22 @@ class IsophoteEyeCenterDetector
             inline const int getRowFilterLength(void) const { return current_row_filter_length; }
             /** Get the col filter length that was used to process the image. */
             inline const int getColFilterLength(void) const { return current_col_filter_length; }
+            /** Get the row stride (in elements) of the image getters, i.e. the element (x,y) of, e.g., getK() is getK()[y*getStride() + x].
+             *  Every row starts SLAB_ALIGNMENT aligned and the stride is padded to avoid cache set aliasing (see aligned_slab.hpp).
+             */
+            inline const int getStride(void) const { return buf_stride; }
             /** Get the left and right ROI that were used to process the image. */
             inline void getCurrentSearchRegions(cv::Rect_<coord_t>& left_roi, cv::Rect_<coord_t>& right_roi) const { left_roi = current_left_roi; right_roi = current_right_roi; }
+            /** Get the (rotated) search regions of the last detectEyeCenters call, i.e. the eye ROIs in the frame of the face (see setRotationAware). The
+             *  regions of getCurrentSearchRegions are their bounding boxes. Without rotation, the regions are the search regions (angle 0).
+             */
+            inline void getCurrentOrientedSearchRegions(cv::RotatedRect& left_roi, cv::RotatedRect& right_roi) const { left_roi = current_left_oriented_roi; right_roi = current_right_oriented_roi; }
+            /** Get the roll angle of the last process/detectEyeCenters call (see setRotationAware). */
+            inline const T getRollAngle(void) const { return current_roll_angle; }
+            /** Get the eye center locations of the last detectEyeCenters call with sub-pixel precision (see setSubpixelPrecision; mapped back from the
+             *  canonical scale, see setCanonicalInterocularDistance). detectEyeCenters returns these locations rounded to pixels.
+             */
+            inline const EyeCenterLocations<T>& getEyeCentersSubpixel(void) const { return subpixel_centers; }
 
             ///
             // Image getter
@@ -103,71 +216,71 @@ class IsophoteEyeCenterDetector
             /** Get the curvature. */
             inline const T* getK(void) const { return k; }
             /** Get the curvature as cv::Mat. */
-            inline const cv::Mat getMatK(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)k); }
+            inline const cv::Mat getMatK(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)k,getStride()*sizeof(T)); }
             /** Get the curvedness. */
             inline const T* getC(void) const { return c; }
             /** Get the curvedness as cv::Mat. */
-            inline const cv::Mat getMatC(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)c); }
+            inline const cv::Mat getMatC(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)c,getStride()*sizeof(T)); }
             /** Get the displacement in x-direction. */
             inline const T* getDx(void) const { return dx; }
             /** Get the displacement in x-direction as cv::Mat. */
-            inline const cv::Mat getMatDx(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)dx); }
+            inline const cv::Mat getMatDx(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)dx,getStride()*sizeof(T)); }
             /** Get the displacement in y-direction. */
             inline const T* getDy(void) const { return dy; }
             /** Get the displacement in y-direction as cv::Mat. */
-            inline const cv::Mat getMatDy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)dy); }
+            inline const cv::Mat getMatDy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)dy,getStride()*sizeof(T)); }
             /** Get the 1st partial derivative in x-direction. */
             inline const T* getLx(void) const { return Lx; }
             /** Get the 1st partial derivative in x-direction as cv::Mat. */
-            inline const cv::Mat getMatLx(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lx); }
+            inline const cv::Mat getMatLx(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lx,getStride()*sizeof(T)); }
             /** Get the 1st partial derivative in y-direction. */
             inline const T* getLy(void) const { return Ly; }
             /** Get the 1st partial derivative in y-direction as cv::Mat. */
-            inline const cv::Mat getMatLy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Ly); }
+            inline const cv::Mat getMatLy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Ly,getStride()*sizeof(T)); }
             /** Get the 2nd partial derivative in x-direction. */
             inline const T* getLxx(void) const { return Lxx; }
             /** Get the 2nd partial derivative in x-direction as cv::Mat. */
-            inline const cv::Mat getMatLxx(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lxx); }
+            inline const cv::Mat getMatLxx(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lxx,getStride()*sizeof(T)); }
             /** Get the 1st partial derivative in x- and y- direction.*/
             inline const T* getLxy(void) const { return Lxy; }
             /** Get the 1st partial derivative in x- and y- direction as cv::Mat. */
-            inline const cv::Mat getMatLxy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lxy); }
+            inline const cv::Mat getMatLxy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lxy,getStride()*sizeof(T)); }
             /** Get the 2nd partial derivative in y-direction. */
             inline const T* getLyy(void) const { return Lyy; }
             /** Get the 2nd partial derivative in y-direction as cv::Mat*/
-            inline const cv::Mat getMatLyy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lyy); }
+            inline const cv::Mat getMatLyy(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)Lyy,getStride()*sizeof(T)); }
             /** Get the accumulator. */
             inline const T* getAcc(void) const { return acc; }
             /** Get the accumulator as cv::Mat. */
-            inline const cv::Mat getMatAcc(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)acc); }
+            inline const cv::Mat getMatAcc(void) const { return cv::Mat(getHeight(),getWidth(),cv::DataType<T>::type,(void*)acc,getStride()*sizeof(T)); }
 
             ///
             // Filter getter
             ///
             /** Get the row Gauss filter. */
-            inline const T* getRowG(void) const { return row_g; }
+            inline const T* getRowG(void) const { return (row_bank != NULL ? row_bank->g : NULL); }
             /** Get the row Gauss filter as cv::Mat. */
-            inline const cv::Mat getMatRowG(void) const { return cv::Mat(getRowFilterLength(),1,cv::DataType<T>::type,(void*)row_g); }
+            inline const cv::Mat getMatRowG(void) const { return cv::Mat(getRowFilterLength(),1,cv::DataType<T>::type,(void*)getRowG()); }
             /** Get the 1st derivative of the row Gauss filter. */
-            inline const T* getRowGP(void) const { return row_gp; }
+            inline const T* getRowGP(void) const { return (row_bank != NULL ? row_bank->gp : NULL); }
             /** Get the 1st derivative of the row Gauss filter as cv::Mat. */
-            inline const cv::Mat getMatRowGP(void) const { return cv::Mat(getRowFilterLength(),1,cv::DataType<T>::type,(void*)row_gp); }
+            inline const cv::Mat getMatRowGP(void) const { return cv::Mat(getRowFilterLength(),1,cv::DataType<T>::type,(void*)getRowGP()); }
             /** Get the 2nd derivative of the row Gauss filter. */
-            inline const T* getRowGPP(void) const { return row_gpp; }
+            inline const T* getRowGPP(void) const { return (row_bank != NULL ? row_bank->gpp : NULL); }
             /** Get the 2nd derivative of the row Gauss filter as cv::Mat. */
-            inline const cv::Mat getMatRowGPP(void) const { return cv::Mat(getRowFilterLength(),1,cv::DataType<T>::type,(void*)row_gpp); }
+            inline const cv::Mat getMatRowGPP(void) const { return cv::Mat(getRowFilterLength(),1,cv::DataType<T>::type,(void*)getRowGPP()); }
             /** Get the col Gauss filter. */
-            inline const T* getColG(void) const { return col_g; }
+            inline const T* getColG(void) const { return (col_bank != NULL ? col_bank->g : NULL); }
             /** Get the col Gauss filter as cv::Mat. */
-            inline const cv::Mat getMatColG(void) const { return cv::Mat(1,getColFilterLength(),cv::DataType<T>::type,(void*)col_g); }
+            inline const cv::Mat getMatColG(void) const { return cv::Mat(1,getColFilterLength(),cv::DataType<T>::type,(void*)getColG()); }
             /** Get the 1st derivative of the col Gauss filter. */
-            inline const T* getColGP(void) const { return col_gp; }
+            inline const T* getColGP(void) const { return (col_bank != NULL ? col_bank->gp : NULL); }
             /** Get the 1st derivative of the col Gauss filter as cv::Mat. */
-            inline const cv::Mat getMatColGP(void) const { return cv::Mat(1,getColFilterLength(),cv::DataType<T>::type,(void*)col_gp); }
+            inline const cv::Mat getMatColGP(void) const { return cv::Mat(1,getColFilterLength(),cv::DataType<T>::type,(void*)getColGP()); }
             /** Get the 2nd derivative of the col Gauss filter. */
-            inline const T* getColGPP(void) const { return col_gpp; }
+            inline const T* getColGPP(void) const { return (col_bank != NULL ? col_bank->gpp : NULL); }
             /** Get the 2nd derivative of the col Gauss filter as cv::Mat. */
-            inline const cv::Mat getMatColGPP(void) const { return cv::Mat(1,getColFilterLength(),cv::DataType<T>::type,(void*)col_gpp); }
+            inline const cv::Mat getMatColGPP(void) const { return cv::Mat(1,getColFilterLength(),cv::DataType<T>::type,(void*)getColGPP()); }
 
             ///
             // 2-D coordinate helper interface (e.g., allow to set/check for invalid/valid coordinates)
@@ -199,18 +312,164 @@ class IsophoteEyeCenterDetector
              *  Note that setSigma can be used for this purpose too, if row_sigma and col_sigma are chosen accordingly.
              */
             inline void setAutoSigma(void) { manual_row_sigma = -1; manual_col_sigma = -1; }
+            /** Set the scales that are tried by the automatical sigma calculation, i.e. num_scales geometrically spaced sigmas in [min_sigma,max_sigma].
+             *  The scales are tried in ascending order and the search stops early as soon as the score does not improve anymore (see SelectSigma).
+             *  min_sigma has to be positive; an empty range (max_sigma <= min_sigma) is collapsed to the single scale min_sigma.
+             */
+            inline void setAutoSigmaRange(const T& min_sigma, const T& max_sigma, int num_scales) { auto_min_sigma = min_sigma; auto_max_sigma = std::max(min_sigma,max_sigma); auto_num_scales = (auto_max_sigma > auto_min_sigma ? std::max(num_scales,1) : 1); }
+            /** Set the channel order of 3/4-channel cv::Mat images (default: BGR, i.e. OpenCV's default order). */
+            inline void setColorOrder(ColorOrder order) { color_order = order; }
+            /** Set the precision of the accumulator. In the fixed-point modes, the curvedness of the votes is quantized relative to the max. curvedness in
+             *  the processed ROIs and the votes are added as integers (saturating) by num_threads threads (<= 0: number of cores). Integer additions do
+             *  not depend on their order, i.e. the accumulator is identical for every number of threads. The votes land in a plane of uint16_t/uint32_t,
+             *  i.e. half of the float/double plane, and are converted to T afterwards (getAcc is in the units of the curvedness in all modes).
+             */
+            inline void setAccumulatorPrecision(AccumulatorPrecision precision, int num_threads = 1) { accumulator_precision = precision; accumulator_threads = num_threads; }
+            inline AccumulatorPrecision getAccumulatorPrecision(void) const { return accumulator_precision; }
+            /** Enable the coarse-to-fine search for images without eye locations (factor <= 1: disabled, default). The face box (or the image) is
+             *  processed at 1/factor resolution (e.g., 2 or 4) and the num_candidates strongest accumulator peaks are refined at full resolution in eye
+             *  ROIs around them (see setEyeROI), i.e. the full resolution processing costs about the same as with eye locations. Every candidate is
+             *  refined independently with the sigma of the coarse detection (scaled to full resolution) and without rotation, i.e. the accumulator
+             *  values of the candidates are comparable. The result are the two refined candidates with the highest (smoothed) accumulator values; the
+             *  one with the larger x coordinate is the left eye (i.e. the left eye of the subject, as in the BioID annotations). If only one candidate
+             *  is found, it is the result for both eyes.
+             */
+            inline void setCoarseToFine(int factor, int num_candidates = 2) { coarse_factor = factor; coarse_candidates = std::max(num_candidates,1); }
+            /** Enable the sub-pixel precision (default: disabled). The votes are split bilinearly among the four accumulator cells around their sub-pixel
+             *  position (see CalculateBilinearAccumulator) and the maxima of the smoothed accumulator are refined with a quadratic fit of their 3x3
+             *  neighborhood (see getEyeCentersSubpixel/detectEyeCentersSubpixel). The fixed-point accumulators (see setAccumulatorPrecision) still
+             *  vote into the nearest cell, but their maxima are refined as well.
+             */
+            inline void setSubpixelPrecision(bool enable) { subpixel_precision = enable; }
+            inline bool getSubpixelPrecision(void) const { return subpixel_precision; }
+            /** Enable the canonical scale (iod <= 0: disabled, default). Faces whose interocular distance is larger than iod pixels are resampled
+             *  (area average) to iod pixels before the filtering, i.e. the processing costs the same for every face size and camera resolution. The
+             *  interocular distance is the distance of the eye locations or, without both eye locations, estimated from the width of the face box.
+             *  The sigmas (see setSigma/setAutoSigmaRange) and the eye ROI (see setEyeROI) are in pixels of the canonical scale and the results
+             *  are mapped back to the image with sub-pixel precision (see getEyeCentersSubpixel). The image planes (e.g., getAcc) are not updated
+             *  if the face has been resampled.
+             */
+            inline void setCanonicalInterocularDistance(T iod) { canonical_iod = iod; }
+            /** Select the image planes that are retained by process/detectEyeCenters (a combination of OutputPlane; default: AllOutputPlanes). The
+             *  accumulator is always retained. If not all planes are selected, the isophote information is calculated and voted in one pass
+             *  (see CalculateIsophoteAccumulator) and only the selected isophote planes are written. If no derivative plane is selected, the
+             *  derivatives are calculated in strips of rows (i.e., in the cache) and the derivative planes are not written either. The content of
+             *  the other planes is undefined, i.e. vote does not work after process (use processIsophotes, which always retains all planes).
+             *  The fixed-point accumulators (see setAccumulatorPrecision) and the automatical sigma calculation (scratch) still use all planes.
+             */
+            inline void setOutputPlanes(int planes) { output_planes = planes & AllOutputPlanes; }
+            inline int getOutputPlanes(void) const { return output_planes; }
+            /** Set the filters of the Gaussian derivatives (default: GaussianDerivativeFilter). The box filters approximate the Gaussian derivatives with
+             *  a few box sums of one integral image of both eye ROIs (see CalculateBoxDerivatives), i.e. they cost the same for every sigma and are
+             *  faster than the separable filters for big sigmas (e.g., big faces without setCanonicalInterocularDistance). For sigma >= 1.5, the
+             *  relative error of the derivatives is about 10% (Lx, Ly, Lxy) and 20% (Lxx, Lyy; see kernel_benchmark --accuracy). The automatical
+             *  sigma calculation still uses its own scale-space.
+             */
+            inline void setDerivativeFilter(DerivativeFilter filter) { derivative_filter = filter; }
+            inline DerivativeFilter getDerivativeFilter(void) const { return derivative_filter; }
+            /** Enable the rotation-aware processing (default: disabled). With both eye locations, detectEyeCenters estimates the roll angle of the face
+             *  from the eye locations (see getRollAngle) and the eye ROIs (see setEyeROI) are rotated with the face, i.e. the maxima are only searched
+             *  in the rotated ROIs and tight ROIs work for tilted heads. The derivatives are calculated in the bounding boxes of the rotated ROIs directly
+             *  from the unrotated image: the isophotes of an isotropic sigma do not depend on the rotation, and the rotated anisotropic Gaussian of
+             *  different row/col sigmas (along the eye line and perpendicular to it) is decomposed into a row filter and a sheared column filter (see
+             *  ShearedColumnFilter). The box filters (see setDerivativeFilter) are axis-aligned, i.e. rotated anisotropic sigmas always use the
+             *  separable Gaussian filters.
+             */
+            inline void setRotationAware(bool enable) { rotation_aware = enable; }
+            inline bool getRotationAware(void) const { return rotation_aware; }
+            /** Back the image planes with transparent huge pages (if supported by the platform). Takes effect with the next (re-)allocation of the image memory. */
+            inline void setUseHugePages(bool use_huge_pages) { image_slab.setUseHugePages(use_huge_pages); }
 
         protected:
+            /** Implementation of detectEyeCenters for all image view types (see image_view.hpp). The roll angle (see setRotationAware) is passed
+             *  explicitly, i.e. it is only estimated from the eye locations of the caller (see GetEyeRollAngle) and not from internal candidates.
+             */
+            template <typename V> EyeCenterLocations<coord_t> DetectEyeCentersView(const V& img,
+                                                                                   const cv::Rect_<coord_t>& face_box,
+                                                                                   const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                                                                   T roll_angle);
+            /** Coarse-to-fine search in region (the face box or the image) for images without eye locations (see setCoarseToFine). */
+            template <typename V> EyeCenterLocations<coord_t> DetectEyeCentersCoarseToFine(const V& img,
+                                                                                           const cv::Rect_<coord_t>& region,
+                                                                                           const cv::Rect_<coord_t>& face_box);
+            /** Detection at the canonical scale, i.e. the region around the eyes is resampled by scale (< 1) (see setCanonicalInterocularDistance). */
+            template <typename V> EyeCenterLocations<coord_t> DetectEyeCentersCanonical(const V& img, T scale,
+                                                                                        const cv::Rect_<coord_t>& face_box,
+                                                                                        const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye,
+                                                                                        T roll_angle);
+            /** Get the roll angle of the processing for the eye locations of the caller (0 if not rotation aware or without both eye locations). */
+            T GetEyeRollAngle(const cv::Point_<coord_t>& left_eye, const cv::Point_<coord_t>& right_eye) const;
+            /** Get the detector for resampled images (coarse-to-fine search, canonical scale) with the settings of this detector, but the sigmas
+             *  multiplied by sigma_scale.
+             */
+            IsophoteEyeCenterDetector<T>& GetResampledDetector(T sigma_scale);
+            /** Get the size of the eye ROIs (width/height) and the position of the eye location in the ROI (x/y). */
+            cv::Rect_<coord_t> GetEyeROI(const cv::Rect_<coord_t>& face_box, bool has_face_box) const;
+            /** Get the value of the accumulator at p after the smoothing of detectEyeCenters (only the neighborhood of p is smoothed) and, optionally,
+             *  the sub-pixel position of the maximum p (see setSubpixelPrecision).
+             */
+            T GetSmoothedAccumulatorValue(const cv::Point_<coord_t>& p, cv::Point_<T>* subpixel_p = NULL) const;
+            /** Implementation of process and processIsophotes (calculate_accumulator=false) for all image view types (see image_view.hpp). */
+            template <typename V> void ProcessView(const V& img,
+                                                   T row_sigma, T col_sigma,
+                                                   const cv::Rect_<coord_t>& left_roi,
+                                                   const cv::Rect_<coord_t>& right_roi,
+                                                   T roll_angle = 0,
+                                                   bool calculate_accumulator = true);
+
+            /** Output planes of FilterDerivatives (row-major, row stride buf_stride); row 0 of the planes is row y0 of the image. */
+            struct DerivativePlanes
+            {
+                T *Lx, *Ly, *Lxx, *Lxy, *Lyy;
+                int y0;
+            };
+            /** Get the derivative planes of the image (y0 = 0). */
+            inline DerivativePlanes GetImageDerivativePlanes(void) const { DerivativePlanes planes = { Lx, Ly, Lxx, Lxy, Lyy, 0 }; return planes; }
+            /** Calculate the Gaussian derivatives Lx, Ly, Lxx, Lxy and Lyy in the ROI with the current filter banks or box filters (see ProcessView and
+             *  setDerivativeFilter). The derivatives are always stored in row-major planes, but the order of the separable filter passes follows the
+             *  memory layout of the image, i.e. column-major image views (see ImageView::isColumnMajor) are filtered column-first. out.y0 has to be
+             *  <= max(0,roi.y - col_length/2), i.e. the planes can be a strip of rows that holds the ROI (see ProcessFused).
+             */
+            template <typename V> void FilterDerivatives(const V& img, const cv::Rect_<coord_t>& roi, const DerivativePlanes& out);
+            template <typename S> void FilterDerivatives(const ImageView<S>& img, const cv::Rect_<coord_t>& roi, const DerivativePlanes& out);
+            /** Calculate the Gaussian derivatives in the ROI with the row filter and the sheared column filter of a rotated anisotropic Gaussian (see
+             *  FilterDerivatives and setRotationAware), i.e. the derivatives along the rows and the sheared columns are combined to the derivatives
+             *  along the image axes.
+             */
+            template <typename V> void FilterShearedDerivatives(const V& img, const cv::Rect_<coord_t>& roi, const DerivativePlanes& out);
+            /** Calculate the integral image of the box filters for both ROIs (plus the support of the boxes; see setDerivativeFilter). */
+            template <typename V> void IntegralImageSetup(const V& img, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi);
+            /** Calculate the box approximations of the derivatives in the ROI from the integral image (see FilterDerivatives and IntegralImageSetup). */
+            void FilterBoxDerivatives(const cv::Rect_<coord_t>& roi, const DerivativePlanes& out);
+            /** Calculate the isophotes and the (floating-point) accumulator of the ROIs in one pass; only the selected planes are written (see setOutputPlanes). */
+            template <typename V> void ProcessFused(const V& img, const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi);
+
+            /** Vote with the pixels in the ROI into the accumulator (see vote). The fixed-point modes vote into qacc and convert it to acc. */
+            void VoteAccumulator(const cv::Rect_<coord_t>& roi, T min_radius, T max_radius, T min_curvedness, bool zero_acc);
+            template <typename A> void VoteQuantizedAccumulator(const cv::Rect_<coord_t>& roi, T min_radius, T max_radius, T min_curvedness, bool zero_acc);
+            /** Set the quantization of the fixed-point accumulator for the current isophote information, i.e. the max. curvedness of a vote in the ROIs
+             *  gets the max. weight.
+             */
+            void SetAccumulatorWeightScale(const cv::Rect_<coord_t>& left_roi, const cv::Rect_<coord_t>& right_roi);
+
+            /** Select the "best" (isotropic) sigma for the ROIs, i.e. the sigma for which the votes are most concentrated in the accumulator peaks.
+             *  The scales are calculated with an incremental Gaussian scale-space, i.e. L(sigma_i) is calculated from L(sigma_{i-1}) with a
+             *  sqrt(sigma_i^2 - sigma_{i-1}^2) blur, and the derivatives are calculated with central differences. Thus, a scale costs considerably
+             *  less than a call of process. Overwrites the content of the image buffers.
+             */
+            template <typename V> T SelectSigma(const V& img,
+                                                const cv::Rect_<coord_t>& left_roi,
+                                                const cv::Rect_<coord_t>& right_roi);
+            /** Get the concentration of the accumulator in the ROI, i.e. the peak of the smoothed accumulator divided by the sum of all votes in the ROI. */
+            T GetAccumulatorConcentration(int width, int height, const cv::Rect_<coord_t>& roi) const;
+
             /** (Re-)Allocate image memory/buffers if necessary.
              *  -> it is recommended to set set_zero=true in order to set the allocated memory to 0 at least ones (this avoids problems with undefined values in unprocessed image border areas!)
+             *  Throws std::bad_alloc if the allocation fails; then, the buffers are released, i.e. the next call allocates again.
              */
             void ReallocateImageMemory(int new_width, int new_height, bool set_zero = true);
             /** Release/Free the image memory/buffers. */
             void ReleaseImageMemory(void);
-            /** (Re-)Allocate filter memory/buffers if necessary */
-            void ReallocateFilterMemory(int new_row_length, int new_col_length);
-            /** Release/Free the filter memory/buffers. */
-            void ReleaseFilterMemory(void);
 
         private:
             // information about the image and applied filters
@@ -220,21 +479,52 @@ class IsophoteEyeCenterDetector
             T current_row_sigma, current_col_sigma; // sigma used for calculation (separate sigma for row and column filter); use GetGaussLength to calculate the length of the filters
             cv::Rect_<coord_t> current_left_roi,    // ROI in which the left eye center is expected and searched
                                current_right_roi;   // ROI in which the right eye center is expected and searched
+            cv::RotatedRect current_left_oriented_roi,  // rotated eye ROIs of the last detectEyeCenters call (see getCurrentOrientedSearchRegions)
+                            current_right_oriented_roi;
+            T current_roll_angle;                   // roll angle of the face used for calculation (see setRotationAware)
 
             // manually set parameters
             cv::Rect_<coord_t> manual_eye_roi;      // manually set width/height and anchor of ROI around eye detections
             T manual_row_sigma, manual_col_sigma;   // manually set row/col sigma
+            ColorOrder color_order;                 // channel order of 3/4-channel cv::Mat images
+            T auto_min_sigma, auto_max_sigma;       // range of the automatical sigma calculation
+            int auto_num_scales;                    // number of scales that are tried by the automatical sigma calculation
+            AccumulatorPrecision accumulator_precision; // floating-point or fixed-point accumulator
+            int accumulator_threads;                // number of threads that vote into the fixed-point accumulator
+            T acc_weight_scale;                     // quantization of the votes of the fixed-point accumulator (weight = curvedness*acc_weight_scale)
+            int coarse_factor;                      // downsampling factor of the coarse-to-fine search (<= 1: disabled)
+            int coarse_candidates;                  // number of candidates of the coarse-to-fine search that are refined at full resolution
+            T canonical_iod;                        // interocular distance of the canonical scale (<= 0: disabled)
+            bool subpixel_precision;                // bilinear voting and refinement of the accumulator maxima
+            int output_planes;                      // retained image planes (combination of OutputPlane)
+            DerivativeFilter derivative_filter;     // separable Gaussian derivatives or their box approximations
+            bool rotation_aware;                    // estimate the roll angle of the face and rotate the eye ROIs and filters with it
+            T filter_shear;                         // shear of the column filter of rotated anisotropic sigmas (0: axis-aligned separable filters)
+            std::vector<T> resampled_image;         // resampled search region (coarse-to-fine search, canonical scale)
+            std::unique_ptr<IsophoteEyeCenterDetector<T> > resampled_detector; // detector for the resampled search region
+            EyeCenterLocations<T> subpixel_centers; // sub-pixel eye center locations of the last detection
 
             // image buffers/memory
+            AlignedSlab image_slab;                 // the memory of all image buffers (the planes below are carved out of the slab)
+            AlignedSlab strip_slab;                 // derivative strips of the fused processing (see ProcessFused)
+            AlignedSlab integral_slab;              // integral image (double elements) of the box filters (see IntegralImageSetup)
+            cv::Rect_<coord_t> integral_region;     // image region of the integral image
+            int integral_stride;                    // row stride (in elements) of the integral image
             int buf_width, buf_height;              // width/height of currently allocated image buffers
+            int buf_stride;                         // row stride (in elements) of the row-major image buffers
+            int buf_tmp_stride;                     // row stride (in elements) of the col-major temporary image buffer, i.e. tmpColMajor
             T *k, *c, *dx, *dy;                     // curvedness, curvature, x- and y-displacement
             T *Lx, *Ly, *Lxx, *Lxy, *Lyy;           // 1st and 2nd order derivatives
             T *tmpColMajor;                         // col-major image as temporary storage for efficient filtering
             T *tmpT1, *tmpLx2, *tmpLy2;             // temporary variables for efficient isophote calculation
             T *acc;                                 // the accumulator
-            // filter buffers/memory
-            int buf_length;                         // length of currently allocated filter buffers
-            T *row_g, *row_gp, *row_gpp;            // row filters (Gaussian, 1st derivative, 2nd derivative)
-            T *col_g, *col_gp, *col_gpp;            // col filters (Gaussian, 1st derivative, 2nd derivative)
-            T *row_ax, *col_ax;                     // support for filter calculation
+            void *qacc;                             // the fixed-point accumulator (uint16_t/uint32_t elements, row stride buf_stride)
+            T *Ls;                                  // smoothed image of the scale-space (automatical sigma calculation)
+            // filters (shared, immutable filter banks; see gauss_filter_bank.hpp)
+            const GaussFilterBank<T>* row_bank;     // row filters (Gaussian, 1st derivative, 2nd derivative)
+            const GaussFilterBank<T>* col_bank;     // col filters (Gaussian, 1st derivative, 2nd derivative)
+            std::unique_ptr<GaussFilterBank<T> > row_overflow_bank; // row filters that did not fit into the filter bank cache
+            std::unique_ptr<GaussFilterBank<T> > col_overflow_bank; // col filters that did not fit into the filter bank cache
+            BoxDerivativeKernel<T> row_box;         // box approximations of the row filters (see setDerivativeFilter)
+            BoxDerivativeKernel<T> col_box;         // box approximations of the col filters
 };
@@ -0,0 +1,579 @@
+/** Micro-benchmarks of the image processing kernels (filters, isophotes, accumulator).
+ *
+ * \author Boris Schauerte
+ * \email  boris.schauerte@eyezag.com
+ * \date   2011
+ *
+ * Copyright (C) 2011  Boris Schauerte
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "separable_filter.hpp"
+#include "gauss_filter.hpp"
+#include "box_filter.hpp"
+#include "isophote.hpp"
+#include "corrfilter1d.hpp"
+#include "aligned_slab.hpp"
+#include "instrumentation.hpp"
+#include "typetostring.hpp"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/** Benchmark settings (see PrintUsage). */
+struct BenchmarkOptions
+{
+    double min_time_ms;   // minimal measurement time per repetition
+    int repetitions;      // number of repetitions; the median is reported
+    bool quick;           // reduced sweep
+    bool csv;             // print CSV instead of a table
+    bool accuracy;        // compare the box derivative filters with the Gaussian derivative filters instead of timing the kernels
+    std::string filter;   // only run kernels whose name contains filter
+
+    BenchmarkOptions(void)
+    : min_time_ms(20), repetitions(5), quick(false), csv(false), accuracy(false)
+    {
+    }
+};
+
+/** One measurement: the kernel is called until min_time_ms has elapsed, which is repeated repetitions times. */
+struct BenchmarkResult
+{
+    double ns_per_call; // median over the repetitions
+    double ns_per_pixel;
+    double gb_per_s;
+};
+
+static volatile double benchmark_sink = 0; // keeps the compiler from removing the kernels
+
+/** Time kernel() and derive the per-pixel time and the bandwidth from the processed pixels and the bytes that are read and written per call. */
+template <typename F>
+static BenchmarkResult
+TimeKernel(const BenchmarkOptions& options, F kernel, double pixels, double bytes)
+{
+    typedef std::chrono::steady_clock clock_t;
+
+    kernel(); // warm-up (caches, page faults, lazy allocations)
+
+    std::vector<double> ns_per_call(options.repetitions);
+    for (int r = 0; r < options.repetitions; r++)
+    {
+        long calls = 0;
+        const clock_t::time_point start = clock_t::now();
+        double elapsed_ns = 0;
+        do
+        {
+            kernel();
+            calls++;
+            elapsed_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - start).count();
+        }
+        while (elapsed_ns < options.min_time_ms*1e6);
+        ns_per_call[r] = elapsed_ns / calls;
+    }
+    std::sort(ns_per_call.begin(),ns_per_call.end());
+
+    BenchmarkResult result;
+    result.ns_per_call = ns_per_call[ns_per_call.size() / 2];
+    result.ns_per_pixel = result.ns_per_call / pixels;
+    result.gb_per_s = bytes / result.ns_per_call; // bytes/ns = GB/s
+    return result;
+}
+
+static void
+PrintHeader(const BenchmarkOptions& options)
+{
+    if (options.csv)
+        printf("kernel,type,image,roi,sigma,us_per_call,ns_per_pixel,gb_per_s\n");
+    else
+        printf("%-34s %-7s %-10s %-10s %6s %12s %10s %8s\n","kernel","type","image","roi","sigma","us/call","ns/pixel","GB/s");
+}
+
+static void
+PrintResult(const BenchmarkOptions& options, const std::string& kernel, const std::string& type, int width, int height, int roi_width, int roi_height, double sigma, const BenchmarkResult& result)
+{
+    char image[32], roi[32];
+    snprintf(image,sizeof(image),"%dx%d",width,height);
+    snprintf(roi,sizeof(roi),"%dx%d",roi_width,roi_height);
+    if (options.csv)
+        printf("%s,%s,%s,%s,%g,%.3f,%.4f,%.3f\n",kernel.c_str(),type.c_str(),image,roi,sigma,result.ns_per_call*1e-3,result.ns_per_pixel,result.gb_per_s);
+    else
+        printf("%-34s %-7s %-10s %-10s %6.2f %12.3f %10.4f %8.3f\n",kernel.c_str(),type.c_str(),image,roi,sigma,result.ns_per_call*1e-3,result.ns_per_pixel,result.gb_per_s);
+    fflush(stdout);
+}
+
+static bool
+IsSelected(const BenchmarkOptions& options, const std::string& kernel)
+{
+    return options.filter.empty() || kernel.find(options.filter) != std::string::npos;
+}
+
+/** Create the (flipped) Gaussian derivative filters for sigma. */
+template <typename T>
+static void
+CreateFilters(T sigma, std::vector<T>& g, std::vector<T>& gp, std::vector<T>& gpp)
+{
+    const int length = GetGaussLength<T,int>(sigma);
+    std::vector<T> ax(length);
+    g.resize(length);
+    gp.resize(length);
+    gpp.resize(length);
+    GetGaussSupport<T,int>(sigma,&ax[0]);
+    CreateGauss(sigma,false,&ax[0],&g[0]);
+    CreateGaussFirstDeriv(sigma,false,&ax[0],&gp[0]);
+    CreateGaussSecondDeriv(sigma,false,&ax[0],&gpp[0]);
+    FlipArray(&g[0],length);
+    FlipArray(&gp[0],length);
+    FlipArray(&gpp[0],length);
+}
+
+/** Run all kernel benchmarks in precision T. */
+template <typename T>
+static void
+RunBenchmarks(const BenchmarkOptions& options)
+{
+    const std::string type = TypeToString<T>();
+
+    std::vector<int> widths, heights;
+    widths.push_back(320);   heights.push_back(240);
+    widths.push_back(640);   heights.push_back(480);
+    if (!options.quick)
+    {
+        widths.push_back(1280);  heights.push_back(720);
+        widths.push_back(1920);  heights.push_back(1080);
+    }
+    std::vector<int> roi_widths, roi_heights; // 0 => complete image
+    roi_widths.push_back(48);  roi_heights.push_back(36); // default eye ROI
+    roi_widths.push_back(160); roi_heights.push_back(120);
+    roi_widths.push_back(0);   roi_heights.push_back(0);
+    std::vector<T> sigmas;
+    sigmas.push_back(T(1));
+    sigmas.push_back(T(2));
+    if (!options.quick)
+        sigmas.push_back(T(4));
+
+    // Filter creation (independent of the image size); "pixels" are the filter taps
+    for (size_t s = 0; s < sigmas.size(); s++)
+    {
+        const T sigma = sigmas[s];
+        const int length = GetGaussLength<T,int>(sigma);
+        std::vector<T> ax(length), out(length);
+        GetGaussSupport<T,int>(sigma,&ax[0]);
+        if (IsSelected(options,"CreateGauss"))
+            PrintResult(options,"CreateGauss",type,length,1,length,1,sigma,
+                        TimeKernel(options,[&]() { CreateGauss(sigma,false,&ax[0],&out[0]); benchmark_sink += out[0]; },length,2.0*length*sizeof(T)));
+        if (IsSelected(options,"CreateGaussFirstDeriv"))
+            PrintResult(options,"CreateGaussFirstDeriv",type,length,1,length,1,sigma,
+                        TimeKernel(options,[&]() { CreateGaussFirstDeriv(sigma,false,&ax[0],&out[0]); benchmark_sink += out[0]; },length,2.0*length*sizeof(T)));
+        if (IsSelected(options,"CreateGaussSecondDeriv"))
+            PrintResult(options,"CreateGaussSecondDeriv",type,length,1,length,1,sigma,
+                        TimeKernel(options,[&]() { CreateGaussSecondDeriv(sigma,false,&ax[0],&out[0]); benchmark_sink += out[0]; },length,2.0*length*sizeof(T)));
+    }
+
+    for (size_t i = 0; i < widths.size(); i++)
+    {
+        const int width = widths[i];
+        const int height = heights[i];
+        const size_t n = (size_t)width*height;
+        const int stride = GetPaddedStride<T>(width);
+        const int tmp_stride = GetPaddedStride<T>(height);
+
+        // input image and buffers
+        std::vector<uint8_t> img(n);
+        srand(42);
+        for (size_t j = 0; j < n; j++)
+            img[j] = (uint8_t)(rand() % 256);
+        std::vector<T> imgT(img.begin(),img.end());
+        std::vector<T> tmp(std::max((size_t)tmp_stride*width,n)), out(std::max((size_t)stride*height,n));
+        T* ptmp = &tmp[0];
+        T* pout = &out[0];
+
+        // Transpose
+        if (IsSelected(options,"Transpose"))
+            PrintResult(options,"Transpose",type,width,height,width,height,0,
+                        TimeKernel(options,[&]() { Transpose(&imgT[0],width,height,pout); benchmark_sink += pout[0]; },n,2.0*n*sizeof(T)));
+
+        // integral image of the box derivative filters (always double, see IsophoteEyeCenterDetector::IntegralImageSetup)
+        const int integral_stride = width + 1;
+        std::vector<double> integral((size_t)integral_stride*(height + 1));
+        const ImageView<uint8_t> view(&img[0],width,height);
+        if (IsSelected(options,"IntegralImage"))
+            PrintResult(options,"IntegralImage",type,width,height,width,height,0,
+                        TimeKernel(options,[&]() { CalculateIntegralImage(view,0,0,width,height,&integral[0],integral_stride); benchmark_sink += integral[n]; },n,n*(1.0 + sizeof(double))));
+        CalculateIntegralImage(view,0,0,width,height,&integral[0],integral_stride);
+
+        for (size_t s = 0; s < sigmas.size(); s++)
+        {
+            const T sigma = sigmas[s];
+            std::vector<T> g, gp, gpp;
+            CreateFilters(sigma,g,gp,gpp);
+            const int length = (int)g.size();
+
+            // RowFilter without ROI (8-bit input, transposed output)
+            if (IsSelected(options,"RowFilter"))
+                PrintResult(options,"RowFilter",type,width,height,width,height,sigma,
+                            TimeKernel(options,[&]() { RowFilter(&img[0],width,height,&g[0],length,ptmp,true); benchmark_sink += ptmp[0]; },n,n*(1.0 + sizeof(T))));
+
+            // SeparableFilter (row + col pass, 8-bit input)
+            if (IsSelected(options,"SeparableFilter"))
+                PrintResult(options,"SeparableFilter",type,width,height,width,height,sigma,
+                            TimeKernel(options,[&]() { SeparableFilter(&img[0],width,height,&g[0],length,&g[0],length,ptmp,pout); benchmark_sink += pout[0]; },n,n*(1.0 + 3.0*sizeof(T))));
+
+            // RowFilter with ROI (strided, transposed output), i.e. the first and second pass of IsophoteEyeCenterDetector::process
+            for (size_t r = 0; r < roi_widths.size(); r++)
+            {
+                const int roi_width = (roi_widths[r] > 0 ? std::min(roi_widths[r],width) : width);
+                const int roi_height = (roi_heights[r] > 0 ? std::min(roi_heights[r],height) : height);
+                const int roi_x = (width - roi_width) / 2;
+                const int roi_y = (height - roi_height) / 2;
+                const double roi_n = (double)roi_width*roi_height;
+                if (IsSelected(options,"RowFilter(ROI,uint8)"))
+                    PrintResult(options,"RowFilter(ROI,uint8)",type,width,height,roi_width,roi_height,sigma,
+                                TimeKernel(options,[&]() { RowFilter(&img[0],width,height,width,&g[0],length,ptmp,tmp_stride,roi_x,roi_y,roi_width,roi_height,false,true); benchmark_sink += ptmp[0]; },
+                                           roi_n,roi_n*(1.0 + sizeof(T))));
+                if (IsSelected(options,"RowFilter(ROI,transposed)"))
+                    PrintResult(options,"RowFilter(ROI,transposed)",type,width,height,roi_width,roi_height,sigma,
+                                TimeKernel(options,[&]() { RowFilter(ptmp,height,width,tmp_stride,&gp[0],length,pout,stride,roi_y,roi_x,roi_height,roi_width,false,true); benchmark_sink += pout[0]; },
+                                           roi_n,roi_n*2.0*sizeof(T)));
+                // column pass of the rotated anisotropic Gaussians (see IsophoteEyeCenterDetector::setRotationAware)
+                if (IsSelected(options,"ShearedColumnFilter(ROI)"))
+                    PrintResult(options,"ShearedColumnFilter(ROI)",type,width,height,roi_width,roi_height,sigma,
+                                TimeKernel(options,[&]() { ShearedColumnFilter(&imgT[0],width,height,width,&gp[0],length,T(0.5),pout,stride,roi_x,roi_y,roi_width,roi_height);
+                                                           benchmark_sink += pout[(roi_y + roi_height / 2)*stride + roi_x + roi_width / 2]; },
+                                           roi_n,roi_n*2.0*sizeof(T)));
+            }
+
+            // box approximations of the five derivatives (see CalculateBoxDerivatives): 12 box sums per pixel for every sigma
+            if (IsSelected(options,"BoxDerivatives"))
+            {
+                BoxDerivativeKernel<T> box;
+                CreateBoxDerivativeKernel(sigma,box);
+                std::vector<T> Lx(n), Ly(n), Lxx(n), Lxy(n), Lyy(n);
+                PrintResult(options,"BoxDerivatives",type,width,height,width,height,sigma,
+                            TimeKernel(options,[&]() { CalculateBoxDerivatives(&integral[0],integral_stride,0,0,width,height,box,box,0,0,width,height,&Lx[0],&Ly[0],&Lxx[0],&Lxy[0],&Lyy[0],width);
+                                                       benchmark_sink += Lxy[n / 2]; },n,n*(sizeof(double) + 5.0*sizeof(T))));
+            }
+
+            // CorrFilterPaddedArray: every image row is padded once and filtered
+            if (IsSelected(options,"CorrFilterPaddedArray"))
+            {
+                std::vector<T> padded(width + 2*length);
+                T* padded_array = &padded[0];
+                T* padded_data = PadArray(padded_array,&imgT[0],width,ReplicatePad,length);
+                PrintResult(options,"CorrFilterPaddedArray",type,width,height,width,height,sigma,
+                            TimeKernel(options,[&]() {
+                                for (int y = 0; y < height; y++)
+                                {
+                                    T* row_out = pout + (size_t)y*width;
+                                    CorrFilterPaddedArray(row_out,padded_data,width,&g[0],length,length/2 + 1);
+                                }
+                                benchmark_sink += pout[0];
+                            },n,n*2.0*sizeof(T)));
+            }
+        }
+
+        // Isophotes and accumulator on realistic derivatives (sigma = 1)
+        std::vector<T> g, gp, gpp;
+        CreateFilters(T(1),g,gp,gpp);
+        const int length = (int)g.size();
+        std::vector<T> Lx(n), Ly(n), Lxx(n), Lxy(n), Lyy(n), k(n), c(n), dx(n), dy(n), acc(n), tmpT1(n), tmpLx2(n), tmpLy2(n);
+        RowFilter(&img[0],width,height,&g[0],length,ptmp,true);
+        RowFilter(ptmp,height,width,&gp[0],length,&Ly[0],true);
+        RowFilter(ptmp,height,width,&gpp[0],length,&Lyy[0],true);
+        RowFilter(&img[0],width,height,&gp[0],length,ptmp,true);
+        RowFilter(ptmp,height,width,&g[0],length,&Lx[0],true);
+        RowFilter(ptmp,height,width,&gp[0],length,&Lxy[0],true);
+        RowFilter(&img[0],width,height,&gpp[0],length,ptmp,true);
+        RowFilter(ptmp,height,width,&g[0],length,&Lxx[0],true);
+
+        if (IsSelected(options,"CalculateIsophoteInformation"))
+        {
+            PrintResult(options,"CalculateIsophoteInformation",type,width,height,width,height,1,
+                        TimeKernel(options,[&]() { CalculateIsophoteInformation(&Lx[0],&Ly[0],&Lxx[0],&Lxy[0],&Lyy[0],width,height,&k[0],&c[0],&dx[0],&dy[0],&tmpT1[0],&tmpLx2[0],&tmpLy2[0]); benchmark_sink += k[0]; },
+                                   n,n*9.0*sizeof(T)));
+            for (size_t r = 0; r < roi_widths.size(); r++)
+            {
+                if (roi_widths[r] <= 0)
+                    continue;
+                const int roi_width = std::min(roi_widths[r],width);
+                const int roi_height = std::min(roi_heights[r],height);
+                const int roi_x = (width - roi_width) / 2;
+                const int roi_y = (height - roi_height) / 2;
+                const double roi_n = (double)roi_width*roi_height;
+                PrintResult(options,"CalculateIsophoteInformation(ROI)",type,width,height,roi_width,roi_height,1,
+                            TimeKernel(options,[&]() { CalculateIsophoteInformation(&Lx[0],&Ly[0],&Lxx[0],&Lxy[0],&Lyy[0],width,height,width,&k[0],&c[0],&dx[0],&dy[0],roi_x,roi_y,roi_width,roi_height,&tmpT1[0],&tmpLx2[0],&tmpLy2[0]); benchmark_sink += k[0]; },
+                                       roi_n,roi_n*9.0*sizeof(T)));
+            }
+        }
+
+        CalculateIsophoteInformation(&Lx[0],&Ly[0],&Lxx[0],&Lxy[0],&Lyy[0],width,height,&k[0],&c[0],&dx[0],&dy[0],&tmpT1[0],&tmpLx2[0],&tmpLy2[0]);
+        // accumulator: reads k, c, dx, dy and zeroes/updates acc (the scattered updates are not included in the bandwidth)
+        if (IsSelected(options,"CalculateAccumulator"))
+            PrintResult(options,"CalculateAccumulator",type,width,height,width,height,1,
+                        TimeKernel(options,[&]() { CalculateAccumulator(&k[0],&c[0],&dx[0],&dy[0],width,height,&acc[0],false,true); benchmark_sink += acc[0]; },n,n*5.0*sizeof(T)));
+        // isophotes and voting in one pass (see CalculateIsophoteAccumulator): reads the five derivative planes, no isophote planes are written
+        if (IsSelected(options,"IsophoteAccumulator"))
+            PrintResult(options,"IsophoteAccumulator",type,width,height,width,height,1,
+                        TimeKernel(options,[&]() { std::fill(acc.begin(),acc.end(),T(0));
+                                                   CalculateIsophoteAccumulator(&Lx[0],&Ly[0],&Lxx[0],&Lxy[0],&Lyy[0],width,height,width,0,0,width,height,0,&acc[0]);
+                                                   benchmark_sink += acc[0]; },n,n*5.0*sizeof(T)));
+        // bilinear voting (see CalculateBilinearAccumulator): four scattered updates per vote
+        if (IsSelected(options,"BilinearAccumulator"))
+            PrintResult(options,"BilinearAccumulator",type,width,height,width,height,1,
+                        TimeKernel(options,[&]() { std::fill(acc.begin(),acc.end(),T(0));
+                                                   CalculateBilinearAccumulator(&k[0],&c[0],&dx[0],&dy[0],width,height,width,0,0,width,height,&acc[0]);
+                                                   benchmark_sink += acc[0]; },n,n*5.0*sizeof(T)));
+        // fixed-point accumulator (see CalculateQuantizedAccumulator): single-threaded and with one thread per core
+        {
+            const int roi_x = 0, roi_y = 0;
+            const T max_c = std::max(*std::max_element(c.begin(),c.end()),T(1e-6));
+            std::vector<uint16_t> qacc16(n);
+            std::vector<uint32_t> qacc32(n);
+            for (int t = 0; t < 2; t++)
+            {
+                const int num_threads = (t == 0 ? 1 : 0);
+                const std::string suffix = (t == 0 ? ")" : ",threads)");
+                if (IsSelected(options,"QuantizedAccumulator(u16" + suffix))
+                    PrintResult(options,"QuantizedAccumulator(u16" + suffix,type,width,height,width,height,1,
+                                TimeKernel(options,[&]() { std::fill(qacc16.begin(),qacc16.end(),uint16_t(0));
+                                                           CalculateQuantizedAccumulator(&k[0],&c[0],&dx[0],&dy[0],width,height,width,roi_x,roi_y,width,height,&qacc16[0],width,T(255) / max_c,num_threads);
+                                                           benchmark_sink += qacc16[0]; },n,n*(4.0*sizeof(T) + sizeof(uint16_t))));
+                if (IsSelected(options,"QuantizedAccumulator(u32" + suffix))
+                    PrintResult(options,"QuantizedAccumulator(u32" + suffix,type,width,height,width,height,1,
+                                TimeKernel(options,[&]() { std::fill(qacc32.begin(),qacc32.end(),uint32_t(0));
+                                                           CalculateQuantizedAccumulator(&k[0],&c[0],&dx[0],&dy[0],width,height,width,roi_x,roi_y,width,height,&qacc32[0],width,T(65535) / max_c,num_threads);
+                                                           benchmark_sink += qacc32[0]; },n,n*(4.0*sizeof(T) + sizeof(uint32_t))));
+            }
+        }
+        if (IsSelected(options,"CalculateAccumulatorPosK"))
+            PrintResult(options,"CalculateAccumulatorPosK",type,width,height,width,height,1,
+                        TimeKernel(options,[&]() { CalculateAccumulatorPosK(&k[0],&c[0],&dx[0],&dy[0],width,height,&acc[0],false,true); benchmark_sink += acc[0]; },n,n*5.0*sizeof(T)));
+    }
+}
+
+/** Filter img with the separable filters (not flipped) and store Lx, Ly, Lxx, Lxy and Lyy in L. */
+template <typename T>
+static void
+FilterDerivatives(const std::vector<uint8_t>& img, int width, int height, std::vector<T> g, std::vector<T> gp, std::vector<T> gpp, std::vector<T>* L)
+{
+    const int length = (int)g.size();
+    FlipArray(&g[0],length);
+    FlipArray(&gp[0],length);
+    FlipArray(&gpp[0],length);
+    std::vector<T> tmp((size_t)width*height);
+    for (int i = 0; i < 5; i++)
+        L[i].assign((size_t)width*height,T(0));
+    RowFilter(&img[0],width,height,&g[0],length,&tmp[0],true);
+    RowFilter(&tmp[0],height,width,&gp[0],length,&L[1][0],true);
+    RowFilter(&tmp[0],height,width,&gpp[0],length,&L[4][0],true);
+    RowFilter(&img[0],width,height,&gp[0],length,&tmp[0],true);
+    RowFilter(&tmp[0],height,width,&g[0],length,&L[0][0],true);
+    RowFilter(&tmp[0],height,width,&gp[0],length,&L[3][0],true);
+    RowFilter(&img[0],width,height,&gpp[0],length,&tmp[0],true);
+    RowFilter(&tmp[0],height,width,&g[0],length,&L[2][0],true);
+}
+
+/** Relative RMS error of the box derivative filters (see CreateBoxDerivativeKernel) and the Gaussian derivative filters (see CreateGauss,
+ *  CreateGaussFirstDeriv and CreateGaussSecondDeriv) on a synthetic image with dark disks (pupils/irises) of different sizes and noise. The
+ *  reference is the Gaussian derivative with 6*sigma support, because the support of the Gaussian derivative filters (3*sigma) is too small for
+ *  the 2nd derivative, i.e. its response to constant signals is not 0.
+ */
+template <typename T>
+static void
+RunAccuracyComparison(const BenchmarkOptions& options)
+{
+    const std::string type = TypeToString<T>();
+    const int width = 640, height = 480;
+    const size_t n = (size_t)width*height;
+
+    std::vector<uint8_t> img(n);
+    {
+        srand(42);
+        std::vector<double> disks;
+        for (int i = 0; i < 60; i++)
+        {
+            disks.push_back(rand() % width);
+            disks.push_back(rand() % height);
+            disks.push_back(3 + rand() % 25);
+        }
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+            {
+                double v = 160 + 40.0*x / width;
+                for (size_t i = 0; i < disks.size(); i += 3)
+                {
+                    const double d = sqrt((x - disks[i])*(x - disks[i]) + (y - disks[i + 1])*(y - disks[i + 1]));
+                    v -= 100 / (1 + exp(2*(d - disks[i + 2]))); // soft edge
+                }
+                v += rand() % 17 - 8;
+                img[(size_t)y*width + x] = (uint8_t)std::min(std::max(v,0.0),255.0);
+            }
+    }
+
+    std::vector<double> sigmas;
+    sigmas.push_back(1);
+    sigmas.push_back(1.5);
+    sigmas.push_back(2);
+    sigmas.push_back(3);
+    sigmas.push_back(4);
+    if (!options.quick)
+    {
+        sigmas.push_back(6);
+        sigmas.push_back(8);
+    }
+    std::vector<double> integral((size_t)(width + 1)*(height + 1));
+    CalculateIntegralImage(ImageView<uint8_t>(&img[0],width,height),0,0,width,height,&integral[0],width + 1);
+    const char* names[5] = { "Lx", "Ly", "Lxx", "Lxy", "Lyy" };
+    for (size_t s = 0; s < sigmas.size(); s++)
+    {
+        const T sigma = T(sigmas[s]);
+        std::vector<T> g, gp, gpp;
+        CreateFilters(sigma,g,gp,gpp); // flipped
+        FlipArray(&g[0],(int)g.size());
+        FlipArray(&gp[0],(int)gp.size());
+        FlipArray(&gpp[0],(int)gpp.size());
+        std::vector<T> fir[5], ref[5], box[5];
+        FilterDerivatives(img,width,height,g,gp,gpp,fir);
+        const int ref_support = (int)ceil(6*sigma);
+        g.resize(2*ref_support + 1);
+        gp.resize(2*ref_support + 1);
+        gpp.resize(2*ref_support + 1);
+        for (int i = -ref_support; i <= ref_support; i++)
+        {
+            const T e = T(exp(-i*i / (2*sigma*sigma)));
+            g[i + ref_support] = e;
+            gp[i + ref_support] = -i / (sigma*sigma) * e;
+            gpp[i + ref_support] = (i*i / (sigma*sigma*sigma*sigma) - 1 / (sigma*sigma)) * e;
+        }
+        FilterDerivatives(img,width,height,g,gp,gpp,ref);
+        BoxDerivativeKernel<T> kernel;
+        CreateBoxDerivativeKernel(sigma,kernel);
+        for (int i = 0; i < 5; i++)
+            box[i].resize(n);
+        CalculateBoxDerivatives(&integral[0],width + 1,0,0,width,height,kernel,kernel,0,0,width,height,&box[0][0],&box[1][0],&box[2][0],&box[3][0],&box[4][0],width);
+
+        const int margin = ref_support + 1; // all filters are valid
+        for (int i = 0; i < 5; i++)
+        {
+            double box_fir = 0, box_ref = 0, fir_ref = 0, sum_fir = 0, sum_ref = 0;
+            for (int y = margin; y < height - margin; y++)
+                for (int x = margin; x < width - margin; x++)
+                {
+                    const size_t j = (size_t)y*width + x;
+                    box_fir += (box[i][j] - fir[i][j])*(box[i][j] - fir[i][j]);
+                    box_ref += (box[i][j] - ref[i][j])*(box[i][j] - ref[i][j]);
+                    fir_ref += (fir[i][j] - ref[i][j])*(fir[i][j] - ref[i][j]);
+                    sum_fir += fir[i][j]*fir[i][j];
+                    sum_ref += ref[i][j]*ref[i][j];
+                }
+            if (options.csv)
+                printf("%s,%s,%g,%.4f,%.4f,%.4f\n",names[i],type.c_str(),(double)sigma,sqrt(box_fir / sum_fir),sqrt(box_ref / sum_ref),sqrt(fir_ref / sum_ref));
+            else
+                printf("%-10s %-7s %6.2f %12.4f %12.4f %12.4f\n",names[i],type.c_str(),(double)sigma,sqrt(box_fir / sum_fir),sqrt(box_ref / sum_ref),sqrt(fir_ref / sum_ref));
+        }
+    }
+}
+
+/** Cost of one instrumented stage (see instrumentation.hpp); "pixels" are the measured scopes (batches of 100 amortize the clock reads of TimeKernel). */
+static void
+RunInstrumentationBenchmarks(const BenchmarkOptions& options)
+{
+    const bool enabled = IsInstrumentationEnabled();
+    for (int e = 0; e < 2; e++)
+    {
+        const std::string kernel = (e == 0 ? "InstrumentationScope(disabled)" : "InstrumentationScope(enabled)");
+        if (!IsSelected(options,kernel))
+            continue;
+        SetInstrumentationEnabled(e == 1);
+        PrintResult(options,kernel,"-",1,1,1,1,0,
+                    TimeKernel(options,[&]() { for (int i = 0; i < 100; i++) { INSTRUMENTATION_SCOPE(RowFilterStage); benchmark_sink += 1; } },100,0));
+    }
+    SetInstrumentationEnabled(enabled);
+    ResetInstrumentation();
+}
+
+static void
+PrintUsage(const char* name)
+{
+    std::cout << "Usage: " << name << " [options]" << std::endl
+              << "  --quick            reduced sweep (small images, fewer sigmas)" << std::endl
+              << "  --csv              print CSV" << std::endl
+              << "  --accuracy         print the relative RMS errors of the box derivative filters instead of the timings" << std::endl
+              << "  --filter <name>    only run kernels whose name contains <name>" << std::endl
+              << "  --type <t>         only run float or double" << std::endl
+              << "  --min-time <ms>    minimal measurement time per repetition (default: 20)" << std::endl
+              << "  --repetitions <n>  number of repetitions; the median is reported (default: 5)" << std::endl;
+}
+
+int
+main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    std::string type;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--quick")
+            options.quick = true;
+        else if (arg == "--csv")
+            options.csv = true;
+        else if (arg == "--accuracy")
+            options.accuracy = true;
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--type" && i + 1 < argc)
+            type = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.min_time_ms = atof(argv[++i]);
+        else if (arg == "--repetitions" && i + 1 < argc)
+            options.repetitions = std::max(1,atoi(argv[++i]));
+        else
+        {
+            PrintUsage(argv[0]);
+            return (arg == "--help" || arg == "-h" ? 0 : 1);
+        }
+    }
+
+    if (options.accuracy)
+    {
+        if (options.csv)
+            printf("derivative,type,sigma,box_vs_gauss,box_vs_reference,gauss_vs_reference\n");
+        else
+            printf("%-10s %-7s %6s %12s %12s %12s\n","derivative","type","sigma","box/gauss","box/ref","gauss/ref");
+        if (type.empty() || type == "float")
+            RunAccuracyComparison<float>(options);
+        if (type.empty() || type == "double")
+            RunAccuracyComparison<double>(options);
+        return 0;
+    }
+
+    PrintHeader(options);
+    if (type.empty() || type == "float")
+        RunBenchmarks<float>(options);
+    if (type.empty() || type == "double")
+        RunBenchmarks<double>(options);
+    if (type.empty())
+        RunInstrumentationBenchmarks(options);
+
+    return 0;
+}
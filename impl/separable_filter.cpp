@@ -26,7 +26,8 @@
 #include <stdint.h>
 #include <math.h>
 
-#include <algorithm> // required for std::swap
+#include <algorithm> // required for std::swap, std::min, and std::max
+#include <vector>
 
 #ifdef __MEX
 #include "mex.h"
@@ -137,6 +138,11 @@ template void RowFilter(const uint8_t*, int, int, const float*, int, float*, boo
 template void RowFilter(const uint8_t*, int, int, const float*, int, double*, bool);
 template void RowFilter(const uint8_t*, int, int, const double*, int, double*, bool);
 template void RowFilter(const uint8_t*, int, int, const double*, int, float*, bool);
+// instantiate for uint16_t images
+template void RowFilter(const uint16_t*, int, int, const float*, int, float*, bool);
+template void RowFilter(const uint16_t*, int, int, const float*, int, double*, bool);
+template void RowFilter(const uint16_t*, int, int, const double*, int, double*, bool);
+template void RowFilter(const uint16_t*, int, int, const double*, int, float*, bool);
 // instantiate for float images
 template void RowFilter(const float*, int, int, const float*, int, float*, bool);
 template void RowFilter(const float*, int, int, const float*, int, double*, bool);
@@ -148,66 +154,207 @@ template void RowFilter(const double*, int, int, const float*, int, double*, boo
 template void RowFilter(const double*, int, int, const double*, int, double*, bool);
 template void RowFilter(const double*, int, int, const double*, int, float*, bool);
 
+/** Correlate length elements of in (step elements apart) with the filter. */
+template <typename T, typename S, typename R, typename T_size>
+inline R
+CorrelateAt(const T* in, T_size step, const S* filter, T_size length)
+{
+    R sum = 0;
+    for (T_size xf(0); xf < length; xf++)
+        sum += (R)(((S)in[xf*step]) * filter[xf]);
+    return sum;
+}
+
+/** Calculate the anchors [x_min,x_max), i.e. the output elements of a row, of the ROI row filter (see RowFilter). */
+template <typename T_size>
+inline void
+GetRowFilterAnchors(T_size width, T_size length, T_size roi_x_min, T_size roi_width, bool isolated, T_size& x_min, T_size& x_max)
+{
+    if (isolated)
+    {
+        // only elements in the ROI are processed
+        x_min = roi_x_min + length / 2;
+        x_max = roi_x_min + roi_width - length / 2;
+    }
+    else
+    {
+        // elements outside the ROI are processed as well, i.e. all filter responses in the ROI are valid
+        x_min = roi_x_min;
+        x_max = roi_x_min + roi_width;
+    }
+    // we do not support border replication and have to take care that no elements "outside the image" are processed
+    x_min = std::max(x_min,length / 2);
+    x_max = std::min(x_max,width - length / 2);
+}
+
+/** Filter one row, i.e. calculate n filter responses starting at in (in steps of in_step) and store them in out (in steps of out_step). */
+template <typename T, typename S, typename R, typename T_size>
+inline void
+FilterRow(const T* in, T_size in_step, const S* filter, T_size length, R* out, T_size out_step, T_size n)
+{
+    if (in_step == 1) // contiguous rows, i.e. let the compiler know that the step is 1
+        for (T_size x(0); x < n; x++)
+            out[x*out_step] = CorrelateAt<T,S,R,T_size>(in + x,1,filter,length);
+    else
+        for (T_size x(0); x < n; x++)
+            out[x*out_step] = CorrelateAt<T,S,R,T_size>(in + x*in_step,in_step,filter,length);
+}
+
 template <typename T, typename S, typename R, typename T_size>
 void
-RowFilter(const T* in, T_size width, T_size height, const S* filter, T_size length, R* out, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated, bool transposeOut)
+RowFilter(const ImageView<T>& in, const S* filter, T_size length, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated, bool transposeOut)
 {
-    /* automatically calculate the ROI */
+    const T_size width = in.width;
+    const T_size height = in.height;
+    const T_size step = in.pixel_step;
+
+    /* calculate the ROI */
     assert(_IS_ODD(length));
-    static bool fixme = true;
-    if (fixme)
-        std::cerr << "RowFilter ROI implementation is incomplete! Please fix me! Currently only y_min <= y < y_min + height is supported!" << std::endl;
-    fixme = false;
-
-    //const T_size x_min_isolated = roi_x_min;
-    //const T_size x_min_notisolated = roi_x_min - length / 2;
-    //const T_size x_max_isolated = (roi_x_min + roi_width - 1);
-    //const T_size x_max_notisolated = (roi_x_min + roi_width - 1) + length / 2;
-    const T_size x_min = length / 2;
-    const T_size x_max = width - length/2;
-    //const T_size x_min = (isolated ? std::max(length / 2,x_min_isolated) : std::max(length / 2,x_min_notisolated)); // we do not support border replication and have to take care the no elements "outside the image" are processed
-    //const T_size x_max = (isolated ? std::min(width - length / 2,x_max_isolated) : std::min(width - length/2,x_max_notisolated)); // we do not support border replication and have to take care the no elements "outside the image" are processed
+    assert(out_stride >= (transposeOut ? height : width));
+    (void)height; // only used by the assertion, i.e. unused if NDEBUG is defined
+    T_size x_min, x_max; // output elements of each row
+    GetRowFilterAnchors(width,length,roi_x_min,roi_width,isolated,x_min,x_max);
+    if (x_max <= x_min)
+        return;
     const T_size y_min = roi_y_min;
     const T_size y_max = (roi_y_min + roi_height - 1);
 
-//    std::cout << "ROI RowFilter:" << std::endl;
-//    std::cout << "  x_min=" << x_min << " x_max=" << x_max << std::endl; 
-//    std::cout << "  y_min=" << y_min << " y_max=" << y_max << std::endl;
-
 #ifdef _OPENMP_ROW_FILTER
 #pragma omp parallel for
 #endif
     for (T_size y = y_min; y <= y_max; y++)
     {
+        const T* row = in.row(y) + (x_min - length / 2)*step; // first input element of the first anchor
         if (transposeOut == true)
-        {
-            // input is row-major, output is column-major
-            for (T_size x_anchor(x_min*height + y), x = y*width; x_anchor < x_max*height + y; x_anchor += height, x++)
-            {
-                out[x_anchor] = 0;
-                for (T_size xf(0); xf < length; xf++)
-                    out[x_anchor] += (R)(((S)in[x + xf]) * filter[xf]);   
-            }
-        }
+            FilterRow(row,step,filter,length,out + x_min*out_stride + y,out_stride,x_max - x_min); // input is row-major, output is column-major
         else
+            FilterRow(row,step,filter,length,out + y*out_stride + x_min,T_size(1),x_max - x_min);  // input is row-major, output is row-major
+    }
+}
+// instantiate for uint8_t images
+template void RowFilter(const ImageView<uint8_t>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<uint8_t>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<uint8_t>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<uint8_t>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for uint16_t images
+template void RowFilter(const ImageView<uint16_t>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<uint16_t>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<uint16_t>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<uint16_t>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for float images
+template void RowFilter(const ImageView<float>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<float>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<float>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<float>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for double images
+template void RowFilter(const ImageView<double>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<double>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<double>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ImageView<double>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+
+template <typename T, typename S, typename R, typename T_size>
+void
+RowFilter(const ColorImageView<T>& in, const S* filter, T_size length, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated, bool transposeOut)
+{
+    const T_size width = in.width;
+    const T_size height = in.height;
+    const T_size step = in.pixel_step;
+
+    /* calculate the ROI */
+    assert(_IS_ODD(length));
+    assert(out_stride >= (transposeOut ? height : width));
+    (void)height; // only used by the assertion, i.e. unused if NDEBUG is defined
+    T_size x_min, x_max; // output elements of each row
+    GetRowFilterAnchors(width,length,roi_x_min,roi_width,isolated,x_min,x_max);
+    if (x_max <= x_min)
+        return;
+    const T_size y_min = roi_y_min;
+    const T_size y_max = (roi_y_min + roi_height - 1);
+    const T_size line_length = (x_max - x_min) + length - 1; // number of input elements of a row that are touched
+
+#ifdef _OPENMP_ROW_FILTER
+#pragma omp parallel
+#endif
+    {
+        std::vector<S> line(line_length); // luma of the touched input elements of the current row (one line buffer per thread)
+#ifdef _OPENMP_ROW_FILTER
+#pragma omp for
+#endif
+        for (T_size y = y_min; y <= y_max; y++)
         {
-            // input is row-major, output is row-major
-            const T_size _x_min = y*width + x_min;
-            const T_size _x_max = y*width + x_max;
-            for (T_size x_anchor(_x_min), x(y*width); x_anchor < _x_max; x_anchor++, x++)
-            {                
-                out[x_anchor] = 0;
-                for (T_size xf = 0; xf < length; xf++)
-                    out[x_anchor] += (R)(((S)in[x + xf]) * filter[xf]);
-            }
+            // convert the touched elements to luma (only once per element and not once per filter tap)
+            const T* row = in.row(y) + (x_min - length / 2)*step;
+            for (T_size x(0); x < line_length; x++)
+                line[x] = in.template luma<S>(row + x*step);
+
+            if (transposeOut == true)
+                FilterRow(&line[0],T_size(1),filter,length,out + x_min*out_stride + y,out_stride,x_max - x_min); // input is row-major, output is column-major
+            else
+                FilterRow(&line[0],T_size(1),filter,length,out + y*out_stride + x_min,T_size(1),x_max - x_min);  // input is row-major, output is row-major
         }
     }
 }
+// instantiate for uint8_t color images
+template void RowFilter(const ColorImageView<uint8_t>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<uint8_t>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<uint8_t>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<uint8_t>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for uint16_t color images
+template void RowFilter(const ColorImageView<uint16_t>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<uint16_t>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<uint16_t>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<uint16_t>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for float color images
+template void RowFilter(const ColorImageView<float>&, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<float>&, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<float>&, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const ColorImageView<float>&, const double*, int, float*, int, int, int, int, int, bool, bool);
+
+template <typename T, typename S, typename R, typename T_size>
+void
+RowFilter(const T* in, T_size width, T_size height, T_size in_stride, const S* filter, T_size length, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated, bool transposeOut)
+{
+    assert(in_stride >= width);
+    RowFilter(ImageView<T>(in,(int)width,(int)height,(int)in_stride),filter,length,out,out_stride,roi_x_min,roi_y_min,roi_width,roi_height,isolated,transposeOut);
+}
+// instantiate for uint8_t images
+template void RowFilter(const uint8_t*, int, int, int, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const uint8_t*, int, int, int, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const uint8_t*, int, int, int, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const uint8_t*, int, int, int, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for uint16_t images
+template void RowFilter(const uint16_t*, int, int, int, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const uint16_t*, int, int, int, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const uint16_t*, int, int, int, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const uint16_t*, int, int, int, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for float images
+template void RowFilter(const float*, int, int, int, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const float*, int, int, int, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const float*, int, int, int, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const float*, int, int, int, const double*, int, float*, int, int, int, int, int, bool, bool);
+// instantiate for double images
+template void RowFilter(const double*, int, int, int, const float*, int, float*, int, int, int, int, int, bool, bool);
+template void RowFilter(const double*, int, int, int, const float*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const double*, int, int, int, const double*, int, double*, int, int, int, int, int, bool, bool);
+template void RowFilter(const double*, int, int, int, const double*, int, float*, int, int, int, int, int, bool, bool);
+
+template <typename T, typename S, typename R, typename T_size>
+void
+RowFilter(const T* in, T_size width, T_size height, const S* filter, T_size length, R* out, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated, bool transposeOut)
+{
+    // compact (unpadded) input and output
+    RowFilter(in,width,height,width,filter,length,out,(transposeOut ? height : width),roi_x_min,roi_y_min,roi_width,roi_height,isolated,transposeOut);
+}
 // instantiate for uint8_t images
 template void RowFilter(const uint8_t*, int, int, const float*, int, float*, int, int, int, int, bool, bool);
 template void RowFilter(const uint8_t*, int, int, const float*, int, double*, int, int, int, int, bool, bool);
 template void RowFilter(const uint8_t*, int, int, const double*, int, double*, int, int, int, int, bool, bool);
 template void RowFilter(const uint8_t*, int, int, const double*, int, float*, int, int, int, int, bool, bool);
+// instantiate for uint16_t images
+template void RowFilter(const uint16_t*, int, int, const float*, int, float*, int, int, int, int, bool, bool);
+template void RowFilter(const uint16_t*, int, int, const float*, int, double*, int, int, int, int, bool, bool);
+template void RowFilter(const uint16_t*, int, int, const double*, int, double*, int, int, int, int, bool, bool);
+template void RowFilter(const uint16_t*, int, int, const double*, int, float*, int, int, int, int, bool, bool);
 // instantiate for float images
 template void RowFilter(const float*, int, int, const float*, int, float*, int, int, int, int, bool, bool);
 template void RowFilter(const float*, int, int, const float*, int, double*, int, int, int, int, bool, bool);
@@ -219,6 +366,57 @@ template void RowFilter(const double*, int, int, const float*, int, double*, int
 template void RowFilter(const double*, int, int, const double*, int, double*, int, int, int, int, bool, bool);
 template void RowFilter(const double*, int, int, const double*, int, float*, int, int, int, int, bool, bool);
 
+template <typename T, typename S, typename R, typename T_size>
+void
+ShearedColumnFilter(const T* in, T_size width, T_size height, T_size in_stride, const S* filter, T_size length, S shear, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height)
+{
+    assert(_IS_ODD(length));
+    assert(in_stride >= width);
+    const T_size half = length / 2;
+
+    // integer offset and interpolation weights of every tap, i.e. tap i reads (1-a)*in(x+s,y+j) + a*in(x+s+1,y+j)
+    std::vector<T_size> offset(length);
+    std::vector<S> w0(length), w1(length);
+    T_size min_offset = 0, max_offset = 0;
+    for (T_size i(0); i < length; i++)
+    {
+        const S o = shear * S(i - half);
+        const S s = std::floor(o);
+        const S a = o - s;
+        offset[i] = (T_size)s;
+        w0[i] = filter[i] * (S(1) - a);
+        w1[i] = filter[i] * a;
+        min_offset = std::min(min_offset,offset[i]);
+        max_offset = std::max(max_offset,offset[i]);
+    }
+
+    // anchors whose support is inside the image (we do not have any border handling, see RowFilter)
+    const T_size x_min = std::max(roi_x_min,-min_offset);
+    const T_size x_max = std::min(roi_x_min + roi_width,width - 1 - max_offset);
+    const T_size y_min = std::max(roi_y_min,half);
+    const T_size y_max = std::min(roi_y_min + roi_height,height - half);
+    if (x_max <= x_min)
+        return;
+
+    for (T_size y = y_min; y < y_max; y++)
+    {
+        R* out_row = out + y*out_stride;
+        for (T_size x = x_min; x < x_max; x++)
+            out_row[x] = R(0);
+        for (T_size i(0); i < length; i++)
+        {
+            // the taps are accumulated line by line, i.e. the inner loop runs over contiguous elements
+            const T* in_row = in + (y - half + i)*in_stride + offset[i];
+            const S a0 = w0[i], a1 = w1[i];
+            for (T_size x = x_min; x < x_max; x++)
+                out_row[x] += (R)(((S)in_row[x])*a0 + ((S)in_row[x + 1])*a1);
+        }
+    }
+}
+// instantiate for the (floating-point) intermediate planes of the detector
+template void ShearedColumnFilter(const float*, int, int, int, const float*, int, float, float*, int, int, int, int, int);
+template void ShearedColumnFilter(const double*, int, int, int, const double*, int, double, double*, int, int, int, int, int);
+
 #ifdef __MEX
 /* MATLAB interface 
  * -> be aware that MATLAB uses column-major data storage
@@ -11,6 +11,8 @@
  */
 #pragma once
 
+#include "image_view.hpp"
+
 #ifndef _IS_ODD
 #define _IS_ODD(x) (x % 2 != 0 ? true : false)
 #endif
@@ -59,22 +61,6 @@ Transpose(const T* in, T_size in_width, T_size in_height, T* out)
             out[x*in_height + y] = in[in_width*y + x];
 }
 
-/** Implementation of 2-D linear separable filter. First we perform row-filtering and the column-filtering. Row-major input is expected. */
-template <typename T, typename S, typename R, typename T_size>
-inline void
-SeparableFilter(const T* in, T_size width, T_size height, const S* row_filter, T_size row_length, const S* col_filter, T_size col_length, R*& tmp, R*& out)
-{
-    /* Allocate output memory if necessary */
-    if (out == NULL)
-        out = new R[width*height];   
-    if (tmp == NULL)
-        tmp = new R[width*height]; // temporary result, i.e. transposed output of the row filter
-        
-    // perform the filtering
-    RowFilter(in,width,height,row_filter,row_length,tmp,true);
-    RowFilter(tmp,height,width,col_filter,col_length,out,true);
-}
-
 /** Filter all rows (separate) of an image. Useful for linear separable filters, which can be applied as (1-D) row/column filter. Row-major! 
  *  Allowing to transpose the output makes it possible to simply (and with good memory access patterns) implement 2-D linear separable filters by
  *  applying the filter as follows:
@@ -97,6 +83,7 @@ RowFilter(const T* in, T_size width, T_size height, const S* filter, T_size leng
  *  Allows the use of a region of interest. The parameter "isolated" has an effect on the border area
  *   isolated = true, then only elements in the ROI are processed, which results to invalid filter responses in the border areas of the output in x-direction, i.e. the first and last floor(length/2) elements are no valid filter responses
  *   isolated = false, then the filtering also processes elements outside the ROI in x-direction and all filter responses in the ROI are valid, i.e. the elements in the x-interval [roi_x_min-length/2,roi_x_max+length/2] are used for calculation
+ *  Only the filter responses of the ROI are written to out, i.e. the output outside of the ROI is left untouched.
  *
  *  Note: at image borders the filter responses in x-direction (i.e. row direction) are invalid (size of this area depends on the filter size)! For efficiency reasons we do not have any border handling, e.g. replication!
  */
@@ -104,6 +91,57 @@ template <typename T, typename S, typename R, typename T_size>
 void
 RowFilter(const T* in, T_size width, T_size height, const S* filter, T_size length, R* out, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated = false, bool transposedOut = false);
 
+/** Filter all rows (separate) of an image with a region of interest (see above), where the input and output rows can be padded.
+ *  \param in_stride number of elements between two consecutive input rows (>= width)
+ *  \param out_stride number of elements between two consecutive output rows (>= width), or - if transposedOut - between two consecutive output columns (>= height)
+ *  This allows to directly process padded planes, e.g. planes carved out of an AlignedSlab.
+ */
+template <typename T, typename S, typename R, typename T_size>
+void
+RowFilter(const T* in, T_size width, T_size height, T_size in_stride, const S* filter, T_size length, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated = false, bool transposedOut = false);
+
+/** Filter all rows (separate) of an image view with a region of interest (see above). The view allows to directly filter the caller's memory, e.g.
+ *  cropped or padded images, 16-bit images, or the luma samples of interleaved YUYV buffers (see image_view.hpp); no copy is necessary.
+ *  \param out_stride number of elements between two consecutive output rows (>= in.width), or - if transposedOut - between two consecutive output columns (>= in.height)
+ */
+template <typename T, typename S, typename R, typename T_size>
+void
+RowFilter(const ImageView<T>& in, const S* filter, T_size length, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated = false, bool transposedOut = false);
+
+/** Filter all rows (separate) of an interleaved color image view with a region of interest (see above). The luma of the input pixels is calculated on
+ *  the fly (once per touched element), i.e. neither a full-frame color conversion nor a grayscale buffer is necessary. The luma is calculated in the
+ *  precision of the filter.
+ */
+template <typename T, typename S, typename R, typename T_size>
+void
+RowFilter(const ColorImageView<T>& in, const S* filter, T_size length, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height, bool isolated = false, bool transposedOut = false);
+
+/** Filter the columns of a row-major image along sheared lines, i.e. the filter tap i (offset j = i - length/2) of the anchor (x,y) is applied to
+ *  in(x + shear*j, y + j), which is linearly interpolated between its two neighbors in row y + j. Together with a row filter (see RowFilter), this
+ *  decomposes a rotated anisotropic Gaussian into two 1-D passes (see Geusebroek et al., "Fast anisotropic Gauss filtering", 2003). The rows are
+ *  processed as contiguous lines, i.e. the shear costs two multiply-adds per tap. Only the filter responses of the ROI whose support is inside the
+ *  image are written to out, i.e. the output at the image borders is left untouched (as with RowFilter).
+ */
+template <typename T, typename S, typename R, typename T_size>
+void
+ShearedColumnFilter(const T* in, T_size width, T_size height, T_size in_stride, const S* filter, T_size length, S shear, R* out, T_size out_stride, T_size roi_x_min, T_size roi_y_min, T_size roi_width, T_size roi_height);
+
+/** Implementation of 2-D linear separable filter (defined after RowFilter, which it uses). First we perform row-filtering and the column-filtering. Row-major input is expected. */
+template <typename T, typename S, typename R, typename T_size>
+inline void
+SeparableFilter(const T* in, T_size width, T_size height, const S* row_filter, T_size row_length, const S* col_filter, T_size col_length, R*& tmp, R*& out)
+{
+    /* Allocate output memory if necessary */
+    if (out == NULL)
+        out = new R[width*height];   
+    if (tmp == NULL)
+        tmp = new R[width*height]; // temporary result, i.e. transposed output of the row filter
+        
+    // perform the filtering
+    RowFilter(in,width,height,row_filter,row_length,tmp,true);
+    RowFilter(tmp,height,width,col_filter,col_length,out,true);
+}
+
 #ifdef _NON_STD_NULL_DEFINED
 #undef _NON_STD_NULL_DEFINED
 #undef NULL
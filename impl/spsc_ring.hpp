@@ -0,0 +1,244 @@
+/** Lock-free single-producer/single-consumer ring buffer with selectable policies for a full ring (block, drop the oldest, keep only the latest).
+ *
+ *  \author B. Schauerte
+ *  \email  <schauerte@ieee.org>
+ *  \date   2011
+ *
+ * Copyright (C) Boris Schauerte - All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ * Written by Boris Schauerte <schauerte@ieee.org>, 2011
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "instrumentation.hpp"
+
+/** What the producer does if the ring is full. */
+enum FrameDropPolicy
+{
+    BlockPolicy = 0,     // wait until the consumer has taken an element, i.e. every element is consumed (offline processing)
+    DropOldestPolicy,    // overwrite the oldest element, i.e. the consumer gets the most recent elements (bounded queue age)
+    LatestOnlyPolicy     // capacity 1 and overwrite, i.e. the consumer always gets the latest element (interactive, minimal latency)
+};
+
+/** Get the name of a policy (e.g., "latest-only"). */
+inline const char*
+ToString(FrameDropPolicy policy)
+{
+    switch (policy)
+    {
+        case BlockPolicy:      return "block";
+        case DropOldestPolicy: return "drop-oldest";
+        case LatestOnlyPolicy: return "latest-only";
+        default:               return "unknown";
+    }
+}
+
+/** Counters of a ring (see SpscRing::getStatistics). */
+struct SpscRingStatistics
+{
+    uint64_t pushed;       // elements that have been pushed
+    uint64_t popped;       // elements that have been consumed
+    uint64_t dropped;      // elements that have been overwritten before they were consumed
+    double mean_age_ms;    // mean time between push and pop of the consumed elements
+    double max_age_ms;
+    size_t max_size;       // max. number of queued elements (at push)
+};
+
+/** Lock-free SPSC ring. Exactly one thread may call push (the producer) and exactly one thread may call pop/tryPop (the consumer).
+ *
+ *  Every slot has an atomic state word that holds the ring position of the element in the slot and its state (empty, written, full, read).
+ *  The producer and the consumer claim a slot with a CAS on the state, i.e. an element is either consumed or dropped, never both, and the
+ *  consumer recognizes dropped positions by the position in the state word. Elements are moved in and out (e.g., a cv::Mat only moves its header).
+ *  push only waits for the consumer if the policy is BlockPolicy or if the consumer is moving out the element of the slot that is overwritten.
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    SpscRing(size_t _capacity, FrameDropPolicy _policy = BlockPolicy)
+    : policy(_policy), capacity(_policy == LatestOnlyPolicy ? 1 : (_capacity > 0 ? _capacity : 1)), slots(capacity), closed(false),
+      write_pos(0), pushed(0), dropped(0), max_size(0), read_pos(0), popped(0), age_ticks_sum(0), age_ticks_max(0)
+    {
+        for (size_t i = 0; i < capacity; i++)
+            slots[i].state.store(MakeState(i,EmptyState),std::memory_order_relaxed);
+    }
+
+    /** Append an element (producer). Returns false (and drops the element) if the ring has been closed. */
+    bool push(T& element)
+    {
+        const uint64_t pos = write_pos.load(std::memory_order_relaxed);
+        Slot& slot = slots[pos % capacity];
+        for (unsigned int spins = 0; ; spins++)
+        {
+            if (closed.load(std::memory_order_relaxed))
+                return false;
+            uint64_t state = slot.state.load(std::memory_order_acquire);
+            if (GetState(state) == EmptyState)
+            {
+                slot.state.store(MakeState(pos,WritingState),std::memory_order_relaxed);
+                break;
+            }
+            // the slot holds the oldest element, i.e. the ring is full
+            if (GetState(state) == FullState && policy != BlockPolicy)
+            {
+                if (slot.state.compare_exchange_strong(state,MakeState(pos,WritingState),std::memory_order_acquire))
+                {
+                    dropped.store(dropped.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+                    break;
+                }
+                continue; // the consumer has just claimed the element
+            }
+            Backoff(spins); // BlockPolicy: wait for the consumer; ReadingState: the consumer moves the element out
+        }
+        slot.value = std::move(element);
+        slot.ticks = GetInstrumentationTicks();
+        slot.state.store(MakeState(pos,FullState),std::memory_order_release);
+        write_pos.store(pos + 1,std::memory_order_relaxed);
+        pushed.store(pushed.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+
+        // number of queued elements (approximate, the consumer runs concurrently)
+        const uint64_t read = read_pos.load(std::memory_order_relaxed);
+        const size_t queued = (size_t)std::min<uint64_t>(pos + 1 - std::min(read,pos + 1),capacity);
+        if (queued > max_size.load(std::memory_order_relaxed))
+            max_size.store(queued,std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Take the oldest available element if there is one (consumer; never blocks). */
+    bool tryPop(T& element)
+    {
+        uint64_t pos = read_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = slots[pos % capacity];
+            uint64_t state = slot.state.load(std::memory_order_acquire);
+            const uint64_t slot_pos = GetPosition(state);
+            if (slot_pos > pos)
+            {
+                // the element at pos has been dropped (overwritten by a newer one), continue with the next position
+                pos++;
+                continue;
+            }
+            if (slot_pos < pos || GetState(state) != FullState)
+            {
+                read_pos.store(pos,std::memory_order_relaxed);
+                return false; // not written yet
+            }
+            if (!slot.state.compare_exchange_strong(state,MakeState(pos,ReadingState),std::memory_order_acquire))
+                continue; // the producer has just dropped the element
+
+            element = std::move(slot.value);
+            const uint64_t age_ticks = GetInstrumentationTicks() - slot.ticks;
+            slot.state.store(MakeState(pos,EmptyState),std::memory_order_release);
+            read_pos.store(pos + 1,std::memory_order_relaxed);
+            popped.store(popped.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+            age_ticks_sum.store(age_ticks_sum.load(std::memory_order_relaxed) + age_ticks,std::memory_order_relaxed);
+            if (age_ticks > age_ticks_max.load(std::memory_order_relaxed))
+                age_ticks_max.store(age_ticks,std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    /** Take the oldest available element (consumer); waits until an element is available. Returns false if the ring is closed and empty. */
+    bool pop(T& element)
+    {
+        for (unsigned int spins = 0; ; spins++)
+        {
+            if (tryPop(element))
+                return true;
+            if (closed.load(std::memory_order_acquire))
+                return tryPop(element); // elements that have been pushed before the close
+            Backoff(spins);
+        }
+    }
+
+    /** Close the ring, i.e. push fails and pop returns the remaining elements and then fails. */
+    void close(void) { closed.store(true,std::memory_order_release); }
+    /** Reopen a closed ring (neither the producer nor the consumer may be active). The remaining elements are dropped and the counters reset. */
+    void reopen(void)
+    {
+        for (size_t i = 0; i < capacity; i++)
+        {
+            slots[i].value = T();
+            slots[i].state.store(MakeState(i,EmptyState),std::memory_order_relaxed);
+        }
+        write_pos.store(0); pushed.store(0); dropped.store(0); max_size.store(0);
+        read_pos.store(0); popped.store(0); age_ticks_sum.store(0); age_ticks_max.store(0);
+        closed.store(false);
+    }
+
+    inline FrameDropPolicy getPolicy(void) const { return policy; }
+    inline size_t getCapacity(void) const { return capacity; }
+
+    /** Get the counters (can be called from any thread). */
+    SpscRingStatistics getStatistics(void) const
+    {
+        const double ns_per_tick = GetInstrumentationNanosecondsPerTick();
+        SpscRingStatistics statistics;
+        statistics.pushed = pushed.load(std::memory_order_relaxed);
+        statistics.popped = popped.load(std::memory_order_relaxed);
+        statistics.dropped = dropped.load(std::memory_order_relaxed);
+        statistics.mean_age_ms = (statistics.popped > 0 ? age_ticks_sum.load(std::memory_order_relaxed) * ns_per_tick / 1e6 / statistics.popped : 0);
+        statistics.max_age_ms = age_ticks_max.load(std::memory_order_relaxed) * ns_per_tick / 1e6;
+        statistics.max_size = max_size.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+private:
+    SpscRing(const SpscRing&);
+    SpscRing& operator=(const SpscRing&);
+
+    // slot states; the state word is position*4 + state
+    enum { EmptyState = 0, WritingState = 1, FullState = 2, ReadingState = 3 };
+    static inline uint64_t MakeState(uint64_t pos, int state) { return (pos << 2) | (uint64_t)state; }
+    static inline int GetState(uint64_t state) { return (int)(state & 3); }
+    static inline uint64_t GetPosition(uint64_t state) { return state >> 2; }
+
+    /** Spin, then yield, then sleep (the waits are short, e.g. for a frame of a camera). */
+    static inline void Backoff(unsigned int spins)
+    {
+        if (spins < 64)
+            return;
+        else if (spins < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    struct Slot
+    {
+        std::atomic<uint64_t> state;
+        uint64_t ticks; // push time (queue age)
+        T value;
+        Slot(void) : state(0), ticks(0) {}
+    };
+
+    const FrameDropPolicy policy;
+    const size_t capacity;
+    std::vector<Slot> slots;
+    std::atomic<bool> closed;
+
+    // producer side (only written by the producer; padded, i.e. the producer and the consumer don't share a cache line)
+    char pad0[64];
+    std::atomic<uint64_t> write_pos;
+    std::atomic<uint64_t> pushed;
+    std::atomic<uint64_t> dropped;
+    std::atomic<size_t> max_size;
+
+    // consumer side (only written by the consumer)
+    char pad1[64];
+    std::atomic<uint64_t> read_pos;
+    std::atomic<uint64_t> popped;
+    std::atomic<uint64_t> age_ticks_sum;
+    std::atomic<uint64_t> age_ticks_max;
+    char pad2[64];
+};
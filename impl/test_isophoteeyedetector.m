@@ -0,0 +1,51 @@
+function test_isophoteeyedetector
+  % @author Boris Schauerte
+  % @email  boris.schauerte@eyezag.com
+  % @date   2011
+  %
+  % Copyright (C) 2011  Boris Schauerte
+  %
+  % This program is free software: you can redistribute it and/or modify
+  % it under the terms of the GNU General Public License as published by
+  % the Free Software Foundation, either version 3 of the License, or
+  % (at your option) any later version.
+  %
+  % This program is distributed in the hope that it will be useful,
+  % but WITHOUT ANY WARRANTY; without even the implied warranty of
+  % MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  % GNU General Public License for more details.
+  %
+  % You should have received a copy of the GNU General Public License
+  % along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+  % synthetic "face": two dark disks (pupils) on a bright background
+  [X,Y]=meshgrid(1:200,1:150);
+  imgin=uint8(200 - 150*((X-60).^2 + (Y-60).^2 < 36) - 150*((X-140).^2 + (Y-60).^2 < 36));
+  imgin=imnoise(imgin,'gaussian',0,0.001);
+
+  options.sigma=1.5;
+  options.face=[1 1 200 150];
+  options.left_eye=[60 60];
+  options.right_eye=[140 60];
+  centers=isophoteeyedetector(imgin,options)
+
+  % all image types give the same result
+  assert(isequal(centers,isophoteeyedetector(single(imgin),options)));
+  assert(isequal(centers,isophoteeyedetector(double(imgin),options)));
+  assert(isequal(centers,isophoteeyedetector(uint16(imgin),options)));
+
+  % batch: cell array and stack (one row per image), processed by native threads
+  imgs={imgin,fliplr(imgin),imgin};
+  options.threads=2;
+  bcenters=isophoteeyedetector(imgs,options)
+  assert(isequal(bcenters,isophoteeyedetector(cat(3,imgs{:}),options)));
+  assert(isequal(bcenters(1,:),centers) && isequal(bcenters(3,:),centers));
+
+  % debug planes are only returned if requested
+  options.planes={'acc','k','c'};
+  [centers,planes]=isophoteeyedetector(imgin,options);
+  figure('name','image'); imshow(imgin); hold on;
+  plot(centers([1 3]),centers([2 4]),'m+');
+  figure('name','acc'); imshow(mat2gray(planes.acc));
+  figure('name','k');   imshow(mat2gray(planes.k));
+  figure('name','c');   imshow(mat2gray(planes.c));